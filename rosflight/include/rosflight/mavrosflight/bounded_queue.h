@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file bounded_queue.h
+ *
+ * Fixed-capacity lock-free queue used to hand mavlink packets between threads
+ */
+
+#ifndef MAVROSFLIGHT_BOUNDED_QUEUE_H
+#define MAVROSFLIGHT_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace mavrosflight
+{
+/**
+ * \brief Bounded multi-producer/multi-consumer queue of preallocated slots
+ *
+ * All storage is allocated once in the constructor. Elements are written and read in place through the callables
+ * passed to try_push() and try_pop(), so moving a packet through the queue never touches the heap and never takes a
+ * lock. Each slot carries a sequence number that tells producers and consumers whether the slot is ready for them
+ * (D. Vyukov's bounded MPMC queue).
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+  /**
+   * \brief Allocates the slots for the queue
+   * \param capacity Requested number of slots, rounded up to the next power of two
+   */
+  explicit BoundedQueue(size_t capacity) : enqueue_pos_(0), dequeue_pos_(0)
+  {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++)
+    {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * \brief Claims a free slot and fills it in place
+   * \param fill Callable invoked as fill(T&) on the claimed slot
+   * \return True if a slot was available, false if the queue is full
+   */
+  template <typename Fill>
+  bool try_push(Fill fill)
+  {
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0)
+      {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    fill(cell->data);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * \brief Copies an element into the queue
+   * \return True if a slot was available, false if the queue is full
+   */
+  bool try_push(const T &value)
+  {
+    return try_push([&value](T &slot) { slot = value; });
+  }
+
+  /**
+   * \brief Claims the oldest element and reads it in place
+   * \param consume Callable invoked as consume(T&) on the claimed slot; the slot is reused once it returns
+   * \return True if an element was available, false if the queue is empty
+   */
+  template <typename Consume>
+  bool try_pop(Consume consume)
+  {
+    Cell *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    consume(cell->data);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * \brief Copies the oldest element out of the queue
+   * \return True if an element was available, false if the queue is empty
+   */
+  bool try_pop(T &value)
+  {
+    return try_pop([&value](T &slot) { value = slot; });
+  }
+
+  /**
+   * \brief Number of elements in the queue (approximate while other threads are pushing or popping)
+   */
+  size_t size() const
+  {
+    size_t enqueue_pos = enqueue_pos_.load(std::memory_order_relaxed);
+    size_t dequeue_pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  /**
+   * \brief Whether the oldest element has been completely pushed, so that try_pop would succeed
+   *
+   * Unlike empty(), this is false while the producer of the oldest element is still filling it in.
+   */
+  bool front_ready() const
+  {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return cells_[pos & mask_].sequence.load(std::memory_order_acquire) == pos + 1;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+
+  // keep the producer and consumer indices on separate cache lines
+  char pad0_[64];
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[64];
+  std::atomic<size_t> dequeue_pos_;
+  char pad2_[64];
+};
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_BOUNDED_QUEUE_H
@@ -37,26 +37,121 @@
 #ifndef MAVROSFLIGHT_MAVLINK_COMM_H
 #define MAVROSFLIGHT_MAVLINK_COMM_H
 
+#include <rosflight/mavrosflight/bounded_queue.h>
 #include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_frame.h>
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
+#include <rosflight/mavrosflight/mavlink_frame_scanner.h>
 #include <rosflight/mavrosflight/mavlink_listener_interface.h>
 
 #include <boost/asio.hpp>
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
-#include <list>
+#include <memory>
 #include <string>
 #include <vector>
 
-#define MAVLINK_SERIAL_READ_BUF_SIZE 256
+#define MAVLINK_SERIAL_READ_BUF_SIZE 2048
+#define MAVLINK_WRITE_QUEUE_SIZE 256
+#define MAVLINK_MAX_WRITE_BATCH 32
+#define MAVLINK_DISPATCH_QUEUE_SIZE 256
+#define MAVLINK_LATENCY_HIST_BINS 20
+#define MAVLINK_RECONNECT_MIN_DELAY_MS 10
+#define MAVLINK_RECONNECT_MAX_DELAY_MS 100
+#define MAVLINK_MAX_SOURCES 32
 
 namespace mavrosflight
 {
 class MavlinkComm
 {
 public:
+  /**
+   * \brief Behavior of send_message when the write queue is full
+   */
+  enum WriteQueueFullPolicy
+  {
+    DROP_OLDEST, //!< discard the oldest queued packet to make room for the new one
+    DROP_NEWEST  //!< reject the new packet
+  };
+
+  /**
+   * \brief Outgoing message priorities, each with its own write queue
+   *
+   * Queued packets are always written from the highest priority queue that has one, so a burst of bulk traffic cannot
+   * delay control messages by more than the packets already handed to the port.
+   */
+  enum WritePriority
+  {
+    PRIORITY_HIGH,   //!< control messages (offboard control, external attitude, aux commands)
+    PRIORITY_NORMAL, //!< everything not assigned to another priority
+    PRIORITY_BULK    //!< parameter traffic
+  };
+
+  /**
+   * \brief Counters describing how well a listener is keeping up with received messages
+   */
+  struct ListenerStats
+  {
+    size_t queue_depth;  //!< messages waiting to be handled (always zero with inline dispatch)
+    uint64_t dispatched; //!< messages handed to the listener
+    uint64_t dropped;    //!< messages dropped because the listener's queue was full
+  };
+
+  /**
+   * \brief Receive counters for a single sending system and component
+   */
+  struct SourceStats
+  {
+    uint8_t sysid;
+    uint8_t compid;
+    uint8_t last_seq;      //!< highest sequence number seen, allowing for wraparound
+    uint64_t frames;       //!< frames received
+    uint64_t lost;         //!< frames missing according to forward gaps in the sequence numbers
+    uint64_t out_of_order; //!< frames that did not advance the sequence number: duplicates, or late after a reorder
+  };
+
+  /**
+   * \brief Counters describing the health and load of the link
+   */
+  struct TransportStats
+  {
+    uint64_t bytes_in;      //!< bytes read from the port
+    uint64_t frames_in;     //!< valid frames received
+    uint64_t crc_errors;    //!< candidate frames rejected for a bad checksum
+    uint64_t length_errors; //!< candidate frames rejected for an unexpected payload length
+    uint64_t bytes_skipped; //!< received bytes that were not part of a valid frame
+
+    uint64_t bytes_out;                                     //!< bytes written to the port
+    uint64_t frames_out;                                    //!< packets completely written to the port
+    uint64_t write_queue_dropped;                           //!< packets dropped because a write queue was full
+    size_t write_queue_depth;                               //!< packets currently waiting in the write queues
+    size_t write_queue_high_water;                          //!< largest write queue depth seen by send_message
+    uint64_t write_latency_max_us;                          //!< longest time from send_message to being written
+    uint64_t write_latency_hist[MAVLINK_LATENCY_HIST_BINS]; //!< see write_latency_bin_limit_us
+
+    std::vector<SourceStats> sources; //!< receive counters for each system and component heard from, up to
+                                      //!< MAVLINK_MAX_SOURCES of them
+
+    bool link_up;        //!< whether the port is open and working
+    uint64_t reconnects; //!< times the port was reopened after an error
+  };
+
+  /**
+   * \brief Upper limit of a bin of TransportStats::write_latency_hist
+   *
+   * Bin i counts packets whose latency was less than 2^i microseconds and at least the limit of bin i - 1. The last
+   * bin also counts everything longer.
+   *
+   * \param bin The histogram bin
+   * \return The limit in microseconds
+   */
+  static uint64_t write_latency_bin_limit_us(size_t bin) { return uint64_t(1) << bin; }
+
   /**
    * \brief Instantiates the class and begins communication on the specified serial port
    * \param port Name of the serial port (e.g. "/dev/ttyUSB0")
@@ -74,37 +169,306 @@ public:
    */
   void open();
 
+  /**
+   * \brief Opens the port and begins communication, or if the port cannot be opened yet, keeps trying in the background
+   *
+   * Packets sent while the port is not open are queued as they would be during an outage.
+   *
+   * \return Whether the port is open now
+   * \throws SerialException if the port could not be opened and auto reconnect is disabled
+   */
+  bool open_or_reconnect();
+
   /**
    * \brief Stops communication and closes the port
    */
   void close();
 
   /**
-   * \brief Register a listener for mavlink messages
+   * \brief Register a listener for all mavlink messages
    * \param listener Pointer to an object that implements the MavlinkListenerInterface interface
    */
   void register_mavlink_listener(MavlinkListenerInterface *const listener);
 
+  /**
+   * \brief Register a listener for a specific set of mavlink messages
+   *
+   * The listener is only called for messages whose ID is in msgids. Registering a listener that is already registered
+   * replaces the set of messages it receives.
+   *
+   * \param listener Pointer to an object that implements the MavlinkListenerInterface interface
+   * \param msgids IDs of the messages to deliver to the listener
+   */
+  void register_mavlink_listener(MavlinkListenerInterface *const listener, const std::vector<uint8_t> &msgids);
+
   /**
    * \brief Unregister a listener for mavlink messages
    * \param listener Pointer to an object that implements the MavlinkListenerInterface interface
    */
   void unregister_mavlink_listener(MavlinkListenerInterface *const listener);
 
+  /**
+   * \brief Register a listener that reads a specific set of mavlink messages in place
+   *
+   * Frame listeners are handed a view of the frame in the receive buffer, so no mavlink_message_t is built for them.
+   * A message is only unpacked if a MavlinkListenerInterface listener is also registered for its ID. Registering a
+   * listener that is already registered replaces the set of messages it receives.
+   *
+   * \param listener Pointer to an object that implements the MavlinkFrameListenerInterface interface
+   * \param msgids IDs of the messages to deliver to the listener
+   */
+  void register_mavlink_frame_listener(MavlinkFrameListenerInterface *const listener,
+                                       const std::vector<uint8_t> &msgids);
+
+  /**
+   * \brief Register a listener that reads every mavlink message in place
+   * \param listener Pointer to an object that implements the MavlinkFrameListenerInterface interface
+   */
+  void register_mavlink_frame_listener(MavlinkFrameListenerInterface *const listener);
+
+  /**
+   * \brief Unregister a frame listener
+   * \param listener Pointer to an object that implements the MavlinkFrameListenerInterface interface
+   */
+  void unregister_mavlink_frame_listener(MavlinkFrameListenerInterface *const listener);
+
+  /**
+   * \brief Hand received messages to listeners on dispatcher threads instead of the io thread
+   *
+   * When enabled, the io thread only parses frames and pushes them onto a bounded lock-free queue per listener, and
+   * each listener is serviced by its own dispatcher thread, so a slow listener cannot stall reading from the port.
+   * Messages for a listener whose queue is full are dropped and counted. Must be called before any listeners are
+   * registered.
+   *
+   * \param enable True to dispatch on dispatcher threads, false to call listeners directly from the io thread
+   * \param queue_size Number of messages each listener's queue can hold
+   */
+  void set_threaded_dispatch(bool enable, size_t queue_size = MAVLINK_DISPATCH_QUEUE_SIZE);
+
+  /**
+   * \brief Get the dispatch counters for a registered listener
+   * \param listener The listener to query
+   * \param[out] stats The listener's counters
+   * \return False if the listener is not registered
+   */
+  bool get_listener_stats(MavlinkListenerInterface *const listener, ListenerStats *stats) const;
+
+  /**
+   * \brief Get the dispatch counters for a registered frame listener
+   * \param listener The listener to query
+   * \param[out] stats The listener's counters
+   * \return False if the listener is not registered
+   */
+  bool get_listener_stats(MavlinkFrameListenerInterface *const listener, ListenerStats *stats) const;
+
   /**
    * \brief Send a mavlink message
+   *
+   * The message is packed directly into a preallocated slot of the write queue; this function never blocks and never
+   * allocates, and may be called from any thread.
+   *
    * \param msg The message to send
+   * \return False if the write queue was full and the message was dropped
+   */
+  bool send_message(const mavlink_message_t &msg);
+
+  /**
+   * \brief Send an already packed mavlink frame unchanged
+   *
+   * Used to forward frames received on another link; the sequence number, system and component IDs and checksum are
+   * kept as they are. Like send_message, this never blocks and may be called from any thread.
+   *
+   * \param frame Pointer to the start byte of the frame
+   * \param len Length of the frame in bytes
+   * \return False if the frame is too long or the write queue was full and the frame was dropped
+   */
+  bool send_raw(const uint8_t *frame, size_t len);
+
+  /**
+   * \brief Set which write queue a message is sent through
+   *
+   * Must be called before the port is opened.
+   *
+   * \param msgid The message ID
+   * \param priority The write queue for the message
    */
-  void send_message(const mavlink_message_t &msg);
+  void set_write_priority(uint8_t msgid, WritePriority priority);
+
+  /**
+   * \brief Limit how often a message may be written to the port
+   *
+   * Each message ID has a token bucket that is checked when a packet reaches the front of its write queue. A packet
+   * that is over its limit holds back the rest of its queue (so packets are never reordered) but not the other queues.
+   * Must be called before the port is opened.
+   *
+   * \param msgid The message ID
+   * \param rate Maximum sustained rate in messages per second; zero removes the limit
+   * \param burst Number of messages that may be written back to back, at least one
+   */
+  void set_write_rate_limit(uint8_t msgid, double rate, double burst = 1);
+
+  /**
+   * \brief Set what happens to outgoing messages when the write queue is full
+   * \param policy The policy to apply
+   */
+  void set_write_queue_full_policy(WriteQueueFullPolicy policy);
+
+  /**
+   * \brief Get the number of outgoing packets dropped because the write queue was full, or lost to a link outage
+   */
+  uint64_t get_write_queue_dropped() const;
+
+  /**
+   * \brief Set the maximum number of queued packets handed to the port in a single write
+   *
+   * Only packets that are already waiting in the queue are batched, so batching never delays a packet into the port.
+   * It can delay the packets after it, though: a high priority packet queued while a batch is being written waits for
+   * the whole batch, which matters on a serial port that holds each write for its time on the wire. A value of 1 (the
+   * default) writes one packet per operation.
+   *
+   * \param max_batch Maximum packets per write, clamped to [1, MAVLINK_MAX_WRITE_BATCH]
+   */
+  void set_max_write_batch(size_t max_batch);
+
+  /**
+   * \brief Reopen the port automatically after a read or write error
+   *
+   * While the link is down, packets keep being queued and are sent once the port is back, except for messages marked
+   * with set_drop_on_reconnect, which are dropped if they were queued before the port came back. Listeners, and
+   * everything built on them, are unaffected by the outage. Must be called before the port is opened.
+   *
+   * \param enable Whether to reconnect; otherwise (the default) an error closes the port for good
+   * \param min_delay Delay before the first attempt to reopen the port, doubled after each failed attempt
+   * \param max_delay Longest delay between attempts
+   */
+  void set_auto_reconnect(
+      bool enable,
+      std::chrono::milliseconds min_delay = std::chrono::milliseconds(MAVLINK_RECONNECT_MIN_DELAY_MS),
+      std::chrono::milliseconds max_delay = std::chrono::milliseconds(MAVLINK_RECONNECT_MAX_DELAY_MS));
+
+  /**
+   * \brief Set whether a message is out of date once the port has been reopened after an outage
+   *
+   * By default setpoints (offboard control, external attitude, aux commands) and TIMESYNC requests are dropped, since
+   * they only describe the moment they were sent, and everything else, such as commands and parameter traffic, is
+   * kept. Must be called before the port is opened.
+   *
+   * \param msgid The message ID
+   * \param drop Whether packets of the message queued before the port came back are dropped instead of sent
+   */
+  void set_drop_on_reconnect(uint8_t msgid, bool drop);
+
+  /**
+   * \brief Set the size of the receive buffer
+   *
+   * Takes effect the next time the port is opened.
+   *
+   * \param size Buffer size in bytes; raised to at least two maximum-length mavlink packets
+   */
+  void set_read_buffer_size(size_t size);
+
+  /**
+   * \brief Get a snapshot of the link counters
+   *
+   * Counters are cumulative since the object was created. May be called from any thread.
+   *
+   * \param[out] stats The link counters
+   */
+  void get_transport_stats(TransportStats *stats) const;
 
 protected:
+  /**
+   * \brief Convenience typedef for the sequence of packet buffers passed to do_async_write
+   */
+  typedef std::vector<boost::asio::const_buffer> WriteBufferSequence;
+
+  /**
+   * \brief Convenience typedef for read and write completion handlers
+   */
+  typedef boost::function<void(const boost::system::error_code &, size_t)> IoHandler;
+
+  /**
+   * \brief Convenience typedef for the completion handler of do_async_open
+   */
+  typedef boost::function<void(const boost::system::error_code &)> OpenHandler;
+
   virtual bool is_open() = 0;
   virtual void do_open() = 0;
   virtual void do_close() = 0;
-  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer,
-                             boost::function<void(const boost::system::error_code &, size_t)> handler) = 0;
-  virtual void do_async_write(const boost::asio::const_buffers_1 &buffer,
-                              boost::function<void(const boost::system::error_code &, size_t)> handler) = 0;
+
+  /**
+   * \brief Reopen the port without blocking the io thread, then call the handler with the result
+   *
+   * Used to reconnect. The default calls do_open, which suits ports that open at once; transports that wait on a
+   * peer, like TCP, override it.
+   */
+  virtual void do_async_open(const OpenHandler &handler);
+
+  /**
+   * \brief Start reading from the port into buffer
+   *
+   * The handler is owned by this class and stays valid for the lifetime of the object, so implementations may keep a
+   * reference to it instead of copying it.
+   */
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) = 0;
+
+  /**
+   * \brief Start writing a batch of packets to the port
+   *
+   * Each buffer holds one complete mavlink packet (or the unsent tail of one). Implementations may write any prefix of
+   * the sequence and report the total number of bytes written to the handler; the remainder is resubmitted. The
+   * buffers and the handler stay valid until the handler is called.
+   */
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler) = 0;
+
+  /**
+   * \brief Run the event loop that completes reads and writes; called on the io thread
+   *
+   * The default runs io_service_.
+   */
+  virtual void run_io();
+
+  /**
+   * \brief Make run_io return; may be called from any thread
+   */
+  virtual void stop_io();
+
+  /**
+   * \brief Arrange for retry_write to be called on the io thread after a delay
+   *
+   * Only one retry is outstanding at a time; scheduling a new one replaces the previous one.
+   */
+  virtual void schedule_write_retry(std::chrono::steady_clock::duration delay);
+
+  /**
+   * \brief Resume writing after a delay requested through schedule_write_retry
+   */
+  void retry_write();
+
+  /**
+   * \brief Record when the data for the read about to complete arrived, e.g. from a kernel timestamp
+   *
+   * Called by implementations just before invoking the read handler. Reads without a recorded time are stamped when
+   * the handler runs.
+   */
+  void set_receive_time(std::chrono::system_clock::time_point time) { read_time_ = time; }
+
+  /**
+   * \brief Time the port takes to receive one byte, used to date frames that ended before the end of a read
+   *
+   * The default of zero suits packet transports, where everything in a read arrived at once.
+   */
+  virtual std::chrono::nanoseconds byte_time() const { return std::chrono::nanoseconds::zero(); }
+
+  /**
+   * \brief Arrange for reconnect to be called on the io thread after a delay
+   */
+  virtual void schedule_reconnect(std::chrono::steady_clock::duration delay);
+
+  /**
+   * \brief Try to reopen the port after an error, scheduling another attempt if it fails
+   */
+  void reconnect();
 
   boost::asio::io_service io_service_; //!< boost io service provider
 
@@ -121,6 +485,7 @@ private:
     uint8_t data[MAVLINK_MAX_PACKET_LEN];
     size_t len;
     size_t pos;
+    std::chrono::steady_clock::time_point queued; //!< when the packet was handed to send_message
 
     WriteBuffer() : len(0), pos(0) {}
 
@@ -135,11 +500,108 @@ private:
     size_t nbytes() const { return len - pos; }
   };
 
+  /**
+   * \brief Convenience typedef for the packet ring shared between senders and the io thread
+   */
+  typedef BoundedQueue<WriteBuffer> WriteQueue;
+
+  /**
+   * \brief A write queue and the packet taken from its front that is waiting on a rate limit
+   */
+  struct WriteLane
+  {
+    explicit WriteLane(size_t capacity) : queue(capacity), has_pending(false) {}
+
+    WriteQueue queue;
+    WriteBuffer pending; //!< owned by whoever holds write_in_progress_
+    bool has_pending;
+  };
+
+  /**
+   * \brief Token bucket limiting the rate of one outgoing message ID
+   */
+  struct RateLimit
+  {
+    double rate; //!< tokens per second, zero for no limit
+    double burst;
+    double tokens;
+    std::chrono::steady_clock::time_point updated;
+  };
+
+  static const size_t NUM_WRITE_PRIORITIES = PRIORITY_BULK + 1;
+
+  /**
+   * \brief Whether the port is usable
+   */
+  enum LinkState
+  {
+    LINK_CLOSED, //!< not opened yet, closed by close(), or failed with reconnecting disabled
+    LINK_UP,     //!< open and working
+    LINK_DOWN    //!< failed, waiting to be reopened
+  };
+
   /**
    * \brief Convenience typedef for mutex lock
    */
   typedef boost::lock_guard<boost::recursive_mutex> mutex_lock;
 
+  /**
+   * \brief Copy of a received frame queued for a dispatcher thread
+   */
+  struct ReceivedFrame
+  {
+    uint8_t data[MAVLINK_MAX_PACKET_LEN];
+    std::chrono::system_clock::time_point received;
+  };
+
+  /**
+   * \brief A registered listener and, with threaded dispatch, its frame queue and dispatcher thread
+   *
+   * Exactly one of listener and frame_listener is set.
+   */
+  struct ListenerEntry
+  {
+    ListenerEntry(MavlinkListenerInterface *listener,
+                  MavlinkFrameListenerInterface *frame_listener,
+                  size_t queue_size);
+    ~ListenerEntry();
+
+    void start();
+    void stop();
+    void push(const uint8_t *frame, size_t frame_len, std::chrono::system_clock::time_point received);
+    void deliver(const uint8_t *frame, std::chrono::system_clock::time_point received);
+    void run();
+
+    MavlinkListenerInterface *const listener;
+    MavlinkFrameListenerInterface *const frame_listener;
+    bool all_messages;                                   //!< whether the listener receives every message
+    std::vector<uint8_t> msgids;                         //!< messages delivered when all_messages is false
+    std::unique_ptr<BoundedQueue<ReceivedFrame> > queue; //!< NULL with inline dispatch
+    mavlink_message_t msg;                               //!< unpack buffer for the dispatcher thread
+    std::atomic<uint64_t> dispatched;
+    std::atomic<uint64_t> dropped;
+
+    boost::thread thread;
+    boost::mutex wait_mutex;
+    boost::condition_variable wait_cond;
+    std::atomic<bool> waiting; //!< set while the dispatcher thread is asleep on an empty queue
+    std::atomic<bool> running;
+  };
+
+  /**
+   * \brief Convenience typedef for a list of registered listeners
+   */
+  typedef std::vector<std::shared_ptr<ListenerEntry> > ListenerList;
+
+  /**
+   * \brief Immutable snapshot of the registered listeners, indexed by the message IDs they receive
+   */
+  struct ListenerTable
+  {
+    ListenerList all;           //!< every registered listener
+    ListenerList by_msgid[256]; //!< listeners that receive each message ID
+  };
+
   //===========================================================================
   // methods
   //===========================================================================
@@ -156,12 +618,105 @@ private:
    */
   void async_read_end(const boost::system::error_code &error, size_t bytes_transferred);
 
+  /**
+   * \brief Deliver a received frame to the listeners registered for its message ID
+   *
+   * The frame is unpacked into a mavlink_message_t at most once, and only if a message listener needs it.
+   */
+  void dispatch(const uint8_t *frame, size_t frame_len, std::chrono::system_clock::time_point received);
+
+  /**
+   * \brief Count a received frame against its sender and check its sequence number for gaps; only called on the io
+   * thread
+   */
+  void update_source_stats(const MavlinkFrame &frame);
+
+  /**
+   * \brief Record a packet that has been completely written to the port
+   */
+  void record_write(const WriteBuffer &buffer, std::chrono::steady_clock::time_point now);
+
+  /**
+   * \brief Register a listener, or update its subscription if it is already registered
+   */
+  void add_listener(MavlinkListenerInterface *const listener,
+                    MavlinkFrameListenerInterface *const frame_listener,
+                    bool all_messages,
+                    const std::vector<uint8_t> &msgids);
+
+  /**
+   * \brief Stop and remove a registered listener
+   */
+  void remove_listener(MavlinkListenerInterface *const listener, MavlinkFrameListenerInterface *const frame_listener);
+
+  /**
+   * \brief Look up the dispatch counters of a registered listener
+   */
+  bool find_listener_stats(MavlinkListenerInterface *const listener,
+                           MavlinkFrameListenerInterface *const frame_listener,
+                           ListenerStats *stats) const;
+
+  /**
+   * \brief Build the per-message-ID index for a new listener list and make it visible to the io thread
+   */
+  void publish_listeners(const ListenerList &listeners);
+
   /**
    * \brief Initialize an asynchronous write operation
    * \param check_write_state If true, only start another write operation if a write sequence is not already running
    */
   void async_write(bool check_write_state);
 
+  /**
+   * \brief Queue a packet for writing, applying the write queue full policy
+   * \param msgid ID of the message, which selects the write queue
+   * \param pack Callable that fills in a WriteBuffer in place
+   */
+  template <typename Pack>
+  bool enqueue(uint8_t msgid, Pack pack);
+
+  /**
+   * \brief Take the next packet that may be written from the highest priority write queue
+   * \param[out] buffer The packet
+   * \param now The current time, for the rate limits
+   * \param[out] wait If a packet is being held back by a rate limit, the shortest time until one may be written
+   * \param[out] blocked Set of queues whose front packet is being held back by a rate limit
+   * \return False if no packet may be written now
+   */
+  bool pop_write(WriteBuffer *buffer,
+                 std::chrono::steady_clock::time_point now,
+                 std::chrono::steady_clock::duration *wait,
+                 bool blocked[NUM_WRITE_PRIORITIES]);
+
+  /**
+   * \brief Take a token from a message's rate limit
+   * \param[out] wait If no token is available, the time until one will be
+   * \return True if the message may be written
+   */
+  bool take_write_token(uint8_t msgid,
+                        std::chrono::steady_clock::time_point now,
+                        std::chrono::steady_clock::duration *wait);
+
+  /**
+   * \brief Whether a queued packet should be dropped because the port was reopened after it was queued
+   */
+  bool out_of_date(const WriteBuffer &buffer) const;
+
+  /**
+   * \brief Handler for the timer that restarts writing once a rate limit allows it
+   */
+  void write_retry_timer_end(const boost::system::error_code &error);
+
+  /**
+   * \brief Total number of packets waiting in the write queues
+   */
+  size_t write_queue_depth() const;
+
+  /**
+   * \brief Write the unsent part of the batch currently in flight
+   */
+  void async_write_current();
+
   /**
    * \brief Handler for end of asynchronous write operation
    * \param error Error code
@@ -169,25 +724,119 @@ private:
    */
   void async_write_end(const boost::system::error_code &error, size_t bytes_transferred);
 
+  /**
+   * \brief Stop writing while the port is not usable, keeping the packets that should survive a reconnect
+   *
+   * Called by the owner of the write batch, which keeps write_in_progress_ set until resume_write.
+   */
+  void park_write();
+
+  /**
+   * \brief Restart a write sequence stopped by park_write, if there is one
+   */
+  void resume_write();
+
+  /**
+   * \brief Take the port down after a read or write error and start reconnecting, or close it for good
+   */
+  void link_lost(const boost::system::error_code &error);
+
+  /**
+   * \brief Start the dispatcher threads and the io thread once the port has been opened, or failed to open
+   */
+  void start(LinkState state);
+
+  /**
+   * \brief Handler for the timer that triggers the next attempt to reopen the port
+   */
+  void reconnect_timer_end(const boost::system::error_code &error);
+
+  /**
+   * \brief Handler for an attempt to reopen the port
+   */
+  void reconnect_end(const boost::system::error_code &error);
+
   //===========================================================================
   // member variables
   //===========================================================================
 
-  std::vector<MavlinkListenerInterface *> listeners_; //!< listeners for mavlink messages
+  IoHandler read_handler_;  //!< bound async_read_end, created once so no handler is built per read
+  IoHandler write_handler_; //!< bound async_write_end, created once so no handler is built per write
+
+  std::shared_ptr<const ListenerTable> listeners_; //!< listeners for mavlink messages, replaced atomically on change
+  bool threaded_dispatch_;                         //!< whether listeners are serviced by dispatcher threads
+  size_t dispatch_queue_size_;                     //!< size of each listener's queue with threaded dispatch
+  bool dispatch_running_;                          //!< whether dispatcher threads should be running
 
   boost::thread io_thread_;      //!< thread on which the io service runs
   boost::recursive_mutex mutex_; //!< mutex for threadsafe operation
 
+  std::atomic<LinkState> link_state_;
+  bool reconnect_enabled_;
+  std::chrono::steady_clock::duration reconnect_min_delay_;
+  std::chrono::steady_clock::duration reconnect_max_delay_;
+  std::chrono::steady_clock::duration reconnect_delay_; //!< delay before the next attempt, only used on the io thread
+  boost::asio::deadline_timer reconnect_timer_;         //!< triggers the next attempt to reopen the port
+  bool drop_on_reconnect_[256];                         //!< messages that are out of date after an outage
+  std::atomic<int64_t> reconnected_ns_; //!< steady clock time the port was last reopened, in nanoseconds
+
   uint8_t sysid_;
   uint8_t compid_;
 
-  uint8_t read_buf_raw_[MAVLINK_SERIAL_READ_BUF_SIZE];
+  std::vector<uint8_t> read_buf_; //!< receive buffer, allocated when the port is opened
+  size_t read_buf_size_;           //!< requested size of the receive buffer
+  size_t read_buf_len_;            //!< bytes of an incomplete frame carried over at the front of read_buf_
 
+  std::chrono::system_clock::time_point read_time_; //!< arrival time of the completing read, if known
+
+  MavlinkFrameScanner scanner_;
   mavlink_message_t msg_in_;
-  mavlink_status_t status_in_;
 
-  std::list<WriteBuffer *> write_queue_; //!< queue of buffers to be written to the serial port
-  bool write_in_progress_;               //!< flag for whether async_write is already running
+  std::unique_ptr<WriteLane> write_lanes_[NUM_WRITE_PRIORITIES]; //!< preallocated rings of packets, by priority
+  WritePriority write_priority_[256];                            //!< write queue of each message ID
+  RateLimit write_rate_limits_[256];                             //!< rate limit of each message ID
+  boost::asio::deadline_timer write_retry_timer_;                //!< restarts writing after a rate limit wait
+  std::atomic<bool> write_in_progress_;                          //!< flag for whether async_write is already running
+  std::atomic<bool> write_parked_;                               //!< write sequence stopped until the port is usable
+  WriteQueueFullPolicy write_queue_policy_;                      //!< what to do when a write queue is full
+  std::atomic<uint64_t> write_queue_dropped_;                    //!< packets dropped because a write queue was full
+
+  // batch in flight, owned by whoever holds write_in_progress_
+  WriteBuffer write_batch_[MAVLINK_MAX_WRITE_BATCH]; //!< packets in the current write batch
+  size_t write_batch_len_;                           //!< number of packets in the current batch
+  size_t write_batch_pos_;                           //!< index of the first packet not completely written
+  WriteBufferSequence write_buffers_;                //!< buffer sequence handed to do_async_write
+  std::atomic<size_t> max_write_batch_;              //!< maximum number of packets per batch
+
+  // link statistics
+  std::atomic<uint64_t> rx_bytes_;
+  std::atomic<uint64_t> rx_frames_;
+  std::atomic<uint64_t> rx_crc_errors_;
+  std::atomic<uint64_t> rx_length_errors_;
+  std::atomic<uint64_t> rx_bytes_skipped_;
+  std::atomic<uint64_t> tx_bytes_;
+  std::atomic<uint64_t> tx_frames_;
+  std::atomic<size_t> write_queue_high_water_;
+  std::atomic<uint64_t> write_latency_max_us_;
+  std::atomic<uint64_t> write_latency_hist_[MAVLINK_LATENCY_HIST_BINS];
+  std::atomic<uint64_t> reconnects_;
+
+  /**
+   * \brief Receive counters for one sender, written only by the io thread
+   */
+  struct SourceSlot
+  {
+    uint8_t sysid;
+    uint8_t compid;
+    std::atomic<uint8_t> last_seq;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> lost;
+    std::atomic<uint64_t> out_of_order;
+  };
+
+  SourceSlot sources_[MAVLINK_MAX_SOURCES];
+  std::atomic<size_t> num_sources_; //!< slots in use; a slot's sysid and compid are set before it is counted here
+  uint8_t source_index_[1 << 16];   //!< one more than the slot for (sysid << 8) | compid, or zero for none yet
 };
 
 } // namespace mavrosflight
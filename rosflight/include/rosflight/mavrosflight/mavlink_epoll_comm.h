@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_epoll_comm.h
+ *
+ * Base class for Linux transports that drive a raw file descriptor with epoll instead of boost::asio
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_EPOLL_COMM_H
+#define MAVROSFLIGHT_MAVLINK_EPOLL_COMM_H
+
+#ifdef __linux__
+
+#include <rosflight/mavrosflight/mavlink_comm.h>
+
+#include <atomic>
+#include <chrono>
+
+#include <sys/types.h>
+
+namespace mavrosflight
+{
+/**
+ * \brief MavlinkComm backend that runs its own epoll loop on the io thread
+ *
+ * Reads go straight into the receive buffer owned by MavlinkComm, and completions call the handlers MavlinkComm
+ * created once at construction, so no handler objects are built, copied or allocated per operation. Writes are
+ * attempted immediately on the calling thread and only fall back to waiting for the descriptor to become writable when
+ * the kernel buffer is full. An eventfd wakes the loop for writes completed on other threads, and timerfds implement
+ * the write rate limit retries and the reconnect attempts.
+ *
+ * Derived classes open the descriptor and provide the actual read and write system calls.
+ */
+class MavlinkEpollComm : public MavlinkComm
+{
+public:
+  MavlinkEpollComm();
+  ~MavlinkEpollComm();
+
+protected:
+  /**
+   * \brief Open the underlying descriptor in non-blocking mode
+   * \return The file descriptor
+   * \throws SerialException if the descriptor could not be opened
+   */
+  virtual int open_fd() = 0;
+
+  /**
+   * \brief Read whatever is available into buf
+   * \return Number of bytes read, or -1 with errno set
+   */
+  virtual ssize_t read_some(uint8_t *buf, size_t len) = 0;
+
+  /**
+   * \brief Write as much of the batch as the descriptor will take without blocking
+   * \return Number of bytes written, or -1 with errno set
+   */
+  virtual ssize_t write_some(const WriteBufferSequence &buffers) = 0;
+
+  int fd() const { return fd_; }
+
+private:
+  //===========================================================================
+  // methods
+  //===========================================================================
+
+  virtual bool is_open();
+  virtual void do_open();
+  virtual void do_close();
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler);
+
+  virtual void run_io();
+  virtual void stop_io();
+  virtual void schedule_write_retry(std::chrono::steady_clock::duration delay);
+  virtual void schedule_reconnect(std::chrono::steady_clock::duration delay);
+
+  /**
+   * \brief Wake the loop from another thread
+   */
+  void kick();
+
+  /**
+   * \brief Set the events the loop waits for on the descriptor from read_watched_ and write_blocked_
+   *
+   * Called after changing either flag; may run on the io thread and a writing thread at once.
+   */
+  void watch_fd();
+
+  void handle_readable(bool hangup);
+  void handle_writable();
+  void complete_write();
+
+  //===========================================================================
+  // member variables
+  //===========================================================================
+
+  std::atomic<int> fd_;
+  int epoll_fd_;
+  int event_fd_; //!< wakes the loop for stop requests and writes completed off the io thread
+  int timer_fd_;           //!< fires write retries
+  int reconnect_timer_fd_; //!< fires reconnect attempts
+
+  std::atomic<bool> stop_requested_;
+
+  // pending read, only touched on the io thread (or before it starts)
+  uint8_t *read_data_;
+  size_t read_size_;
+  const IoHandler *read_handler_; //!< NULL when no read is pending
+
+  // readiness is level triggered, so the descriptor is only watched for input while a read is pending
+  boost::mutex watch_mutex_;       //!< serializes changes to the events watched on the descriptor
+  std::atomic<bool> read_watched_; //!< EPOLLIN is wanted; only changed on the io thread
+
+  // pending write, owned by whoever holds the write batch in MavlinkComm
+  const WriteBufferSequence *write_buffers_;
+  const IoHandler *write_handler_;
+  std::atomic<bool> write_blocked_;  //!< waiting for the descriptor to become writable
+  std::atomic<bool> write_complete_; //!< a write finished off the io thread and its handler has not run yet
+  int write_error_;
+  size_t write_bytes_;
+};
+
+} // namespace mavrosflight
+
+#endif // __linux__
+
+#endif // MAVROSFLIGHT_MAVLINK_EPOLL_COMM_H
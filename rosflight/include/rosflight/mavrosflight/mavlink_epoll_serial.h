@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_epoll_serial.h
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_EPOLL_SERIAL_H
+#define MAVROSFLIGHT_MAVLINK_EPOLL_SERIAL_H
+
+#ifdef __linux__
+
+#include <rosflight/mavrosflight/mavlink_epoll_comm.h>
+
+#include <string>
+
+namespace mavrosflight
+{
+/**
+ * \brief Serial port transport on the epoll backend
+ */
+class MavlinkEpollSerial : public MavlinkEpollComm
+{
+public:
+  /**
+   * \brief Instantiates the class; communication begins when the port is opened
+   * \param port Name of the serial port (e.g. "/dev/ttyUSB0")
+   * \param baud_rate Serial communication baud rate
+   * \param low_latency Take exclusive access to the port and tune it for receive latency (see set_serial_low_latency)
+   * \param hardware_flow_control Use RTS/CTS flow control
+   */
+  MavlinkEpollSerial(std::string port, int baud_rate, bool low_latency = false, bool hardware_flow_control = false);
+
+  /**
+   * \brief Stops communication and closes the serial port before the object is destroyed
+   */
+  ~MavlinkEpollSerial();
+
+private:
+  virtual int open_fd();
+  virtual ssize_t read_some(uint8_t *buf, size_t len);
+
+  /**
+   * \brief Write the batch with a single writev call
+   */
+  virtual ssize_t write_some(const WriteBufferSequence &buffers);
+
+  /**
+   * \brief Time to receive one byte: a start bit, eight data bits and a stop bit at the configured baud rate
+   */
+  virtual std::chrono::nanoseconds byte_time() const;
+
+  std::string port_;
+  int baud_rate_;
+  bool low_latency_;
+  bool hardware_flow_control_;
+};
+
+} // namespace mavrosflight
+
+#endif // __linux__
+
+#endif // MAVROSFLIGHT_MAVLINK_EPOLL_SERIAL_H
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_epoll_udp.h
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_EPOLL_UDP_H
+#define MAVROSFLIGHT_MAVLINK_EPOLL_UDP_H
+
+#ifdef __linux__
+
+#include <rosflight/mavrosflight/mavlink_epoll_comm.h>
+
+#include <string>
+
+#include <netinet/in.h>
+
+namespace mavrosflight
+{
+/**
+ * \brief UDP transport on the epoll backend
+ */
+class MavlinkEpollUDP : public MavlinkEpollComm
+{
+public:
+  /**
+   * \brief Instantiates the class; communication begins when the socket is opened
+   * \param bind_host Host where this node is running
+   * \param bind_port Port number for this node
+   * \param remote_host Host where the other node is running
+   * \param remote_port Port number for the other node
+   */
+  MavlinkEpollUDP(std::string bind_host, uint16_t bind_port, std::string remote_host, uint16_t remote_port);
+
+  /**
+   * \brief Stops communication and closes the socket before the object is destroyed
+   */
+  ~MavlinkEpollUDP();
+
+private:
+  virtual int open_fd();
+
+  /**
+   * \brief Receive one datagram, remembering its sender as the remote endpoint
+   */
+  virtual ssize_t read_some(uint8_t *buf, size_t len);
+
+  /**
+   * \brief Send each packet in the batch as its own datagram with a single sendmmsg call
+   */
+  virtual ssize_t write_some(const WriteBufferSequence &buffers);
+
+  std::string bind_host_;
+  uint16_t bind_port_;
+
+  std::string remote_host_;
+  uint16_t remote_port_;
+
+  struct sockaddr_in remote_addr_;
+};
+
+} // namespace mavrosflight
+
+#endif // __linux__
+
+#endif // MAVROSFLIGHT_MAVLINK_EPOLL_UDP_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_frame.h
+ *
+ * Read-only view of a received mavlink frame
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_FRAME_H
+#define MAVROSFLIGHT_MAVLINK_FRAME_H
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * \brief Read a field of a mavlink message in place from a MavlinkFrame
+ *
+ * The offset and type of the field come from the generated message struct, so this works for every message in the
+ * dialect, e.g. MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, xacc).
+ */
+#define MAVLINK_FRAME_FIELD(frame, msg_type, field) \
+  (frame).get<decltype(msg_type::field)>(offsetof(msg_type, field))
+
+/**
+ * \brief Read element i of an array field of a mavlink message in place from a MavlinkFrame
+ */
+#define MAVLINK_FRAME_ARRAY_FIELD(frame, msg_type, field, i)                                              \
+  (frame).get<std::remove_extent<decltype(msg_type::field)>::type>(                                       \
+      offsetof(msg_type, field) + (i) * sizeof(std::remove_extent<decltype(msg_type::field)>::type))
+
+namespace mavrosflight
+{
+/**
+ * \brief Non-owning view of a complete, validated mavlink frame
+ *
+ * The view points into the buffer the frame was received into and is only valid for the duration of the
+ * handle_mavlink_frame call it was passed to. Fields are read directly from the payload with get() (or the
+ * MAVLINK_FRAME_FIELD macro) instead of decoding the whole message into a struct first.
+ */
+class MavlinkFrame
+{
+public:
+  /**
+   * \param frame Pointer to the start byte of a frame that has passed length and checksum validation
+   * \param received When the last byte of the frame arrived
+   */
+  explicit MavlinkFrame(const uint8_t *frame,
+                        std::chrono::system_clock::time_point received = std::chrono::system_clock::time_point()) :
+    frame_(frame),
+    received_(received)
+  {
+  }
+
+  uint8_t len() const { return frame_[1]; }
+  uint8_t seq() const { return frame_[2]; }
+  uint8_t sysid() const { return frame_[3]; }
+  uint8_t compid() const { return frame_[4]; }
+  uint8_t msgid() const { return frame_[5]; }
+
+  /**
+   * \brief Pointer to the first byte of the payload
+   */
+  const uint8_t *payload() const { return frame_ + MAVLINK_NUM_HEADER_BYTES; }
+
+  /**
+   * \brief Pointer to the raw frame, from the start byte through the checksum
+   */
+  const uint8_t *data() const { return frame_; }
+
+  /**
+   * \brief Length of the raw frame in bytes
+   */
+  size_t size() const { return len() + MAVLINK_NUM_NON_PAYLOAD_BYTES; }
+
+  /**
+   * \brief When the frame arrived, as close to the wire as the transport can tell, or the epoch if unknown
+   *
+   * Taken from the kernel for UDP, and estimated from the read completion time and the frame's position in the read
+   * for serial ports. Unlike the time a listener runs, this does not include io thread or dispatcher scheduling delays.
+   */
+  std::chrono::system_clock::time_point received() const { return received_; }
+
+  /**
+   * \brief Read a value from the payload
+   *
+   * The payload is not necessarily aligned within the receive buffer, so the value is read with memcpy, which the
+   * compiler reduces to a plain load.
+   *
+   * \param offset Byte offset of the value within the payload
+   */
+  template <typename T>
+  T get(size_t offset) const
+  {
+    T value;
+    memcpy(&value, payload() + offset, sizeof(T));
+    return value;
+  }
+
+  /**
+   * \brief Decode the whole payload into a generated message struct
+   */
+  template <typename T>
+  void decode(T *msg) const
+  {
+    memset(msg, 0, sizeof(T));
+    memcpy(msg, payload(), len() < sizeof(T) ? len() : sizeof(T));
+  }
+
+private:
+  const uint8_t *frame_;
+  std::chrono::system_clock::time_point received_;
+};
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_MAVLINK_FRAME_H
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_frame_listener_interface.h
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_FRAME_LISTENER_INTERFACE_H
+#define MAVROSFLIGHT_MAVLINK_FRAME_LISTENER_INTERFACE_H
+
+#include <rosflight/mavrosflight/mavlink_frame.h>
+
+namespace mavrosflight
+{
+/**
+ * \brief Describes an interface classes can implement to read received mavlink frames in place
+ *
+ * Unlike MavlinkListenerInterface, no mavlink_message_t is built for these listeners; they are handed a view of the
+ * frame in the receive buffer.
+ */
+class MavlinkFrameListenerInterface
+{
+public:
+  /**
+   * \brief The handler function for mavlink frames to be implemented by derived classes
+   * \param frame View of the received frame, valid only for the duration of the call
+   */
+  virtual void handle_mavlink_frame(const MavlinkFrame &frame) = 0;
+};
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_MAVLINK_FRAME_LISTENER_INTERFACE_H
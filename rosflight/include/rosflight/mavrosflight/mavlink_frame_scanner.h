@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_frame_scanner.h
+ *
+ * Bulk parser that extracts complete mavlink frames from a receive buffer
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_FRAME_SCANNER_H
+#define MAVROSFLIGHT_MAVLINK_FRAME_SCANNER_H
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace mavrosflight
+{
+/**
+ * \brief Finds, validates and emits complete mavlink frames from a span of received bytes
+ *
+ * Instead of stepping the mavlink_parse_char state machine once per byte, the scanner searches for the start byte,
+ * checks the payload length against the expected length for the message ID, and verifies the checksum over the whole
+ * frame at once. Frames are handed to the caller in place, pointing into the scanned buffer.
+ */
+class MavlinkFrameScanner
+{
+public:
+  MavlinkFrameScanner();
+
+  /**
+   * \brief Scan a buffer for complete frames
+   *
+   * A frame that is cut off at the end of the buffer is not consumed; the caller must keep those bytes and present
+   * them again at the start of the next call, followed by the newly received data.
+   *
+   * \param data Received bytes
+   * \param len Number of bytes in data
+   * \param handler Callable invoked as handler(const uint8_t *frame, size_t frame_len) for each valid frame
+   * \return Number of bytes consumed from the front of data
+   */
+  template <typename Handler>
+  size_t scan(const uint8_t *data, size_t len, Handler handler)
+  {
+    size_t pos = 0;
+    while (pos < len)
+    {
+      const uint8_t *stx = (const uint8_t *)memchr(data + pos, MAVLINK_STX, len - pos);
+      if (stx == NULL)
+      {
+        bytes_skipped_ += len - pos;
+        return len;
+      }
+
+      size_t start = stx - data;
+      bytes_skipped_ += start - pos;
+      pos = start;
+
+      if (len - pos < MAVLINK_NUM_HEADER_BYTES)
+        break; // wait for the rest of the header
+
+      uint8_t payload_len = data[pos + 1];
+      uint8_t msgid = data[pos + 5];
+      if (!check_length(msgid, payload_len))
+      {
+        length_errors_++;
+        bytes_skipped_++;
+        pos++;
+        continue;
+      }
+
+      size_t frame_len = payload_len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+      if (len - pos < frame_len)
+        break; // wait for the rest of the frame
+
+      if (!check_crc(data + pos, payload_len))
+      {
+        crc_errors_++;
+        bytes_skipped_++;
+        pos++;
+        continue;
+      }
+
+      frames_++;
+      handler(data + pos, frame_len);
+      pos += frame_len;
+    }
+
+    return pos;
+  }
+
+  /**
+   * \brief Copy a validated frame into a mavlink message struct
+   * \param frame Pointer to the start byte of a frame returned by scan()
+   * \param msg The message to fill
+   */
+  static void unpack(const uint8_t *frame, mavlink_message_t *msg);
+
+  uint64_t frames() const { return frames_; }
+  uint64_t crc_errors() const { return crc_errors_; }
+  uint64_t length_errors() const { return length_errors_; }
+  uint64_t bytes_skipped() const { return bytes_skipped_; }
+
+private:
+  bool check_length(uint8_t msgid, uint8_t payload_len) const;
+  bool check_crc(const uint8_t *frame, uint8_t payload_len) const;
+
+  uint64_t frames_;        //!< number of valid frames emitted
+  uint64_t crc_errors_;    //!< number of candidate frames rejected for a bad checksum
+  uint64_t length_errors_; //!< number of candidate frames rejected for an unexpected payload length
+  uint64_t bytes_skipped_; //!< number of bytes discarded while searching for a start byte
+};
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_MAVLINK_FRAME_SCANNER_H
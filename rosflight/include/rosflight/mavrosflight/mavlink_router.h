@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_router.h
+ *
+ * Forwards raw mavlink frames between the flight controller link and additional endpoints
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_ROUTER_H
+#define MAVROSFLIGHT_MAVLINK_ROUTER_H
+
+#include <rosflight/mavrosflight/mavlink_comm.h>
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mavrosflight
+{
+/**
+ * \brief Fans frames from one upstream link out to any number of endpoints, and frames from the endpoints back up
+ *
+ * Frames are forwarded as they were received, straight from the receive buffer into each endpoint's write queue, so
+ * no message is unpacked or repacked. Each endpoint is its own MavlinkComm with its own write queues and io thread; a
+ * slow endpoint only fills (and drops from) its own queue and never holds up the upstream link or other endpoints.
+ */
+class MavlinkRouter
+{
+public:
+  /**
+   * \brief Counters for one endpoint
+   */
+  struct EndpointStats
+  {
+    uint64_t forwarded; //!< upstream frames queued to the endpoint
+    uint64_t filtered;  //!< upstream frames not forwarded because of the endpoint's message filter
+    uint64_t dropped;   //!< upstream frames rejected, evicted or lost to an outage by the endpoint's write queue
+    uint64_t received;  //!< frames from the endpoint forwarded upstream
+  };
+
+  /**
+   * \param upstream The flight controller link; must outlive the router
+   */
+  explicit MavlinkRouter(MavlinkComm *upstream);
+
+  /**
+   * \brief Stops forwarding and closes the endpoints
+   */
+  ~MavlinkRouter();
+
+  /**
+   * \brief Add an endpoint and start forwarding to it
+   *
+   * The router takes ownership of the endpoint and opens it. If the endpoint has auto reconnect enabled and cannot be
+   * opened yet, e.g. because a ground station is not listening, it is still added and keeps trying to connect, with
+   * frames for it queued meanwhile.
+   *
+   * \param endpoint The endpoint link, not yet opened
+   * \param msgids IDs of the upstream messages to forward to the endpoint; empty forwards everything
+   * \throws SerialException if the endpoint could not be opened and does not reconnect
+   */
+  void add_endpoint(MavlinkComm *endpoint, const std::vector<uint8_t> &msgids = std::vector<uint8_t>());
+
+  /**
+   * \brief Number of endpoints
+   */
+  size_t num_endpoints() const { return endpoints_.size(); }
+
+  /**
+   * \brief Get the counters for an endpoint
+   * \param index Index of the endpoint, in the order they were added
+   */
+  EndpointStats get_endpoint_stats(size_t index) const;
+
+private:
+  /**
+   * \brief An endpoint link, and the listener that forwards its frames upstream
+   */
+  struct Endpoint : public MavlinkFrameListenerInterface
+  {
+    Endpoint(MavlinkComm *upstream, MavlinkComm *comm, const std::vector<uint8_t> &msgids);
+    ~Endpoint();
+
+    virtual void handle_mavlink_frame(const MavlinkFrame &frame);
+
+    /**
+     * \brief Forward an upstream frame to this endpoint if it passes the filter
+     */
+    void forward(const MavlinkFrame &frame);
+
+    MavlinkComm *const upstream;
+    std::unique_ptr<MavlinkComm> comm;
+    std::bitset<256> filter; //!< upstream message IDs forwarded to this endpoint
+
+    std::atomic<uint64_t> forwarded;
+    std::atomic<uint64_t> filtered;
+    std::atomic<uint64_t> received;
+  };
+
+  /**
+   * \brief Receives every upstream frame and hands it to the endpoints
+   */
+  struct UpstreamListener : public MavlinkFrameListenerInterface
+  {
+    explicit UpstreamListener(MavlinkRouter *router) : router(router) {}
+    virtual void handle_mavlink_frame(const MavlinkFrame &frame);
+    MavlinkRouter *const router;
+  };
+
+  typedef std::vector<std::shared_ptr<Endpoint> > EndpointList;
+
+  MavlinkComm *upstream_;
+  UpstreamListener upstream_listener_;
+
+  EndpointList endpoints_;                     //!< every endpoint, only changed from add_endpoint
+  std::shared_ptr<const EndpointList> active_; //!< endpoints seen by the upstream listener, replaced atomically
+};
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_MAVLINK_ROUTER_H
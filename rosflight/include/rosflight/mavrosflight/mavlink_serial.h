@@ -53,8 +53,10 @@ public:
    * \brief Instantiates the class and begins communication on the specified serial port
    * \param port Name of the serial port (e.g. "/dev/ttyUSB0")
    * \param baud_rate Serial communication baud rate
+   * \param low_latency Take exclusive access to the port and tune it for receive latency (see set_serial_low_latency)
+   * \param hardware_flow_control Use RTS/CTS flow control
    */
-  MavlinkSerial(std::string port, int baud_rate);
+  MavlinkSerial(std::string port, int baud_rate, bool low_latency = false, bool hardware_flow_control = false);
 
   /**
    * \brief Stops communication and closes the serial port before the object is destroyed
@@ -73,15 +75,19 @@ private:
   /**
    * \brief Initiate an asynchronous read operation
    */
-  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer,
-                             boost::function<void(const boost::system::error_code &, size_t)> handler);
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
 
   /**
    * \brief Initialize an asynchronous write operation
-   * \param check_write_state If true, only start another write operation if a write sequence is not already running
+   *
+   * The whole batch is handed to the port as a single scatter-gather write.
    */
-  virtual void do_async_write(const boost::asio::const_buffers_1 &buffer,
-                              boost::function<void(const boost::system::error_code &, size_t)> handler);
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler);
+
+  /**
+   * \brief Time to receive one byte: a start bit, eight data bits and a stop bit at the configured baud rate
+   */
+  virtual std::chrono::nanoseconds byte_time() const;
 
   //===========================================================================
   // member variables
@@ -91,6 +97,8 @@ private:
 
   std::string port_;
   int baud_rate_;
+  bool low_latency_;
+  bool hardware_flow_control_;
 };
 
 } // namespace mavrosflight
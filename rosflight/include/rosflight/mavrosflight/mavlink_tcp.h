@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_tcp.h
+ *
+ * MAVLink over a TCP connection, for links that need reliable delivery and flow control.
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_TCP_H
+#define MAVROSFLIGHT_MAVLINK_TCP_H
+
+#include <rosflight/mavrosflight/mavlink_comm.h>
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+
+#include <string>
+
+namespace mavrosflight
+{
+class MavlinkTCP : public MavlinkComm
+{
+public:
+  /**
+   * \brief Instantiates the class; the connection is made when the link is opened
+   * \param remote_host Host where the other node is listening
+   * \param remote_port Port number the other node is listening on
+   */
+  MavlinkTCP(std::string remote_host, uint16_t remote_port);
+
+  /**
+   * \brief Stops communication and closes the connection before the object is destroyed
+   */
+  ~MavlinkTCP();
+
+private:
+  //===========================================================================
+  // methods
+  //===========================================================================
+
+  virtual bool is_open();
+  virtual void do_open();
+  virtual void do_close();
+
+  /**
+   * \brief Resolve the host and connect without blocking the io thread
+   */
+  virtual void do_async_open(const OpenHandler &handler);
+
+  /**
+   * \brief Handler for the host lookup started by do_async_open
+   */
+  void async_resolve_end(const boost::system::error_code &error,
+                         boost::asio::ip::tcp::resolver::iterator endpoints,
+                         const OpenHandler &handler);
+
+  /**
+   * \brief Handler for the connection attempt started by async_resolve_end
+   */
+  void async_connect_end(boost::system::error_code error, const OpenHandler &handler);
+
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+
+  /**
+   * \brief Write as much of the batch as the socket buffer accepts
+   *
+   * A full socket buffer holds the write back, so a slow peer fills the write queue rather than losing bytes.
+   */
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler);
+
+  //===========================================================================
+  // member variables
+  //===========================================================================
+
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::ip::tcp::resolver resolver_;
+
+  std::string remote_host_;
+  uint16_t remote_port_;
+};
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_MAVLINK_TCP_H
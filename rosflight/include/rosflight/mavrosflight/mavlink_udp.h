@@ -42,6 +42,8 @@
 #include <boost/asio.hpp>
 #include <boost/function.hpp>
 
+#include <atomic>
+#include <cstddef>
 #include <string>
 
 namespace mavrosflight
@@ -71,10 +73,53 @@ private:
   virtual bool is_open();
   virtual void do_open();
   virtual void do_close();
-  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer,
-                             boost::function<void(const boost::system::error_code &, size_t)> handler);
-  virtual void do_async_write(const boost::asio::const_buffers_1 &buffer,
-                              boost::function<void(const boost::system::error_code &, size_t)> handler);
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+
+  /**
+   * \brief Send each packet in the batch as its own datagram (with a single sendmmsg call on Linux)
+   */
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler);
+
+#ifdef __linux__
+  /**
+   * \brief Read the datagram do_async_read waited for
+   */
+  void read_ready(const boost::system::error_code &error);
+
+  /**
+   * \brief Hand the current batch to the kernel, waiting for the socket to become writable if its buffer is full
+   */
+  void write_batch();
+
+  /**
+   * \brief Complete the current batch; posted by write_batch so the next one is not started from inside it
+   */
+  void write_done();
+
+  /**
+   * \brief Handler that calls write_done, with its memory in write_done_storage_
+   *
+   * Handlers posted from a thread that is not running the io service are allocated on the heap by default, and
+   * write_batch often runs on the thread that called send_message. Only one write completion is in flight at a time.
+   */
+  struct WriteDone
+  {
+    explicit WriteDone(MavlinkUDP *udp) : udp(udp) {}
+    void operator()() const { udp->write_done(); }
+
+    void *allocate(size_t size);
+    void deallocate(void *pointer);
+    friend void *asio_handler_allocate(size_t size, WriteDone *handler) { return handler->allocate(size); }
+    friend void asio_handler_deallocate(void *pointer, size_t, WriteDone *handler) { handler->deallocate(pointer); }
+
+    MavlinkUDP *udp;
+  };
+#else
+  /**
+   * \brief Send the next packet of the current batch, completing the batch once they have all been sent
+   */
+  void send_next();
+#endif
 
   //===========================================================================
   // member variables
@@ -89,6 +134,18 @@ private:
   boost::asio::ip::udp::socket socket_;
   boost::asio::ip::udp::endpoint bind_endpoint_;
   boost::asio::ip::udp::endpoint remote_endpoint_;
+
+  // the read and write in progress, kept here so the handlers given to asio only need to capture this
+  boost::asio::mutable_buffers_1 read_buffer_;
+  const IoHandler *read_handler_;
+  const WriteBufferSequence *write_buffers_;
+  const IoHandler *write_handler_;
+  boost::system::error_code write_error_;
+  size_t write_bytes_;
+  size_t write_index_; //!< next packet of the batch to send, where there is no sendmmsg
+
+  alignas(std::max_align_t) unsigned char write_done_storage_[128];
+  std::atomic<bool> write_done_storage_used_;
 };
 
 } // namespace mavrosflight
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_unix.h
+ *
+ * MAVLink over a Unix domain stream socket, for processes running on the same machine.
+ */
+
+#ifndef MAVROSFLIGHT_MAVLINK_UNIX_H
+#define MAVROSFLIGHT_MAVLINK_UNIX_H
+
+#include <rosflight/mavrosflight/mavlink_comm.h>
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+
+#include <string>
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+namespace mavrosflight
+{
+class MavlinkUnix : public MavlinkComm
+{
+public:
+  /**
+   * \brief Instantiates the class; the connection is made when the link is opened
+   * \param path Filesystem path of the socket the other process is listening on
+   */
+  explicit MavlinkUnix(std::string path);
+
+  /**
+   * \brief Stops communication and closes the connection before the object is destroyed
+   */
+  ~MavlinkUnix();
+
+private:
+  //===========================================================================
+  // methods
+  //===========================================================================
+
+  virtual bool is_open();
+  virtual void do_open();
+  virtual void do_close();
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+
+  /**
+   * \brief Write as much of the batch as the socket buffer accepts
+   *
+   * Unlike UDP on loopback, a reader that falls behind blocks the writer instead of silently losing datagrams.
+   */
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler);
+
+  //===========================================================================
+  // member variables
+  //===========================================================================
+
+  boost::asio::local::stream_protocol::socket socket_;
+
+  std::string path_;
+};
+
+} // namespace mavrosflight
+
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+#endif // MAVROSFLIGHT_MAVLINK_UNIX_H
@@ -40,6 +40,8 @@
 #include <rosflight/mavrosflight/mavlink_bridge.h>
 #include <rosflight/mavrosflight/mavlink_serial.h>
 
+#include <cstring>
+
 #include <yaml-cpp/yaml.h>
 
 namespace mavrosflight
@@ -62,16 +64,35 @@ public:
   MAV_PARAM_TYPE getType() const;
   double getValue() const;
 
+  /**
+   * \brief Pack a PARAM_SET for a new value, converted to the parameter type
+   *
+   * The message is packed even if the parameter already holds the value, since a set still waiting to be applied may
+   * be about to change it; deciding whether to send it is up to the caller.
+   */
   void requestSet(double value, mavlink_message_t *msg);
   bool handleUpdate(const mavlink_param_value_t &msg);
 
+  float getRawValue(double value);
+
+  /**
+   * \brief Whether two raw values have the same bit pattern
+   *
+   * Integer parameters are carried in the bits of a float, and many of their values read as NaN, which never compares
+   * equal as a float.
+   */
+  static bool sameRawValue(float a, float b);
+
+  /**
+   * \brief The value the parameter would hold if set to the given value, after conversion to its type
+   */
+  double getCastValue(double value);
+
 private:
   void init(std::string name, int index, MAV_PARAM_TYPE type, float raw_value);
 
   void setFromRawValue(float raw_value);
   float getRawValue();
-  float getRawValue(double value);
-  double getCastValue(double value);
 
   template <typename T>
   double fromRawValue(float value)
@@ -83,8 +104,11 @@ private:
   template <typename T>
   float toRawValue(double value)
   {
+    // narrower types leave the upper bytes zero, so equal values always have equal bit patterns
     T t_value = (T)value;
-    return *(float *)&t_value;
+    float raw_value = 0.0f;
+    memcpy(&raw_value, &t_value, sizeof(t_value));
+    return raw_value;
   }
 
   template <typename T>
@@ -45,67 +45,456 @@
 #include <rosflight/mavrosflight/param_listener_interface.h>
 #include <rosflight/mavrosflight/timer_interface.h>
 
+#include <chrono>
 #include <deque>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#define PARAM_DOWNLOAD_WINDOW 8
+#define PARAM_REQUEST_TIMEOUT_MS 100
+#define PARAM_REQUEST_MAX_TIMEOUT_MS 2000
+#define PARAM_CACHE_VERSION_TIMEOUT_MS 2000
+#define PARAM_SET_WINDOW 8
+#define PARAM_SET_MAX_ATTEMPTS 5
+
 namespace mavrosflight
 {
 template <typename DerivedLogger>
 class ParamManager : public MavlinkListenerInterface
 {
 public:
+  /**
+   * \brief Progress of the parameter download started by request_params
+   */
+  struct DownloadStats
+  {
+    size_t received;                      //!< parameters received so far
+    size_t total;                         //!< parameters on the flight controller, or zero if not yet known
+    bool complete;                        //!< whether every parameter has been received
+    bool from_cache;                      //!< whether the parameters were loaded from the cache file
+    bool verifying;                       //!< whether the cache is still being checked with the flight controller
+    std::chrono::nanoseconds elapsed;     //!< time since the download started, or the time it took once complete
+    uint64_t requests;                    //!< individual parameter requests sent, including retries
+    uint64_t retries;                     //!< requests sent again after timing out
+    std::chrono::nanoseconds latency;     //!< mean time from an individual request to its answer
+    std::chrono::nanoseconds latency_max; //!< longest time from an individual request to its answer
+  };
+
+  /**
+   * \brief Outcome of the parameter sets sent by set_param_value and load_from_file
+   */
+  struct SetStats
+  {
+    size_t pending;                       //!< sets queued or waiting for confirmation
+    uint64_t confirmed;                   //!< sets the flight controller echoed back with the new value
+    uint64_t failed;                      //!< sets still unconfirmed after PARAM_SET_MAX_ATTEMPTS tries
+    uint64_t retries;                     //!< sets sent again after going unconfirmed
+    std::chrono::nanoseconds latency;     //!< mean time from first sending a set to its confirmation
+    std::chrono::nanoseconds latency_max; //!< longest time from first sending a set to its confirmation
+  };
+
+  /**
+   * \brief Confirmation latency of the sets of one parameter
+   */
+  struct ParamSetLatency
+  {
+    uint64_t confirmed;             //!< sets of the parameter the flight controller echoed back
+    std::chrono::nanoseconds last;  //!< time from first sending the latest confirmed set to its confirmation
+    std::chrono::nanoseconds max;   //!< longest time from first sending a set to its confirmation
+    std::chrono::nanoseconds total; //!< sum of the confirmation times, for the mean
+    int last_attempts;              //!< times the latest confirmed set was sent
+  };
+
+  /**
+   * \brief A parameter whose value in a file differs from its value on the flight controller
+   */
+  struct ParamChange
+  {
+    std::string name;
+    double old_value; //!< value on the flight controller, or the value a pending set will give it
+    double new_value; //!< value from the file, converted to the parameter type
+  };
+
+  /**
+   * \brief Outcome of a set_param_values call
+   */
+  struct SetManyResult
+  {
+    std::vector<bool> exists;    //!< whether each parameter is known
+    std::vector<bool> confirmed; //!< whether the flight controller confirmed each set
+    bool rolled_back;            //!< whether the previous values were restored after an all-or-nothing set failed
+    bool success;                //!< whether every parameter exists and every set was confirmed
+  };
+
+  /**
+   * \brief Called once every set of a set_param_value or load_from_file call has been confirmed or has failed
+   *
+   * Runs on the thread that handled the last confirmation or timeout, or on the calling thread if nothing needed to be
+   * sent, without any ParamManager lock held.
+   */
+  typedef std::function<void(size_t confirmed, size_t failed)> SetCallback;
+
+  /**
+   * \brief Called once a set_param_values call has finished, including restoring the previous values; runs as
+   * SetCallback does
+   */
+  typedef std::function<void(const SetManyResult &result)> SetManyCallback;
+
   ParamManager(MavlinkComm *const comm, LoggerInterface<DerivedLogger> &logger, TimerProviderInterface &timer_provider);
-  ~ParamManager();
 
   virtual void handle_mavlink_message(const mavlink_message_t &msg);
 
   bool unsaved_changes();
 
-  bool get_param_value(std::string name, double *value);
-  bool set_param_value(std::string name, double value);
+  bool get_param_value(const std::string &name, double *value);
+  /**
+   * \brief Set a parameter on the flight controller
+   *
+   * Up to PARAM_SET_WINDOW sets are in flight at once. Each is sent again until the flight controller echoes the new
+   * value back, and counted as failed after PARAM_SET_MAX_ATTEMPTS tries. A value the parameter already has, or that
+   * the newest set of it still waiting to be applied will give it, is not sent, and counts as confirmed straight away,
+   * unless the value only comes from a cache that has not been verified yet.
+   *
+   * \param callback Optional completion callback
+   * \return false if the parameter is unknown, in which case the callback is never called
+   */
+  bool set_param_value(const std::string &name, double value, SetCallback callback = SetCallback());
+  /**
+   * \brief Set several parameters, each as set_param_value does
+   *
+   * With all_or_nothing nothing is sent unless every parameter is known, and if any set fails the previous values of
+   * all of them are set again; those whose set never took effect already hold their previous value and are not sent.
+   *
+   * \param values New values, one for each name
+   * \param callback Called with the outcome once every set, and any restore, has completed
+   */
+  void set_param_values(const std::vector<std::string> &names,
+                        const std::vector<double> &values,
+                        bool all_or_nothing,
+                        const SetManyCallback &callback);
   bool write_params();
 
   void register_param_listener(ParamListenerInterface *listener);
   void unregister_param_listener(ParamListenerInterface *listener);
 
+  /**
+   * \brief Write every received parameter to a YAML file, in index order
+   * \return false if the file could not be written, or if parameters loaded from the cache are still being verified
+   */
   bool save_to_file(std::string filename);
-  bool load_from_file(std::string filename);
+  /**
+   * \brief Set the parameters listed in a file written by save_to_file
+   *
+   * Each value is converted to the type of its parameter and compared with the value on the flight controller, or the
+   * value a set still waiting to be applied will give it, and only those that differ are sent. Parameters loaded from a
+   * cache that has not been verified yet are always sent. Entries naming unknown parameters or the wrong type are
+   * skipped.
+   *
+   * \param callback Optional callback for when all of the resulting sets have completed; called straight away if
+   * nothing differs
+   * \param changes If not null, filled with the parameters being changed
+   * \return false if the file could not be read, in which case nothing is sent and the callback is never called
+   */
+  bool load_from_file(std::string filename,
+                      SetCallback callback = SetCallback(),
+                      std::vector<ParamChange> *changes = nullptr);
 
   int get_num_params();
   int get_params_received();
   bool got_all_params();
 
+  /**
+   * \brief Start downloading the parameters the flight controller has not sent yet
+   *
+   * The full list is requested first. Once that stream goes quiet, the missing parameters are requested individually,
+   * keeping up to the download window of requests in flight and retrying each with exponential backoff until it is
+   * answered. The download runs on its own timer until every parameter has been received.
+   */
   void request_params();
 
+  /**
+   * \brief Configure the parameter download
+   * \param window Maximum number of individual parameter requests in flight
+   * \param timeout Time to wait for an answer before the first retry; doubled on each retry of the same request
+   */
+  void set_download_window(size_t window, std::chrono::milliseconds timeout);
+
+  DownloadStats get_download_stats();
+  SetStats get_set_stats();
+
+  /**
+   * \brief Confirmation latency of each parameter that has had a set confirmed, by name
+   *
+   * Sets that needed no sending, because the parameter already had the value, are not included.
+   */
+  std::map<std::string, ParamSetLatency> get_set_latencies();
+
+  /**
+   * \brief Keep a copy of the parameter table in a file, to be reused the next time the same firmware is seen
+   *
+   * Must be called before request_params, which then waits for set_firmware_version (or a timeout) before starting
+   * the download. An empty filename disables the cache. The file should be specific to the connection, since boards
+   * running the same firmware can hold different values.
+   */
+  void set_cache_file(std::string filename);
+
+  /**
+   * \brief Report the firmware version of the flight controller, which the cache file is keyed by
+   *
+   * If the cache was written by the same firmware it is loaded in place of a download, so got_all_params is true
+   * straight away, and the whole table is then downloaded in the background and checked against it. A parameter that
+   * does not fit the cached table discards the cache and downloads the table afresh; a value that differs replaces the
+   * cached one and is reported to the param listeners as an update.
+   */
+  void set_firmware_version(std::string version);
+
 private:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * \brief An individual parameter request waiting for its answer
+   */
+  struct PendingRequest
+  {
+    size_t index;
+    Clock::time_point sent;     //!< when the request was last sent
+    Clock::time_point deadline; //!< when it is sent again if still unanswered
+    int attempts;               //!< times it has been sent
+  };
+
   void request_param_list();
   void request_param(int index);
 
+  /**
+   * \brief Send requests for missing parameters until the window is full
+   *
+   * Must be called with download_mutex_ held.
+   */
+  void fill_download_window(Clock::time_point now);
+  void download_timer_callback();
+
+  /**
+   * \brief Request the list, or wait for the firmware version first if the cache may be used
+   *
+   * Must be called with download_mutex_ held.
+   */
+  void start_download(Clock::time_point now);
+
+  /**
+   * \brief Forget all parameters so that they are downloaded again
+   *
+   * Must be called with download_mutex_ held.
+   */
+  void discard_params();
+
+  /**
+   * \brief Load the cache file if it matches the firmware version, and start checking its contents
+   *
+   * Must be called with download_mutex_ held.
+   * \return true if the cache was loaded
+   */
+  bool load_cache(Clock::time_point now);
+  bool save_cache();
+
+  /**
+   * \brief Tell the param listeners about every parameter loaded from the cache
+   */
+  void notify_cached_params();
+
+  /**
+   * \brief Check that a received parameter fits the table loaded from the cache, and mark it verified
+   *
+   * Only the name, index, type and parameter count are checked here; a differing value is handled as an update.
+   * Must be called with download_mutex_ held.
+   * \param index Index of the parameter with the received name in params_, or -1 if there is none
+   * \return false if the parameter does not fit the cached table, which must then be discarded
+   */
+  bool verify_cached_param(const mavlink_param_value_t &param, int index);
+
   void handle_param_value_msg(const mavlink_message_t &msg);
   void handle_command_ack_msg(const mavlink_message_t &msg);
 
-  bool is_param_id(std::string name);
+  /**
+   * \brief Slot of the open-addressing table from parameter ID to index into params_
+   */
+  struct ParamSlot
+  {
+    char id[MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN]; //!< ID padded with zeros, as sent in PARAM_VALUE
+    int index;                                           //!< index into params_, or -1 if the slot is empty
+  };
+
+  /**
+   * \brief Size the parameter table for the given number of parameters, forgetting any already received
+   *
+   * Must be called with download_mutex_ held.
+   */
+  void reset_params(size_t count);
+
+  /**
+   * \brief Store a parameter at its index and make it findable by name
+   *
+   * Must be called with download_mutex_ held, and with an index inside the table.
+   */
+  void add_param(const Param &param);
+
+  /**
+   * \brief Look a parameter up by name, without allocating
+   *
+   * Must be called with download_mutex_ held.
+   * \return index into params_, or -1 if no parameter of that name has been received
+   */
+  int find_param(const std::string &name) const;
 
   std::vector<ParamListenerInterface *> listeners_;
 
   MavlinkComm *comm_;
-  std::map<std::string, Param> params_;
+
+  // the parameter table is guarded by download_mutex_, since the download can resize it at any time
+  std::vector<Param> params_;          //!< indexed by param_index; entries not yet received have an index of -1
+  std::vector<ParamSlot> param_slots_; //!< power of two in size and at most half full, so probe runs stay short
 
   bool unsaved_changes_;
   bool write_request_in_progress_;
 
+  // download state is shared between the thread handling PARAM_VALUE messages and the download timer
+  std::mutex download_mutex_;
   bool first_param_received_;
   size_t num_params_;
   size_t received_count_;
-  bool *received_;
+  std::vector<bool> received_;
   bool got_all_params_;
 
-  std::deque<mavlink_message_t> param_set_queue_;
+  std::shared_ptr<TimerInterface> download_timer_;
+  bool download_in_progress_;
+  bool list_streaming_;                       //!< waiting for the stream that answers PARAM_REQUEST_LIST to finish
+  size_t download_window_;                    //!< maximum individual requests in flight
+  std::chrono::milliseconds request_timeout_; //!< time before the first retry of a request
+  std::vector<PendingRequest> in_flight_;     //!< individual requests waiting for an answer
+  size_t next_request_index_;                 //!< where the search for the next missing parameter starts
+  int list_attempts_;                         //!< times PARAM_REQUEST_LIST has been sent in this download
+  Clock::time_point download_start_;
+  Clock::time_point download_end_;
+  Clock::time_point list_deadline_;           //!< when the list is requested again if nothing has arrived
+  Clock::time_point last_value_time_;         //!< when the last new parameter arrived
+  uint64_t requests_sent_;
+  uint64_t retries_;
+  uint64_t answered_requests_;
+  std::chrono::nanoseconds latency_total_;
+  std::chrono::nanoseconds latency_max_;
+
+  std::string cache_file_;
+  std::string firmware_version_;
+  bool waiting_for_version_;           //!< the download is held until the firmware version is known
+  bool loaded_from_cache_;
+  bool verifying_cache_;               //!< a loaded cache is being checked against the flight controller
+  std::vector<bool> verified_;         //!< which cached parameters the flight controller has confirmed
+  size_t verified_count_;
+  bool cache_stale_;                   //!< the check has found cached values that were out of date
+  Clock::time_point version_deadline_; //!< when the download starts without the firmware version
+
+  /**
+   * \brief Completion state shared by the sets of one set_param_value or load_from_file call
+   */
+  struct SetBatch
+  {
+    size_t remaining;
+    size_t confirmed;
+    size_t failed;
+    SetCallback callback;
+  };
+
+  /**
+   * \brief A parameter set waiting to be sent or confirmed
+   */
+  struct PendingSet
+  {
+    std::string name;
+    mavlink_message_t msg;
+    double value;                 //!< value the parameter holds once the set is applied
+    float raw_value;              //!< value the flight controller echoes back once the set is applied
+    Clock::time_point first_sent; //!< when the set was first sent, for the confirmation latency
+    Clock::time_point deadline;   //!< when it is sent again if still unconfirmed
+    int attempts;                 //!< times it has been sent
+    std::shared_ptr<SetBatch> batch;
+  };
+
+  /**
+   * \brief Queue a packed PARAM_SET as part of a batch and send it as soon as the window allows
+   *
+   * Must be called with set_mutex_ held.
+   */
+  void queue_param_set(const std::string &name,
+                       double value,
+                       const mavlink_message_t &msg,
+                       const std::shared_ptr<SetBatch> &batch);
+
+  /**
+   * \brief The value a parameter will hold once its queued and in-flight sets have been applied
+   *
+   * Must be called with download_mutex_ and set_mutex_ held.
+   */
+  double target_value(int index);
+
+  /**
+   * \brief Whether the value held for a parameter came from the flight controller, rather than from a cache that is
+   * still being checked
+   *
+   * Must be called with download_mutex_ held.
+   */
+  bool value_verified(int index) const;
+
+  /**
+   * \brief Send queued sets until the window is full, keeping at most one set per parameter in flight
+   *
+   * Must be called with set_mutex_ held.
+   */
+  void fill_set_window(Clock::time_point now);
+
+  /**
+   * \brief Count a set as confirmed or failed, and collect its batch callback if that was the last set of the batch
+   *
+   * Must be called with set_mutex_ held.
+   */
+  void finish_param_set(const PendingSet &set, bool confirmed, std::vector<std::function<void()>> *callbacks);
+
+  /**
+   * \brief Match a received PARAM_VALUE against the sets waiting for confirmation
+   */
+  void confirm_param_set(const std::string &name, float raw_value);
+
+  /**
+   * \brief Release one reference to a batch, collecting its callback if it was the last
+   *
+   * Must be called with set_mutex_ held.
+   */
+  void release_set_batch(const std::shared_ptr<SetBatch> &batch, std::vector<std::function<void()>> *callbacks);
+
+  typedef std::function<void(const std::vector<bool> &exists, const std::vector<bool> &confirmed)> SetGroupCallback;
+
+  /**
+   * \brief Call set_param_value for each parameter and report on all of them once every set has completed
+   * \param callback Called with whether each parameter exists and whether each set was confirmed
+   */
+  void set_param_group(const std::vector<std::string> &names,
+                       const std::vector<double> &values,
+                       const SetGroupCallback &callback);
+
+  // set state is shared between the callers of set_param_value, the thread handling PARAM_VALUE and the set timer
+  std::mutex set_mutex_;
+  std::deque<PendingSet> param_set_queue_; //!< sets waiting for room in the window
+  std::vector<PendingSet> sets_in_flight_; //!< sets sent and waiting for confirmation
   std::shared_ptr<TimerInterface> param_set_timer_;
   bool param_set_in_progress_;
+  uint64_t sets_confirmed_;
+  uint64_t sets_failed_;
+  uint64_t set_retries_;
+  std::chrono::nanoseconds set_latency_total_;
+  std::chrono::nanoseconds set_latency_max_;
+  std::map<std::string, ParamSetLatency> set_latencies_; //!< confirmation latency of each parameter
   void param_set_timer_callback();
 
   LoggerInterface<DerivedLogger> &logger_;
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file seqlock.h
+ *
+ * Single-writer sequence lock for publishing small values to any number of reader threads
+ */
+
+#ifndef MAVROSFLIGHT_SEQLOCK_H
+#define MAVROSFLIGHT_SEQLOCK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mavrosflight
+{
+/**
+ * \brief A value written by one thread and read by many without locks
+ *
+ * The writer bumps a sequence number to odd, stores the value and bumps it back to even; a reader copies the value
+ * and retries if the sequence number was odd or changed while it was copying (H. Boehm, "Can Seqlocks Get Along With
+ * Programming Language Memory Models?"). The value is held as atomic words, so readers never race with the writer.
+ * Readers only retry when they overlap a store, so with infrequent writes a load completes in a single pass. Neither
+ * side ever blocks.
+ *
+ * Only one thread may call store() at a time.
+ */
+template <typename T>
+class SeqLock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied bytewise");
+
+public:
+  explicit SeqLock(const T &value = T()) : sequence_(0)
+  {
+    uint64_t words[NUM_WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+    for (size_t i = 0; i < NUM_WORDS; i++)
+    {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * \brief Publish a new value
+   */
+  void store(const T &value)
+  {
+    uint64_t words[NUM_WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+
+    uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < NUM_WORDS; i++)
+    {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  /**
+   * \brief Get a consistent copy of the most recently published value
+   */
+  T load() const
+  {
+    uint64_t words[NUM_WORDS];
+    uint64_t before, after;
+    do
+    {
+      before = sequence_.load(std::memory_order_acquire);
+      for (size_t i = 0; i < NUM_WORDS; i++)
+      {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence_.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+private:
+  static const size_t NUM_WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint64_t> sequence_; //!< odd while a store is in progress
+  std::atomic<uint64_t> words_[NUM_WORDS];
+};
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_SEQLOCK_H
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file serial_tuning.h
+ *
+ * Helpers for configuring serial ports beyond what boost::asio exposes
+ */
+
+#ifndef MAVROSFLIGHT_SERIAL_TUNING_H
+#define MAVROSFLIGHT_SERIAL_TUNING_H
+
+namespace mavrosflight
+{
+/**
+ * \brief Configure an open serial port for the lowest receive latency
+ *
+ * Takes exclusive access to the port so no other process can read from it and on Linux asks the driver to set
+ * ASYNC_LOW_LATENCY, which turns off the receive latency timer of FTDI and similar USB adapters. Drivers that do not
+ * support the flag are left as they are. VMIN/VTIME are left alone: both backends read without blocking, and with
+ * VMIN=0 an empty read returns 0 instead of EAGAIN, which asio reports as end of file.
+ *
+ * \param fd File descriptor of the open serial port
+ * \throws SerialException if the port settings could not be changed
+ */
+void set_serial_low_latency(int fd);
+
+} // namespace mavrosflight
+
+#endif // MAVROSFLIGHT_SERIAL_TUNING_H
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file socket_timestamps.h
+ *
+ * Helpers for reading the time the kernel received a datagram
+ */
+
+#ifndef MAVROSFLIGHT_SOCKET_TIMESTAMPS_H
+#define MAVROSFLIGHT_SOCKET_TIMESTAMPS_H
+
+#ifdef __linux__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+namespace mavrosflight
+{
+/**
+ * \brief Ask the kernel to record when each datagram arrives on a socket (SO_TIMESTAMPNS)
+ * \param fd File descriptor of the open socket
+ * \throws SerialException if the option could not be set
+ */
+void enable_receive_timestamps(int fd);
+
+/**
+ * \brief recvfrom() that also returns the arrival time recorded by the kernel
+ * \param[out] received When the datagram arrived, or the epoch if the kernel did not record it
+ * \return Number of bytes received, or -1 with errno set
+ */
+ssize_t recvfrom_timestamped(int fd,
+                             uint8_t *buf,
+                             size_t len,
+                             int flags,
+                             struct sockaddr *addr,
+                             socklen_t *addr_len,
+                             std::chrono::system_clock::time_point *received);
+
+} // namespace mavrosflight
+
+#endif // __linux__
+
+#endif // MAVROSFLIGHT_SOCKET_TIMESTAMPS_H
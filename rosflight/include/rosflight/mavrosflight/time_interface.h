@@ -50,6 +50,14 @@ class TimeInterface
 {
 public:
   virtual std::chrono::nanoseconds now() const = 0;
+
+  /**
+   * \brief Whether now() reads the same clock as std::chrono::system_clock
+   *
+   * Receive times are taken from the system clock, so they can only be compared with now() when it does. Simulated
+   * time, for one, does not.
+   */
+  virtual bool is_system_clock() const { return false; }
 };
 
 } // namespace mavrosflight
@@ -40,17 +40,22 @@
 #include <rosflight/mavrosflight/logger_interface.h>
 #include <rosflight/mavrosflight/mavlink_bridge.h>
 #include <rosflight/mavrosflight/mavlink_comm.h>
-#include <rosflight/mavrosflight/mavlink_listener_interface.h>
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
+#include <rosflight/mavrosflight/seqlock.h>
 #include <rosflight/mavrosflight/time_interface.h>
 #include <rosflight/mavrosflight/timer_interface.h>
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <memory>
 
+#define TIMESYNC_SAMPLE_WINDOW 8
+
 namespace mavrosflight
 {
 template <typename DerivedLogger>
-class TimeManager : MavlinkListenerInterface
+class TimeManager : MavlinkFrameListenerInterface
 {
 public:
   TimeManager(MavlinkComm *comm,
@@ -58,21 +63,152 @@ public:
               const TimeInterface &time_interface,
               TimerProviderInterface &timer_provider);
 
-  virtual void handle_mavlink_message(const mavlink_message_t &msg);
+  /**
+   * \brief Handle a TIMESYNC response, dated by when the frame arrived rather than when it is handled
+   */
+  virtual void handle_mavlink_frame(const MavlinkFrame &frame);
 
+  /**
+   * \brief Convert an FCU timestamp to system time using the current clock model
+   *
+   * Before the first TIMESYNC exchange completes, the current system time is returned instead. May be called from any
+   * thread; it never blocks or allocates.
+   */
   std::chrono::nanoseconds fcu_time_to_system_time(std::chrono::nanoseconds fcu_time);
 
+  /**
+   * \brief Estimated offset from FCU time to system time, as of the latest accepted TIMESYNC exchange
+   */
+  std::chrono::nanoseconds get_offset() const;
+
+  /**
+   * \brief One standard deviation of the uncertainty in get_offset
+   */
+  std::chrono::nanoseconds get_offset_stddev() const;
+
+  /**
+   * \brief Estimated rate of change of get_offset in parts per million, negative when the FCU clock runs fast
+   */
+  double get_skew_ppm() const;
+
+  /**
+   * \brief Number of TIMESYNC exchanges rejected as outliers by the clock filter
+   */
+  uint64_t get_rejected_samples() const;
+
+  /**
+   * \brief Round-trip time of the most recent TIMESYNC exchange, or zero if none has completed
+   */
+  std::chrono::nanoseconds get_rtt() const;
+
+  /**
+   * \brief Low-pass filtered TIMESYNC round-trip time, or zero if no exchange has completed
+   */
+  std::chrono::nanoseconds get_rtt_average() const;
+
+  /**
+   * \brief Shortest round-trip time among the last TIMESYNC_SAMPLE_WINDOW exchanges
+   */
+  std::chrono::nanoseconds get_rtt_min() const;
+
+  /**
+   * \brief Round-trip time of the exchange most recently used to update the clock model
+   */
+  std::chrono::nanoseconds get_selected_rtt() const;
+
 private:
   MavlinkComm *comm_;
 
   std::shared_ptr<TimerInterface> time_sync_timer_;
   void timer_callback();
 
-  double offset_alpha_;
-  std::chrono::nanoseconds offset_ns_;
+  /**
+   * \brief What fcu_time_to_system_time and the getters need from the clock filter
+   */
+  struct ClockModel
+  {
+    bool valid; //!< false until the first TIMESYNC exchange completes
+    std::chrono::nanoseconds base_offset;
+    std::chrono::nanoseconds reference_time;
+    double offset;        //!< seconds, relative to base_offset at reference_time
+    double skew;          //!< seconds per second
+    double offset_stddev; //!< seconds
+  };
+
+  /**
+   * \brief A completed TIMESYNC exchange
+   */
+  struct Sample
+  {
+    std::chrono::nanoseconds time;   //!< system time at the middle of the exchange
+    std::chrono::nanoseconds offset; //!< measured offset from FCU time to system time
+    std::chrono::nanoseconds rtt;    //!< round-trip time
+    bool outlier;                    //!< disagreed with the clock model when it arrived
+  };
+
+  /**
+   * \brief Add an exchange to the sample window and update the clock model from the best sample in it
+   *
+   * Queueing delays only ever add to the round trip and are usually one-sided, so the exchange with the shortest round
+   * trip in the window is the least biased (the same selection NTP makes). It is only used once, and only if it is
+   * newer than the sample used last. Each exchange is also checked against the model as it arrives, and after
+   * MAX_CONSECUTIVE_REJECTED outliers in a row the clock is taken to have jumped: the samples from before the jump are
+   * dropped and the filter restarts from those after it.
+   */
+  void add_sample(const Sample &sample);
+
+  /**
+   * \brief Check an exchange against the clock model predicted to its time, and mark it as an outlier if it disagrees
+   */
+  bool is_outlier(Sample &sample);
+
+  /**
+   * \brief Feed one TIMESYNC offset measurement to the clock filter
+   * \param time System time the measurement applies to (the middle of the exchange)
+   * \param offset Measured offset from FCU time to system time
+   * \param rtt Round-trip time of the exchange, which bounds the error from an asymmetric link
+   */
+  void update_clock_model(std::chrono::nanoseconds time, std::chrono::nanoseconds offset, std::chrono::nanoseconds rtt);
+
+  /**
+   * \brief Restart the clock filter from a single measurement
+   */
+  void reset_clock_model(std::chrono::nanoseconds time, std::chrono::nanoseconds offset, double variance);
+
+  /**
+   * \brief Make the current filter state visible to fcu_time_to_system_time on other threads
+   */
+  void publish_clock_model();
+
+  double rtt_alpha_;
+
+  std::atomic<int64_t> rtt_ns_;          //!< latest round-trip time, read from other threads
+  std::atomic<int64_t> rtt_average_ns_;  //!< filtered round-trip time, read from other threads
+  std::atomic<int64_t> rtt_min_ns_;      //!< shortest round-trip time in the sample window
+  std::atomic<int64_t> selected_rtt_ns_; //!< round-trip time of the sample last used by the clock filter
+
+  Sample samples_[TIMESYNC_SAMPLE_WINDOW]; //!< ring of the most recent exchanges
+  size_t num_samples_;
+  size_t next_sample_;                     //!< ring index the next exchange is stored at
+  std::chrono::nanoseconds selected_time_; //!< time of the sample last used by the clock filter
+
+  // Kalman filter on the clock model offset(t) = base_offset_ + offset_ + skew_ * (t - reference_time_), where t is
+  // system time; the integral part of the offset is kept separately so the filter can work in double precision. The
+  // filter state is only touched by the thread handling TIMESYNC messages; other threads read clock_model_.
+  std::chrono::nanoseconds base_offset_;    //!< fixed when the filter is (re)initialized
+  std::chrono::nanoseconds reference_time_; //!< system time of the latest measurement
+  double offset_;                           //!< offset relative to base_offset_ at reference_time_, in seconds
+  double skew_;                             //!< rate of change of the offset, in seconds per second
+  double offset_var_;                       //!< covariance of offset_ and skew_
+  double offset_skew_cov_;
+  double skew_var_;
+  int consecutive_rejected_; //!< outliers in a row; a long run means the FCU clock really jumped (e.g. a reboot)
+  std::atomic<uint64_t> rejected_;
 
   bool initialized_;
 
+  SeqLock<ClockModel> clock_model_; //!< snapshot of the filter published after every update
+
   LoggerInterface<DerivedLogger> &logger_;
   const TimeInterface &time_interface_;
   TimerProviderInterface &timer_provider_;
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file named_publisher_cache.h
+ *
+ * Publishers for MAVLink named values, looked up by the fixed-size name field
+ */
+
+#ifndef ROSFLIGHT_NAMED_PUBLISHER_CACHE_H
+#define ROSFLIGHT_NAMED_PUBLISHER_CACHE_H
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ros
+{
+class NodeHandle;
+class Publisher;
+} // namespace ros
+
+namespace rosflight
+{
+/**
+ * \class NamedPublisherCache
+ * \brief Advertises a topic for each name the first time it is seen, and finds it again without allocating
+ *
+ * The flight controller only ever sends a handful of names, so they are kept in a short list searched with a
+ * fixed-size comparison of the name field. The node handle and publisher types are parameters so that the cache can
+ * be tested without a ROS master; NodeHandle only needs a ROS-style advertise<MessageType>(topic, queue_size).
+ */
+template <typename MessageType, typename NodeHandle = ros::NodeHandle, typename Publisher = ros::Publisher>
+class NamedPublisherCache
+{
+public:
+  static const size_t NAME_LEN = MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN;
+
+  inline NamedPublisherCache(const NodeHandle &nh, const std::string &topic_prefix) :
+    nh_(nh),
+    topic_prefix_(topic_prefix)
+  {
+  }
+
+  /**
+   * \brief Publisher for a name field, which is only null terminated if shorter than NAME_LEN
+   *
+   * The reference is valid until the next call.
+   */
+  inline Publisher &get(const char *name)
+  {
+    // anything after the terminator is not part of the name
+    char key[NAME_LEN] = {0};
+    for (size_t i = 0; i < NAME_LEN && name[i] != '\0'; i++)
+    {
+      key[i] = name[i];
+    }
+
+    for (size_t i = 0; i < entries_.size(); i++)
+    {
+      if (memcmp(entries_[i].name, key, NAME_LEN) == 0)
+        return entries_[i].publisher;
+    }
+
+    Entry entry;
+    memcpy(entry.name, key, NAME_LEN);
+    entry.publisher = nh_.template advertise<MessageType>(topic_prefix_ + std::string(key, strnlen(key, NAME_LEN)), 1);
+    entries_.push_back(entry);
+    return entries_.back().publisher;
+  }
+
+private:
+  struct Entry
+  {
+    char name[NAME_LEN]; //!< name padded with zeros
+    Publisher publisher;
+  };
+
+  NodeHandle nh_;
+  std::string topic_prefix_;
+  std::vector<Entry> entries_;
+};
+
+} // namespace rosflight
+
+#endif // ROSFLIGHT_NAMED_PUBLISHER_CACHE_H
@@ -48,6 +48,7 @@ class ROSTimeInterface : public mavrosflight::TimeInterface
 {
 public:
   inline std::chrono::nanoseconds now() const { return std::chrono::nanoseconds(ros::Time::now().toNSec()); }
+  inline bool is_system_clock() const { return !ros::Time::isSimTime(); }
 };
 
 } // namespace rosflight
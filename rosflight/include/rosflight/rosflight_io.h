@@ -37,9 +37,12 @@
 #ifndef ROSFLIGHT_IO_MAVROSFLIGHT_ROS_H
 #define ROSFLIGHT_IO_MAVROSFLIGHT_ROS_H
 
-#include <map>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include <ros/callback_queue.h>
 #include <ros/ros.h>
 
 #include <geometry_msgs/Quaternion.h>
@@ -59,6 +62,8 @@
 
 #include <std_srvs/Trigger.h>
 
+#include <diagnostic_msgs/DiagnosticArray.h>
+
 #include <rosflight_msgs/Airspeed.h>
 #include <rosflight_msgs/Attitude.h>
 #include <rosflight_msgs/AuxCommand.h>
@@ -71,15 +76,22 @@
 #include <rosflight_msgs/OutputRaw.h>
 #include <rosflight_msgs/RCRaw.h>
 #include <rosflight_msgs/Status.h>
+#include <rosflight_msgs/TimeSync.h>
 
 #include <rosflight_msgs/ParamFile.h>
 #include <rosflight_msgs/ParamGet.h>
+#include <rosflight_msgs/ParamGetMany.h>
 #include <rosflight_msgs/ParamSet.h>
+#include <rosflight_msgs/ParamSetMany.h>
 
 #include <rosflight/mavrosflight/mavlink_comm.h>
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
 #include <rosflight/mavrosflight/mavlink_listener_interface.h>
+#include <rosflight/mavrosflight/mavlink_router.h>
 #include <rosflight/mavrosflight/mavrosflight.h>
 #include <rosflight/mavrosflight/param_listener_interface.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+#include <rosflight/named_publisher_cache.h>
 #include <rosflight/ros_logger.h>
 #include <rosflight/ros_time.h>
 #include <rosflight/ros_timer.h>
@@ -88,21 +100,31 @@
 
 namespace rosflight_io
 {
-class rosflightIO : public mavrosflight::MavlinkListenerInterface, public mavrosflight::ParamListenerInterface
+class rosflightIO : public mavrosflight::MavlinkListenerInterface,
+                    public mavrosflight::MavlinkFrameListenerInterface,
+                    public mavrosflight::ParamListenerInterface
 {
 public:
-  rosflightIO();
+  /**
+   * \param nh Node handle for the topics and services
+   * \param nh_private Node handle for the configuration parameters
+   * \throws mavrosflight::SerialException if the link to the flight controller could not be opened
+   */
+  rosflightIO(ros::NodeHandle nh = ros::NodeHandle(), ros::NodeHandle nh_private = ros::NodeHandle("~"));
   ~rosflightIO();
 
   virtual void handle_mavlink_message(const mavlink_message_t &msg);
+  virtual void handle_mavlink_frame(const mavrosflight::MavlinkFrame &frame);
 
   virtual void on_new_param_received(std::string name, double value);
   virtual void on_param_value_updated(std::string name, double value);
   virtual void on_params_saved_change(bool unsaved_changes);
 
-  static constexpr float HEARTBEAT_PERIOD = 1; // Time between heartbeat messages
-  static constexpr float VERSION_PERIOD = 10;  // Time between version requests
-  static constexpr float PARAMETER_PERIOD = 3; // Time between parameter requests
+  static constexpr float HEARTBEAT_PERIOD = 1;   // Time between heartbeat messages
+  static constexpr float VERSION_PERIOD = 10;    // Time between version requests
+  static constexpr float PARAMETER_PERIOD = 1;   // Time between parameter download progress reports
+  static constexpr float DIAGNOSTICS_PERIOD = 1; // Default time between link diagnostics messages
+  static constexpr float TIME_SYNC_PERIOD = 0.1; // Time between clock synchronization messages
 
 private:
   // handle mavlink messages
@@ -110,9 +132,9 @@ private:
   void handle_status_msg(const mavlink_message_t &msg);
   void handle_command_ack_msg(const mavlink_message_t &msg);
   void handle_statustext_msg(const mavlink_message_t &msg);
-  void handle_attitude_quaternion_msg(const mavlink_message_t &msg);
-  void handle_small_imu_msg(const mavlink_message_t &msg);
-  void handle_rosflight_output_raw_msg(const mavlink_message_t &msg);
+  void handle_attitude_quaternion_msg(const mavrosflight::MavlinkFrame &frame);
+  void handle_small_imu_msg(const mavrosflight::MavlinkFrame &frame);
+  void handle_rosflight_output_raw_msg(const mavrosflight::MavlinkFrame &frame);
   void handle_rc_channels_raw_msg(const mavlink_message_t &msg);
   void handle_diff_pressure_msg(const mavlink_message_t &msg);
   void handle_small_baro_msg(const mavlink_message_t &msg);
@@ -136,6 +158,8 @@ private:
   // ROS service callbacks
   bool paramGetSrvCallback(rosflight_msgs::ParamGet::Request &req, rosflight_msgs::ParamGet::Response &res);
   bool paramSetSrvCallback(rosflight_msgs::ParamSet::Request &req, rosflight_msgs::ParamSet::Response &res);
+  bool paramGetManySrvCallback(rosflight_msgs::ParamGetMany::Request &req, rosflight_msgs::ParamGetMany::Response &res);
+  bool paramSetManySrvCallback(rosflight_msgs::ParamSetMany::Request &req, rosflight_msgs::ParamSetMany::Response &res);
   bool paramWriteSrvCallback(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
   bool paramSaveToFileCallback(rosflight_msgs::ParamFile::Request &req, rosflight_msgs::ParamFile::Response &res);
   bool paramLoadFromFileCallback(rosflight_msgs::ParamFile::Request &req, rosflight_msgs::ParamFile::Response &res);
@@ -150,10 +174,17 @@ private:
   void paramTimerCallback(const ros::TimerEvent &e);
   void versionTimerCallback(const ros::TimerEvent &e);
   void heartbeatTimerCallback(const ros::TimerEvent &e);
+  void diagnosticsTimerCallback(const ros::TimerEvent &e);
+  void timeSyncTimerCallback(const ros::TimerEvent &e);
 
   // helpers
+  /**
+   * \brief Fill in the handler tables and register for the message IDs they cover
+   */
+  void setup_handlers();
   void request_version();
   void send_heartbeat();
+  void setup_router(ros::NodeHandle &nh_private, bool use_epoll);
   void check_error_code(uint8_t current, uint8_t previous, ROSFLIGHT_ERROR_CODE code, std::string name);
   ros::Time fcu_time_to_ros_time(std::chrono::nanoseconds fcu_time);
 
@@ -163,6 +194,11 @@ private:
     return value < min ? min : (value > max ? max : value);
   }
 
+  typedef void (rosflightIO::*MessageHandler)(const mavlink_message_t &msg);
+  typedef void (rosflightIO::*FrameHandler)(const mavrosflight::MavlinkFrame &frame);
+  MessageHandler message_handlers_[256]; //!< handler of each unpacked message ID, or null
+  FrameHandler frame_handlers_[256];     //!< handler of each message ID read in place from the receive buffer, or null
+
   ros::NodeHandle nh_;
 
   ros::Subscriber command_sub_;
@@ -191,9 +227,11 @@ private:
   ros::Publisher lidar_pub_;
   ros::Publisher error_pub_;
   ros::Publisher battery_status_pub_;
-  std::map<std::string, ros::Publisher> named_value_int_pubs_;
-  std::map<std::string, ros::Publisher> named_value_float_pubs_;
-  std::map<std::string, ros::Publisher> named_command_struct_pubs_;
+  ros::Publisher diagnostics_pub_;
+  ros::Publisher time_sync_pub_;
+  rosflight::NamedPublisherCache<std_msgs::Int32> named_value_int_pubs_;
+  rosflight::NamedPublisherCache<std_msgs::Float32> named_value_float_pubs_;
+  rosflight::NamedPublisherCache<rosflight_msgs::Command> named_command_struct_pubs_;
 
   ros::ServiceServer param_get_srv_;
   ros::ServiceServer param_set_srv_;
@@ -208,17 +246,33 @@ private:
   ros::ServiceServer reboot_srv_;
   ros::ServiceServer reboot_bootloader_srv_;
 
+  // the bulk parameter services wait for the flight controller, so they run on their own thread to keep the timers
+  // that retry parameter sets running in the meantime
+  ros::CallbackQueue param_srv_queue_;
+  std::unique_ptr<ros::AsyncSpinner> param_srv_spinner_;
+  std::atomic<bool> param_srv_shutdown_; //!< tells waiting bulk parameter services to give up
+  ros::ServiceServer param_get_many_srv_;
+  ros::ServiceServer param_set_many_srv_;
+
   ros::Timer param_timer_;
   ros::Timer version_timer_;
   ros::Timer heartbeat_timer_;
+  ros::Timer diagnostics_timer_;
+  ros::Timer time_sync_timer_;
 
   geometry_msgs::Quaternion attitude_quat_;
   mavlink_rosflight_status_t prev_status_;
 
   std::string frame_id_;
+  std::string link_name_;
+  std::vector<std::string> router_endpoint_names_;
+
+  mavrosflight::MavlinkComm::TransportStats prev_transport_stats_;
+  ros::Time prev_transport_stats_time_;
 
   mavrosflight::MavlinkComm *mavlink_comm_;
   mavrosflight::MavROSflight<rosflight::ROSLogger> *mavrosflight_;
+  mavrosflight::MavlinkRouter *router_;
 
   rosflight::ROSLogger logger_;
   rosflight::ROSTimeInterface time_interface_;
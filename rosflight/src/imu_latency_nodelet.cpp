@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file imu_latency_nodelet.cpp
+ *
+ * Measures how long imu/data messages take to arrive, for comparing rosflight_io as a standalone node with rosflight_io
+ * loaded into the same nodelet manager
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include <sensor_msgs/Imu.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace rosflight_io
+{
+/**
+ * \class ImuLatencyNodelet
+ * \brief Periodically reports the delay from each IMU message's stamp to its arrival
+ *
+ * The stamp is the flight controller's sample time, so the delay includes the link and rosflight_io itself; those are
+ * the same whichever way rosflight_io runs, and the difference between two runs is what the transport costs. Besides
+ * the periodic reports, the first ~samples messages are summarized once, so that runs of the same length can be
+ * compared.
+ */
+class ImuLatencyNodelet : public nodelet::Nodelet
+{
+private:
+  virtual void onInit()
+  {
+    ros::NodeHandle &nh = getNodeHandle();
+    ros::NodeHandle &nh_private = getPrivateNodeHandle();
+
+    samples_ = std::max(nh_private.param<int>("samples", 60000), 1);
+    run_latencies_.reserve(samples_);
+    latencies_.reserve(100000);
+    imu_sub_ = nh.subscribe("imu/data", 100, &ImuLatencyNodelet::imuCallback, this, ros::TransportHints().tcpNoDelay());
+    report_timer_ = nh.createTimer(ros::Duration(nh_private.param<double>("report_period", 10.0)),
+                                   &ImuLatencyNodelet::reportTimerCallback, this);
+  }
+
+  void imuCallback(const sensor_msgs::ImuConstPtr &msg)
+  {
+    double latency = (ros::Time::now() - msg->header.stamp).toSec() * 1e6;
+    latencies_.push_back(latency);
+
+    if (run_latencies_.size() < samples_)
+    {
+      run_latencies_.push_back(latency);
+      if (run_latencies_.size() == samples_)
+        report("IMU latency for the run", run_latencies_);
+    }
+  }
+
+  void reportTimerCallback(const ros::TimerEvent &)
+  {
+    if (latencies_.empty())
+    {
+      NODELET_WARN("No IMU messages received");
+      return;
+    }
+
+    report("IMU latency", latencies_);
+    latencies_.clear();
+  }
+
+  //! Log the distribution of latencies, sorting them in place
+  void report(const char *label, std::vector<double> &latencies)
+  {
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (size_t i = 0; i < latencies.size(); i++)
+    {
+      mean += latencies[i] / latencies.size();
+    }
+    NODELET_INFO("%s over %zu messages: mean %.0f us, median %.0f us, 99th percentile %.0f us, max %.0f us", label,
+                 latencies.size(), mean, latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100],
+                 latencies.back());
+  }
+
+  ros::Subscriber imu_sub_;
+  ros::Timer report_timer_;
+  std::vector<double> latencies_;     //!< microseconds from stamp to arrival, since the last report
+  std::vector<double> run_latencies_; //!< microseconds from stamp to arrival, for the first samples_ messages
+  size_t samples_;                    //!< number of messages in the run summary
+};
+
+} // namespace rosflight_io
+
+PLUGINLIB_EXPORT_CLASS(rosflight_io::ImuLatencyNodelet, nodelet::Nodelet)
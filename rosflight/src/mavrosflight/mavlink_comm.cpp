@@ -35,70 +35,357 @@
  */
 
 #include <rosflight/mavrosflight/mavlink_comm.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 namespace mavrosflight
 {
 using boost::asio::serial_port_base;
 
-MavlinkComm::MavlinkComm() : io_service_(), write_in_progress_(false) {}
+MavlinkComm::MavlinkComm() :
+  io_service_(),
+  read_handler_(boost::bind(&MavlinkComm::async_read_end,
+                            this,
+                            boost::asio::placeholders::error,
+                            boost::asio::placeholders::bytes_transferred)),
+  write_handler_(boost::bind(&MavlinkComm::async_write_end,
+                             this,
+                             boost::asio::placeholders::error,
+                             boost::asio::placeholders::bytes_transferred)),
+  listeners_(std::make_shared<ListenerTable>()),
+  threaded_dispatch_(false),
+  dispatch_queue_size_(MAVLINK_DISPATCH_QUEUE_SIZE),
+  dispatch_running_(false),
+  link_state_(LINK_CLOSED),
+  reconnect_enabled_(false),
+  reconnect_min_delay_(std::chrono::milliseconds(MAVLINK_RECONNECT_MIN_DELAY_MS)),
+  reconnect_max_delay_(std::chrono::milliseconds(MAVLINK_RECONNECT_MAX_DELAY_MS)),
+  reconnect_delay_(reconnect_min_delay_),
+  reconnect_timer_(io_service_),
+  reconnected_ns_(std::numeric_limits<int64_t>::min()),
+  read_buf_size_(MAVLINK_SERIAL_READ_BUF_SIZE),
+  read_buf_len_(0),
+  write_retry_timer_(io_service_),
+  write_in_progress_(false),
+  write_parked_(false),
+  write_queue_policy_(DROP_OLDEST),
+  write_queue_dropped_(0),
+  write_batch_len_(0),
+  write_batch_pos_(0),
+  max_write_batch_(1),
+  rx_bytes_(0),
+  rx_frames_(0),
+  rx_crc_errors_(0),
+  rx_length_errors_(0),
+  rx_bytes_skipped_(0),
+  tx_bytes_(0),
+  tx_frames_(0),
+  write_queue_high_water_(0),
+  write_latency_max_us_(0),
+  reconnects_(0),
+  num_sources_(0)
+{
+  write_buffers_.reserve(MAVLINK_MAX_WRITE_BATCH);
+  std::fill(source_index_, source_index_ + (1 << 16), 0);
+
+  for (size_t i = 0; i < NUM_WRITE_PRIORITIES; i++)
+  {
+    write_lanes_[i].reset(new WriteLane(MAVLINK_WRITE_QUEUE_SIZE));
+  }
+  for (size_t msgid = 0; msgid < 256; msgid++)
+  {
+    write_priority_[msgid] = PRIORITY_NORMAL;
+    set_write_rate_limit(msgid, 0);
+    drop_on_reconnect_[msgid] = false;
+  }
+
+  // control must not wait behind anything else, and parameter traffic must not delay anything else
+  write_priority_[MAVLINK_MSG_ID_OFFBOARD_CONTROL] = PRIORITY_HIGH;
+  write_priority_[MAVLINK_MSG_ID_EXTERNAL_ATTITUDE] = PRIORITY_HIGH;
+  write_priority_[MAVLINK_MSG_ID_ROSFLIGHT_AUX_CMD] = PRIORITY_HIGH;
+  write_priority_[MAVLINK_MSG_ID_PARAM_SET] = PRIORITY_BULK;
+  write_priority_[MAVLINK_MSG_ID_PARAM_REQUEST_LIST] = PRIORITY_BULK;
+  write_priority_[MAVLINK_MSG_ID_PARAM_REQUEST_READ] = PRIORITY_BULK;
+
+  // setpoints and clock sync requests only describe the moment they were sent, so there is no point sending them late
+  drop_on_reconnect_[MAVLINK_MSG_ID_OFFBOARD_CONTROL] = true;
+  drop_on_reconnect_[MAVLINK_MSG_ID_EXTERNAL_ATTITUDE] = true;
+  drop_on_reconnect_[MAVLINK_MSG_ID_ROSFLIGHT_AUX_CMD] = true;
+  drop_on_reconnect_[MAVLINK_MSG_ID_TIMESYNC] = true;
+
+  for (size_t i = 0; i < MAVLINK_LATENCY_HIST_BINS; i++)
+  {
+    write_latency_hist_[i] = 0;
+  }
+}
 
 MavlinkComm::~MavlinkComm() {}
 
 void MavlinkComm::open()
 {
-  // open the port
   do_open();
+  start(LINK_UP);
+}
 
-  // start reading from the port
-  async_read();
-  io_thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &this->io_service_));
+bool MavlinkComm::open_or_reconnect()
+{
+  try
+  {
+    do_open();
+  }
+  catch (const SerialException &)
+  {
+    if (!reconnect_enabled_)
+      throw;
+    start(LINK_DOWN);
+    return false;
+  }
+
+  start(LINK_UP);
+  return true;
 }
 
-void MavlinkComm::close()
+void MavlinkComm::start(LinkState state)
 {
-  mutex_lock lock(mutex_);
+  read_buf_.assign(read_buf_size_, 0);
+  read_buf_len_ = 0;
 
-  io_service_.stop();
-  do_close();
+  // start the dispatcher threads before any messages can arrive
+  {
+    mutex_lock lock(mutex_);
+    dispatch_running_ = true;
+    std::shared_ptr<const ListenerTable> listeners = std::atomic_load(&listeners_);
+    for (size_t i = 0; i < listeners->all.size(); i++)
+    {
+      listeners->all[i]->start();
+    }
+  }
 
-  if (io_thread_.joinable())
+  // start reading from the port, and writing anything queued before it was opened, or start trying to open it
+  link_state_ = state;
+  if (state == LINK_UP)
+  {
+    async_read();
+    resume_write();
+  }
+  else
+  {
+    reconnect_delay_ = reconnect_min_delay_;
+    schedule_reconnect(reconnect_delay_);
+  }
+  io_thread_ = boost::thread(boost::bind(&MavlinkComm::run_io, this));
+}
+
+void MavlinkComm::close()
+{
+  {
+    mutex_lock lock(mutex_);
+    link_state_ = LINK_CLOSED;
+    stop_io();
+    do_close();
+  }
+
+  // without the lock, since the io thread may be waiting for it in link_lost; a listener may also call close() on the
+  // io thread, which cannot wait for itself
+  if (io_thread_.joinable() && io_thread_.get_id() != boost::this_thread::get_id())
   {
     io_thread_.join();
   }
+
+  // finish delivering anything already queued, then stop the dispatcher threads
+  mutex_lock lock(mutex_);
+  dispatch_running_ = false;
+  std::shared_ptr<const ListenerTable> listeners = std::atomic_load(&listeners_);
+  for (size_t i = 0; i < listeners->all.size(); i++)
+  {
+    listeners->all[i]->stop();
+  }
+}
+
+void MavlinkComm::run_io()
+{
+  io_service_.run();
+}
+
+void MavlinkComm::stop_io()
+{
+  io_service_.stop();
 }
 
 void MavlinkComm::register_mavlink_listener(MavlinkListenerInterface *const listener)
 {
-  if (listener == NULL)
-    return;
+  if (listener != NULL)
+    add_listener(listener, NULL, true, std::vector<uint8_t>());
+}
+
+void MavlinkComm::register_mavlink_listener(MavlinkListenerInterface *const listener,
+                                            const std::vector<uint8_t> &msgids)
+{
+  if (listener != NULL)
+    add_listener(listener, NULL, false, msgids);
+}
+
+void MavlinkComm::unregister_mavlink_listener(MavlinkListenerInterface *const listener)
+{
+  if (listener != NULL)
+    remove_listener(listener, NULL);
+}
+
+void MavlinkComm::register_mavlink_frame_listener(MavlinkFrameListenerInterface *const listener,
+                                                  const std::vector<uint8_t> &msgids)
+{
+  if (listener != NULL)
+    add_listener(NULL, listener, false, msgids);
+}
+
+void MavlinkComm::register_mavlink_frame_listener(MavlinkFrameListenerInterface *const listener)
+{
+  if (listener != NULL)
+    add_listener(NULL, listener, true, std::vector<uint8_t>());
+}
 
-  bool already_registered = false;
-  for (int i = 0; i < listeners_.size(); i++)
+void MavlinkComm::unregister_mavlink_frame_listener(MavlinkFrameListenerInterface *const listener)
+{
+  if (listener != NULL)
+    remove_listener(NULL, listener);
+}
+
+void MavlinkComm::add_listener(MavlinkListenerInterface *const listener,
+                               MavlinkFrameListenerInterface *const frame_listener,
+                               bool all_messages,
+                               const std::vector<uint8_t> &msgids)
+{
+  mutex_lock lock(mutex_);
+  std::shared_ptr<const ListenerTable> current = std::atomic_load(&listeners_);
+  ListenerList updated = current->all;
+
+  std::shared_ptr<ListenerEntry> entry;
+  for (size_t i = 0; i < updated.size(); i++)
   {
-    if (listener == listeners_[i])
+    if (updated[i]->listener == listener && updated[i]->frame_listener == frame_listener)
     {
-      already_registered = true;
+      entry = updated[i];
       break;
     }
   }
 
-  if (!already_registered)
-    listeners_.push_back(listener);
+  if (!entry)
+  {
+    entry = std::make_shared<ListenerEntry>(listener, frame_listener, threaded_dispatch_ ? dispatch_queue_size_ : 0);
+    if (dispatch_running_)
+      entry->start();
+    updated.push_back(entry);
+  }
+
+  // subscriptions are only read while holding mutex_, when building a new table
+  entry->all_messages = all_messages;
+  entry->msgids = msgids;
+
+  publish_listeners(updated);
 }
 
-void MavlinkComm::unregister_mavlink_listener(MavlinkListenerInterface *const listener)
+void MavlinkComm::remove_listener(MavlinkListenerInterface *const listener,
+                                  MavlinkFrameListenerInterface *const frame_listener)
 {
-  if (listener == NULL)
-    return;
+  mutex_lock lock(mutex_);
+  std::shared_ptr<const ListenerTable> current = std::atomic_load(&listeners_);
+  ListenerList updated;
+  for (size_t i = 0; i < current->all.size(); i++)
+  {
+    if (current->all[i]->listener == listener && current->all[i]->frame_listener == frame_listener)
+      current->all[i]->stop();
+    else
+      updated.push_back(current->all[i]);
+  }
+  publish_listeners(updated);
+}
+
+void MavlinkComm::publish_listeners(const ListenerList &listeners)
+{
+  // the io thread may be dispatching from the current table, so publish a new one instead of changing it in place
+  std::shared_ptr<ListenerTable> table = std::make_shared<ListenerTable>();
+  table->all = listeners;
+  for (size_t i = 0; i < listeners.size(); i++)
+  {
+    const std::shared_ptr<ListenerEntry> &entry = listeners[i];
+    if (entry->all_messages)
+    {
+      for (size_t msgid = 0; msgid < 256; msgid++)
+      {
+        table->by_msgid[msgid].push_back(entry);
+      }
+    }
+    else
+    {
+      for (size_t j = 0; j < entry->msgids.size(); j++)
+      {
+        ListenerList &targets = table->by_msgid[entry->msgids[j]];
+        if (std::find(targets.begin(), targets.end(), entry) == targets.end())
+          targets.push_back(entry);
+      }
+    }
+  }
+
+  std::atomic_store(&listeners_, std::shared_ptr<const ListenerTable>(table));
+}
+
+void MavlinkComm::set_threaded_dispatch(bool enable, size_t queue_size)
+{
+  mutex_lock lock(mutex_);
+  threaded_dispatch_ = enable;
+  dispatch_queue_size_ = queue_size;
+}
 
-  for (int i = 0; i < listeners_.size(); i++)
+bool MavlinkComm::get_listener_stats(MavlinkListenerInterface *const listener, ListenerStats *stats) const
+{
+  return find_listener_stats(listener, NULL, stats);
+}
+
+bool MavlinkComm::get_listener_stats(MavlinkFrameListenerInterface *const listener, ListenerStats *stats) const
+{
+  return find_listener_stats(NULL, listener, stats);
+}
+
+bool MavlinkComm::find_listener_stats(MavlinkListenerInterface *const listener,
+                                      MavlinkFrameListenerInterface *const frame_listener,
+                                      ListenerStats *stats) const
+{
+  std::shared_ptr<const ListenerTable> listeners = std::atomic_load(&listeners_);
+  for (size_t i = 0; i < listeners->all.size(); i++)
   {
-    if (listener == listeners_[i])
+    const ListenerEntry &entry = *listeners->all[i];
+    if (entry.listener == listener && entry.frame_listener == frame_listener)
     {
-      listeners_.erase(listeners_.begin() + i);
-      i--;
+      stats->queue_depth = entry.queue ? entry.queue->size() : 0;
+      stats->dispatched = entry.dispatched;
+      stats->dropped = entry.dropped;
+      return true;
     }
   }
+
+  return false;
+}
+
+void MavlinkComm::set_auto_reconnect(bool enable,
+                                     std::chrono::milliseconds min_delay,
+                                     std::chrono::milliseconds max_delay)
+{
+  reconnect_enabled_ = enable;
+  reconnect_min_delay_ = std::max(min_delay, std::chrono::milliseconds(1));
+  reconnect_max_delay_ = std::max(max_delay, min_delay);
+}
+
+void MavlinkComm::set_drop_on_reconnect(uint8_t msgid, bool drop)
+{
+  drop_on_reconnect_[msgid] = drop;
+}
+
+void MavlinkComm::set_read_buffer_size(size_t size)
+{
+  read_buf_size_ = std::max<size_t>(size, 2 * MAVLINK_MAX_PACKET_LEN);
 }
 
 void MavlinkComm::async_read()
@@ -106,9 +393,9 @@ void MavlinkComm::async_read()
   if (!is_open())
     return;
 
-  do_async_read(boost::asio::buffer(read_buf_raw_, MAVLINK_SERIAL_READ_BUF_SIZE),
-                boost::bind(&MavlinkComm::async_read_end, this, boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
+  // read in behind any partial frame left over from the last read
+  do_async_read(boost::asio::buffer(read_buf_.data() + read_buf_len_, read_buf_.size() - read_buf_len_),
+                read_handler_);
 }
 
 void MavlinkComm::async_read_end(const boost::system::error_code &error, size_t bytes_transferred)
@@ -118,82 +405,675 @@ void MavlinkComm::async_read_end(const boost::system::error_code &error, size_t
 
   if (error)
   {
-    close();
+    link_lost(error);
+    return;
+  }
+
+  // the end of the read arrived at read_time; frames that ended earlier in it arrived a byte time sooner per byte
+  std::chrono::system_clock::time_point read_time =
+      read_time_ != std::chrono::system_clock::time_point() ? read_time_ : std::chrono::system_clock::now();
+  read_time_ = std::chrono::system_clock::time_point();
+  std::chrono::nanoseconds byte_time = this->byte_time();
+
+  size_t len = read_buf_len_ + bytes_transferred;
+  const uint8_t *buf = read_buf_.data();
+  size_t consumed = scanner_.scan(read_buf_.data(), len, [&](const uint8_t *frame, size_t frame_len) {
+    size_t bytes_after = len - (frame - buf + frame_len);
+    std::chrono::system_clock::time_point received =
+        read_time - std::chrono::duration_cast<std::chrono::system_clock::duration>(bytes_after * byte_time);
+    update_source_stats(MavlinkFrame(frame));
+    dispatch(frame, frame_len, received);
+  });
+
+  // the scanner is only touched by the io thread; publish its counters for get_transport_stats
+  rx_bytes_.fetch_add(bytes_transferred, std::memory_order_relaxed);
+  rx_frames_.store(scanner_.frames(), std::memory_order_relaxed);
+  rx_crc_errors_.store(scanner_.crc_errors(), std::memory_order_relaxed);
+  rx_length_errors_.store(scanner_.length_errors(), std::memory_order_relaxed);
+  rx_bytes_skipped_.store(scanner_.bytes_skipped(), std::memory_order_relaxed);
+
+  // keep the tail of a frame that was cut off so it is completed by the next read
+  read_buf_len_ = len - consumed;
+  if (read_buf_len_ > 0 && consumed > 0)
+  {
+    memmove(read_buf_.data(), read_buf_.data() + consumed, read_buf_len_);
+  }
+
+  async_read();
+}
+
+void MavlinkComm::update_source_stats(const MavlinkFrame &frame)
+{
+  uint8_t &index = source_index_[(uint16_t(frame.sysid()) << 8) | frame.compid()];
+  if (index == 0)
+  {
+    // senders beyond the size of the table are not counted
+    size_t count = num_sources_.load(std::memory_order_relaxed);
+    if (count == MAVLINK_MAX_SOURCES)
+      return;
+
+    SourceSlot &source = sources_[count];
+    source.sysid = frame.sysid();
+    source.compid = frame.compid();
+    source.last_seq.store(frame.seq(), std::memory_order_relaxed);
+    source.frames.store(1, std::memory_order_relaxed);
+    source.lost.store(0, std::memory_order_relaxed);
+    source.out_of_order.store(0, std::memory_order_relaxed);
+    num_sources_.store(count + 1, std::memory_order_release);
+    index = count + 1;
+    return;
+  }
+
+  SourceSlot &source = sources_[index - 1];
+  source.frames.store(source.frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  // a step of less than half the sequence space is forward, and skips step - 1 frames; anything else is a frame
+  // repeated or arriving after later ones, which neither loses frames nor moves the sequence on
+  uint8_t step = uint8_t(frame.seq() - source.last_seq.load(std::memory_order_relaxed));
+  if (step == 0 || step >= 128)
+  {
+    source.out_of_order.store(source.out_of_order.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     return;
   }
+  source.lost.store(source.lost.load(std::memory_order_relaxed) + step - 1, std::memory_order_relaxed);
+  source.last_seq.store(frame.seq(), std::memory_order_relaxed);
+}
+
+void MavlinkComm::get_transport_stats(TransportStats *stats) const
+{
+  stats->bytes_in = rx_bytes_.load(std::memory_order_relaxed);
+  stats->frames_in = rx_frames_.load(std::memory_order_relaxed);
+  stats->crc_errors = rx_crc_errors_.load(std::memory_order_relaxed);
+  stats->length_errors = rx_length_errors_.load(std::memory_order_relaxed);
+  stats->bytes_skipped = rx_bytes_skipped_.load(std::memory_order_relaxed);
+
+  stats->bytes_out = tx_bytes_.load(std::memory_order_relaxed);
+  stats->frames_out = tx_frames_.load(std::memory_order_relaxed);
+  stats->write_queue_dropped = write_queue_dropped_;
+  stats->write_queue_depth = write_queue_depth();
+  stats->write_queue_high_water = write_queue_high_water_.load(std::memory_order_relaxed);
+  stats->link_up = link_state_ == LINK_UP;
+  stats->reconnects = reconnects_.load(std::memory_order_relaxed);
+  stats->write_latency_max_us = write_latency_max_us_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < MAVLINK_LATENCY_HIST_BINS; i++)
+  {
+    stats->write_latency_hist[i] = write_latency_hist_[i].load(std::memory_order_relaxed);
+  }
 
-  for (int i = 0; i < bytes_transferred; i++)
+  size_t num_sources = num_sources_.load(std::memory_order_acquire);
+  stats->sources.resize(num_sources);
+  for (size_t i = 0; i < num_sources; i++)
   {
-    if (mavlink_parse_char(MAVLINK_COMM_0, read_buf_raw_[i], &msg_in_, &status_in_))
+    SourceStats &source = stats->sources[i];
+    source.sysid = sources_[i].sysid;
+    source.compid = sources_[i].compid;
+    source.last_seq = sources_[i].last_seq.load(std::memory_order_relaxed);
+    source.frames = sources_[i].frames.load(std::memory_order_relaxed);
+    source.lost = sources_[i].lost.load(std::memory_order_relaxed);
+    source.out_of_order = sources_[i].out_of_order.load(std::memory_order_relaxed);
+  }
+}
+
+void MavlinkComm::dispatch(const uint8_t *frame,
+                           size_t frame_len,
+                           std::chrono::system_clock::time_point received)
+{
+  std::shared_ptr<const ListenerTable> listeners = std::atomic_load(&listeners_);
+  MavlinkFrame view(frame, received);
+  const ListenerList &targets = listeners->by_msgid[view.msgid()];
+  bool unpacked = false;
+  for (size_t i = 0; i < targets.size(); i++)
+  {
+    ListenerEntry &entry = *targets[i];
+    if (entry.queue)
+    {
+      entry.push(frame, frame_len, received);
+    }
+    else if (entry.frame_listener)
     {
-      for (int i = 0; i < listeners_.size(); i++)
+      entry.frame_listener->handle_mavlink_frame(view);
+      entry.dispatched++;
+    }
+    else
+    {
+      if (!unpacked)
       {
-        listeners_[i]->handle_mavlink_message(msg_in_);
+        MavlinkFrameScanner::unpack(frame, &msg_in_);
+        unpacked = true;
       }
+      entry.listener->handle_mavlink_message(msg_in_);
+      entry.dispatched++;
     }
   }
+}
 
-  async_read();
+bool MavlinkComm::send_message(const mavlink_message_t &msg)
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  return enqueue(msg.msgid, [&msg, now](WriteBuffer &buffer) {
+    buffer.len = mavlink_msg_to_send_buffer(buffer.data, &msg);
+    buffer.pos = 0;
+    buffer.queued = now;
+    assert(buffer.len <= MAVLINK_MAX_PACKET_LEN); //! \todo Do something less catastrophic here
+  });
+}
+
+bool MavlinkComm::send_raw(const uint8_t *frame, size_t len)
+{
+  if (len < MAVLINK_NUM_NON_PAYLOAD_BYTES || len > MAVLINK_MAX_PACKET_LEN)
+    return false;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  return enqueue(MavlinkFrame(frame).msgid(), [frame, len, now](WriteBuffer &buffer) {
+    memcpy(buffer.data, frame, len);
+    buffer.len = len;
+    buffer.pos = 0;
+    buffer.queued = now;
+  });
 }
 
-void MavlinkComm::send_message(const mavlink_message_t &msg)
+template <typename Pack>
+bool MavlinkComm::enqueue(uint8_t msgid, Pack pack)
 {
-  WriteBuffer *buffer = new WriteBuffer();
-  buffer->len = mavlink_msg_to_send_buffer(buffer->data, &msg);
-  assert(buffer->len <= MAVLINK_MAX_PACKET_LEN); //! \todo Do something less catastrophic here
+  WriteQueue &queue = write_lanes_[write_priority_[msgid]]->queue;
+  bool queued = queue.try_push(pack);
+  while (!queued && write_queue_policy_ == DROP_OLDEST)
+  {
+    // make room by discarding the oldest packet; the pop can fail if the io thread just drained the queue
+    if (queue.try_pop([](WriteBuffer &) {}))
+      write_queue_dropped_++;
+    queued = queue.try_push(pack);
+  }
 
+  if (!queued)
+    write_queue_dropped_++;
+
+  size_t depth = write_queue_depth();
+  size_t high_water = write_queue_high_water_.load(std::memory_order_relaxed);
+  while (depth > high_water
+         && !write_queue_high_water_.compare_exchange_weak(high_water, depth, std::memory_order_relaxed))
   {
-    mutex_lock lock(mutex_);
-    write_queue_.push_back(buffer);
   }
 
+  // pairs with the fence in async_write after it clears write_in_progress_, so that either the writer sees this
+  // packet or async_write(true) below sees the flag cleared
+  std::atomic_thread_fence(std::memory_order_seq_cst);
   async_write(true);
+  return queued;
+}
+
+void MavlinkComm::set_write_priority(uint8_t msgid, WritePriority priority)
+{
+  write_priority_[msgid] = priority;
+}
+
+void MavlinkComm::set_write_rate_limit(uint8_t msgid, double rate, double burst)
+{
+  burst = std::max(burst, 1.0);
+  RateLimit limit = {std::max(rate, 0.0), burst, burst, std::chrono::steady_clock::time_point()};
+  write_rate_limits_[msgid] = limit;
+}
+
+size_t MavlinkComm::write_queue_depth() const
+{
+  size_t depth = 0;
+  for (size_t i = 0; i < NUM_WRITE_PRIORITIES; i++)
+  {
+    depth += write_lanes_[i]->queue.size();
+  }
+  return depth;
+}
+
+void MavlinkComm::set_write_queue_full_policy(WriteQueueFullPolicy policy)
+{
+  write_queue_policy_ = policy;
+}
+
+uint64_t MavlinkComm::get_write_queue_dropped() const
+{
+  return write_queue_dropped_;
+}
+
+void MavlinkComm::set_max_write_batch(size_t max_batch)
+{
+  max_write_batch_ = std::max<size_t>(1, std::min<size_t>(max_batch, MAVLINK_MAX_WRITE_BATCH));
 }
 
 void MavlinkComm::async_write(bool check_write_state)
 {
-  if (check_write_state && write_in_progress_)
+  // only one write sequence runs at a time; whoever wins the flag owns the write batch until it is released
+  if (check_write_state)
+  {
+    bool expected = false;
+    if (!write_in_progress_.compare_exchange_strong(expected, true))
+      return;
+  }
+
+  if (link_state_ != LINK_UP)
+  {
+    park_write();
     return;
+  }
 
-  mutex_lock lock(mutex_);
-  if (write_queue_.empty())
+  // gather everything that is already queued and allowed by the rate limits, up to the batch limit
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::duration wait = std::chrono::steady_clock::duration::max();
+  bool blocked[NUM_WRITE_PRIORITIES] = {};
+  size_t max_batch = max_write_batch_;
+  write_batch_len_ = 0;
+  write_batch_pos_ = 0;
+  while (write_batch_len_ < max_batch && pop_write(&write_batch_[write_batch_len_], now, &wait, blocked))
+  {
+    write_batch_len_++;
+  }
+
+  if (write_batch_len_ == 0)
+  {
+    // come back once the first packet held back by a rate limit may go
+    if (wait != std::chrono::steady_clock::duration::max())
+      schedule_write_retry(wait);
+
+    write_in_progress_ = false;
+
+    // a packet may have been queued after the pop failed but before the flag was cleared; one that is still being
+    // filled in is left to its sender, which calls async_write once it is done. Pairs with the fence in enqueue: each
+    // side stores (flag here, packet there) then loads the other's, so without both fences each could miss the other
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (size_t i = 0; i < NUM_WRITE_PRIORITIES; i++)
+    {
+      if (!blocked[i] && write_lanes_[i]->queue.front_ready())
+      {
+        async_write(true);
+        return;
+      }
+    }
+    return;
+  }
+
+  async_write_current();
+}
+
+bool MavlinkComm::pop_write(WriteBuffer *buffer,
+                            std::chrono::steady_clock::time_point now,
+                            std::chrono::steady_clock::duration *wait,
+                            bool blocked[NUM_WRITE_PRIORITIES])
+{
+  for (size_t i = 0; i < NUM_WRITE_PRIORITIES; i++)
+  {
+    if (blocked[i])
+      continue;
+
+    // the front packet is held aside while it waits on its rate limit, so the queue's order is kept
+    WriteLane &lane = *write_lanes_[i];
+    while (!lane.has_pending && lane.queue.try_pop([&lane](WriteBuffer &front) { lane.pending = front; }))
+    {
+      lane.has_pending = !out_of_date(lane.pending);
+      if (!lane.has_pending)
+        write_queue_dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!lane.has_pending)
+      continue;
+
+    std::chrono::steady_clock::duration lane_wait;
+    if (!take_write_token(MavlinkFrame(lane.pending.data).msgid(), now, &lane_wait))
+    {
+      blocked[i] = true;
+      *wait = std::min(*wait, lane_wait);
+      continue;
+    }
+
+    *buffer = lane.pending;
+    lane.has_pending = false;
+    return true;
+  }
+
+  return false;
+}
+
+bool MavlinkComm::out_of_date(const WriteBuffer &buffer) const
+{
+  return drop_on_reconnect_[MavlinkFrame(buffer.data).msgid()]
+         && std::chrono::duration_cast<std::chrono::nanoseconds>(buffer.queued.time_since_epoch()).count()
+                < reconnected_ns_.load(std::memory_order_relaxed);
+}
+
+bool MavlinkComm::take_write_token(uint8_t msgid,
+                                   std::chrono::steady_clock::time_point now,
+                                   std::chrono::steady_clock::duration *wait)
+{
+  RateLimit &limit = write_rate_limits_[msgid];
+  if (limit.rate <= 0)
+    return true;
+
+  double elapsed = std::chrono::duration<double>(now - limit.updated).count();
+  limit.tokens = std::min(limit.burst, limit.tokens + elapsed * limit.rate);
+  limit.updated = now;
+
+  if (limit.tokens >= 1)
+  {
+    limit.tokens -= 1;
+    return true;
+  }
+
+  *wait = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>((1 - limit.tokens) / limit.rate));
+  return false;
+}
+
+void MavlinkComm::schedule_write_retry(std::chrono::steady_clock::duration delay)
+{
+  write_retry_timer_.expires_from_now(
+      boost::posix_time::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(delay).count() + 1));
+  write_retry_timer_.async_wait(
+      boost::bind(&MavlinkComm::write_retry_timer_end, this, boost::asio::placeholders::error));
+}
+
+void MavlinkComm::write_retry_timer_end(const boost::system::error_code &error)
+{
+  if (error) // cancelled because another retry was scheduled
     return;
 
-  write_in_progress_ = true;
-  WriteBuffer *buffer = write_queue_.front();
-  do_async_write(boost::asio::buffer(buffer->dpos(), buffer->nbytes()),
-                 boost::bind(&MavlinkComm::async_write_end, this, boost::asio::placeholders::error,
-                             boost::asio::placeholders::bytes_transferred));
+  retry_write();
+}
+
+void MavlinkComm::retry_write()
+{
+  async_write(true);
+}
+
+void MavlinkComm::async_write_current()
+{
+  write_buffers_.clear();
+  for (size_t i = write_batch_pos_; i < write_batch_len_; i++)
+  {
+    write_buffers_.push_back(boost::asio::const_buffer(write_batch_[i].dpos(), write_batch_[i].nbytes()));
+  }
+
+  do_async_write(write_buffers_, write_handler_);
 }
 
 void MavlinkComm::async_write_end(const boost::system::error_code &error, std::size_t bytes_transferred)
 {
   if (error)
   {
-    std::cerr << error.message() << std::endl;
-    close();
+    // keep the batch; it is finished, or thrown away, once the port is usable again
+    link_lost(error);
+    park_write();
     return;
   }
 
-  mutex_lock lock(mutex_);
-  if (write_queue_.empty())
+  tx_bytes_.fetch_add(bytes_transferred, std::memory_order_relaxed);
+
+  // advance through the batch by the number of bytes that made it out
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  while (bytes_transferred > 0 && write_batch_pos_ < write_batch_len_)
   {
-    write_in_progress_ = false;
-    return;
+    WriteBuffer &buffer = write_batch_[write_batch_pos_];
+    size_t n = std::min(bytes_transferred, buffer.nbytes());
+    buffer.pos += n;
+    bytes_transferred -= n;
+    if (buffer.nbytes() == 0)
+    {
+      record_write(buffer, now);
+      write_batch_pos_++;
+    }
   }
 
-  WriteBuffer *buffer = write_queue_.front();
-  buffer->pos += bytes_transferred;
-  if (buffer->nbytes() == 0)
+  if (write_batch_pos_ < write_batch_len_)
+    async_write_current();
+  else
+    async_write(false);
+}
+
+void MavlinkComm::park_write()
+{
+  // packets that made it out before the error are not sent again, the rest are restarted from their first byte
+  // unless they will be out of date by the time the port is back
+  size_t len = 0;
+  for (size_t i = write_batch_pos_; i < write_batch_len_; i++)
   {
-    write_queue_.pop_front();
-    delete buffer;
+    if (!drop_on_reconnect_[MavlinkFrame(write_batch_[i].data).msgid()])
+    {
+      write_batch_[len] = write_batch_[i];
+      write_batch_[len].pos = 0;
+      len++;
+    }
   }
+  write_queue_dropped_.fetch_add(write_batch_len_ - write_batch_pos_ - len, std::memory_order_relaxed);
+  write_batch_len_ = len;
+  write_batch_pos_ = 0;
 
-  if (write_queue_.empty())
-    write_in_progress_ = false;
+  // the port may have come back while this was running, in which case nobody else will resume the writes
+  write_parked_ = true;
+  if (link_state_ == LINK_UP)
+    resume_write();
+}
+
+void MavlinkComm::resume_write()
+{
+  if (!write_parked_.exchange(false))
+    return;
+
+  if (write_batch_pos_ < write_batch_len_)
+    async_write_current();
   else
     async_write(false);
 }
 
+void MavlinkComm::link_lost(const boost::system::error_code &error)
+{
+  // a single failure often completes both the pending read and the pending write with an error
+  LinkState expected = LINK_UP;
+  if (!link_state_.compare_exchange_strong(expected, LINK_DOWN))
+    return;
+
+  std::cerr << error.message() << std::endl;
+  if (!reconnect_enabled_)
+  {
+    // stop the io thread and leave the rest to the owner's close(), which joins it; unless that is already under way
+    mutex_lock lock(mutex_);
+    LinkState down = LINK_DOWN;
+    if (link_state_.compare_exchange_strong(down, LINK_CLOSED))
+    {
+      stop_io();
+      do_close();
+    }
+    return;
+  }
+
+  do_close();
+  reconnect_delay_ = reconnect_min_delay_;
+  schedule_reconnect(reconnect_delay_);
+}
+
+void MavlinkComm::schedule_reconnect(std::chrono::steady_clock::duration delay)
+{
+  reconnect_timer_.expires_from_now(
+      boost::posix_time::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(delay).count()));
+  reconnect_timer_.async_wait(
+      boost::bind(&MavlinkComm::reconnect_timer_end, this, boost::asio::placeholders::error));
+}
+
+void MavlinkComm::reconnect_timer_end(const boost::system::error_code &error)
+{
+  if (error)
+    return;
+
+  reconnect();
+}
+
+void MavlinkComm::do_async_open(const OpenHandler &handler)
+{
+  try
+  {
+    do_open();
+  }
+  catch (const SerialException &)
+  {
+    handler(boost::asio::error::make_error_code(boost::asio::error::not_connected));
+    return;
+  }
+  handler(boost::system::error_code());
+}
+
+void MavlinkComm::reconnect()
+{
+  if (link_state_ != LINK_DOWN)
+    return;
+
+  do_async_open(boost::bind(&MavlinkComm::reconnect_end, this, boost::asio::placeholders::error));
+}
+
+void MavlinkComm::reconnect_end(const boost::system::error_code &error)
+{
+  if (error)
+  {
+    reconnect_delay_ = std::min(2 * reconnect_delay_, reconnect_max_delay_);
+    schedule_reconnect(reconnect_delay_);
+    return;
+  }
+
+  // anything marked drop_on_reconnect_ that was queued up to now is out of date
+  reconnected_ns_.store(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(),
+      std::memory_order_relaxed);
+
+  // close() may have been called while the port was being reopened
+  LinkState expected = LINK_DOWN;
+  if (!link_state_.compare_exchange_strong(expected, LINK_UP))
+  {
+    do_close();
+    return;
+  }
+  reconnects_.fetch_add(1, std::memory_order_relaxed);
+
+  read_buf_len_ = 0;
+  async_read();
+  resume_write();
+}
+
+void MavlinkComm::record_write(const WriteBuffer &buffer, std::chrono::steady_clock::time_point now)
+{
+  tx_frames_.fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - buffer.queued).count();
+  size_t bin = 0;
+  while (bin < MAVLINK_LATENCY_HIST_BINS - 1 && us >= write_latency_bin_limit_us(bin))
+  {
+    bin++;
+  }
+  write_latency_hist_[bin].fetch_add(1, std::memory_order_relaxed);
+
+  // only the owner of the write batch gets here, so there is no competing writer for the maximum
+  if (us > write_latency_max_us_.load(std::memory_order_relaxed))
+    write_latency_max_us_.store(us, std::memory_order_relaxed);
+}
+
+//=============================================================================
+// ListenerEntry
+//=============================================================================
+
+MavlinkComm::ListenerEntry::ListenerEntry(MavlinkListenerInterface *listener,
+                                          MavlinkFrameListenerInterface *frame_listener,
+                                          size_t queue_size) :
+  listener(listener),
+  frame_listener(frame_listener),
+  all_messages(true),
+  queue(queue_size > 0 ? new BoundedQueue<ReceivedFrame>(queue_size) : NULL),
+  dispatched(0),
+  dropped(0),
+  waiting(false),
+  running(false)
+{
+}
+
+MavlinkComm::ListenerEntry::~ListenerEntry()
+{
+  stop();
+}
+
+void MavlinkComm::ListenerEntry::start()
+{
+  if (!queue || running)
+    return;
+
+  running = true;
+  thread = boost::thread(boost::bind(&ListenerEntry::run, this));
+}
+
+void MavlinkComm::ListenerEntry::stop()
+{
+  if (!running)
+    return;
+
+  {
+    boost::lock_guard<boost::mutex> lock(wait_mutex);
+    running = false;
+    wait_cond.notify_one();
+  }
+
+  if (thread.get_id() == boost::this_thread::get_id())
+    thread.detach(); // unregistered from inside its own handler
+  else if (thread.joinable())
+    thread.join();
+}
+
+void MavlinkComm::ListenerEntry::push(const uint8_t *frame,
+                                      size_t frame_len,
+                                      std::chrono::system_clock::time_point received)
+{
+  if (!queue->try_push([frame, frame_len, received](ReceivedFrame &slot) {
+        memcpy(slot.data, frame, frame_len);
+        slot.received = received;
+      }))
+  {
+    dropped++;
+    return;
+  }
+
+  // pairs with the fence in run() so that either the dispatcher sees the new message or we see it waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting)
+  {
+    boost::lock_guard<boost::mutex> lock(wait_mutex);
+    wait_cond.notify_one();
+  }
+}
+
+void MavlinkComm::ListenerEntry::deliver(const uint8_t *frame, std::chrono::system_clock::time_point received)
+{
+  if (frame_listener)
+  {
+    frame_listener->handle_mavlink_frame(MavlinkFrame(frame, received));
+  }
+  else
+  {
+    MavlinkFrameScanner::unpack(frame, &msg);
+    listener->handle_mavlink_message(msg);
+  }
+}
+
+void MavlinkComm::ListenerEntry::run()
+{
+  for (;;)
+  {
+    // handle the frame in place in the queue slot; the slot is released to the io thread once the handler returns
+    if (queue->try_pop([this](ReceivedFrame &frame) { deliver(frame.data, frame.received); }))
+    {
+      dispatched++;
+      continue;
+    }
+
+    boost::unique_lock<boost::mutex> lock(wait_mutex);
+    if (!running)
+      break;
+
+    waiting = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (queue->empty())
+      wait_cond.wait(lock);
+    waiting = false;
+  }
+}
+
 } // namespace mavrosflight
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_epoll_comm.cpp
+ */
+
+#ifdef __linux__
+
+#include <rosflight/mavrosflight/mavlink_epoll_comm.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace mavrosflight
+{
+namespace
+{
+//! The epoll loop running on the current thread, so writes completed inside the loop do not need to wake it
+thread_local const MavlinkEpollComm *current_loop = NULL;
+
+void close_fd(int fd)
+{
+  if (fd >= 0)
+    ::close(fd);
+}
+
+void set_timer(int fd, std::chrono::steady_clock::duration delay)
+{
+  int64_t ns = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count(), 1);
+
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = ns / 1000000000;
+  spec.it_value.tv_nsec = ns % 1000000000;
+  timerfd_settime(fd, 0, &spec, NULL);
+}
+
+} // namespace
+
+MavlinkEpollComm::MavlinkEpollComm() :
+  MavlinkComm(),
+  fd_(-1),
+  epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+  event_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+  reconnect_timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+  stop_requested_(false),
+  read_data_(NULL),
+  read_size_(0),
+  read_handler_(NULL),
+  read_watched_(true),
+  write_buffers_(NULL),
+  write_handler_(NULL),
+  write_blocked_(false),
+  write_complete_(false),
+  write_error_(0),
+  write_bytes_(0)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+
+  bool ok = epoll_fd_ >= 0 && event_fd_ >= 0 && timer_fd_ >= 0 && reconnect_timer_fd_ >= 0;
+  if (ok)
+  {
+    event.data.fd = event_fd_;
+    ok = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) == 0;
+  }
+  if (ok)
+  {
+    event.data.fd = timer_fd_;
+    ok = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event) == 0;
+  }
+  if (ok)
+  {
+    event.data.fd = reconnect_timer_fd_;
+    ok = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, reconnect_timer_fd_, &event) == 0;
+  }
+
+  if (!ok)
+  {
+    std::string error = strerror(errno);
+    close_fd(reconnect_timer_fd_);
+    close_fd(timer_fd_);
+    close_fd(event_fd_);
+    close_fd(epoll_fd_);
+    throw SerialException("Failed to create epoll loop: " + error);
+  }
+}
+
+MavlinkEpollComm::~MavlinkEpollComm()
+{
+  close();
+  close_fd(reconnect_timer_fd_);
+  close_fd(timer_fd_);
+  close_fd(event_fd_);
+  close_fd(epoll_fd_);
+}
+
+bool MavlinkEpollComm::is_open()
+{
+  return fd_ >= 0;
+}
+
+void MavlinkEpollComm::do_open()
+{
+  int fd = open_fd();
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+  {
+    std::string error = strerror(errno);
+    ::close(fd);
+    throw SerialException("Failed to watch port: " + error);
+  }
+
+  // a reconnect from inside the loop must not lose a stop request or the aborted write left by do_close
+  read_handler_ = NULL;
+  read_watched_ = true;
+  if (current_loop != this)
+  {
+    write_blocked_ = false;
+    write_complete_ = false;
+    stop_requested_ = false;
+  }
+  fd_ = fd;
+}
+
+void MavlinkEpollComm::do_close()
+{
+  // closing the descriptor also removes it from the epoll set
+  close_fd(fd_.exchange(-1));
+
+  // a write waiting for the descriptor would never finish, so fail it the way asio aborts pending operations
+  if (write_blocked_.exchange(false))
+  {
+    write_error_ = ECANCELED;
+    write_bytes_ = 0;
+    write_complete_ = true;
+  }
+}
+
+void MavlinkEpollComm::do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
+{
+  // the loop reads straight into the caller's buffer once the descriptor is readable
+  read_data_ = boost::asio::buffer_cast<uint8_t *>(buffer);
+  read_size_ = boost::asio::buffer_size(buffer);
+  read_handler_ = &handler;
+  if (!read_watched_)
+  {
+    read_watched_ = true;
+    watch_fd();
+  }
+}
+
+void MavlinkEpollComm::do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+{
+  write_buffers_ = &buffers;
+  write_handler_ = &handler;
+
+  // try the write right away; only wait on the loop if the kernel buffer is full
+  ssize_t written = write_some(buffers);
+  if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+    write_blocked_ = true;
+    watch_fd();
+    return;
+  }
+
+  // complete on the loop so the next batch is not started from inside this call
+  write_error_ = written < 0 ? errno : 0;
+  write_bytes_ = written < 0 ? 0 : written;
+  write_complete_ = true;
+  if (current_loop != this)
+    kick();
+}
+
+void MavlinkEpollComm::run_io()
+{
+  current_loop = this;
+
+  static const int MAX_EVENTS = 8;
+  struct epoll_event events[MAX_EVENTS];
+  while (!stop_requested_)
+  {
+    if (write_complete_)
+    {
+      complete_write();
+      continue;
+    }
+
+    int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "epoll_wait: " << strerror(errno) << std::endl;
+      break;
+    }
+
+    for (int i = 0; i < count && !stop_requested_; i++)
+    {
+      int fd = events[i].data.fd;
+      uint32_t flags = events[i].events;
+      if (fd == event_fd_ || fd == timer_fd_ || fd == reconnect_timer_fd_)
+      {
+        uint64_t expirations;
+        if (::read(fd, &expirations, sizeof(expirations)) > 0)
+        {
+          if (fd == timer_fd_)
+            retry_write();
+          else if (fd == reconnect_timer_fd_)
+            reconnect();
+        }
+      }
+      else if (fd == fd_)
+      {
+        if ((flags & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && write_blocked_)
+          handle_writable();
+        if (flags & (EPOLLIN | EPOLLERR | EPOLLHUP))
+          handle_readable(flags & EPOLLHUP);
+      }
+    }
+  }
+
+  current_loop = NULL;
+}
+
+void MavlinkEpollComm::stop_io()
+{
+  stop_requested_ = true;
+  kick();
+}
+
+void MavlinkEpollComm::schedule_write_retry(std::chrono::steady_clock::duration delay)
+{
+  set_timer(timer_fd_, delay);
+}
+
+void MavlinkEpollComm::schedule_reconnect(std::chrono::steady_clock::duration delay)
+{
+  set_timer(reconnect_timer_fd_, delay);
+}
+
+void MavlinkEpollComm::kick()
+{
+  uint64_t one = 1;
+  if (::write(event_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    std::cerr << "eventfd: " << strerror(errno) << std::endl;
+}
+
+void MavlinkEpollComm::watch_fd()
+{
+  // whichever call runs last sees both flags as they are now, so no change is lost
+  boost::lock_guard<boost::mutex> lock(watch_mutex_);
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = (read_watched_ ? EPOLLIN : 0) | (write_blocked_ ? EPOLLOUT : 0);
+  event.data.fd = fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, event.data.fd, &event);
+}
+
+void MavlinkEpollComm::handle_readable(bool hangup)
+{
+  // stop watching for input until the next read is requested, or the loop would wake for it again and again
+  if (read_handler_ == NULL)
+  {
+    read_watched_ = false;
+    watch_fd();
+    return;
+  }
+
+  ssize_t received = read_some(read_data_, read_size_);
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return;
+
+  // the handler normally starts the next read, which sets read_handler_ again
+  const IoHandler &handler = *read_handler_;
+  read_handler_ = NULL;
+  if (received < 0)
+    handler(boost::system::error_code(errno, boost::system::system_category()), 0);
+  else if (received == 0 && hangup)
+    handler(boost::asio::error::eof, 0);
+  else
+    handler(boost::system::error_code(), received);
+}
+
+void MavlinkEpollComm::handle_writable()
+{
+  ssize_t written = write_some(*write_buffers_);
+  if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+
+  int error = written < 0 ? errno : 0;
+  write_blocked_ = false;
+  watch_fd();
+
+  (*write_handler_)(error ? boost::system::error_code(error, boost::system::system_category()) :
+                            boost::system::error_code(),
+                    written < 0 ? 0 : written);
+}
+
+void MavlinkEpollComm::complete_write()
+{
+  write_complete_ = false;
+  (*write_handler_)(write_error_ ? boost::system::error_code(write_error_, boost::system::system_category()) :
+                                   boost::system::error_code(),
+                    write_bytes_);
+}
+
+} // namespace mavrosflight
+
+#endif // __linux__
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_epoll_serial.cpp
+ */
+
+#ifdef __linux__
+
+#include <rosflight/mavrosflight/mavlink_epoll_serial.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+#include <rosflight/mavrosflight/serial_tuning.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace mavrosflight
+{
+namespace
+{
+bool baud_rate_to_speed(int baud_rate, speed_t *speed)
+{
+  switch (baud_rate)
+  {
+  case 9600:
+    *speed = B9600;
+    return true;
+  case 19200:
+    *speed = B19200;
+    return true;
+  case 38400:
+    *speed = B38400;
+    return true;
+  case 57600:
+    *speed = B57600;
+    return true;
+  case 115200:
+    *speed = B115200;
+    return true;
+  case 230400:
+    *speed = B230400;
+    return true;
+  case 460800:
+    *speed = B460800;
+    return true;
+  case 500000:
+    *speed = B500000;
+    return true;
+  case 921600:
+    *speed = B921600;
+    return true;
+  case 1000000:
+    *speed = B1000000;
+    return true;
+  case 1500000:
+    *speed = B1500000;
+    return true;
+  case 2000000:
+    *speed = B2000000;
+    return true;
+  case 3000000:
+    *speed = B3000000;
+    return true;
+  case 4000000:
+    *speed = B4000000;
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+MavlinkEpollSerial::MavlinkEpollSerial(std::string port, int baud_rate, bool low_latency, bool hardware_flow_control) :
+  MavlinkEpollComm(),
+  port_(port),
+  baud_rate_(baud_rate),
+  low_latency_(low_latency),
+  hardware_flow_control_(hardware_flow_control)
+{
+}
+
+MavlinkEpollSerial::~MavlinkEpollSerial()
+{
+  close();
+}
+
+int MavlinkEpollSerial::open_fd()
+{
+  speed_t speed;
+  if (!baud_rate_to_speed(baud_rate_, &speed))
+    throw SerialException("Unsupported baud rate " + std::to_string(baud_rate_));
+
+  int fd = ::open(port_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    throw SerialException(port_ + ": " + strerror(errno));
+
+  // raw 8N1, optionally with RTS/CTS flow control
+  struct termios tio;
+  bool ok = tcgetattr(fd, &tio) == 0;
+  if (ok)
+  {
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    if (hardware_flow_control_)
+      tio.c_cflag |= CRTSCTS;
+    ok = cfsetispeed(&tio, speed) == 0 && cfsetospeed(&tio, speed) == 0 && tcsetattr(fd, TCSANOW, &tio) == 0;
+  }
+
+  if (!ok)
+  {
+    std::string error = strerror(errno);
+    ::close(fd);
+    throw SerialException(port_ + ": " + error);
+  }
+
+  if (low_latency_)
+  {
+    try
+    {
+      set_serial_low_latency(fd);
+    }
+    catch (const SerialException &)
+    {
+      ::close(fd);
+      throw;
+    }
+  }
+
+  return fd;
+}
+
+ssize_t MavlinkEpollSerial::read_some(uint8_t *buf, size_t len)
+{
+  return ::read(fd(), buf, len);
+}
+
+ssize_t MavlinkEpollSerial::write_some(const WriteBufferSequence &buffers)
+{
+  struct iovec iov[MAVLINK_MAX_WRITE_BATCH];
+  size_t count = std::min<size_t>(buffers.size(), MAVLINK_MAX_WRITE_BATCH);
+  for (size_t i = 0; i < count; i++)
+  {
+    iov[i].iov_base = const_cast<void *>(boost::asio::buffer_cast<const void *>(buffers[i]));
+    iov[i].iov_len = boost::asio::buffer_size(buffers[i]);
+  }
+
+  return ::writev(fd(), iov, count);
+}
+
+std::chrono::nanoseconds MavlinkEpollSerial::byte_time() const
+{
+  return baud_rate_ > 0 ? std::chrono::nanoseconds(10 * 1000000000LL / baud_rate_) : std::chrono::nanoseconds::zero();
+}
+
+} // namespace mavrosflight
+
+#endif // __linux__
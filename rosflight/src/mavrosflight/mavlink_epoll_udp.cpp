@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_epoll_udp.cpp
+ */
+
+#ifdef __linux__
+
+#include <rosflight/mavrosflight/mavlink_epoll_udp.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+#include <rosflight/mavrosflight/socket_timestamps.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace mavrosflight
+{
+namespace
+{
+void resolve(const std::string &host, uint16_t port, struct sockaddr_in *addr)
+{
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  struct addrinfo *result;
+  int error = getaddrinfo(host.c_str(), NULL, &hints, &result);
+  if (error != 0)
+    throw SerialException(host + ": " + gai_strerror(error));
+
+  memcpy(addr, result->ai_addr, sizeof(*addr));
+  addr->sin_port = htons(port);
+  freeaddrinfo(result);
+}
+
+} // namespace
+
+MavlinkEpollUDP::MavlinkEpollUDP(std::string bind_host,
+                                 uint16_t bind_port,
+                                 std::string remote_host,
+                                 uint16_t remote_port) :
+  MavlinkEpollComm(),
+  bind_host_(bind_host),
+  bind_port_(bind_port),
+  remote_host_(remote_host),
+  remote_port_(remote_port)
+{
+  memset(&remote_addr_, 0, sizeof(remote_addr_));
+}
+
+MavlinkEpollUDP::~MavlinkEpollUDP()
+{
+  close();
+}
+
+int MavlinkEpollUDP::open_fd()
+{
+  struct sockaddr_in bind_addr;
+  resolve(bind_host_, bind_port_, &bind_addr);
+  resolve(remote_host_, remote_port_, &remote_addr_);
+
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    throw SerialException(std::string("socket: ") + strerror(errno));
+
+  int reuse = 1;
+  int send_buffer_size = 1000 * MAVLINK_MAX_PACKET_LEN;
+  int receive_buffer_size = 1000 * MAVLINK_SERIAL_READ_BUF_SIZE;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+      || setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer_size, sizeof(send_buffer_size)) < 0
+      || setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size)) < 0
+      || bind(fd, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0)
+  {
+    std::string error = strerror(errno);
+    ::close(fd);
+    throw SerialException(bind_host_ + ":" + std::to_string(bind_port_) + ": " + error);
+  }
+
+  try
+  {
+    enable_receive_timestamps(fd);
+  }
+  catch (const SerialException &)
+  {
+    ::close(fd);
+    throw;
+  }
+
+  return fd;
+}
+
+ssize_t MavlinkEpollUDP::read_some(uint8_t *buf, size_t len)
+{
+  socklen_t addr_len = sizeof(remote_addr_);
+  std::chrono::system_clock::time_point received;
+  ssize_t result = recvfrom_timestamped(fd(), buf, len, 0, (struct sockaddr *)&remote_addr_, &addr_len, &received);
+  if (result >= 0)
+    set_receive_time(received);
+  return result;
+}
+
+ssize_t MavlinkEpollUDP::write_some(const WriteBufferSequence &buffers)
+{
+  struct iovec iov[MAVLINK_MAX_WRITE_BATCH];
+  struct mmsghdr msgs[MAVLINK_MAX_WRITE_BATCH];
+  size_t count = std::min<size_t>(buffers.size(), MAVLINK_MAX_WRITE_BATCH);
+  for (size_t i = 0; i < count; i++)
+  {
+    iov[i].iov_base = const_cast<void *>(boost::asio::buffer_cast<const void *>(buffers[i]));
+    iov[i].iov_len = boost::asio::buffer_size(buffers[i]);
+
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    msgs[i].msg_hdr.msg_name = &remote_addr_;
+    msgs[i].msg_hdr.msg_namelen = sizeof(remote_addr_);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int sent = sendmmsg(fd(), msgs, count, 0);
+  if (sent < 0)
+    return -1;
+
+  ssize_t bytes = 0;
+  for (int i = 0; i < sent; i++)
+  {
+    bytes += msgs[i].msg_len;
+  }
+  return bytes;
+}
+
+} // namespace mavrosflight
+
+#endif // __linux__
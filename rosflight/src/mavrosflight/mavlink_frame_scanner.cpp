@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_frame_scanner.cpp
+ */
+
+#include <rosflight/mavrosflight/mavlink_frame_scanner.h>
+
+namespace mavrosflight
+{
+namespace
+{
+const uint8_t message_crcs[256] = MAVLINK_MESSAGE_CRCS;
+#ifdef MAVLINK_MESSAGE_LENGTHS
+const uint8_t message_lengths[256] = MAVLINK_MESSAGE_LENGTHS;
+#endif
+} // namespace
+
+MavlinkFrameScanner::MavlinkFrameScanner() : frames_(0), crc_errors_(0), length_errors_(0), bytes_skipped_(0) {}
+
+void MavlinkFrameScanner::unpack(const uint8_t *frame, mavlink_message_t *msg)
+{
+  uint8_t payload_len = frame[1];
+
+  msg->magic = frame[0];
+  msg->len = payload_len;
+  msg->seq = frame[2];
+  msg->sysid = frame[3];
+  msg->compid = frame[4];
+  msg->msgid = frame[5];
+  memcpy(_MAV_PAYLOAD_NON_CONST(msg), frame + MAVLINK_NUM_HEADER_BYTES, payload_len + MAVLINK_NUM_CHECKSUM_BYTES);
+  msg->checksum = frame[MAVLINK_NUM_HEADER_BYTES + payload_len]
+                  | (frame[MAVLINK_NUM_HEADER_BYTES + payload_len + 1] << 8);
+}
+
+bool MavlinkFrameScanner::check_length(uint8_t msgid, uint8_t payload_len) const
+{
+#ifdef MAVLINK_MESSAGE_LENGTHS
+  // messages unknown to this dialect have a length of zero in the table and are passed through unchecked
+  return message_lengths[msgid] == 0 || message_lengths[msgid] == payload_len;
+#else
+  return true;
+#endif
+}
+
+bool MavlinkFrameScanner::check_crc(const uint8_t *frame, uint8_t payload_len) const
+{
+  // the checksum covers everything after the start byte, followed by the message's CRC_EXTRA seed
+  uint16_t crc;
+  crc_init(&crc);
+  const uint8_t *end = frame + MAVLINK_NUM_HEADER_BYTES + payload_len;
+  for (const uint8_t *p = frame + 1; p < end; p++)
+  {
+    crc_accumulate(*p, &crc);
+  }
+  crc_accumulate(message_crcs[frame[5]], &crc);
+
+  return end[0] == (crc & 0xFF) && end[1] == (crc >> 8);
+}
+
+} // namespace mavrosflight
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_router.cpp
+ */
+
+#include <rosflight/mavrosflight/mavlink_router.h>
+
+namespace mavrosflight
+{
+MavlinkRouter::MavlinkRouter(MavlinkComm *upstream) :
+  upstream_(upstream),
+  upstream_listener_(this),
+  active_(std::make_shared<EndpointList>())
+{
+  upstream_->register_mavlink_frame_listener(&upstream_listener_);
+}
+
+MavlinkRouter::~MavlinkRouter()
+{
+  upstream_->unregister_mavlink_frame_listener(&upstream_listener_);
+
+  // a frame being forwarded right now holds its own reference to the endpoints it is using
+  std::atomic_store(&active_, std::shared_ptr<const EndpointList>(std::make_shared<EndpointList>()));
+  endpoints_.clear();
+}
+
+void MavlinkRouter::add_endpoint(MavlinkComm *endpoint, const std::vector<uint8_t> &msgids)
+{
+  std::shared_ptr<Endpoint> entry = std::make_shared<Endpoint>(upstream_, endpoint, msgids);
+  entry->comm->open_or_reconnect();
+
+  endpoints_.push_back(entry);
+  std::atomic_store(&active_, std::shared_ptr<const EndpointList>(std::make_shared<EndpointList>(endpoints_)));
+}
+
+MavlinkRouter::EndpointStats MavlinkRouter::get_endpoint_stats(size_t index) const
+{
+  const Endpoint &endpoint = *endpoints_[index];
+  EndpointStats stats;
+  stats.forwarded = endpoint.forwarded.load(std::memory_order_relaxed);
+  stats.filtered = endpoint.filtered.load(std::memory_order_relaxed);
+  // the endpoint's write queue only ever holds forwarded frames, and it counts every one it loses, including the oldest
+  // frames it discards to make room for new ones
+  stats.dropped = endpoint.comm->get_write_queue_dropped();
+  stats.received = endpoint.received.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void MavlinkRouter::UpstreamListener::handle_mavlink_frame(const MavlinkFrame &frame)
+{
+  std::shared_ptr<const EndpointList> endpoints = std::atomic_load(&router->active_);
+  for (size_t i = 0; i < endpoints->size(); i++)
+  {
+    (*endpoints)[i]->forward(frame);
+  }
+}
+
+//=============================================================================
+// Endpoint
+//=============================================================================
+
+MavlinkRouter::Endpoint::Endpoint(MavlinkComm *upstream, MavlinkComm *comm, const std::vector<uint8_t> &msgids) :
+  upstream(upstream),
+  comm(comm),
+  forwarded(0),
+  filtered(0),
+  received(0)
+{
+  if (msgids.empty())
+    filter.set();
+  for (size_t i = 0; i < msgids.size(); i++)
+  {
+    filter.set(msgids[i]);
+  }
+
+  comm->register_mavlink_frame_listener(this);
+}
+
+MavlinkRouter::Endpoint::~Endpoint()
+{
+  comm->close();
+}
+
+void MavlinkRouter::Endpoint::handle_mavlink_frame(const MavlinkFrame &frame)
+{
+  upstream->send_raw(frame.data(), frame.size());
+  received.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MavlinkRouter::Endpoint::forward(const MavlinkFrame &frame)
+{
+  if (!filter.test(frame.msgid()))
+    filtered.fetch_add(1, std::memory_order_relaxed);
+  else if (comm->send_raw(frame.data(), frame.size()))
+    forwarded.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace mavrosflight
@@ -36,16 +36,19 @@
 
 #include <rosflight/mavrosflight/mavlink_serial.h>
 #include <rosflight/mavrosflight/serial_exception.h>
+#include <rosflight/mavrosflight/serial_tuning.h>
 
 namespace mavrosflight
 {
 using boost::asio::serial_port_base;
 
-MavlinkSerial::MavlinkSerial(std::string port, int baud_rate) :
+MavlinkSerial::MavlinkSerial(std::string port, int baud_rate, bool low_latency, bool hardware_flow_control) :
   MavlinkComm(),
   serial_port_(io_service_),
   port_(port),
-  baud_rate_(baud_rate)
+  baud_rate_(baud_rate),
+  low_latency_(low_latency),
+  hardware_flow_control_(hardware_flow_control)
 {
 }
 
@@ -68,12 +71,27 @@ void MavlinkSerial::do_open()
     serial_port_.set_option(serial_port_base::character_size(8));
     serial_port_.set_option(serial_port_base::parity(serial_port_base::parity::none));
     serial_port_.set_option(serial_port_base::stop_bits(serial_port_base::stop_bits::one));
-    serial_port_.set_option(serial_port_base::flow_control(serial_port_base::flow_control::none));
+    serial_port_.set_option(serial_port_base::flow_control(hardware_flow_control_ ?
+                                                               serial_port_base::flow_control::hardware :
+                                                               serial_port_base::flow_control::none));
   }
   catch (boost::system::system_error e)
   {
     throw SerialException(e);
   }
+
+  if (low_latency_)
+  {
+    try
+    {
+      set_serial_low_latency(serial_port_.native_handle());
+    }
+    catch (const SerialException &)
+    {
+      serial_port_.close();
+      throw;
+    }
+  }
 }
 
 void MavlinkSerial::do_close()
@@ -81,16 +99,19 @@ void MavlinkSerial::do_close()
   serial_port_.close();
 }
 
-void MavlinkSerial::do_async_read(const boost::asio::mutable_buffers_1 &buffer,
-                                  boost::function<void(const boost::system::error_code &, size_t)> handler)
+void MavlinkSerial::do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
 {
   serial_port_.async_read_some(buffer, handler);
 }
 
-void MavlinkSerial::do_async_write(const boost::asio::const_buffers_1 &buffer,
-                                   boost::function<void(const boost::system::error_code &, size_t)> handler)
+void MavlinkSerial::do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+{
+  serial_port_.async_write_some(buffers, handler);
+}
+
+std::chrono::nanoseconds MavlinkSerial::byte_time() const
 {
-  serial_port_.async_write_some(buffer, handler);
+  return baud_rate_ > 0 ? std::chrono::nanoseconds(10 * 1000000000LL / baud_rate_) : std::chrono::nanoseconds::zero();
 }
 
 } // namespace mavrosflight
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_tcp.cpp
+ */
+
+#include <rosflight/mavrosflight/mavlink_tcp.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+
+using boost::asio::ip::tcp;
+
+namespace mavrosflight
+{
+MavlinkTCP::MavlinkTCP(std::string remote_host, uint16_t remote_port) :
+  MavlinkComm(),
+  socket_(io_service_),
+  resolver_(io_service_),
+  remote_host_(remote_host),
+  remote_port_(remote_port)
+{
+}
+
+MavlinkTCP::~MavlinkTCP()
+{
+  do_close();
+}
+
+bool MavlinkTCP::is_open()
+{
+  return socket_.is_open();
+}
+
+void MavlinkTCP::do_open()
+{
+  try
+  {
+    tcp::resolver resolver(io_service_);
+    boost::asio::connect(socket_, resolver.resolve({remote_host_, std::to_string(remote_port_)}));
+
+    // packets are already coalesced by the write batching, so don't hold them back any further
+    socket_.set_option(tcp::no_delay(true));
+  }
+  catch (const boost::system::system_error &e)
+  {
+    socket_.close();
+    throw SerialException(e);
+  }
+}
+
+void MavlinkTCP::do_close()
+{
+  resolver_.cancel();
+  socket_.close();
+}
+
+void MavlinkTCP::do_async_open(const OpenHandler &handler)
+{
+  resolver_.async_resolve(tcp::resolver::query(remote_host_, std::to_string(remote_port_)),
+                          boost::bind(&MavlinkTCP::async_resolve_end, this, boost::asio::placeholders::error,
+                                      boost::asio::placeholders::iterator, handler));
+}
+
+void MavlinkTCP::async_resolve_end(const boost::system::error_code &error,
+                                   tcp::resolver::iterator endpoints,
+                                   const OpenHandler &handler)
+{
+  if (error)
+  {
+    handler(error);
+    return;
+  }
+
+  boost::asio::async_connect(
+      socket_, endpoints, boost::bind(&MavlinkTCP::async_connect_end, this, boost::asio::placeholders::error, handler));
+}
+
+void MavlinkTCP::async_connect_end(boost::system::error_code error, const OpenHandler &handler)
+{
+  if (!error)
+    socket_.set_option(tcp::no_delay(true), error);
+  if (error)
+  {
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+  }
+  handler(error);
+}
+
+void MavlinkTCP::do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
+{
+  socket_.async_read_some(buffer, handler);
+}
+
+void MavlinkTCP::do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+{
+  socket_.async_write_some(buffers, handler);
+}
+
+} // namespace mavrosflight
@@ -36,6 +36,16 @@
 
 #include <rosflight/mavrosflight/mavlink_udp.h>
 #include <rosflight/mavrosflight/serial_exception.h>
+#include <rosflight/mavrosflight/socket_timestamps.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
 
 using boost::asio::ip::udp;
 
@@ -49,7 +59,14 @@ MavlinkUDP::MavlinkUDP(std::string bind_host, uint16_t bind_port, std::string re
   bind_host_(bind_host),
   bind_port_(bind_port),
   remote_host_(remote_host),
-  remote_port_(remote_port)
+  remote_port_(remote_port),
+  read_buffer_(nullptr, 0),
+  read_handler_(nullptr),
+  write_buffers_(nullptr),
+  write_handler_(nullptr),
+  write_bytes_(0),
+  write_index_(0),
+  write_done_storage_used_(false)
 {
 }
 
@@ -81,6 +98,9 @@ void MavlinkUDP::do_open()
     socket_.set_option(udp::socket::reuse_address(true));
     socket_.set_option(udp::socket::send_buffer_size(1000 * MAVLINK_MAX_PACKET_LEN));
     socket_.set_option(udp::socket::receive_buffer_size(1000 * MAVLINK_SERIAL_READ_BUF_SIZE));
+#ifdef __linux__
+    enable_receive_timestamps(socket_.native_handle());
+#endif
   }
   catch (boost::system::system_error e)
   {
@@ -93,16 +113,150 @@ void MavlinkUDP::do_close()
   socket_.close();
 }
 
-void MavlinkUDP::do_async_read(const boost::asio::mutable_buffers_1 &buffer,
-                               boost::function<void(const boost::system::error_code &, size_t)> handler)
+void MavlinkUDP::do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
 {
+#ifdef __linux__
+  // wait for a datagram, then read it with recvmsg so the kernel's receive timestamp comes with it
+  read_buffer_ = buffer;
+  read_handler_ = &handler;
+  socket_.async_receive(boost::asio::null_buffers(),
+                        [this](const boost::system::error_code &error, size_t) { read_ready(error); });
+#else
   socket_.async_receive_from(buffer, remote_endpoint_, handler);
+#endif
+}
+
+void MavlinkUDP::do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+{
+#ifdef __linux__
+  write_buffers_ = &buffers;
+  write_handler_ = &handler;
+  write_batch();
+#else
+  write_buffers_ = &buffers;
+  write_handler_ = &handler;
+  write_index_ = 0;
+  write_bytes_ = 0;
+  send_next();
+#endif
+}
+
+#ifndef __linux__
+void MavlinkUDP::send_next()
+{
+  socket_.async_send_to(boost::asio::buffer((*write_buffers_)[write_index_]), remote_endpoint_,
+                        [this](const boost::system::error_code &error, size_t bytes_transferred) {
+                          write_bytes_ += bytes_transferred;
+                          if (!error && ++write_index_ < write_buffers_->size())
+                            send_next();
+                          else
+                            (*write_handler_)(error, write_bytes_);
+                        });
+}
+#endif
+
+#ifdef __linux__
+void MavlinkUDP::read_ready(const boost::system::error_code &error)
+{
+  if (error)
+  {
+    (*read_handler_)(error, 0);
+    return;
+  }
+
+  socklen_t addr_len = remote_endpoint_.capacity();
+  std::chrono::system_clock::time_point received;
+  ssize_t n = recvfrom_timestamped(socket_.native_handle(), boost::asio::buffer_cast<uint8_t *>(read_buffer_),
+                                   boost::asio::buffer_size(read_buffer_), MSG_DONTWAIT, remote_endpoint_.data(),
+                                   &addr_len, &received);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+  {
+    do_async_read(read_buffer_, *read_handler_);
+  }
+  else if (n < 0)
+  {
+    (*read_handler_)(boost::system::error_code(errno, boost::system::system_category()), 0);
+  }
+  else
+  {
+    remote_endpoint_.resize(addr_len);
+    set_receive_time(received);
+    (*read_handler_)(boost::system::error_code(), n);
+  }
+}
+
+void MavlinkUDP::write_batch()
+{
+  // one datagram per packet, all handed to the kernel in a single sendmmsg call
+  const WriteBufferSequence &buffers = *write_buffers_;
+  struct iovec iov[MAVLINK_MAX_WRITE_BATCH];
+  struct mmsghdr msgs[MAVLINK_MAX_WRITE_BATCH];
+  size_t count = std::min<size_t>(buffers.size(), MAVLINK_MAX_WRITE_BATCH);
+  for (size_t i = 0; i < count; i++)
+  {
+    iov[i].iov_base = const_cast<void *>(boost::asio::buffer_cast<const void *>(buffers[i]));
+    iov[i].iov_len = boost::asio::buffer_size(buffers[i]);
+
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    msgs[i].msg_hdr.msg_name = remote_endpoint_.data();
+    msgs[i].msg_hdr.msg_namelen = remote_endpoint_.size();
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int sent;
+  do
+  {
+    sent = ::sendmmsg(socket_.native_handle(), msgs, count, MSG_DONTWAIT);
+  } while (sent < 0 && errno == EINTR);
+
+  if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+    // the socket buffer is full, so wait until it is writable and try again
+    socket_.async_send_to(boost::asio::null_buffers(), remote_endpoint_,
+                          [this](const boost::system::error_code &error, size_t) {
+                            if (error)
+                              (*write_handler_)(error, 0);
+                            else
+                              write_batch();
+                          });
+    return;
+  }
+
+  write_error_ = boost::system::error_code();
+  write_bytes_ = 0;
+  if (sent < 0)
+  {
+    write_error_ = boost::system::error_code(errno, boost::system::system_category());
+  }
+  for (int i = 0; i < sent; i++)
+  {
+    write_bytes_ += msgs[i].msg_len;
+  }
+
+  // complete through the io service so the next batch is not started from inside this call
+  io_service_.post(WriteDone(this));
+}
+
+void MavlinkUDP::write_done()
+{
+  (*write_handler_)(write_error_, write_bytes_);
+}
+
+void *MavlinkUDP::WriteDone::allocate(size_t size)
+{
+  if (size <= sizeof(udp->write_done_storage_) && !udp->write_done_storage_used_.exchange(true))
+    return udp->write_done_storage_;
+  return ::operator new(size);
 }
 
-void MavlinkUDP::do_async_write(const boost::asio::const_buffers_1 &buffer,
-                                boost::function<void(const boost::system::error_code &, size_t)> handler)
+void MavlinkUDP::WriteDone::deallocate(void *pointer)
 {
-  socket_.async_send_to(buffer, remote_endpoint_, handler);
+  if (pointer == udp->write_done_storage_)
+    udp->write_done_storage_used_ = false;
+  else
+    ::operator delete(pointer);
 }
+#endif
 
 } // namespace mavrosflight
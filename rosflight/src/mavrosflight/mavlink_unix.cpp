@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file mavlink_unix.cpp
+ */
+
+#include <rosflight/mavrosflight/mavlink_unix.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+using boost::asio::local::stream_protocol;
+
+namespace mavrosflight
+{
+MavlinkUnix::MavlinkUnix(std::string path) : MavlinkComm(), socket_(io_service_), path_(path) {}
+
+MavlinkUnix::~MavlinkUnix()
+{
+  do_close();
+}
+
+bool MavlinkUnix::is_open()
+{
+  return socket_.is_open();
+}
+
+void MavlinkUnix::do_open()
+{
+  try
+  {
+    socket_.connect(stream_protocol::endpoint(path_));
+  }
+  catch (const boost::system::system_error &e)
+  {
+    socket_.close();
+    throw SerialException(e);
+  }
+}
+
+void MavlinkUnix::do_close()
+{
+  socket_.close();
+}
+
+void MavlinkUnix::do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
+{
+  socket_.async_read_some(buffer, handler);
+}
+
+void MavlinkUnix::do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+{
+  socket_.async_write_some(buffers, handler);
+}
+
+} // namespace mavrosflight
+
+#endif // BOOST_ASIO_HAS_LOCAL_SOCKETS
@@ -79,15 +79,12 @@ double Param::getValue() const
 
 void Param::requestSet(double value, mavlink_message_t *msg)
 {
-  if (value != value_)
-  {
-    new_value_ = getCastValue(value);
-    expected_raw_value_ = getRawValue(new_value_);
+  new_value_ = getCastValue(value);
+  expected_raw_value_ = getRawValue(new_value_);
 
-    mavlink_msg_param_set_pack(1, 50, msg, 1, MAV_COMP_ID_ALL, name_.c_str(), expected_raw_value_, type_);
+  mavlink_msg_param_set_pack(1, 50, msg, 1, MAV_COMP_ID_ALL, name_.c_str(), expected_raw_value_, type_);
 
-    set_in_progress_ = true;
-  }
+  set_in_progress_ = true;
 }
 
 bool Param::handleUpdate(const mavlink_param_value_t &msg)
@@ -98,10 +95,10 @@ bool Param::handleUpdate(const mavlink_param_value_t &msg)
   if (msg.param_type != type_)
     return false;
 
-  if (set_in_progress_ && msg.param_value == expected_raw_value_)
+  if (set_in_progress_ && sameRawValue(msg.param_value, expected_raw_value_))
     set_in_progress_ = false;
 
-  if (msg.param_value != getRawValue())
+  if (!sameRawValue(msg.param_value, getRawValue()))
   {
     setFromRawValue(msg.param_value);
     return true;
@@ -184,6 +181,11 @@ float Param::getRawValue(double value)
   return raw_value;
 }
 
+bool Param::sameRawValue(float a, float b)
+{
+  return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
 double Param::getCastValue(double value)
 {
   double cast_value;
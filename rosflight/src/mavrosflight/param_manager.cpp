@@ -34,6 +34,9 @@
  * \author Daniel Koch <daniel.koch@byu.edu>
  */
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <functional>
 
@@ -44,6 +47,68 @@
 
 namespace mavrosflight
 {
+namespace
+{
+/**
+ * \brief Time to wait for an answer to a request that has been sent the given number of times
+ */
+std::chrono::milliseconds retry_timeout(std::chrono::milliseconds timeout, int attempts)
+{
+  const std::chrono::milliseconds max_timeout(PARAM_REQUEST_MAX_TIMEOUT_MS);
+  for (int i = 1; i < attempts && timeout < max_timeout; i++)
+  {
+    timeout *= 2;
+  }
+  return std::min(timeout, max_timeout);
+}
+
+/**
+ * \brief FNV-1a hash of a parameter ID padded with zeros to its full length
+ */
+size_t hash_param_id(const char *id)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN; i++)
+  {
+    hash ^= static_cast<uint8_t>(id[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * \brief FNV-1a hash of the name, index, type and raw value of every parameter in index order, as a hex string
+ */
+std::string hash_params(std::vector<Param> &params)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const void *data, size_t len) {
+    for (size_t i = 0; i < len; i++)
+    {
+      hash ^= static_cast<const uint8_t *>(data)[i];
+      hash *= 1099511628211ULL;
+    }
+  };
+
+  for (size_t i = 0; i < params.size(); i++)
+  {
+    std::string name = params[i].getName();
+    int32_t index = params[i].getIndex();
+    int32_t type = params[i].getType();
+    float raw_value = params[i].getRawValue(params[i].getValue());
+    add(name.c_str(), name.size() + 1);
+    add(&index, sizeof(index));
+    add(&type, sizeof(type));
+    add(&raw_value, sizeof(raw_value));
+  }
+
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+  return hex;
+}
+
+} // namespace
+
 template <typename DerivedLogger>
 ParamManager<DerivedLogger>::ParamManager(MavlinkComm *const comm,
                                           LoggerInterface<DerivedLogger> &logger,
@@ -54,25 +119,40 @@ ParamManager<DerivedLogger>::ParamManager(MavlinkComm *const comm,
   first_param_received_(false),
   received_count_(0),
   got_all_params_(false),
+  download_in_progress_(false),
+  list_streaming_(false),
+  download_window_(PARAM_DOWNLOAD_WINDOW),
+  request_timeout_(PARAM_REQUEST_TIMEOUT_MS),
+  next_request_index_(0),
+  list_attempts_(0),
+  requests_sent_(0),
+  retries_(0),
+  answered_requests_(0),
+  latency_total_(0),
+  latency_max_(0),
+  waiting_for_version_(false),
+  loaded_from_cache_(false),
+  verifying_cache_(false),
+  verified_count_(0),
+  cache_stale_(false),
   param_set_in_progress_(false),
+  sets_confirmed_(0),
+  sets_failed_(0),
+  set_retries_(0),
+  set_latency_total_(0),
+  set_latency_max_(0),
   logger_(logger),
   timer_provider_(timer_provider)
 {
-  comm_->register_mavlink_listener(this);
+  comm_->register_mavlink_listener(this, {MAVLINK_MSG_ID_PARAM_VALUE, MAVLINK_MSG_ID_ROSFLIGHT_CMD_ACK});
 
   std::function<void()> bound_callback = std::bind(&ParamManager<DerivedLogger>::param_set_timer_callback, this);
   param_set_timer_ =
       timer_provider_.create_timer(std::chrono::milliseconds(10), bound_callback, false, /* not oneshot */
                                    false /* not autostart */);
-}
 
-template <typename DerivedLogger>
-ParamManager<DerivedLogger>::~ParamManager()
-{
-  if (first_param_received_)
-  {
-    delete[] received_;
-  }
+  std::function<void()> download_callback = std::bind(&ParamManager<DerivedLogger>::download_timer_callback, this);
+  download_timer_ = timer_provider_.create_timer(std::chrono::milliseconds(10), download_callback, false, false);
 }
 
 template <typename DerivedLogger>
@@ -96,11 +176,13 @@ bool ParamManager<DerivedLogger>::unsaved_changes()
 }
 
 template <typename DerivedLogger>
-bool ParamManager<DerivedLogger>::get_param_value(std::string name, double *value)
+bool ParamManager<DerivedLogger>::get_param_value(const std::string &name, double *value)
 {
-  if (is_param_id(name))
+  std::lock_guard<std::mutex> lock(download_mutex_);
+  int index = find_param(name);
+  if (index >= 0)
   {
-    *value = params_[name].getValue();
+    *value = params_[index].getValue();
     return true;
   }
   else
@@ -111,26 +193,81 @@ bool ParamManager<DerivedLogger>::get_param_value(std::string name, double *valu
 }
 
 template <typename DerivedLogger>
-bool ParamManager<DerivedLogger>::set_param_value(std::string name, double value)
+bool ParamManager<DerivedLogger>::set_param_value(const std::string &name, double value, SetCallback callback)
 {
-  if (is_param_id(name))
   {
-    mavlink_message_t msg;
-    params_[name].requestSet(value, &msg);
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    int index = find_param(name);
+    if (index < 0)
+      return false;
 
-    param_set_queue_.push_back(msg);
-    if (!param_set_in_progress_)
+    // compare against any pending set too, so that a set undoing one that has not been applied yet is still sent
+    double cast_value = params_[index].getCastValue(value);
+    std::lock_guard<std::mutex> set_lock(set_mutex_);
+    if (!value_verified(index) || cast_value != target_value(index))
     {
-      param_set_timer_->start();
-      param_set_in_progress_ = true;
+      mavlink_message_t msg;
+      params_[index].requestSet(cast_value, &msg);
+
+      std::shared_ptr<SetBatch> batch = std::make_shared<SetBatch>();
+      batch->remaining = 0;
+      batch->confirmed = 0;
+      batch->failed = 0;
+      batch->callback = callback;
+      queue_param_set(name, cast_value, msg, batch);
+      return true;
     }
+  }
 
-    return true;
+  // the flight controller already holds this value, or is about to
+  if (callback)
+    callback(1, 0);
+  return true;
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::set_param_values(const std::vector<std::string> &names,
+                                                   const std::vector<double> &values,
+                                                   bool all_or_nothing,
+                                                   const SetManyCallback &callback)
+{
+  std::shared_ptr<SetManyResult> result = std::make_shared<SetManyResult>();
+  result->exists.assign(names.size(), false);
+  result->confirmed.assign(names.size(), false);
+  result->rolled_back = false;
+  result->success = false;
+
+  std::vector<double> previous(names.size(), 0.0);
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    result->exists[i] = get_param_value(names[i], &previous[i]);
   }
-  else
+  if (all_or_nothing && std::find(result->exists.begin(), result->exists.end(), false) != result->exists.end())
   {
-    return false;
+    callback(*result);
+    return;
   }
+
+  set_param_group(names, values, [this, names, previous, all_or_nothing, result, callback](
+                                     const std::vector<bool> &exists, const std::vector<bool> &confirmed) {
+    result->exists = exists;
+    result->confirmed = confirmed;
+    result->success = std::find(exists.begin(), exists.end(), false) == exists.end()
+                      && std::find(confirmed.begin(), confirmed.end(), false) == confirmed.end();
+    if (result->success || !all_or_nothing)
+    {
+      callback(*result);
+      return;
+    }
+
+    set_param_group(names, previous, [this, result, callback](const std::vector<bool> &,
+                                                              const std::vector<bool> &restored) {
+      result->rolled_back = std::find(restored.begin(), restored.end(), false) == restored.end();
+      if (!result->rolled_back)
+        logger_.error("Failed to restore the previous parameter values after a failed set");
+      callback(*result);
+    });
+  });
 }
 
 template <typename DerivedLogger>
@@ -195,15 +332,26 @@ bool ParamManager<DerivedLogger>::save_to_file(std::string filename)
   // build YAML document
   YAML::Emitter yaml;
   yaml << YAML::BeginSeq;
-  std::map<std::string, Param>::iterator it;
-  for (it = params_.begin(); it != params_.end(); it++)
   {
-    yaml << YAML::Flow;
-    yaml << YAML::BeginMap;
-    yaml << YAML::Key << "name" << YAML::Value << it->second.getName();
-    yaml << YAML::Key << "type" << YAML::Value << (int)it->second.getType();
-    yaml << YAML::Key << "value" << YAML::Value << it->second.getValue();
-    yaml << YAML::EndMap;
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    if (verifying_cache_)
+    {
+      logger_.warn("Parameters loaded from the cache are still being checked, try again once they are verified");
+      return false;
+    }
+
+    for (size_t i = 0; i < params_.size(); i++)
+    {
+      if (params_[i].getIndex() < 0)
+        continue;
+
+      yaml << YAML::Flow;
+      yaml << YAML::BeginMap;
+      yaml << YAML::Key << "name" << YAML::Value << params_[i].getName();
+      yaml << YAML::Key << "type" << YAML::Value << (int)params_[i].getType();
+      yaml << YAML::Key << "value" << YAML::Value << params_[i].getValue();
+      yaml << YAML::EndMap;
+    }
   }
   yaml << YAML::EndSeq;
 
@@ -224,53 +372,406 @@ bool ParamManager<DerivedLogger>::save_to_file(std::string filename)
 }
 
 template <typename DerivedLogger>
-bool ParamManager<DerivedLogger>::load_from_file(std::string filename)
+bool ParamManager<DerivedLogger>::load_from_file(std::string filename,
+                                                 SetCallback callback,
+                                                 std::vector<ParamChange> *changes)
 {
+  YAML::Node root;
   try
   {
-    YAML::Node root = YAML::LoadFile(filename);
-    assert(root.IsSequence());
+    root = YAML::LoadFile(filename);
+  }
+  catch (...)
+  {
+    return false;
+  }
+
+  // the batch holds an extra reference while it is filled so that it cannot complete early
+  std::shared_ptr<SetBatch> batch = std::make_shared<SetBatch>();
+  batch->remaining = 1;
+  batch->confirmed = 0;
+  batch->failed = 0;
+  batch->callback = callback;
+
+  {
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    std::lock_guard<std::mutex> set_lock(set_mutex_);
 
-    for (int i = 0; i < root.size(); i++)
+    // read the whole file first, so that a parse error leaves nothing half-sent
+    std::vector<std::pair<int, double>> values;
+    size_t skipped = 0;
+    try
     {
-      if (root[i].IsMap() && root[i]["name"] && root[i]["type"] && root[i]["value"])
+      assert(root.IsSequence());
+
+      for (int i = 0; i < root.size(); i++)
       {
-        if (is_param_id(root[i]["name"].as<std::string>()))
+        if (root[i].IsMap() && root[i]["name"] && root[i]["type"] && root[i]["value"])
         {
-          Param param = params_.find(root[i]["name"].as<std::string>())->second;
-          if ((MAV_PARAM_TYPE)root[i]["type"].as<int>() == param.getType())
+          int index = find_param(root[i]["name"].as<std::string>());
+          if (index < 0 || (MAV_PARAM_TYPE)root[i]["type"].as<int>() != params_[index].getType())
           {
-            set_param_value(root[i]["name"].as<std::string>(), root[i]["value"].as<double>());
+            skipped++;
+            continue;
           }
+
+          // a value that matches once converted to the parameter type would not change anything, but a value from a
+          // cache that is still being checked may not be what the flight controller holds, so it is always sent
+          double value = params_[index].getCastValue(root[i]["value"].as<double>());
+          if (!value_verified(index) || value != target_value(index))
+            values.push_back(std::make_pair(index, value));
         }
       }
     }
+    catch (...)
+    {
+      return false;
+    }
 
-    return true;
+    if (skipped > 0)
+      logger_.warn("Skipped %d entries in %s that do not match a parameter", (int)skipped, filename.c_str());
+    if (changes != nullptr)
+    {
+      changes->clear();
+      for (size_t i = 0; i < values.size(); i++)
+      {
+        ParamChange change;
+        change.name = params_[values[i].first].getName();
+        change.old_value = target_value(values[i].first);
+        change.new_value = values[i].second;
+        changes->push_back(change);
+      }
+    }
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+      Param &param = params_[values[i].first];
+      mavlink_message_t msg;
+      param.requestSet(values[i].second, &msg);
+      queue_param_set(param.getName(), values[i].second, msg, batch);
+    }
   }
-  catch (...)
+
+  std::vector<std::function<void()>> callbacks;
   {
-    return false;
+    std::lock_guard<std::mutex> lock(set_mutex_);
+    release_set_batch(batch, &callbacks);
   }
+  for (size_t i = 0; i < callbacks.size(); i++) callbacks[i]();
+
+  return true;
 }
 
 template <typename DerivedLogger>
 void ParamManager<DerivedLogger>::request_params()
 {
-  if (!first_param_received_)
+  bool loaded = false;
+  {
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    if (got_all_params_ || download_in_progress_)
+      return;
+
+    Clock::time_point now = Clock::now();
+    download_in_progress_ = true;
+    download_start_ = now;
+    requests_sent_ = 0;
+    retries_ = 0;
+    answered_requests_ = 0;
+    latency_total_ = std::chrono::nanoseconds(0);
+    latency_max_ = std::chrono::nanoseconds(0);
+
+    if (!cache_file_.empty() && !first_param_received_ && firmware_version_.empty())
+    {
+      // the cache is keyed by firmware version, so hold the download until the version is known
+      waiting_for_version_ = true;
+      version_deadline_ = now + std::chrono::milliseconds(PARAM_CACHE_VERSION_TIMEOUT_MS);
+    }
+    else if (!cache_file_.empty() && !first_param_received_ && load_cache(now))
+    {
+      loaded = true;
+    }
+    else
+    {
+      start_download(now);
+    }
+
+    download_timer_->start();
+  }
+
+  if (loaded)
+    notify_cached_params();
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::start_download(Clock::time_point now)
+{
+  last_value_time_ = now;
+  in_flight_.clear();
+
+  if (!first_param_received_ || verifying_cache_)
   {
+    // the flight controller answers the list request by streaming every parameter
+    list_streaming_ = true;
+    list_attempts_ = 1;
+    list_deadline_ = now + retry_timeout(request_timeout_, list_attempts_);
     request_param_list();
   }
   else
   {
-    for (size_t i = 0; i < num_params_; i++)
+    list_streaming_ = false;
+    fill_download_window(now);
+  }
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::discard_params()
+{
+  reset_params(0);
+  first_param_received_ = false;
+  received_count_ = 0;
+  got_all_params_ = false;
+  loaded_from_cache_ = false;
+  verifying_cache_ = false;
+  verified_.clear();
+  verified_count_ = 0;
+  cache_stale_ = false;
+  in_flight_.clear();
+  next_request_index_ = 0;
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::set_cache_file(std::string filename)
+{
+  std::lock_guard<std::mutex> lock(download_mutex_);
+  cache_file_ = filename;
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::set_firmware_version(std::string version)
+{
+  bool loaded = false;
+  bool save = false;
+  {
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    if (version == firmware_version_)
+      return;
+    firmware_version_ = version;
+
+    if (waiting_for_version_)
     {
-      if (!received_[i])
-      {
-        request_param(i);
-      }
+      Clock::time_point now = Clock::now();
+      waiting_for_version_ = false;
+      loaded = load_cache(now);
+      if (!loaded)
+        start_download(now);
+    }
+    else if (got_all_params_ && !loaded_from_cache_ && !cache_file_.empty())
+    {
+      // the download finished before the version arrived
+      save = true;
+    }
+  }
+
+  if (loaded)
+    notify_cached_params();
+  if (save)
+    save_cache();
+}
+
+template <typename DerivedLogger>
+bool ParamManager<DerivedLogger>::load_cache(Clock::time_point now)
+{
+  if (cache_file_.empty() || firmware_version_.empty() || first_param_received_)
+    return false;
+
+  std::vector<Param> params;
+  size_t count;
+  try
+  {
+    YAML::Node root = YAML::LoadFile(cache_file_);
+    if (!root.IsMap() || root["firmware_version"].as<std::string>() != firmware_version_)
+    {
+      logger_.info("Parameter cache %s is for different firmware", cache_file_.c_str());
+      return false;
     }
+
+    YAML::Node list = root["params"];
+    count = root["param_count"].as<size_t>();
+    if (!list.IsSequence() || count == 0 || list.size() != count)
+      return false;
+
+    params.resize(count);
+    for (size_t i = 0; i < list.size(); i++)
+    {
+      std::string name = list[i]["name"].as<std::string>();
+      int index = list[i]["index"].as<int>();
+      MAV_PARAM_TYPE type = (MAV_PARAM_TYPE)list[i]["type"].as<int>();
+      if (index < 0 || index >= count || params[index].getIndex() >= 0)
+        return false;
+
+      Param param(name, index, type, 0.0f);
+      params[index] = Param(name, index, type, param.getRawValue(list[i]["value"].as<double>()));
+    }
+
+    // the hash only catches a damaged file; whether the table still matches the flight controller is checked below
+    if (hash_params(params) != root["hash"].as<std::string>())
+    {
+      logger_.warn("Parameter cache %s is corrupt", cache_file_.c_str());
+      return false;
+    }
+  }
+  catch (...)
+  {
+    return false;
+  }
+
+  first_param_received_ = true;
+  num_params_ = count;
+  reset_params(num_params_);
+  for (size_t i = 0; i < num_params_; i++)
+  {
+    add_param(params[i]);
   }
+  received_count_ = num_params_;
+  got_all_params_ = true;
+  loaded_from_cache_ = true;
+  download_end_ = now;
+
+  // the same firmware can hold different values (another board, or a reset EEPROM), so the whole table is downloaded
+  // again in the background and every parameter checked against the cache
+  verifying_cache_ = true;
+  cache_stale_ = false;
+  verified_.assign(num_params_, false);
+  verified_count_ = 0;
+  start_download(now);
+
+  logger_.info("Loaded %d parameters from cache %s", (int)num_params_, cache_file_.c_str());
+  return true;
+}
+
+template <typename DerivedLogger>
+bool ParamManager<DerivedLogger>::save_cache()
+{
+  std::string filename;
+  YAML::Emitter yaml;
+  {
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    if (!got_all_params_ || verifying_cache_ || cache_file_.empty() || firmware_version_.empty())
+      return false;
+    filename = cache_file_;
+
+    yaml << YAML::BeginMap;
+    yaml << YAML::Key << "firmware_version" << YAML::Value << firmware_version_;
+    yaml << YAML::Key << "param_count" << YAML::Value << params_.size();
+    yaml << YAML::Key << "hash" << YAML::Value << hash_params(params_);
+    yaml << YAML::Key << "params" << YAML::Value << YAML::BeginSeq;
+    for (size_t i = 0; i < params_.size(); i++)
+    {
+      yaml << YAML::Flow;
+      yaml << YAML::BeginMap;
+      yaml << YAML::Key << "name" << YAML::Value << params_[i].getName();
+      yaml << YAML::Key << "index" << YAML::Value << params_[i].getIndex();
+      yaml << YAML::Key << "type" << YAML::Value << (int)params_[i].getType();
+      yaml << YAML::Key << "value" << YAML::Value << params_[i].getValue();
+      yaml << YAML::EndMap;
+    }
+    yaml << YAML::EndSeq;
+    yaml << YAML::EndMap;
+  }
+
+  // write a temporary file and rename it into place, so an interrupted write cannot leave a truncated cache
+  std::string temp_filename = filename + ".tmp";
+  std::ofstream fout(temp_filename.c_str());
+  fout << yaml.c_str();
+  fout.close();
+  if (!fout || std::rename(temp_filename.c_str(), filename.c_str()) != 0)
+  {
+    logger_.warn("Failed to write parameter cache %s", filename.c_str());
+    std::remove(temp_filename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::notify_cached_params()
+{
+  std::vector<Param> params;
+  {
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    params = params_;
+  }
+
+  for (size_t index = 0; index < params.size(); index++)
+  {
+    for (int i = 0; i < listeners_.size(); i++)
+      listeners_[i]->on_new_param_received(params[index].getName(), params[index].getValue());
+  }
+}
+
+template <typename DerivedLogger>
+bool ParamManager<DerivedLogger>::verify_cached_param(const mavlink_param_value_t &param, int index)
+{
+  if (index < 0 || param.param_count != num_params_ || index != param.param_index
+      || params_[index].getType() != param.param_type)
+    return false;
+
+  Clock::time_point now = Clock::now();
+  last_value_time_ = now;
+  if (!verified_[index])
+  {
+    verified_[index] = true;
+    verified_count_++;
+  }
+
+  for (size_t i = 0; i < in_flight_.size(); i++)
+  {
+    if (in_flight_[i].index == index)
+    {
+      std::chrono::nanoseconds latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - in_flight_[i].sent);
+      latency_total_ += latency;
+      latency_max_ = std::max(latency_max_, latency);
+      answered_requests_++;
+      in_flight_.erase(in_flight_.begin() + i);
+      break;
+    }
+  }
+
+  if (download_in_progress_ && !list_streaming_)
+    fill_download_window(now);
+  return true;
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::set_download_window(size_t window, std::chrono::milliseconds timeout)
+{
+  std::lock_guard<std::mutex> lock(download_mutex_);
+  download_window_ = std::max<size_t>(window, 1);
+  request_timeout_ = std::max(timeout, std::chrono::milliseconds(1));
+}
+
+template <typename DerivedLogger>
+typename ParamManager<DerivedLogger>::DownloadStats ParamManager<DerivedLogger>::get_download_stats()
+{
+  std::lock_guard<std::mutex> lock(download_mutex_);
+
+  DownloadStats stats;
+  stats.received = received_count_;
+  stats.total = first_param_received_ ? num_params_ : 0;
+  stats.complete = got_all_params_;
+  stats.from_cache = loaded_from_cache_;
+  stats.verifying = verifying_cache_;
+  stats.elapsed = std::chrono::nanoseconds(0);
+  if (got_all_params_ && download_end_ > download_start_)
+    stats.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(download_end_ - download_start_);
+  else if (download_in_progress_)
+    stats.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - download_start_);
+  stats.requests = requests_sent_;
+  stats.retries = retries_;
+  stats.latency = answered_requests_ > 0 ? latency_total_ / int64_t(answered_requests_) : std::chrono::nanoseconds(0);
+  stats.latency_max = latency_max_;
+  return stats;
 }
 
 template <typename DerivedLogger>
@@ -291,22 +792,104 @@ void ParamManager<DerivedLogger>::request_param(int index)
 }
 
 template <typename DerivedLogger>
-void ParamManager<DerivedLogger>::handle_param_value_msg(const mavlink_message_t &msg)
+void ParamManager<DerivedLogger>::fill_download_window(Clock::time_point now)
 {
-  mavlink_param_value_t param;
-  mavlink_msg_param_value_decode(&msg, &param);
-
   if (!first_param_received_)
+    return;
+
+  for (size_t checked = 0; checked < num_params_ && in_flight_.size() < download_window_; checked++)
+  {
+    size_t index = next_request_index_;
+    next_request_index_ = (next_request_index_ + 1) % num_params_;
+
+    if (verifying_cache_ ? verified_[index] : received_[index])
+      continue;
+    if (std::find_if(in_flight_.begin(), in_flight_.end(),
+                     [index](const PendingRequest &request) { return request.index == index; })
+        != in_flight_.end())
+      continue;
+
+    PendingRequest request;
+    request.index = index;
+    request.sent = now;
+    request.attempts = 1;
+    request.deadline = now + retry_timeout(request_timeout_, request.attempts);
+    in_flight_.push_back(request);
+
+    request_param(index);
+    requests_sent_++;
+  }
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::download_timer_callback()
+{
+  std::lock_guard<std::mutex> lock(download_mutex_);
+  if (!download_in_progress_)
+    return;
+
+  if (got_all_params_ && !verifying_cache_ && in_flight_.empty())
+  {
+    download_timer_->stop();
+    download_in_progress_ = false;
+    return;
+  }
+
+  Clock::time_point now = Clock::now();
+  if (waiting_for_version_)
   {
-    first_param_received_ = true;
-    num_params_ = param.param_count;
-    received_ = new bool[num_params_];
-    for (int i = 0; i < num_params_; i++)
+    if (now < version_deadline_)
+      return;
+
+    logger_.warn("No firmware version received, downloading parameters without the cache");
+    waiting_for_version_ = false;
+    start_download(now);
+    return;
+  }
+
+  if (list_streaming_)
+  {
+    if (!first_param_received_)
     {
-      received_[i] = false;
+      // nothing has arrived, so the list request or the start of its answer was lost
+      if (now >= list_deadline_)
+      {
+        list_attempts_++;
+        list_deadline_ = now + retry_timeout(request_timeout_, list_attempts_);
+        request_param_list();
+      }
+      return;
     }
+
+    // once the stream goes quiet, request whatever it missed individually
+    if (now - last_value_time_ < request_timeout_)
+      return;
+    list_streaming_ = false;
   }
 
+  for (size_t i = 0; i < in_flight_.size(); i++)
+  {
+    PendingRequest &request = in_flight_[i];
+    if (now >= request.deadline)
+    {
+      request.attempts++;
+      request.sent = now;
+      request.deadline = now + retry_timeout(request_timeout_, request.attempts);
+      request_param(request.index);
+      requests_sent_++;
+      retries_++;
+    }
+  }
+
+  fill_download_window(now);
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::handle_param_value_msg(const mavlink_message_t &msg)
+{
+  mavlink_param_value_t param;
+  mavlink_msg_param_value_decode(&msg, &param);
+
   // ensure null termination of name
   char c_name[MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN + 1];
   memcpy(c_name, param.param_id, MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN);
@@ -314,28 +897,122 @@ void ParamManager<DerivedLogger>::handle_param_value_msg(const mavlink_message_t
 
   std::string name(c_name);
 
-  if (!is_param_id(name)) // if we haven't received this param before, add it
+  bool is_new = false;
+  bool updated = false;
+  bool completed = false;
+  bool checked = false; // the message checked a parameter loaded from the cache
+  bool verified = false;
+  bool stale = false;
+  double value;
   {
-    params_[name] = Param(param);
-    received_[param.param_index] = true;
+    std::lock_guard<std::mutex> lock(download_mutex_);
+    if (!first_param_received_)
+    {
+      first_param_received_ = true;
+      num_params_ = param.param_count;
+      reset_params(num_params_);
+    }
 
-    // increase the param count
-    received_count_++;
-    if (received_count_ == num_params_)
+    int index = find_param(name);
+    if (verifying_cache_ && (index < 0 || !verified_[index]))
     {
-      got_all_params_ = true;
+      if (!verify_cached_param(param, index))
+      {
+        // start again from nothing; the list stream resends this parameter along with everything else
+        logger_.warn("Parameter cache is out of date, downloading all parameters");
+        discard_params();
+        start_download(Clock::now());
+        return;
+      }
+      checked = true;
     }
 
-    for (int i = 0; i < listeners_.size(); i++) listeners_[i]->on_new_param_received(name, params_[name].getValue());
+    if (index < 0) // if we haven't received this param before, add it
+    {
+      // the table is sized by the param count of the first message, and each index holds a single parameter
+      if (param.param_index >= num_params_ || received_[param.param_index])
+        return;
+
+      Clock::time_point now = Clock::now();
+      index = param.param_index;
+      add_param(Param(param));
+      last_value_time_ = now;
+      is_new = true;
+
+      // increase the param count
+      received_count_++;
+      if (received_count_ == num_params_)
+      {
+        got_all_params_ = true;
+        download_end_ = now;
+        completed = true;
+      }
+
+      for (size_t i = 0; i < in_flight_.size(); i++)
+      {
+        if (in_flight_[i].index == param.param_index)
+        {
+          std::chrono::nanoseconds latency =
+              std::chrono::duration_cast<std::chrono::nanoseconds>(now - in_flight_[i].sent);
+          latency_total_ += latency;
+          latency_max_ = std::max(latency_max_, latency);
+          answered_requests_++;
+          in_flight_.erase(in_flight_.begin() + i);
+          break;
+        }
+      }
+
+      // keep the window full rather than waiting for the next timer tick
+      if (download_in_progress_ && !list_streaming_ && !got_all_params_)
+        fill_download_window(now);
+    }
+    else // otherwise check if we have new unsaved changes as a result of a param set request
+    {
+      updated = params_[index].handleUpdate(param);
+      if (updated && checked)
+        cache_stale_ = true; // the cached value was wrong, not changed since the last write
+      else if (updated)
+        unsaved_changes_ = true;
+    }
+    value = params_[index].getValue();
+
+    if (checked && verified_count_ == num_params_)
+    {
+      verifying_cache_ = false;
+      verified = true;
+      stale = cache_stale_;
+    }
   }
-  else // otherwise check if we have new unsaved changes as a result of a param set request
+
+  if (verified)
   {
-    if (params_[name].handleUpdate(param))
+    if (stale)
+    {
+      logger_.warn("Parameter cache held out-of-date values, which have been replaced");
+      save_cache();
+    }
+    else
+    {
+      logger_.info("Parameter cache verified");
+    }
+  }
+
+  if (is_new)
+  {
+    if (completed)
+      save_cache();
+
+    for (int i = 0; i < listeners_.size(); i++) listeners_[i]->on_new_param_received(name, value);
+  }
+  else
+  {
+    confirm_param_set(name, param.param_value);
+
+    if (updated)
     {
-      unsaved_changes_ = true;
       for (int i = 0; i < listeners_.size(); i++)
       {
-        listeners_[i]->on_param_value_updated(name, params_[name].getValue());
+        listeners_[i]->on_param_value_updated(name, value);
         listeners_[i]->on_params_saved_change(unsaved_changes_);
       }
     }
@@ -357,6 +1034,7 @@ void ParamManager<DerivedLogger>::handle_command_ack_msg(const mavlink_message_t
       {
         logger_.info("Param write succeeded");
         unsaved_changes_ = false;
+        save_cache();
 
         for (int i = 0; i < listeners_.size(); i++) listeners_[i]->on_params_saved_change(unsaved_changes_);
       }
@@ -371,14 +1049,67 @@ void ParamManager<DerivedLogger>::handle_command_ack_msg(const mavlink_message_t
 }
 
 template <typename DerivedLogger>
-bool ParamManager<DerivedLogger>::is_param_id(std::string name)
+void ParamManager<DerivedLogger>::reset_params(size_t count)
+{
+  params_.assign(count, Param());
+  received_.assign(count, false);
+
+  size_t slots = count > 0 ? 8 : 0;
+  while (slots < 2 * count)
+  {
+    slots *= 2;
+  }
+  ParamSlot empty;
+  memset(empty.id, 0, sizeof(empty.id));
+  empty.index = -1;
+  param_slots_.assign(slots, empty);
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::add_param(const Param &param)
 {
-  return (params_.find(name) != params_.end());
+  size_t index = param.getIndex();
+  params_[index] = param;
+  received_[index] = true;
+
+  std::string name = param.getName();
+  char id[MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN] = {0};
+  memcpy(id, name.data(), std::min<size_t>(name.size(), sizeof(id)));
+
+  size_t mask = param_slots_.size() - 1;
+  for (size_t slot = hash_param_id(id) & mask;; slot = (slot + 1) & mask)
+  {
+    if (param_slots_[slot].index < 0 || memcmp(param_slots_[slot].id, id, sizeof(id)) == 0)
+    {
+      memcpy(param_slots_[slot].id, id, sizeof(id));
+      param_slots_[slot].index = index;
+      return;
+    }
+  }
+}
+
+template <typename DerivedLogger>
+int ParamManager<DerivedLogger>::find_param(const std::string &name) const
+{
+  if (param_slots_.empty() || name.size() > MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN)
+    return -1;
+
+  char id[MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN] = {0};
+  memcpy(id, name.data(), name.size());
+
+  size_t mask = param_slots_.size() - 1;
+  for (size_t slot = hash_param_id(id) & mask; param_slots_[slot].index >= 0; slot = (slot + 1) & mask)
+  {
+    if (memcmp(param_slots_[slot].id, id, sizeof(id)) == 0)
+      return param_slots_[slot].index;
+  }
+  return -1;
 }
 
 template <typename DerivedLogger>
 int ParamManager<DerivedLogger>::get_num_params()
 {
+  std::lock_guard<std::mutex> lock(download_mutex_);
   if (first_param_received_)
   {
     return num_params_;
@@ -392,28 +1123,269 @@ int ParamManager<DerivedLogger>::get_num_params()
 template <typename DerivedLogger>
 int ParamManager<DerivedLogger>::get_params_received()
 {
+  std::lock_guard<std::mutex> lock(download_mutex_);
   return received_count_;
 }
 
 template <typename DerivedLogger>
 bool ParamManager<DerivedLogger>::got_all_params()
 {
+  std::lock_guard<std::mutex> lock(download_mutex_);
   return got_all_params_;
 }
 
 template <typename DerivedLogger>
-void ParamManager<DerivedLogger>::param_set_timer_callback()
+typename ParamManager<DerivedLogger>::SetStats ParamManager<DerivedLogger>::get_set_stats()
 {
-  if (param_set_queue_.empty())
+  std::lock_guard<std::mutex> lock(set_mutex_);
+
+  SetStats stats;
+  stats.pending = param_set_queue_.size() + sets_in_flight_.size();
+  stats.confirmed = sets_confirmed_;
+  stats.failed = sets_failed_;
+  stats.retries = set_retries_;
+  stats.latency = sets_confirmed_ > 0 ? set_latency_total_ / int64_t(sets_confirmed_) : std::chrono::nanoseconds(0);
+  stats.latency_max = set_latency_max_;
+  return stats;
+}
+
+template <typename DerivedLogger>
+std::map<std::string, typename ParamManager<DerivedLogger>::ParamSetLatency>
+ParamManager<DerivedLogger>::get_set_latencies()
+{
+  std::lock_guard<std::mutex> lock(set_mutex_);
+  return set_latencies_;
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::queue_param_set(const std::string &name,
+                                                  double value,
+                                                  const mavlink_message_t &msg,
+                                                  const std::shared_ptr<SetBatch> &batch)
+{
+  mavlink_param_set_t set_msg;
+  mavlink_msg_param_set_decode(&msg, &set_msg);
+
+  PendingSet set;
+  set.name = name;
+  set.msg = msg;
+  set.value = value;
+  set.raw_value = set_msg.param_value;
+  set.attempts = 0;
+  set.batch = batch;
+
+  batch->remaining++;
+  param_set_queue_.push_back(set);
+  fill_set_window(Clock::now());
+
+  if (!param_set_in_progress_)
   {
-    param_set_timer_->stop();
-    param_set_in_progress_ = false;
+    param_set_timer_->start();
+    param_set_in_progress_ = true;
+  }
+}
+
+template <typename DerivedLogger>
+bool ParamManager<DerivedLogger>::value_verified(int index) const
+{
+  return !verifying_cache_ || verified_[index];
+}
+
+template <typename DerivedLogger>
+double ParamManager<DerivedLogger>::target_value(int index)
+{
+  // queued sets of a parameter are newer than the one in flight, and the newest is last
+  const std::string name = params_[index].getName();
+  for (typename std::deque<PendingSet>::reverse_iterator it = param_set_queue_.rbegin();
+       it != param_set_queue_.rend(); it++)
+  {
+    if (it->name == name)
+      return it->value;
+  }
+  for (size_t i = 0; i < sets_in_flight_.size(); i++)
+  {
+    if (sets_in_flight_[i].name == name)
+      return sets_in_flight_[i].value;
+  }
+  return params_[index].getValue();
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::fill_set_window(Clock::time_point now)
+{
+  typename std::deque<PendingSet>::iterator it = param_set_queue_.begin();
+  while (it != param_set_queue_.end() && sets_in_flight_.size() < PARAM_SET_WINDOW)
+  {
+    // sets of the same parameter go out in order, one at a time, so each confirmation is unambiguous
+    const std::string &name = it->name;
+    if (std::find_if(sets_in_flight_.begin(), sets_in_flight_.end(),
+                     [&name](const PendingSet &set) { return set.name == name; })
+        != sets_in_flight_.end())
+    {
+      it++;
+      continue;
+    }
+
+    PendingSet set = *it;
+    it = param_set_queue_.erase(it);
+
+    set.attempts = 1;
+    set.first_sent = now;
+    set.deadline = now + retry_timeout(std::chrono::milliseconds(PARAM_REQUEST_TIMEOUT_MS), set.attempts);
+    comm_->send_message(set.msg);
+    sets_in_flight_.push_back(set);
+  }
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::finish_param_set(const PendingSet &set,
+                                                   bool confirmed,
+                                                   std::vector<std::function<void()>> *callbacks)
+{
+  if (confirmed)
+  {
+    sets_confirmed_++;
+    set.batch->confirmed++;
   }
   else
   {
-    comm_->send_message(param_set_queue_.front());
-    param_set_queue_.pop_front();
+    sets_failed_++;
+    set.batch->failed++;
+    logger_.warn("Parameter %s was not confirmed after %d attempts", set.name.c_str(), set.attempts);
+  }
+  release_set_batch(set.batch, callbacks);
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::set_param_group(const std::vector<std::string> &names,
+                                                  const std::vector<double> &values,
+                                                  const SetGroupCallback &callback)
+{
+  struct Group
+  {
+    std::mutex mutex;
+    size_t remaining;
+    std::vector<bool> exists;
+    std::vector<bool> confirmed;
+  };
+
+  // one extra count held until every set has been started, since a set can complete before the next one starts
+  std::shared_ptr<Group> group = std::make_shared<Group>();
+  group->remaining = names.size() + 1;
+  group->exists.assign(names.size(), false);
+  group->confirmed.assign(names.size(), false);
+
+  auto finish = [group, callback](int index, bool confirmed) {
+    {
+      std::lock_guard<std::mutex> lock(group->mutex);
+      if (index >= 0)
+        group->confirmed[index] = confirmed;
+      if (--group->remaining > 0)
+        return;
+    }
+    callback(group->exists, group->confirmed);
+  };
+
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    bool exists = set_param_value(names[i], values[i], [finish, i](size_t confirmed, size_t) {
+      finish(static_cast<int>(i), confirmed > 0);
+    });
+
+    {
+      std::lock_guard<std::mutex> lock(group->mutex);
+      group->exists[i] = exists;
+    }
+    if (!exists)
+      finish(static_cast<int>(i), false);
   }
+  finish(-1, false);
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::release_set_batch(const std::shared_ptr<SetBatch> &batch,
+                                                    std::vector<std::function<void()>> *callbacks)
+{
+  batch->remaining--;
+  if (batch->remaining == 0 && batch->callback)
+    callbacks->push_back(std::bind(batch->callback, batch->confirmed, batch->failed));
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::confirm_param_set(const std::string &name, float raw_value)
+{
+  std::vector<std::function<void()>> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(set_mutex_);
+    for (size_t i = 0; i < sets_in_flight_.size(); i++)
+    {
+      if (sets_in_flight_[i].name == name && Param::sameRawValue(sets_in_flight_[i].raw_value, raw_value))
+      {
+        Clock::time_point now = Clock::now();
+        std::chrono::nanoseconds latency =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - sets_in_flight_[i].first_sent);
+        set_latency_total_ += latency;
+        set_latency_max_ = std::max(set_latency_max_, latency);
+
+        ParamSetLatency &param_latency = set_latencies_[name]; // zeroed the first time
+        param_latency.confirmed++;
+        param_latency.last = latency;
+        param_latency.max = std::max(param_latency.max, latency);
+        param_latency.total += latency;
+        param_latency.last_attempts = sets_in_flight_[i].attempts;
+
+        finish_param_set(sets_in_flight_[i], true, &callbacks);
+        sets_in_flight_.erase(sets_in_flight_.begin() + i);
+        fill_set_window(now);
+        break;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < callbacks.size(); i++) callbacks[i]();
+}
+
+template <typename DerivedLogger>
+void ParamManager<DerivedLogger>::param_set_timer_callback()
+{
+  std::vector<std::function<void()>> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(set_mutex_);
+    if (param_set_queue_.empty() && sets_in_flight_.empty())
+    {
+      param_set_timer_->stop();
+      param_set_in_progress_ = false;
+      return;
+    }
+
+    // send unconfirmed sets again, giving up on those that have used all their attempts
+    Clock::time_point now = Clock::now();
+    for (size_t i = 0; i < sets_in_flight_.size();)
+    {
+      PendingSet &set = sets_in_flight_[i];
+      if (now < set.deadline)
+      {
+        i++;
+      }
+      else if (set.attempts >= PARAM_SET_MAX_ATTEMPTS)
+      {
+        finish_param_set(set, false, &callbacks);
+        sets_in_flight_.erase(sets_in_flight_.begin() + i);
+      }
+      else
+      {
+        set.attempts++;
+        set.deadline = now + retry_timeout(std::chrono::milliseconds(PARAM_REQUEST_TIMEOUT_MS), set.attempts);
+        comm_->send_message(set.msg);
+        set_retries_++;
+        i++;
+      }
+    }
+
+    fill_set_window(now);
+  }
+
+  for (size_t i = 0; i < callbacks.size(); i++) callbacks[i]();
 }
 
 template class ParamManager<DerivedLoggerType>;
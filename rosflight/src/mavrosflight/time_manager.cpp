@@ -33,6 +33,8 @@
  * \file time_manager.cpp
  * \author Daniel Koch <daniel.koch@byu.edu>
  */
+#include <algorithm>
+#include <cmath>
 #include <functional>
 
 #include <rosflight/mavrosflight/interface_adapter.h>
@@ -42,33 +44,80 @@
 
 namespace mavrosflight
 {
+namespace
+{
+// clock filter tuning
+const double MEASUREMENT_STDDEV = 50e-6;   //!< offset measurement noise with a perfectly symmetric link, in seconds
+const double OFFSET_RANDOM_WALK = 1e-12;   //!< offset process noise, in s^2 per second (1 us after 1 s)
+const double SKEW_RANDOM_WALK = 1e-16;     //!< skew process noise, in (s/s)^2 per second
+const double INITIAL_SKEW_STDDEV = 100e-6; //!< typical crystal tolerance
+const double OUTLIER_GATE = 3;             //!< innovations beyond this many standard deviations are rejected
+const int MAX_CONSECUTIVE_REJECTED = 3;    //!< rejections in a row after which the filter is restarted
+
+double seconds(std::chrono::nanoseconds ns)
+{
+  return std::chrono::duration<double>(ns).count();
+}
+
+std::chrono::nanoseconds nanoseconds(double seconds)
+{
+  return std::chrono::nanoseconds(int64_t(std::llround(seconds * 1e9)));
+}
+
+} // namespace
+
 template <typename DerivedLogger>
 TimeManager<DerivedLogger>::TimeManager(MavlinkComm *comm,
                                         LoggerInterface<DerivedLogger> &logger,
                                         const TimeInterface &time_interface,
                                         TimerProviderInterface &timer_provider) :
   comm_(comm),
-  offset_alpha_(0.95),
-  offset_ns_(0),
+  rtt_alpha_(0.95),
+  rtt_ns_(0),
+  rtt_average_ns_(0),
+  rtt_min_ns_(0),
+  selected_rtt_ns_(0),
+  num_samples_(0),
+  next_sample_(0),
+  selected_time_(0),
+  base_offset_(0),
+  reference_time_(0),
+  offset_(0),
+  skew_(0),
+  offset_var_(0),
+  offset_skew_cov_(0),
+  skew_var_(0),
+  consecutive_rejected_(0),
+  rejected_(0),
   initialized_(false),
+  clock_model_(ClockModel()),
   logger_(logger),
   time_interface_(time_interface),
   timer_provider_(timer_provider)
 {
-  comm_->register_mavlink_listener(this);
+  comm_->register_mavlink_frame_listener(this, {MAVLINK_MSG_ID_TIMESYNC});
   std::function<void()> bound_callback = std::bind(&TimeManager<DerivedLogger>::timer_callback, this);
   time_sync_timer_ = timer_provider_.create_timer(std::chrono::milliseconds(100), bound_callback);
 }
 
 template <typename DerivedLogger>
-void TimeManager<DerivedLogger>::handle_mavlink_message(const mavlink_message_t &msg)
+void TimeManager<DerivedLogger>::handle_mavlink_frame(const MavlinkFrame &frame)
 {
   std::chrono::nanoseconds now = time_interface_.now();
 
-  if (msg.msgid == MAVLINK_MSG_ID_TIMESYNC)
+  // take out the time the response spent queued since it arrived, so the round trip is only the link's; the receive
+  // time is from the system clock, so this only works when now is too
+  if (frame.received() != std::chrono::system_clock::time_point() && time_interface_.is_system_clock())
+  {
+    std::chrono::system_clock::duration age = std::chrono::system_clock::now() - frame.received();
+    if (age > std::chrono::system_clock::duration::zero())
+      now -= std::chrono::duration_cast<std::chrono::nanoseconds>(age);
+  }
+
+  if (frame.msgid() == MAVLINK_MSG_ID_TIMESYNC)
   {
     mavlink_timesync_t tsync;
-    mavlink_msg_timesync_decode(&msg, &tsync);
+    frame.decode(&tsync);
 
     std::chrono::nanoseconds tc1_chrono(tsync.tc1);
 
@@ -77,40 +126,242 @@ void TimeManager<DerivedLogger>::handle_mavlink_message(const mavlink_message_t
       std::chrono::nanoseconds ts1_chrono(tsync.ts1);
       std::chrono::nanoseconds offset_ns((ts1_chrono + now - 2 * tc1_chrono) / 2);
 
-      // if difference > 10ms, use it directly
-      if (!initialized_ || (offset_ns_ - offset_ns) > std::chrono::milliseconds(10)
-          || (offset_ns_ - offset_ns) < std::chrono::milliseconds(-10))
-      {
-        offset_ns_ = offset_ns;
-        logger_.info("Detected time offset of %0.3f s.", std::chrono::duration<double>(offset_ns).count());
-        logger_.debug("FCU time: %0.3f, System time: %0.3f", tsync.tc1 * 1e-9, tsync.ts1 * 1e-9);
-        initialized_ = true;
-      }
-      else // otherwise low-pass filter the offset
-      {
-        offset_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(offset_alpha_ * offset_ns
-                                                                          + (1.0 - offset_alpha_) * offset_ns_);
-      }
+      // ts1 is the time the request was sent, echoed back by the FCU
+      int64_t rtt_ns = (now - ts1_chrono).count();
+      rtt_ns_ = rtt_ns;
+      if (rtt_average_ns_ == 0)
+        rtt_average_ns_ = rtt_ns;
+      else
+        rtt_average_ns_ = int64_t(rtt_alpha_ * rtt_average_ns_ + (1.0 - rtt_alpha_) * rtt_ns);
+
+      // the offset is measured at the middle of the exchange
+      Sample sample;
+      sample.time = (ts1_chrono + now) / 2;
+      sample.offset = offset_ns;
+      sample.rtt = now - ts1_chrono;
+      add_sample(sample);
+      logger_.debug("FCU time: %0.3f, System time: %0.3f", tsync.tc1 * 1e-9, tsync.ts1 * 1e-9);
     }
   }
 }
 
 template <typename DerivedLogger>
-std::chrono::nanoseconds TimeManager<DerivedLogger>::fcu_time_to_system_time(std::chrono::nanoseconds fcu_time)
+void TimeManager<DerivedLogger>::add_sample(const Sample &sample)
+{
+  Sample &stored = samples_[next_sample_];
+  stored = sample;
+  stored.outlier = false;
+  next_sample_ = (next_sample_ + 1) % TIMESYNC_SAMPLE_WINDOW;
+  num_samples_ = std::min<size_t>(num_samples_ + 1, TIMESYNC_SAMPLE_WINDOW);
+
+  // every exchange is checked against the model as it arrives, whether or not it has the shortest round trip, so a
+  // jump of the FCU clock is noticed after a few exchanges rather than once the older samples age out of the window
+  if (initialized_ && is_outlier(stored))
+  {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    if (++consecutive_rejected_ < MAX_CONSECUTIVE_REJECTED)
+      return;
+
+    // only the exchanges since the jump describe the clock now
+    logger_.warn("FCU clock jumped by %0.3f s, resetting time synchronization",
+                 seconds(sample.offset - base_offset_) - offset_);
+    // copy out first, since the run may wrap the ring and overlap its own destination
+    size_t count = consecutive_rejected_;
+    Sample recent[TIMESYNC_SAMPLE_WINDOW];
+    for (size_t i = 0; i < count; i++)
+    {
+      recent[i] = samples_[(next_sample_ + TIMESYNC_SAMPLE_WINDOW - count + i) % TIMESYNC_SAMPLE_WINDOW];
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+      samples_[i] = recent[i];
+    }
+    num_samples_ = count;
+    next_sample_ = count % TIMESYNC_SAMPLE_WINDOW;
+    initialized_ = false;
+  }
+  else if (initialized_)
+  {
+    consecutive_rejected_ = 0;
+  }
+
+  // outliers in the window are never the best sample: they are either discarded above when the clock jumped, or far
+  // enough from the model that the filter should not see them
+  const Sample *best = NULL;
+  for (size_t i = 0; i < num_samples_; i++)
+  {
+    if ((best == NULL || samples_[i].rtt < best->rtt) && (!initialized_ || !samples_[i].outlier))
+      best = &samples_[i];
+  }
+  if (best == NULL)
+    return;
+  rtt_min_ns_ = best->rtt.count();
+
+  if (initialized_ && best->time <= selected_time_)
+    return;
+
+  selected_time_ = best->time;
+  selected_rtt_ns_ = best->rtt.count();
+  update_clock_model(best->time, best->offset, best->rtt);
+}
+
+template <typename DerivedLogger>
+bool TimeManager<DerivedLogger>::is_outlier(Sample &sample)
 {
+  // predict the model forward to the time of the sample, without changing it
+  double rtt_s = seconds(sample.rtt);
+  double r = MEASUREMENT_STDDEV * MEASUREMENT_STDDEV + rtt_s * rtt_s / 12;
+  double dt = std::max(0.0, seconds(sample.time - reference_time_));
+  double offset = offset_ + skew_ * dt;
+  double offset_var = offset_var_ + dt * (2 * offset_skew_cov_ + dt * skew_var_) + OFFSET_RANDOM_WALK * dt;
+
+  double innovation = seconds(sample.offset - base_offset_) - offset;
+  sample.outlier = innovation * innovation > OUTLIER_GATE * OUTLIER_GATE * (offset_var + r);
+  return sample.outlier;
+}
+
+template <typename DerivedLogger>
+void TimeManager<DerivedLogger>::update_clock_model(std::chrono::nanoseconds time,
+                                                    std::chrono::nanoseconds offset,
+                                                    std::chrono::nanoseconds rtt)
+{
+  // the link may be asymmetric anywhere within the round trip, so treat the error as uniform over +/- rtt/2
+  double rtt_s = seconds(rtt);
+  double r = MEASUREMENT_STDDEV * MEASUREMENT_STDDEV + rtt_s * rtt_s / 12;
+
   if (!initialized_)
+  {
+    reset_clock_model(time, offset, r);
+    return;
+  }
+
+  // predict forward to the time of the measurement
+  double dt = std::max(0.0, seconds(time - reference_time_));
+  offset_ += skew_ * dt;
+  offset_var_ += dt * (2 * offset_skew_cov_ + dt * skew_var_) + OFFSET_RANDOM_WALK * dt;
+  offset_skew_cov_ += dt * skew_var_;
+  skew_var_ += SKEW_RANDOM_WALK * dt;
+  reference_time_ = time;
+
+  // outliers were already kept out by add_sample
+  double innovation = seconds(offset - base_offset_) - offset_;
+  double s = offset_var_ + r;
+  double offset_gain = offset_var_ / s;
+  double skew_gain = offset_skew_cov_ / s;
+  offset_ += offset_gain * innovation;
+  skew_ += skew_gain * innovation;
+  skew_var_ -= skew_gain * offset_skew_cov_;
+  offset_skew_cov_ -= offset_gain * offset_skew_cov_;
+  offset_var_ -= offset_gain * offset_var_;
+  publish_clock_model();
+}
+
+template <typename DerivedLogger>
+void TimeManager<DerivedLogger>::reset_clock_model(std::chrono::nanoseconds time,
+                                                   std::chrono::nanoseconds offset,
+                                                   double variance)
+{
+  base_offset_ = offset;
+  reference_time_ = time;
+  offset_ = 0;
+  skew_ = 0;
+  offset_var_ = variance;
+  offset_skew_cov_ = 0;
+  skew_var_ = INITIAL_SKEW_STDDEV * INITIAL_SKEW_STDDEV;
+  consecutive_rejected_ = 0;
+  initialized_ = true;
+
+  for (size_t i = 0; i < num_samples_; i++)
+  {
+    samples_[i].outlier = false;
+  }
+
+  publish_clock_model();
+  logger_.info("Detected time offset of %0.3f s.", seconds(offset));
+}
+
+template <typename DerivedLogger>
+void TimeManager<DerivedLogger>::publish_clock_model()
+{
+  ClockModel model;
+  model.valid = initialized_;
+  model.base_offset = base_offset_;
+  model.reference_time = reference_time_;
+  model.offset = offset_;
+  model.skew = skew_;
+  model.offset_stddev = std::sqrt(offset_var_);
+  clock_model_.store(model);
+}
+
+template <typename DerivedLogger>
+std::chrono::nanoseconds TimeManager<DerivedLogger>::fcu_time_to_system_time(std::chrono::nanoseconds fcu_time)
+{
+  ClockModel model = clock_model_.load();
+  if (!model.valid)
     return time_interface_.now();
 
-  std::chrono::nanoseconds ns = fcu_time + offset_ns_;
+  // evaluate the drifting offset at (approximately) the system time being computed
+  std::chrono::nanoseconds offset = model.base_offset + nanoseconds(model.offset);
+  std::chrono::nanoseconds elapsed = fcu_time + offset - model.reference_time;
+  std::chrono::nanoseconds ns = fcu_time + offset + nanoseconds(model.skew * seconds(elapsed));
   if (ns < std::chrono::nanoseconds::zero())
   {
     logger_.error_throttle(1, "negative time calculated from FCU: fcu_time=%ld, offset_ns=%ld.  Using system time",
-                           fcu_time, offset_ns_);
+                           fcu_time, offset);
     return time_interface_.now();
   }
   return ns;
 }
 
+template <typename DerivedLogger>
+std::chrono::nanoseconds TimeManager<DerivedLogger>::get_offset() const
+{
+  ClockModel model = clock_model_.load();
+  return model.base_offset + nanoseconds(model.offset);
+}
+
+template <typename DerivedLogger>
+std::chrono::nanoseconds TimeManager<DerivedLogger>::get_offset_stddev() const
+{
+  return nanoseconds(clock_model_.load().offset_stddev);
+}
+
+template <typename DerivedLogger>
+double TimeManager<DerivedLogger>::get_skew_ppm() const
+{
+  return clock_model_.load().skew * 1e6;
+}
+
+template <typename DerivedLogger>
+uint64_t TimeManager<DerivedLogger>::get_rejected_samples() const
+{
+  return rejected_.load(std::memory_order_relaxed);
+}
+
+template <typename DerivedLogger>
+std::chrono::nanoseconds TimeManager<DerivedLogger>::get_rtt() const
+{
+  return std::chrono::nanoseconds(rtt_ns_);
+}
+
+template <typename DerivedLogger>
+std::chrono::nanoseconds TimeManager<DerivedLogger>::get_rtt_average() const
+{
+  return std::chrono::nanoseconds(rtt_average_ns_);
+}
+
+template <typename DerivedLogger>
+std::chrono::nanoseconds TimeManager<DerivedLogger>::get_rtt_min() const
+{
+  return std::chrono::nanoseconds(rtt_min_ns_);
+}
+
+template <typename DerivedLogger>
+std::chrono::nanoseconds TimeManager<DerivedLogger>::get_selected_rtt() const
+{
+  return std::chrono::nanoseconds(selected_rtt_ns_);
+}
+
 template <typename DerivedLogger>
 void TimeManager<DerivedLogger>::timer_callback()
 {
@@ -39,22 +39,39 @@
 #define GIT_VERSION_STRING TOSTRING(ROSFLIGHT_VERSION)
 #endif
 
+#include <boost/make_shared.hpp>
+#include <rosflight/mavrosflight/mavlink_epoll_serial.h>
+#include <rosflight/mavrosflight/mavlink_epoll_udp.h>
 #include <rosflight/mavrosflight/mavlink_serial.h>
+#include <rosflight/mavrosflight/mavlink_tcp.h>
 #include <rosflight/mavrosflight/mavlink_udp.h>
+#include <rosflight/mavrosflight/mavlink_unix.h>
 #include <rosflight/mavrosflight/serial_exception.h>
 #include <rosflight/ros_logger.h>
 #include <rosflight/ros_time.h>
 #include <tf/tf.h>
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
 #include <eigen3/Eigen/Core>
 #include <eigen3/Eigen/Dense>
+#include <map>
+#include <mutex>
 #include <string>
 
 #include <rosflight/rosflight_io.h>
 
 namespace rosflight_io
 {
-rosflightIO::rosflightIO()
+rosflightIO::rosflightIO(ros::NodeHandle nh, ros::NodeHandle nh_private) :
+  nh_(nh),
+  named_value_int_pubs_(nh_, "named_value/int/"),
+  named_value_float_pubs_(nh_, "named_value/float/"),
+  named_command_struct_pubs_(nh_, "named_value/command_struct/"),
+  param_srv_shutdown_(false),
+  router_(nullptr)
 {
   command_sub_ = nh_.subscribe("command", 1, &rosflightIO::commandCallback, this);
   aux_command_sub_ = nh_.subscribe("aux_command", 1, &rosflightIO::auxCommandCallback, this);
@@ -76,9 +93,46 @@ rosflightIO::rosflightIO()
   reboot_bootloader_srv_ =
       nh_.advertiseService("reboot_to_bootloader", &rosflightIO::rebootToBootloaderSrvCallback, this);
 
-  ros::NodeHandle nh_private("~");
+  // "asio" (default) or, on Linux, "epoll" for the raw file descriptor backend
+  std::string backend = nh_private.param<std::string>("backend", "asio");
+#ifdef __linux__
+  bool use_epoll = backend == "epoll";
+#else
+  bool use_epoll = false;
+#endif
+  if (backend != "asio" && !use_epoll)
+  {
+    ROS_WARN("Unsupported backend \"%s\", using asio", backend.c_str());
+  }
+
+  // sockets take a whole write batch at once; a serial port holds it for as long as it takes on the wire, and a
+  // command queued behind it would wait that long, so serial links write one packet at a time unless told otherwise
+  int default_write_batch = MAVLINK_MAX_WRITE_BATCH;
+
+  std::string unix_socket = nh_private.param<std::string>("unix_socket", "");
+  if ((!unix_socket.empty() || nh_private.param<bool>("tcp", false)) && use_epoll)
+  {
+    ROS_WARN("The epoll backend only supports serial and UDP links, using asio");
+    use_epoll = false;
+  }
+
+  if (!unix_socket.empty())
+  {
+    ROS_INFO("Connecting to Unix socket \"%s\"", unix_socket.c_str());
+    mavlink_comm_ = new mavrosflight::MavlinkUnix(unix_socket);
+    link_name_ = "unix://" + unix_socket;
+  }
+  else if (nh_private.param<bool>("tcp", false))
+  {
+    std::string remote_host = nh_private.param<std::string>("remote_host", "localhost");
+    uint16_t remote_port = (uint16_t)nh_private.param<int>("remote_port", 5760);
+
+    ROS_INFO("Connecting over TCP to \"%s:%d\"", remote_host.c_str(), remote_port);
 
-  if (nh_private.param<bool>("udp", false))
+    mavlink_comm_ = new mavrosflight::MavlinkTCP(remote_host, remote_port);
+    link_name_ = "tcp://" + remote_host + ":" + std::to_string(remote_port);
+  }
+  else if (nh_private.param<bool>("udp", false))
   {
     std::string bind_host = nh_private.param<std::string>("bind_host", "localhost");
     uint16_t bind_port = (uint16_t)nh_private.param<int>("bind_port", 14520);
@@ -88,16 +142,61 @@ rosflightIO::rosflightIO()
     ROS_INFO("Connecting over UDP to \"%s:%d\", from \"%s:%d\"", remote_host.c_str(), remote_port, bind_host.c_str(),
              bind_port);
 
-    mavlink_comm_ = new mavrosflight::MavlinkUDP(bind_host, bind_port, remote_host, remote_port);
+#ifdef __linux__
+    if (use_epoll)
+      mavlink_comm_ = new mavrosflight::MavlinkEpollUDP(bind_host, bind_port, remote_host, remote_port);
+    else
+#endif
+      mavlink_comm_ = new mavrosflight::MavlinkUDP(bind_host, bind_port, remote_host, remote_port);
+    link_name_ = "udp://" + remote_host + ":" + std::to_string(remote_port);
   }
   else
   {
     std::string port = nh_private.param<std::string>("port", "/dev/ttyACM0");
     int baud_rate = nh_private.param<int>("baud_rate", 921600);
+    bool low_latency = nh_private.param<bool>("low_latency", false);
+    bool hardware_flow_control = nh_private.param<bool>("hardware_flow_control", false);
 
     ROS_INFO("Connecting to serial port \"%s\", at %d baud", port.c_str(), baud_rate);
+    default_write_batch = 1;
 
-    mavlink_comm_ = new mavrosflight::MavlinkSerial(port, baud_rate);
+#ifdef __linux__
+    if (use_epoll)
+      mavlink_comm_ = new mavrosflight::MavlinkEpollSerial(port, baud_rate, low_latency, hardware_flow_control);
+    else
+#endif
+      mavlink_comm_ = new mavrosflight::MavlinkSerial(port, baud_rate, low_latency, hardware_flow_control);
+    link_name_ = port;
+  }
+
+  // number of queued packets that may be coalesced into a single write (1 disables batching)
+  int write_batch_size = nh_private.param<int>("write_batch_size", default_write_batch);
+  if (write_batch_size < 1)
+  {
+    ROS_WARN("write_batch_size must be at least 1, using %d", default_write_batch);
+    write_batch_size = default_write_batch;
+  }
+  mavlink_comm_->set_max_write_batch(write_batch_size);
+  mavlink_comm_->set_read_buffer_size(nh_private.param<int>("read_buffer_size", MAVLINK_SERIAL_READ_BUF_SIZE));
+
+  // reopen the port after an error (e.g. a USB brownout) instead of leaving the link dead
+  if (nh_private.param<bool>("reconnect", true))
+  {
+    mavlink_comm_->set_auto_reconnect(true);
+  }
+
+  // optionally run the mavlink listeners on their own threads so that slow handlers cannot stall the port
+  if (nh_private.param<bool>("threaded_dispatch", false))
+  {
+    mavlink_comm_->set_threaded_dispatch(true,
+                                         nh_private.param<int>("dispatch_queue_size", MAVLINK_DISPATCH_QUEUE_SIZE));
+  }
+
+  // optionally cap the rate of parameter writes so that loading a parameter file cannot saturate the link
+  double param_rate_limit = nh_private.param<double>("param_rate_limit", 0);
+  if (param_rate_limit > 0)
+  {
+    mavlink_comm_->set_write_rate_limit(MAVLINK_MSG_ID_PARAM_SET, param_rate_limit);
   }
 
   try
@@ -109,16 +208,38 @@ rosflightIO::rosflightIO()
     mavrosflight_ =
         new mavrosflight::MavROSflight<rosflight::ROSLogger>(*mavlink_comm_, logger_, time_interface_, timer_provider_);
   }
-  catch (mavrosflight::SerialException e)
+  catch (const mavrosflight::SerialException &)
   {
-    ROS_FATAL("%s", e.what());
-    ros::shutdown();
+    // the destructor does not run for a constructor that throws, and the port is all there is to clean up so far
+    delete mavlink_comm_;
+    throw;
   }
 
-  mavrosflight_->comm.register_mavlink_listener(this);
+  setup_handlers();
   mavrosflight_->param.register_param_listener(this);
 
-  // request the param list
+  // forward traffic between the flight controller and any ground stations or companion programs
+  setup_router(nh_private, use_epoll);
+
+  // download the params, keeping several individual requests in flight once the list stream has finished
+  double param_timeout = nh_private.param<double>("param_timeout", PARAM_REQUEST_TIMEOUT_MS / 1000.0);
+  mavrosflight_->param.set_download_window(nh_private.param<int>("param_window", PARAM_DOWNLOAD_WINDOW),
+                                           std::chrono::milliseconds(int(1000 * param_timeout)));
+
+  // reuse the param table from the last run with the same firmware instead of downloading it again, keeping a
+  // separate cache for each node and link so that different boards never share one
+  std::string cache_key = nh_private.getNamespace() + "_" + link_name_;
+  for (size_t i = 0; i < cache_key.size(); i++)
+  {
+    if (!isalnum(cache_key[i]) && cache_key[i] != '-' && cache_key[i] != '.')
+      cache_key[i] = '_';
+  }
+  std::string param_cache;
+  if (getenv("ROS_HOME"))
+    param_cache = std::string(getenv("ROS_HOME")) + "/rosflight_param_cache" + cache_key + ".yaml";
+  else if (getenv("HOME"))
+    param_cache = std::string(getenv("HOME")) + "/.ros/rosflight_param_cache" + cache_key + ".yaml";
+  mavrosflight_->param.set_cache_file(nh_private.param<std::string>("param_cache", param_cache));
   mavrosflight_->param.request_params();
   param_timer_ = nh_.createTimer(ros::Duration(PARAMETER_PERIOD), &rosflightIO::paramTimerCallback, this);
 
@@ -143,86 +264,96 @@ rosflightIO::rosflightIO()
 
   // Start the heartbeat
   heartbeat_timer_ = nh_.createTimer(ros::Duration(HEARTBEAT_PERIOD), &rosflightIO::heartbeatTimerCallback, this);
+
+  // Publish link statistics (a period of zero disables them)
+  double diagnostics_period = nh_private.param<double>("diagnostics_period", DIAGNOSTICS_PERIOD);
+  if (diagnostics_period > 0)
+  {
+    mavlink_comm_->get_transport_stats(&prev_transport_stats_);
+    prev_transport_stats_time_ = ros::Time::now();
+    diagnostics_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+    diagnostics_timer_ =
+        nh_.createTimer(ros::Duration(diagnostics_period), &rosflightIO::diagnosticsTimerCallback, this);
+  }
+
+  // Publish clock synchronization statistics at the rate of the TIMESYNC exchanges
+  time_sync_pub_ = nh_.advertise<rosflight_msgs::TimeSync>("time_sync", 1);
+  time_sync_timer_ = nh_.createTimer(ros::Duration(TIME_SYNC_PERIOD), &rosflightIO::timeSyncTimerCallback, this);
+
+  // Serve the bulk parameter services, which block until the flight controller answers, on their own thread
+  ros::NodeHandle param_nh(nh_);
+  param_nh.setCallbackQueue(&param_srv_queue_);
+  param_get_many_srv_ = param_nh.advertiseService("param_get_many", &rosflightIO::paramGetManySrvCallback, this);
+  param_set_many_srv_ = param_nh.advertiseService("param_set_many", &rosflightIO::paramSetManySrvCallback, this);
+  param_srv_spinner_.reset(new ros::AsyncSpinner(1, &param_srv_queue_));
+  param_srv_spinner_->start();
 }
 
 rosflightIO::~rosflightIO()
 {
+  param_srv_shutdown_ = true;
+  if (param_srv_spinner_)
+    param_srv_spinner_->stop();
+
+  delete router_;
   delete mavrosflight_;
   delete mavlink_comm_;
 }
 
-void rosflightIO::handle_mavlink_message(const mavlink_message_t &msg)
+void rosflightIO::setup_handlers()
 {
-  switch (msg.msgid)
+  std::fill(message_handlers_, message_handlers_ + 256, nullptr);
+  std::fill(frame_handlers_, frame_handlers_ + 256, nullptr);
+
+  // high-rate sensor streams are read in place from the receive buffer; everything else is unpacked
+  frame_handlers_[MAVLINK_MSG_ID_ATTITUDE_QUATERNION] = &rosflightIO::handle_attitude_quaternion_msg;
+  frame_handlers_[MAVLINK_MSG_ID_SMALL_IMU] = &rosflightIO::handle_small_imu_msg;
+  frame_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_OUTPUT_RAW] = &rosflightIO::handle_rosflight_output_raw_msg;
+
+  message_handlers_[MAVLINK_MSG_ID_HEARTBEAT] = &rosflightIO::handle_heartbeat_msg;
+  message_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_STATUS] = &rosflightIO::handle_status_msg;
+  message_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_CMD_ACK] = &rosflightIO::handle_command_ack_msg;
+  message_handlers_[MAVLINK_MSG_ID_STATUSTEXT] = &rosflightIO::handle_statustext_msg;
+  message_handlers_[MAVLINK_MSG_ID_SMALL_MAG] = &rosflightIO::handle_small_mag_msg;
+  message_handlers_[MAVLINK_MSG_ID_RC_CHANNELS] = &rosflightIO::handle_rc_channels_raw_msg;
+  message_handlers_[MAVLINK_MSG_ID_DIFF_PRESSURE] = &rosflightIO::handle_diff_pressure_msg;
+  message_handlers_[MAVLINK_MSG_ID_NAMED_VALUE_INT] = &rosflightIO::handle_named_value_int_msg;
+  message_handlers_[MAVLINK_MSG_ID_NAMED_VALUE_FLOAT] = &rosflightIO::handle_named_value_float_msg;
+  message_handlers_[MAVLINK_MSG_ID_NAMED_COMMAND_STRUCT] = &rosflightIO::handle_named_command_struct_msg;
+  message_handlers_[MAVLINK_MSG_ID_SMALL_BARO] = &rosflightIO::handle_small_baro_msg;
+  message_handlers_[MAVLINK_MSG_ID_SMALL_RANGE] = &rosflightIO::handle_small_range_msg;
+  message_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_GNSS] = &rosflightIO::handle_rosflight_gnss_msg;
+  message_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_GNSS_FULL] = &rosflightIO::handle_rosflight_gnss_full_msg;
+  message_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_VERSION] = &rosflightIO::handle_version_msg;
+  message_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_HARD_ERROR] = &rosflightIO::handle_hard_error_msg;
+  message_handlers_[MAVLINK_MSG_ID_ROSFLIGHT_BATTERY_STATUS] = &rosflightIO::handle_battery_status_msg;
+
+  // only the IDs in the tables are delivered, so the handlers need no check of their own
+  std::vector<uint8_t> frame_ids;
+  std::vector<uint8_t> message_ids;
+  for (size_t msgid = 0; msgid < 256; msgid++)
   {
-  case MAVLINK_MSG_ID_HEARTBEAT:
-    handle_heartbeat_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_STATUS:
-    handle_status_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_CMD_ACK:
-    handle_command_ack_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_STATUSTEXT:
-    handle_statustext_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ATTITUDE_QUATERNION:
-    handle_attitude_quaternion_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_SMALL_IMU:
-    handle_small_imu_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_SMALL_MAG:
-    handle_small_mag_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_OUTPUT_RAW:
-    handle_rosflight_output_raw_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_RC_CHANNELS:
-    handle_rc_channels_raw_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_DIFF_PRESSURE:
-    handle_diff_pressure_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_NAMED_VALUE_INT:
-    handle_named_value_int_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_NAMED_VALUE_FLOAT:
-    handle_named_value_float_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_NAMED_COMMAND_STRUCT:
-    handle_named_command_struct_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_SMALL_BARO:
-    handle_small_baro_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_SMALL_RANGE:
-    handle_small_range_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_GNSS:
-    handle_rosflight_gnss_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_GNSS_FULL:
-    handle_rosflight_gnss_full_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_VERSION:
-    handle_version_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_PARAM_VALUE:
-  case MAVLINK_MSG_ID_TIMESYNC:
-    // silently ignore (handled elsewhere)
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_HARD_ERROR:
-    handle_hard_error_msg(msg);
-    break;
-  case MAVLINK_MSG_ID_ROSFLIGHT_BATTERY_STATUS:
-    handle_battery_status_msg(msg);
-    break;
-  default:
-    ROS_DEBUG("rosflight_io: Got unhandled mavlink message ID %d", msg.msgid);
-    break;
+    if (frame_handlers_[msgid] != nullptr)
+      frame_ids.push_back(msgid);
+    if (message_handlers_[msgid] != nullptr)
+      message_ids.push_back(msgid);
   }
+  mavrosflight_->comm.register_mavlink_frame_listener(this, frame_ids);
+  mavrosflight_->comm.register_mavlink_listener(this, message_ids);
+}
+
+void rosflightIO::handle_mavlink_message(const mavlink_message_t &msg)
+{
+  MessageHandler handler = message_handlers_[msg.msgid];
+  if (handler != nullptr)
+    (this->*handler)(msg);
+}
+
+void rosflightIO::handle_mavlink_frame(const mavrosflight::MavlinkFrame &frame)
+{
+  FrameHandler handler = frame_handlers_[frame.msgid()];
+  if (handler != nullptr)
+    (this->*handler)(frame);
 }
 
 void rosflightIO::on_new_param_received(std::string name, double value)
@@ -349,7 +480,7 @@ void rosflightIO::handle_status_msg(const mavlink_message_t &msg)
   out_status.error_code = status_msg.error_code;
   out_status.num_errors = status_msg.num_errors;
   out_status.loop_time_us = status_msg.loop_time_us;
-  if (status_pub_.getTopic().empty())
+  if (!status_pub_)
   {
     status_pub_ = nh_.advertise<rosflight_msgs::Status>("status", 1);
   }
@@ -402,36 +533,39 @@ void rosflightIO::handle_statustext_msg(const mavlink_message_t &msg)
   }
 }
 
-void rosflightIO::handle_attitude_quaternion_msg(const mavlink_message_t &msg)
+void rosflightIO::handle_attitude_quaternion_msg(const mavrosflight::MavlinkFrame &frame)
 {
-  mavlink_attitude_quaternion_t attitude;
-  mavlink_msg_attitude_quaternion_decode(&msg, &attitude);
-
-  rosflight_msgs::Attitude attitude_msg;
-
-  attitude_msg.header.stamp = fcu_time_to_ros_time(std::chrono::milliseconds(attitude.time_boot_ms));
-  attitude_msg.attitude.w = attitude.q1;
-  attitude_msg.attitude.x = attitude.q2;
-  attitude_msg.attitude.y = attitude.q3;
-  attitude_msg.attitude.z = attitude.q4;
-  attitude_msg.angular_velocity.x = attitude.rollspeed;
-  attitude_msg.angular_velocity.y = attitude.pitchspeed;
-  attitude_msg.angular_velocity.z = attitude.yawspeed;
-
-  geometry_msgs::Vector3Stamped euler_msg;
-  euler_msg.header.stamp = attitude_msg.header.stamp;
-
-  tf::Quaternion quat(attitude.q2, attitude.q3, attitude.q4, attitude.q1);
-  tf::Matrix3x3(quat).getEulerYPR(euler_msg.vector.z, euler_msg.vector.y, euler_msg.vector.x);
+  // messages are published by shared pointer, so subscribers in the same nodelet manager receive them without a copy.
+  // Each message is a fresh allocation. It cannot be reused until every subscriber has dropped it, on whatever thread
+  // that happens, so a pool would have to recycle across threads, and roscpp allocates on every publish regardless. At
+  // about 0.2 us per allocation, the high-rate streams cost well under a millisecond of CPU per second.
+  rosflight_msgs::AttitudePtr attitude_msg = boost::make_shared<rosflight_msgs::Attitude>();
+
+  attitude_msg->header.stamp = fcu_time_to_ros_time(
+      std::chrono::milliseconds(MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, time_boot_ms)));
+  attitude_msg->attitude.w = MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, q1);
+  attitude_msg->attitude.x = MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, q2);
+  attitude_msg->attitude.y = MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, q3);
+  attitude_msg->attitude.z = MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, q4);
+  attitude_msg->angular_velocity.x = MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, rollspeed);
+  attitude_msg->angular_velocity.y = MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, pitchspeed);
+  attitude_msg->angular_velocity.z = MAVLINK_FRAME_FIELD(frame, mavlink_attitude_quaternion_t, yawspeed);
+
+  geometry_msgs::Vector3StampedPtr euler_msg = boost::make_shared<geometry_msgs::Vector3Stamped>();
+  euler_msg->header.stamp = attitude_msg->header.stamp;
+
+  tf::Quaternion quat(attitude_msg->attitude.x, attitude_msg->attitude.y, attitude_msg->attitude.z,
+                      attitude_msg->attitude.w);
+  tf::Matrix3x3(quat).getEulerYPR(euler_msg->vector.z, euler_msg->vector.y, euler_msg->vector.x);
 
   // save off the quaternion for use with the IMU callback
   tf::quaternionTFToMsg(quat, attitude_quat_);
 
-  if (attitude_pub_.getTopic().empty())
+  if (!attitude_pub_)
   {
     attitude_pub_ = nh_.advertise<rosflight_msgs::Attitude>("attitude", 1);
   }
-  if (euler_pub_.getTopic().empty())
+  if (!euler_pub_)
   {
     euler_pub_ = nh_.advertise<geometry_msgs::Vector3Stamped>("attitude/euler", 1);
   }
@@ -439,53 +573,49 @@ void rosflightIO::handle_attitude_quaternion_msg(const mavlink_message_t &msg)
   euler_pub_.publish(euler_msg);
 }
 
-void rosflightIO::handle_small_imu_msg(const mavlink_message_t &msg)
+void rosflightIO::handle_small_imu_msg(const mavrosflight::MavlinkFrame &frame)
 {
-  mavlink_small_imu_t imu;
-  mavlink_msg_small_imu_decode(&msg, &imu);
-
-  sensor_msgs::Imu imu_msg;
-  imu_msg.header.stamp = fcu_time_to_ros_time(std::chrono::microseconds(imu.time_boot_us));
-  imu_msg.header.frame_id = frame_id_;
-  imu_msg.linear_acceleration.x = imu.xacc;
-  imu_msg.linear_acceleration.y = imu.yacc;
-  imu_msg.linear_acceleration.z = imu.zacc;
-  imu_msg.angular_velocity.x = imu.xgyro;
-  imu_msg.angular_velocity.y = imu.ygyro;
-  imu_msg.angular_velocity.z = imu.zgyro;
-  imu_msg.orientation = attitude_quat_;
-
-  sensor_msgs::Temperature temp_msg;
-  temp_msg.header.stamp = imu_msg.header.stamp;
-  temp_msg.header.frame_id = frame_id_;
-  temp_msg.temperature = imu.temperature;
-
-  if (imu_pub_.getTopic().empty())
+  sensor_msgs::ImuPtr imu_msg = boost::make_shared<sensor_msgs::Imu>();
+  imu_msg->header.stamp =
+      fcu_time_to_ros_time(std::chrono::microseconds(MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, time_boot_us)));
+  imu_msg->header.frame_id = frame_id_;
+  imu_msg->linear_acceleration.x = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, xacc);
+  imu_msg->linear_acceleration.y = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, yacc);
+  imu_msg->linear_acceleration.z = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, zacc);
+  imu_msg->angular_velocity.x = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, xgyro);
+  imu_msg->angular_velocity.y = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, ygyro);
+  imu_msg->angular_velocity.z = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, zgyro);
+  imu_msg->orientation = attitude_quat_;
+
+  sensor_msgs::TemperaturePtr temp_msg = boost::make_shared<sensor_msgs::Temperature>();
+  temp_msg->header.stamp = imu_msg->header.stamp;
+  temp_msg->header.frame_id = frame_id_;
+  temp_msg->temperature = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, temperature);
+
+  if (!imu_pub_)
   {
     imu_pub_ = nh_.advertise<sensor_msgs::Imu>("imu/data", 1);
   }
   imu_pub_.publish(imu_msg);
 
-  if (imu_temp_pub_.getTopic().empty())
+  if (!imu_temp_pub_)
   {
     imu_temp_pub_ = nh_.advertise<sensor_msgs::Temperature>("imu/temperature", 1);
   }
   imu_temp_pub_.publish(temp_msg);
 }
 
-void rosflightIO::handle_rosflight_output_raw_msg(const mavlink_message_t &msg)
+void rosflightIO::handle_rosflight_output_raw_msg(const mavrosflight::MavlinkFrame &frame)
 {
-  mavlink_rosflight_output_raw_t servo;
-  mavlink_msg_rosflight_output_raw_decode(&msg, &servo);
-
-  rosflight_msgs::OutputRaw out_msg;
-  out_msg.header.stamp = fcu_time_to_ros_time(std::chrono::microseconds(servo.stamp));
+  rosflight_msgs::OutputRawPtr out_msg = boost::make_shared<rosflight_msgs::OutputRaw>();
+  out_msg->header.stamp = fcu_time_to_ros_time(
+      std::chrono::microseconds(MAVLINK_FRAME_FIELD(frame, mavlink_rosflight_output_raw_t, stamp)));
   for (int i = 0; i < 14; i++)
   {
-    out_msg.values[i] = servo.values[i];
+    out_msg->values[i] = MAVLINK_FRAME_ARRAY_FIELD(frame, mavlink_rosflight_output_raw_t, values, i);
   }
 
-  if (output_raw_pub_.getTopic().empty())
+  if (!output_raw_pub_)
   {
     output_raw_pub_ = nh_.advertise<rosflight_msgs::OutputRaw>("output_raw", 1);
   }
@@ -509,7 +639,7 @@ void rosflightIO::handle_rc_channels_raw_msg(const mavlink_message_t &msg)
   out_msg.values[6] = rc.chan7_raw;
   out_msg.values[7] = rc.chan8_raw;
 
-  if (rc_raw_pub_.getTopic().empty())
+  if (!rc_raw_pub_)
   {
     rc_raw_pub_ = nh_.advertise<rosflight_msgs::RCRaw>("rc_raw", 1);
   }
@@ -527,13 +657,13 @@ void rosflightIO::handle_diff_pressure_msg(const mavlink_message_t &msg)
   airspeed_msg.differential_pressure = diff.diff_pressure;
   airspeed_msg.temperature = diff.temperature;
 
-  if (calibrate_airspeed_srv_.getService().empty())
+  if (!calibrate_airspeed_srv_)
   {
     calibrate_airspeed_srv_ =
         nh_.advertiseService("calibrate_airspeed", &rosflightIO::calibrateAirspeedSrvCallback, this);
   }
 
-  if (diff_pressure_pub_.getTopic().empty())
+  if (!diff_pressure_pub_)
   {
     diff_pressure_pub_ = nh_.advertise<rosflight_msgs::Airspeed>("airspeed", 1);
   }
@@ -545,22 +675,10 @@ void rosflightIO::handle_named_value_int_msg(const mavlink_message_t &msg)
   mavlink_named_value_int_t val;
   mavlink_msg_named_value_int_decode(&msg, &val);
 
-  // ensure null termination of name
-  char c_name[MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN + 1];
-  memcpy(c_name, val.name, MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN);
-  c_name[MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN] = '\0';
-  std::string name(c_name);
-
-  if (named_value_int_pubs_.find(name) == named_value_int_pubs_.end())
-  {
-    ros::NodeHandle nh;
-    named_value_int_pubs_[name] = nh.advertise<std_msgs::Int32>("named_value/int/" + name, 1);
-  }
-
   std_msgs::Int32 out_msg;
   out_msg.data = val.value;
 
-  named_value_int_pubs_[name].publish(out_msg);
+  named_value_int_pubs_.get(val.name).publish(out_msg);
 }
 
 void rosflightIO::handle_named_value_float_msg(const mavlink_message_t &msg)
@@ -568,22 +686,10 @@ void rosflightIO::handle_named_value_float_msg(const mavlink_message_t &msg)
   mavlink_named_value_float_t val;
   mavlink_msg_named_value_float_decode(&msg, &val);
 
-  // ensure null termination of name
-  char c_name[MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN + 1];
-  memcpy(c_name, val.name, MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN);
-  c_name[MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN] = '\0';
-  std::string name(c_name);
-
-  if (named_value_float_pubs_.find(name) == named_value_float_pubs_.end())
-  {
-    ros::NodeHandle nh;
-    named_value_float_pubs_[name] = nh.advertise<std_msgs::Float32>("named_value/float/" + name, 1);
-  }
-
   std_msgs::Float32 out_msg;
   out_msg.data = val.value;
 
-  named_value_float_pubs_[name].publish(out_msg);
+  named_value_float_pubs_.get(val.name).publish(out_msg);
 }
 
 void rosflightIO::handle_named_command_struct_msg(const mavlink_message_t &msg)
@@ -591,18 +697,6 @@ void rosflightIO::handle_named_command_struct_msg(const mavlink_message_t &msg)
   mavlink_named_command_struct_t command;
   mavlink_msg_named_command_struct_decode(&msg, &command);
 
-  // ensure null termination of name
-  char c_name[MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN + 1];
-  memcpy(c_name, command.name, MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN);
-  c_name[MAVLINK_MSG_NAMED_VALUE_FLOAT_FIELD_NAME_LEN] = '\0';
-  std::string name(c_name);
-
-  if (named_command_struct_pubs_.find(name) == named_command_struct_pubs_.end())
-  {
-    ros::NodeHandle nh;
-    named_command_struct_pubs_[name] = nh.advertise<rosflight_msgs::Command>("named_value/command_struct/" + name, 1);
-  }
-
   rosflight_msgs::Command command_msg;
   if (command.type == MODE_PASS_THROUGH)
     command_msg.mode = rosflight_msgs::Command::MODE_PASS_THROUGH;
@@ -616,7 +710,7 @@ void rosflightIO::handle_named_command_struct_msg(const mavlink_message_t &msg)
   command_msg.y = command.y;
   command_msg.z = command.z;
   command_msg.F = command.F;
-  named_command_struct_pubs_[name].publish(command_msg);
+  named_command_struct_pubs_.get(command.name).publish(command_msg);
 }
 
 void rosflightIO::handle_small_baro_msg(const mavlink_message_t &msg)
@@ -631,12 +725,12 @@ void rosflightIO::handle_small_baro_msg(const mavlink_message_t &msg)
   baro_msg.temperature = baro.temperature;
 
   // If we are getting barometer messages, then we should publish the barometer calibration service
-  if (calibrate_baro_srv_.getService().empty())
+  if (!calibrate_baro_srv_)
   {
     calibrate_baro_srv_ = nh_.advertiseService("calibrate_baro", &rosflightIO::calibrateBaroSrvCallback, this);
   }
 
-  if (baro_pub_.getTopic().empty())
+  if (!baro_pub_)
   {
     baro_pub_ = nh_.advertise<rosflight_msgs::Barometer>("baro", 1);
   }
@@ -657,7 +751,7 @@ void rosflightIO::handle_small_mag_msg(const mavlink_message_t &msg)
   mag_msg.magnetic_field.y = mag.ymag;
   mag_msg.magnetic_field.z = mag.zmag;
 
-  if (mag_pub_.getTopic().empty())
+  if (!mag_pub_)
   {
     mag_pub_ = nh_.advertise<sensor_msgs::MagneticField>("magnetometer", 1);
   }
@@ -681,7 +775,7 @@ void rosflightIO::handle_small_range_msg(const mavlink_message_t &msg)
     alt_msg.radiation_type = sensor_msgs::Range::ULTRASOUND;
     alt_msg.field_of_view = 1.0472; // approx 60 deg
 
-    if (sonar_pub_.getTopic().empty())
+    if (!sonar_pub_)
     {
       sonar_pub_ = nh_.advertise<sensor_msgs::Range>("sonar", 1);
     }
@@ -691,7 +785,7 @@ void rosflightIO::handle_small_range_msg(const mavlink_message_t &msg)
     alt_msg.radiation_type = sensor_msgs::Range::INFRARED;
     alt_msg.field_of_view = .0349066; // approx 2 deg
 
-    if (lidar_pub_.getTopic().empty())
+    if (!lidar_pub_)
     {
       lidar_pub_ = nh_.advertise<sensor_msgs::Range>("lidar", 1);
     }
@@ -729,11 +823,12 @@ void rosflightIO::handle_version_msg(const mavlink_message_t &msg)
   std_msgs::String version_msg;
   version_msg.data = version.version;
 
-  if (version_pub_.getTopic().empty())
+  if (!version_pub_)
   {
     version_pub_ = nh_.advertise<std_msgs::String>("version", 1, true);
   }
   version_pub_.publish(version_msg);
+  mavrosflight_->param.set_firmware_version(version.version);
 #ifdef GIT_VERSION_STRING // Macro so that is compiles even if git is not available
   const std::string git_version_string = GIT_VERSION_STRING;
   const std::string rosflight_major_minor_version = get_major_minor_version(git_version_string);
@@ -779,7 +874,7 @@ void rosflightIO::handle_battery_status_msg(const mavlink_message_t &msg)
 {
   mavlink_rosflight_battery_status_t battery_status;
   mavlink_msg_rosflight_battery_status_decode(&msg, &battery_status);
-  if (battery_status_pub_.getTopic().empty())
+  if (!battery_status_pub_)
   {
     battery_status_pub_ = nh_.advertise<rosflight_msgs::BatteryStatus>("battery", 1);
   }
@@ -811,7 +906,7 @@ void rosflightIO::handle_rosflight_gnss_msg(const mavlink_message_t &msg)
   gnss_msg.velocity[1] = .01 * gnss.ecef_v_y;
   gnss_msg.velocity[2] = .01 * gnss.ecef_v_z;
   gnss_msg.speed_accuracy = gnss.s_acc;
-  if (gnss_pub_.getTopic().empty())
+  if (!gnss_pub_)
   {
     gnss_pub_ = nh_.advertise<rosflight_msgs::GNSS>("gnss", 1);
   }
@@ -845,7 +940,7 @@ void rosflightIO::handle_rosflight_gnss_msg(const mavlink_message_t &msg)
   navsat_status.service = 1; // Report that only GPS was used, even though others may have been
   navsat_fix.status = navsat_status;
 
-  if (nav_sat_fix_pub_.getTopic().empty())
+  if (!nav_sat_fix_pub_)
   {
     nav_sat_fix_pub_ = nh_.advertise<sensor_msgs::NavSatFix>("navsat_compat/fix", 1);
   }
@@ -862,7 +957,7 @@ void rosflightIO::handle_rosflight_gnss_msg(const mavlink_message_t &msg)
   twist_stamped.twist.linear.y = .001 * gnss.vel_e;
   twist_stamped.twist.linear.z = .001 * gnss.vel_d;
 
-  if (twist_stamped_pub_.getTopic().empty())
+  if (!twist_stamped_pub_)
     twist_stamped_pub_ = nh_.advertise<geometry_msgs::TwistStamped>("navsat_compat/vel", 1);
   twist_stamped_pub_.publish(twist_stamped);
 
@@ -871,7 +966,7 @@ void rosflightIO::handle_rosflight_gnss_msg(const mavlink_message_t &msg)
   time_ref.source = "GNSS";
   time_ref.time_ref = ros::Time(gnss.time, gnss.nanos);
 
-  if (time_reference_pub_.getTopic().empty())
+  if (!time_reference_pub_)
     time_reference_pub_ = nh_.advertise<sensor_msgs::TimeReference>("navsat_compat/time_reference", 1);
 
   time_reference_pub_.publish(time_ref);
@@ -911,7 +1006,7 @@ void rosflightIO::handle_rosflight_gnss_full_msg(const mavlink_message_t &msg)
   msg_out.head_acc = full.head_acc;
   msg_out.p_dop = full.p_dop;
 
-  if (gnss_full_pub_.getTopic().empty())
+  if (!gnss_full_pub_)
     gnss_full_pub_ = nh_.advertise<rosflight_msgs::GNSSFull>("gnss_full", 1);
   gnss_full_pub_.publish(msg_out);
 }
@@ -977,7 +1072,67 @@ bool rosflightIO::paramGetSrvCallback(rosflight_msgs::ParamGet::Request &req, ro
 
 bool rosflightIO::paramSetSrvCallback(rosflight_msgs::ParamSet::Request &req, rosflight_msgs::ParamSet::Response &res)
 {
-  res.exists = mavrosflight_->param.set_param_value(req.name, req.value);
+  std::string name = req.name;
+  res.exists = mavrosflight_->param.set_param_value(req.name, req.value, [name](size_t confirmed, size_t failed) {
+    if (failed > 0)
+      ROS_WARN("Flight controller did not confirm the new value of parameter %s", name.c_str());
+  });
+  return true;
+}
+
+bool rosflightIO::paramGetManySrvCallback(rosflight_msgs::ParamGetMany::Request &req,
+                                          rosflight_msgs::ParamGetMany::Response &res)
+{
+  res.exists.resize(req.names.size());
+  res.values.resize(req.names.size());
+  for (size_t i = 0; i < req.names.size(); i++)
+  {
+    res.exists[i] = mavrosflight_->param.get_param_value(req.names[i], &res.values[i]);
+  }
+  return true;
+}
+
+bool rosflightIO::paramSetManySrvCallback(rosflight_msgs::ParamSetMany::Request &req,
+                                          rosflight_msgs::ParamSetMany::Response &res)
+{
+  if (req.names.size() != req.values.size())
+  {
+    ROS_ERROR("param_set_many: %zu names but %zu values", req.names.size(), req.values.size());
+    return false;
+  }
+
+  struct Outcome
+  {
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished;
+    mavrosflight::ParamManager<rosflight::ROSLogger>::SetManyResult result;
+  };
+
+  // shared with the callback, which outlives this call if it stops waiting at shutdown
+  std::shared_ptr<Outcome> outcome = std::make_shared<Outcome>();
+  outcome->finished = false;
+  mavrosflight_->param.set_param_values(
+      req.names, req.values, req.all_or_nothing,
+      [outcome](const mavrosflight::ParamManager<rosflight::ROSLogger>::SetManyResult &result) {
+        std::lock_guard<std::mutex> lock(outcome->mutex);
+        outcome->result = result;
+        outcome->finished = true;
+        outcome->done.notify_all();
+      });
+
+  std::unique_lock<std::mutex> lock(outcome->mutex);
+  while (!outcome->finished && ros::ok() && !param_srv_shutdown_)
+  {
+    outcome->done.wait_for(lock, std::chrono::milliseconds(100));
+  }
+  if (!outcome->finished)
+    return false;
+
+  res.exists.assign(outcome->result.exists.begin(), outcome->result.exists.end());
+  res.confirmed.assign(outcome->result.confirmed.begin(), outcome->result.confirmed.end());
+  res.rolled_back = outcome->result.rolled_back;
+  res.success = outcome->result.success;
   return true;
 }
 
@@ -1002,7 +1157,26 @@ bool rosflightIO::paramSaveToFileCallback(rosflight_msgs::ParamFile::Request &re
 bool rosflightIO::paramLoadFromFileCallback(rosflight_msgs::ParamFile::Request &req,
                                             rosflight_msgs::ParamFile::Response &res)
 {
-  res.success = mavrosflight_->param.load_from_file(req.filename);
+  std::string filename = req.filename;
+  std::vector<mavrosflight::ParamManager<rosflight::ROSLogger>::ParamChange> changes;
+  res.success = mavrosflight_->param.load_from_file(
+      req.filename,
+      [filename](size_t confirmed, size_t failed) {
+        if (failed > 0)
+          ROS_WARN("Loaded %s: %zu parameters confirmed, %zu not confirmed", filename.c_str(), confirmed, failed);
+        else if (confirmed > 0)
+          ROS_INFO("Loaded %s: %zu parameters confirmed", filename.c_str(), confirmed);
+      },
+      &changes);
+
+  if (res.success)
+  {
+    ROS_INFO("Loading %s: %zu parameters differ from the flight controller", filename.c_str(), changes.size());
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+      ROS_INFO("  %s: %g -> %g", changes[i].name.c_str(), changes[i].old_value, changes[i].new_value);
+    }
+  }
   return true;
 }
 
@@ -1027,16 +1201,29 @@ bool rosflightIO::calibrateRCTrimSrvCallback(std_srvs::Trigger::Request &req, st
 
 void rosflightIO::paramTimerCallback(const ros::TimerEvent &e)
 {
-  if (mavrosflight_->param.got_all_params())
+  // the download retries on its own; this only reports its progress
+  mavrosflight::ParamManager<rosflight::ROSLogger>::DownloadStats stats = mavrosflight_->param.get_download_stats();
+  if (stats.complete && stats.verifying)
+  {
+    // the cache may still turn out to be stale
+    return;
+  }
+  else if (stats.complete && stats.from_cache)
   {
     param_timer_.stop();
-    ROS_INFO("Received all parameters");
+    ROS_INFO("Loaded all %zu parameters from the cache", stats.total);
+  }
+  else if (stats.complete)
+  {
+    param_timer_.stop();
+    ROS_INFO("Received all %zu parameters in %.2f s (%lu requests, %lu retries, %.1f ms mean request latency)",
+             stats.total, std::chrono::duration<double>(stats.elapsed).count(), (unsigned long)stats.requests,
+             (unsigned long)stats.retries, std::chrono::duration<double, std::milli>(stats.latency).count());
   }
   else
   {
-    mavrosflight_->param.request_params();
-    ROS_ERROR("Received %d of %d parameters. Requesting missing parameters...",
-              mavrosflight_->param.get_params_received(), mavrosflight_->param.get_num_params());
+    ROS_WARN("Received %zu of %zu parameters after %.1f s. Requesting missing parameters...", stats.received,
+             stats.total, std::chrono::duration<double>(stats.elapsed).count());
   }
 }
 
@@ -1050,6 +1237,189 @@ void rosflightIO::heartbeatTimerCallback(const ros::TimerEvent &e)
   send_heartbeat();
 }
 
+void rosflightIO::diagnosticsTimerCallback(const ros::TimerEvent &e)
+{
+  mavrosflight::MavlinkComm::TransportStats stats;
+  mavlink_comm_->get_transport_stats(&stats);
+  ros::Time now = ros::Time::now();
+  double dt = (now - prev_transport_stats_time_).toSec();
+  const mavrosflight::MavlinkComm::TransportStats &prev = prev_transport_stats_;
+
+  uint64_t lost = 0;
+  uint64_t out_of_order = 0;
+  for (size_t i = 0; i < stats.sources.size(); i++)
+  {
+    lost += stats.sources[i].lost;
+    out_of_order += stats.sources[i].out_of_order;
+  }
+  uint64_t prev_lost = 0;
+  for (size_t i = 0; i < prev.sources.size(); i++)
+  {
+    prev_lost += prev.sources[i].lost;
+  }
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = "rosflight_io: MAVLink link";
+  status.hardware_id = link_name_;
+  if (!stats.link_up)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+    status.message = "Link down";
+  }
+  else if (stats.crc_errors > prev.crc_errors || stats.write_queue_dropped > prev.write_queue_dropped
+           || lost > prev_lost)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "Corrupted, lost or dropped frames";
+  }
+  else
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = "OK";
+  }
+
+  auto add_value = [&status](const std::string &key, const std::string &value) {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = value;
+    status.values.push_back(kv);
+  };
+
+  if (dt > 0)
+  {
+    add_value("Receive rate (bytes/s)", std::to_string((stats.bytes_in - prev.bytes_in) / dt));
+    add_value("Receive rate (frames/s)", std::to_string((stats.frames_in - prev.frames_in) / dt));
+    add_value("Transmit rate (bytes/s)", std::to_string((stats.bytes_out - prev.bytes_out) / dt));
+    add_value("Transmit rate (frames/s)", std::to_string((stats.frames_out - prev.frames_out) / dt));
+  }
+  add_value("Reconnects", std::to_string(stats.reconnects));
+  add_value("Bytes received", std::to_string(stats.bytes_in));
+  add_value("Frames received", std::to_string(stats.frames_in));
+  add_value("CRC errors", std::to_string(stats.crc_errors));
+  add_value("Length errors", std::to_string(stats.length_errors));
+  add_value("Bytes skipped", std::to_string(stats.bytes_skipped));
+  add_value("Frames lost", std::to_string(lost));
+  add_value("Frames duplicated or out of order", std::to_string(out_of_order));
+  for (size_t i = 0; i < stats.sources.size(); i++)
+  {
+    const mavrosflight::MavlinkComm::SourceStats &source = stats.sources[i];
+    add_value("Frames lost from " + std::to_string(source.sysid) + "/" + std::to_string(source.compid),
+              std::to_string(source.lost) + " of " + std::to_string(source.frames + source.lost));
+  }
+  add_value("Bytes sent", std::to_string(stats.bytes_out));
+  add_value("Frames sent", std::to_string(stats.frames_out));
+  add_value("Write queue depth", std::to_string(stats.write_queue_depth));
+  add_value("Write queue high water", std::to_string(stats.write_queue_high_water));
+  add_value("Write queue dropped", std::to_string(stats.write_queue_dropped));
+  add_value("Write latency max (us)", std::to_string(stats.write_latency_max_us));
+  add_value("TIMESYNC round trip (ms)",
+            std::to_string(std::chrono::duration<double, std::milli>(mavrosflight_->time.get_rtt()).count()));
+  add_value("TIMESYNC round trip average (ms)",
+            std::to_string(std::chrono::duration<double, std::milli>(mavrosflight_->time.get_rtt_average()).count()));
+  add_value("TIMESYNC round trip min (ms)",
+            std::to_string(std::chrono::duration<double, std::milli>(mavrosflight_->time.get_rtt_min()).count()));
+  add_value("Clock offset (s)",
+            std::to_string(std::chrono::duration<double>(mavrosflight_->time.get_offset()).count()));
+  add_value("Clock offset uncertainty (us)",
+            std::to_string(std::chrono::duration<double, std::micro>(mavrosflight_->time.get_offset_stddev()).count()));
+  add_value("Clock skew (ppm)", std::to_string(mavrosflight_->time.get_skew_ppm()));
+  add_value("TIMESYNC outliers rejected", std::to_string(mavrosflight_->time.get_rejected_samples()));
+  mavrosflight::ParamManager<rosflight::ROSLogger>::DownloadStats param_stats =
+      mavrosflight_->param.get_download_stats();
+  add_value("Parameters received", std::to_string(param_stats.received) + " of " + std::to_string(param_stats.total));
+  add_value("Parameter request retries", std::to_string(param_stats.retries));
+  add_value("Parameter request latency max (ms)",
+            std::to_string(std::chrono::duration<double, std::milli>(param_stats.latency_max).count()));
+  mavrosflight::ParamManager<rosflight::ROSLogger>::SetStats set_stats = mavrosflight_->param.get_set_stats();
+  add_value("Parameter sets pending", std::to_string(set_stats.pending));
+  add_value("Parameter sets confirmed", std::to_string(set_stats.confirmed));
+  add_value("Parameter sets failed", std::to_string(set_stats.failed));
+  add_value("Parameter set latency (ms)",
+            std::to_string(std::chrono::duration<double, std::milli>(set_stats.latency).count()));
+  add_value("Parameter set latency max (ms)",
+            std::to_string(std::chrono::duration<double, std::milli>(set_stats.latency_max).count()));
+  typedef std::map<std::string, mavrosflight::ParamManager<rosflight::ROSLogger>::ParamSetLatency> SetLatencies;
+  SetLatencies set_latencies = mavrosflight_->param.get_set_latencies();
+  SetLatencies::const_iterator slowest = set_latencies.end();
+  for (SetLatencies::const_iterator it = set_latencies.begin(); it != set_latencies.end(); ++it)
+  {
+    if (slowest == set_latencies.end() || it->second.max > slowest->second.max)
+      slowest = it;
+  }
+  if (slowest != set_latencies.end())
+  {
+    add_value("Slowest parameter set (ms)",
+              slowest->first + ": "
+                  + std::to_string(std::chrono::duration<double, std::milli>(slowest->second.max).count()));
+  }
+  for (size_t i = 0; i < MAVLINK_LATENCY_HIST_BINS; i++)
+  {
+    if (stats.write_latency_hist[i] > 0)
+    {
+      std::string limit = i + 1 < MAVLINK_LATENCY_HIST_BINS ?
+                              "< " + std::to_string(mavrosflight::MavlinkComm::write_latency_bin_limit_us(i)) :
+                              ">= " + std::to_string(mavrosflight::MavlinkComm::write_latency_bin_limit_us(i - 1));
+      add_value("Write latency " + limit + " us", std::to_string(stats.write_latency_hist[i]));
+    }
+  }
+
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = now;
+  msg.status.push_back(status);
+
+  for (size_t i = 0; router_ && i < router_->num_endpoints(); i++)
+  {
+    mavrosflight::MavlinkRouter::EndpointStats endpoint_stats = router_->get_endpoint_stats(i);
+    diagnostic_msgs::DiagnosticStatus endpoint_status;
+    endpoint_status.name = "rosflight_io: MAVLink router endpoint";
+    endpoint_status.hardware_id = router_endpoint_names_[i];
+    endpoint_status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    endpoint_status.message = "OK";
+    if (endpoint_stats.dropped > 0)
+    {
+      endpoint_status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      endpoint_status.message = "Dropped frames";
+    }
+
+    diagnostic_msgs::KeyValue kv;
+    kv.key = "Frames forwarded";
+    kv.value = std::to_string(endpoint_stats.forwarded);
+    endpoint_status.values.push_back(kv);
+    kv.key = "Frames filtered";
+    kv.value = std::to_string(endpoint_stats.filtered);
+    endpoint_status.values.push_back(kv);
+    kv.key = "Frames dropped";
+    kv.value = std::to_string(endpoint_stats.dropped);
+    endpoint_status.values.push_back(kv);
+    kv.key = "Frames received";
+    kv.value = std::to_string(endpoint_stats.received);
+    endpoint_status.values.push_back(kv);
+    msg.status.push_back(endpoint_status);
+  }
+  diagnostics_pub_.publish(msg);
+
+  prev_transport_stats_ = stats;
+  prev_transport_stats_time_ = now;
+}
+
+void rosflightIO::timeSyncTimerCallback(const ros::TimerEvent &e)
+{
+  if (time_sync_pub_.getNumSubscribers() == 0)
+    return;
+
+  rosflight_msgs::TimeSync msg;
+  msg.header.stamp = ros::Time::now();
+  msg.offset = std::chrono::duration<double>(mavrosflight_->time.get_offset()).count();
+  msg.offset_stddev = std::chrono::duration<double>(mavrosflight_->time.get_offset_stddev()).count();
+  msg.skew = mavrosflight_->time.get_skew_ppm();
+  msg.rtt = std::chrono::duration<double>(mavrosflight_->time.get_rtt()).count();
+  msg.rtt_average = std::chrono::duration<double>(mavrosflight_->time.get_rtt_average()).count();
+  msg.rtt_min = std::chrono::duration<double>(mavrosflight_->time.get_rtt_min()).count();
+  msg.selected_rtt = std::chrono::duration<double>(mavrosflight_->time.get_selected_rtt()).count();
+  msg.rejected = mavrosflight_->time.get_rejected_samples();
+  time_sync_pub_.publish(msg);
+}
+
 void rosflightIO::request_version()
 {
   mavlink_message_t msg;
@@ -1063,6 +1433,90 @@ void rosflightIO::send_heartbeat()
   mavrosflight_->comm.send_message(msg);
 }
 
+void rosflightIO::setup_router(ros::NodeHandle &nh_private, bool use_epoll)
+{
+  // each entry is {type, host, port, bind_host, bind_port, path, msgids}, where type is "udp" (default), "tcp" or
+  // "unix"; msgids (forwarded to the endpoint) defaults to all
+  XmlRpc::XmlRpcValue endpoints;
+  if (!nh_private.getParam("router_endpoints", endpoints))
+    return;
+
+  if (endpoints.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR("Parameter ~router_endpoints must be a list, not routing");
+    return;
+  }
+
+  router_ = new mavrosflight::MavlinkRouter(mavlink_comm_);
+  for (int i = 0; i < endpoints.size(); i++)
+  {
+    try
+    {
+      XmlRpc::XmlRpcValue &endpoint = endpoints[i];
+      std::string type = endpoint.hasMember("type") ? static_cast<std::string>(endpoint["type"]) : std::string("udp");
+
+      std::vector<uint8_t> msgids;
+      if (endpoint.hasMember("msgids"))
+      {
+        for (int j = 0; j < endpoint["msgids"].size(); j++)
+        {
+          msgids.push_back((uint8_t) static_cast<int>(endpoint["msgids"][j]));
+        }
+      }
+
+      mavrosflight::MavlinkComm *comm;
+      std::string name;
+      if (type == "unix")
+      {
+        std::string path = static_cast<std::string>(endpoint["path"]);
+        comm = new mavrosflight::MavlinkUnix(path);
+        name = "unix://" + path;
+      }
+      else if (type == "tcp" || type == "udp")
+      {
+        std::string host = static_cast<std::string>(endpoint["host"]);
+        uint16_t port = (uint16_t) static_cast<int>(endpoint["port"]);
+        if (type == "tcp")
+        {
+          comm = new mavrosflight::MavlinkTCP(host, port);
+        }
+        else
+        {
+          std::string bind_host = endpoint.hasMember("bind_host") ? static_cast<std::string>(endpoint["bind_host"]) :
+                                                                    std::string("localhost");
+          uint16_t bind_port =
+              endpoint.hasMember("bind_port") ? (uint16_t) static_cast<int>(endpoint["bind_port"]) : 0;
+#ifdef __linux__
+          if (use_epoll)
+            comm = new mavrosflight::MavlinkEpollUDP(bind_host, bind_port, host, port);
+          else
+#endif
+            comm = new mavrosflight::MavlinkUDP(bind_host, bind_port, host, port);
+        }
+        name = type + "://" + host + ":" + std::to_string(port);
+      }
+      else
+      {
+        ROS_ERROR("Unsupported type \"%s\" for entry %d in ~router_endpoints", type.c_str(), i);
+        continue;
+      }
+
+      comm->set_auto_reconnect(true);
+      router_->add_endpoint(comm, msgids);
+      router_endpoint_names_.push_back(name);
+      ROS_INFO("Routing MAVLink to \"%s\"", name.c_str());
+    }
+    catch (const XmlRpc::XmlRpcException &e)
+    {
+      ROS_ERROR("Invalid entry %d in ~router_endpoints: %s", i, e.getMessage().c_str());
+    }
+    catch (const mavrosflight::SerialException &e)
+    {
+      ROS_ERROR("Failed to open router endpoint %d: %s", i, e.what());
+    }
+  }
+}
+
 void rosflightIO::check_error_code(uint8_t current, uint8_t previous, ROSFLIGHT_ERROR_CODE code, std::string name)
 {
   if ((current & code) != (previous & code))
@@ -39,9 +39,20 @@
 #include <ros/ros.h>
 #include <rosflight/rosflight_io.h>
 
+#include <memory>
+
 int main(int argc, char **argv)
 {
   ros::init(argc, argv, "rosflight_io");
-  rosflight_io::rosflightIO rosflight_io;
+  std::unique_ptr<rosflight_io::rosflightIO> rosflight_io;
+  try
+  {
+    rosflight_io.reset(new rosflight_io::rosflightIO());
+  }
+  catch (const mavrosflight::SerialException &e)
+  {
+    ROS_FATAL("%s", e.what());
+    return 1;
+  }
   ros::spin();
 }
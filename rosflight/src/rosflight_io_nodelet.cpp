@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file rosflight_io_nodelet.cpp
+ *
+ * rosflight_io as a nodelet, so that subscribers loaded into the same nodelet manager receive its messages without
+ * serialization
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <rosflight/rosflight_io.h>
+
+#include <memory>
+
+namespace rosflight_io
+{
+/**
+ * \class RosflightIONodelet
+ * \brief Runs rosflightIO in a nodelet manager, with the same topics, services and parameters as the standalone node
+ */
+class RosflightIONodelet : public nodelet::Nodelet
+{
+private:
+  virtual void onInit()
+  {
+    // shutting ROS down here would take every other nodelet in the manager with it, so only this one is left inert
+    try
+    {
+      rosflight_io_.reset(new rosflightIO(getNodeHandle(), getPrivateNodeHandle()));
+    }
+    catch (const mavrosflight::SerialException &e)
+    {
+      NODELET_FATAL("%s", e.what());
+    }
+  }
+
+  std::unique_ptr<rosflightIO> rosflight_io_;
+};
+
+} // namespace rosflight_io
+
+PLUGINLIB_EXPORT_CLASS(rosflight_io::RosflightIONodelet, nodelet::Nodelet)
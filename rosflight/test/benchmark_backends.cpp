@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file benchmark_backends.cpp
+ *
+ * Compares the asio and epoll serial backends over a pseudo-terminal pair: the latency from writing a frame into the
+ * master side until MavlinkComm hands it to a listener, and the CPU time the receiving side uses.
+ *
+ * Usage: benchmark_backends [frames per second] [seconds]
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_comm.h>
+#include <rosflight/mavrosflight/mavlink_epoll_serial.h>
+#include <rosflight/mavrosflight/mavlink_serial.h>
+
+#include "latency_listener.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace mavrosflight;
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+double cpu_seconds(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void run(const char *name, MavlinkComm &comm, int master, int rate, int seconds)
+{
+  rosflight_test::LatencyListener listener;
+  comm.register_mavlink_frame_listener(&listener);
+  comm.open();
+
+  int frames = rate * seconds;
+  double process_start = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID);
+  double writer_start = cpu_seconds(CLOCK_THREAD_CPUTIME_ID);
+  Clock::time_point start = Clock::now();
+  Clock::time_point next = start;
+  for (int i = 0; i < frames; i++)
+  {
+    next += std::chrono::nanoseconds(1000000000LL / rate);
+    std::this_thread::sleep_until(next);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    uint16_t len = rosflight_test::pack_timed_frame(buf, i + 1);
+    if (write(master, buf, len) != len)
+    {
+      perror("write");
+      break;
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100)); // let the last frames arrive
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  double writer_cpu = cpu_seconds(CLOCK_THREAD_CPUTIME_ID) - writer_start;
+  double cpu = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID) - process_start - writer_cpu;
+
+  comm.close();
+  comm.unregister_mavlink_frame_listener(&listener);
+
+  std::vector<int64_t> latencies = listener.sorted_latencies_ns();
+  if (latencies.empty())
+  {
+    printf("%-6s received nothing\n", name);
+    return;
+  }
+  printf("%-6s %8lu/%-8d %10.1f %10.1f %10.1f %10.1f\n", name, (unsigned long)latencies.size(), frames,
+         latencies[latencies.size() / 2] * 1e-3, latencies[latencies.size() * 99 / 100] * 1e-3,
+         latencies.back() * 1e-3, 100 * cpu / elapsed);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int rate = argc > 1 ? atoi(argv[1]) : 1000;
+  int seconds = argc > 2 ? atoi(argv[2]) : 5;
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+    perror("posix_openpt");
+    return 1;
+  }
+  std::string slave = ptsname(master);
+
+  printf("%d frames/s for %d s over %s\n", rate, seconds, slave.c_str());
+  printf("%-6s %17s %10s %10s %10s %10s\n", "", "received", "p50 (us)", "p99 (us)", "max (us)", "CPU (%)");
+
+  {
+    MavlinkSerial serial(slave, 921600);
+    run("asio", serial, master, rate, seconds);
+  }
+#ifdef __linux__
+  {
+    MavlinkEpollSerial serial(slave, 921600);
+    run("epoll", serial, master, rate, seconds);
+  }
+#endif
+
+  close(master);
+  return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file benchmark_frame_scanner.cpp
+ *
+ * Measures how many received bytes per second MavlinkFrameScanner parses, against feeding the same bytes through
+ * mavlink_parse_char one at a time.
+ *
+ * Usage: benchmark_frame_scanner [capture file] [read size]
+ *
+ * The capture file holds raw bytes as read from the port, e.g. recorded with
+ *   stty -F /dev/ttyACM0 921600 raw && cat /dev/ttyACM0 > capture.bin
+ * Without one, a capture is synthesized: 1 kHz SMALL_IMU, a 1 Hz heartbeat, 10 Hz TIMESYNC and a parameter download,
+ * with one corrupted byte in every 10000.
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_frame_scanner.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using mavrosflight::MavlinkFrameScanner;
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const double MIN_DURATION_S = 1.0; //!< each parser runs over the capture repeatedly for at least this long
+
+void append(std::vector<uint8_t> *data, const mavlink_message_t &msg)
+{
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+  data->insert(data->end(), buf, buf + len);
+}
+
+/**
+ * \brief Ten seconds of a typical flight controller stream
+ */
+std::vector<uint8_t> synthesize_capture()
+{
+  std::vector<uint8_t> data;
+  mavlink_message_t msg;
+  for (int ms = 0; ms < 10000; ms++)
+  {
+    mavlink_msg_small_imu_pack(1, 1, &msg, ms * 1000ULL, 0.1f, -0.2f, -9.8f, 0.01f, 0.02f, -0.03f, 31.5f);
+    append(&data, msg);
+
+    if (ms % 100 == 0)
+    {
+      mavlink_msg_timesync_pack(1, 1, &msg, ms * 1000000LL, 0);
+      append(&data, msg);
+    }
+    if (ms % 1000 == 0)
+    {
+      mavlink_msg_heartbeat_pack(1, 1, &msg, 0, 0, 0, 0, 0);
+      append(&data, msg);
+    }
+    if (ms < 200)
+    {
+      mavlink_msg_param_value_pack(1, 1, &msg, "PARAM", 1.0f, MAV_PARAM_TYPE_REAL32, 200, ms);
+      append(&data, msg);
+    }
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<size_t> position(0, data.size() - 1);
+  for (size_t i = 0; i < data.size() / 10000; i++)
+  {
+    data[position(rng)] ^= 0x40;
+  }
+  return data;
+}
+
+bool load_capture(const char *filename, std::vector<uint8_t> *data)
+{
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+    return false;
+
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+  {
+    data->insert(data->end(), buf, buf + n);
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * \brief Scan the capture a read at a time, carrying cut-off frames over like MavlinkComm does
+ */
+uint64_t scan_capture(const std::vector<uint8_t> &capture, size_t read_size)
+{
+  MavlinkFrameScanner scanner;
+  std::vector<uint8_t> buffer(read_size + MAVLINK_MAX_PACKET_LEN);
+  size_t held = 0;
+  uint64_t frames = 0;
+
+  for (size_t pos = 0; pos < capture.size(); pos += read_size)
+  {
+    size_t n = std::min(read_size, capture.size() - pos);
+    memcpy(buffer.data() + held, capture.data() + pos, n);
+    size_t len = held + n;
+
+    size_t consumed = scanner.scan(buffer.data(), len, [&frames](const uint8_t *frame, size_t frame_len) { frames++; });
+    held = len - consumed;
+    memmove(buffer.data(), buffer.data() + consumed, held);
+  }
+  return frames;
+}
+
+uint64_t parse_capture(const std::vector<uint8_t> &capture)
+{
+  mavlink_message_t msg;
+  mavlink_status_t status;
+  uint64_t frames = 0;
+  for (size_t i = 0; i < capture.size(); i++)
+  {
+    if (mavlink_parse_char(MAVLINK_COMM_0, capture[i], &msg, &status))
+      frames++;
+  }
+  return frames;
+}
+
+template <typename Parse>
+void measure(const char *name, const std::vector<uint8_t> &capture, Parse parse)
+{
+  uint64_t frames = 0;
+  int passes = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed;
+  do
+  {
+    frames = parse();
+    passes++;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < MIN_DURATION_S);
+
+  double bytes_per_second = capture.size() * passes / elapsed;
+  printf("%-24s %10.1f MB/s %10lu frames/pass %8.1f ns/byte\n", name, bytes_per_second / 1e6, (unsigned long)frames,
+         1e9 / bytes_per_second);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::vector<uint8_t> capture;
+  if (argc > 1)
+  {
+    if (!load_capture(argv[1], &capture))
+    {
+      fprintf(stderr, "could not read %s\n", argv[1]);
+      return 1;
+    }
+    printf("%s: %lu bytes\n", argv[1], (unsigned long)capture.size());
+  }
+  else
+  {
+    capture = synthesize_capture();
+    printf("synthesized capture: %lu bytes\n", (unsigned long)capture.size());
+  }
+  size_t read_size = argc > 2 ? atoi(argv[2]) : 2048;
+
+  measure("mavlink_parse_char", capture, [&]() { return parse_capture(capture); });
+  char name[64];
+  snprintf(name, sizeof(name), "scanner (%lu B reads)", (unsigned long)read_size);
+  measure(name, capture, [&]() { return scan_capture(capture, read_size); });
+  return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file benchmark_frame_view.cpp
+ *
+ * Measures the cost per SMALL_IMU frame of getting from received bytes to the values a handler publishes, the way
+ * MavlinkComm did it before frame views and the way it does it now:
+ *  - before: mavlink_parse_char fills a mavlink_message_t, which the handler decodes into a mavlink_small_imu_t
+ *  - after: MavlinkFrameScanner finds the frame in the read buffer and the handler reads fields from it in place
+ *
+ * Usage: benchmark_frame_view [frames]
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_frame.h>
+#include <rosflight/mavrosflight/mavlink_frame_scanner.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using mavrosflight::MavlinkFrame;
+using mavrosflight::MavlinkFrameScanner;
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const size_t READ_SIZE = 2048;
+
+/**
+ * \brief The parts of sensor_msgs/Imu and sensor_msgs/Temperature filled from a SMALL_IMU message
+ */
+struct ImuOutput
+{
+  uint64_t stamp_us;
+  double linear_acceleration[3];
+  double angular_velocity[3];
+  double temperature;
+};
+
+double sink = 0; //!< keeps the compiler from discarding the outputs
+
+void consume(const ImuOutput &out)
+{
+  sink += out.stamp_us + out.linear_acceleration[0] + out.angular_velocity[2] + out.temperature;
+}
+
+void handle_message(const mavlink_message_t &msg)
+{
+  mavlink_small_imu_t imu;
+  mavlink_msg_small_imu_decode(&msg, &imu);
+
+  ImuOutput out;
+  out.stamp_us = imu.time_boot_us;
+  out.linear_acceleration[0] = imu.xacc;
+  out.linear_acceleration[1] = imu.yacc;
+  out.linear_acceleration[2] = imu.zacc;
+  out.angular_velocity[0] = imu.xgyro;
+  out.angular_velocity[1] = imu.ygyro;
+  out.angular_velocity[2] = imu.zgyro;
+  out.temperature = imu.temperature;
+  consume(out);
+}
+
+void handle_frame(const MavlinkFrame &frame)
+{
+  ImuOutput out;
+  out.stamp_us = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, time_boot_us);
+  out.linear_acceleration[0] = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, xacc);
+  out.linear_acceleration[1] = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, yacc);
+  out.linear_acceleration[2] = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, zacc);
+  out.angular_velocity[0] = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, xgyro);
+  out.angular_velocity[1] = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, ygyro);
+  out.angular_velocity[2] = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, zgyro);
+  out.temperature = MAVLINK_FRAME_FIELD(frame, mavlink_small_imu_t, temperature);
+  consume(out);
+}
+
+/**
+ * \brief Received bytes to handler, one byte at a time through mavlink_parse_char
+ */
+size_t receive_before(const std::vector<uint8_t> &stream)
+{
+  mavlink_message_t msg_in;
+  mavlink_status_t status;
+  size_t frames = 0;
+  for (size_t pos = 0; pos < stream.size(); pos += READ_SIZE)
+  {
+    size_t end = std::min(pos + READ_SIZE, stream.size());
+    for (size_t i = pos; i < end; i++)
+    {
+      if (mavlink_parse_char(MAVLINK_COMM_0, stream[i], &msg_in, &status))
+      {
+        handle_message(msg_in);
+        frames++;
+      }
+    }
+  }
+  return frames;
+}
+
+/**
+ * \brief Received bytes to handler through the frame scanner and frame views
+ */
+size_t receive_after(const std::vector<uint8_t> &stream)
+{
+  MavlinkFrameScanner scanner;
+  std::vector<uint8_t> buffer(READ_SIZE + MAVLINK_MAX_PACKET_LEN);
+  size_t held = 0;
+  size_t frames = 0;
+  for (size_t pos = 0; pos < stream.size(); pos += READ_SIZE)
+  {
+    size_t n = std::min(READ_SIZE, stream.size() - pos);
+    memcpy(buffer.data() + held, stream.data() + pos, n);
+    size_t len = held + n;
+    size_t consumed = scanner.scan(buffer.data(), len, [&frames](const uint8_t *frame, size_t frame_len) {
+      handle_frame(MavlinkFrame(frame));
+      frames++;
+    });
+    held = len - consumed;
+    memmove(buffer.data(), buffer.data() + consumed, held);
+  }
+  return frames;
+}
+
+/**
+ * \brief Frames already found in the buffer, unpacked into a message and decoded, as the old listeners got them
+ */
+size_t decode_before(const std::vector<uint8_t> &stream, size_t frame_len)
+{
+  mavlink_message_t msg;
+  size_t frames = 0;
+  for (size_t pos = 0; pos + frame_len <= stream.size(); pos += frame_len)
+  {
+    MavlinkFrameScanner::unpack(stream.data() + pos, &msg);
+    handle_message(msg);
+    frames++;
+  }
+  return frames;
+}
+
+/**
+ * \brief Frames already found in the buffer, read in place
+ */
+size_t decode_after(const std::vector<uint8_t> &stream, size_t frame_len)
+{
+  size_t frames = 0;
+  for (size_t pos = 0; pos + frame_len <= stream.size(); pos += frame_len)
+  {
+    handle_frame(MavlinkFrame(stream.data() + pos));
+    frames++;
+  }
+  return frames;
+}
+
+template <typename Receive>
+void measure(const char *name, Receive receive)
+{
+  // warm up, then take the best of several runs
+  receive();
+  double best_ns = 1e30;
+  size_t frames = 0;
+  for (int run = 0; run < 5; run++)
+  {
+    Clock::time_point start = Clock::now();
+    frames = receive();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / frames;
+    best_ns = std::min(best_ns, ns);
+  }
+  printf("%-44s %8.1f ns/frame (%lu frames)\n", name, best_ns, (unsigned long)frames);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  size_t count = argc > 1 ? atoi(argv[1]) : 100000;
+
+  std::vector<uint8_t> stream;
+  size_t frame_len = 0;
+  mavlink_message_t msg;
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  for (size_t i = 0; i < count; i++)
+  {
+    mavlink_msg_small_imu_pack(1, 1, &msg, i * 1000, 0.1f, -0.2f, -9.8f, 0.01f, 0.02f, -0.03f, 31.5f);
+    frame_len = mavlink_msg_to_send_buffer(buf, &msg);
+    stream.insert(stream.end(), buf, buf + frame_len);
+  }
+
+  measure("bytes to fields, mavlink_parse_char + decode", [&]() { return receive_before(stream); });
+  measure("bytes to fields, scanner + frame view", [&]() { return receive_after(stream); });
+  measure("frame to fields, unpack + decode", [&]() { return decode_before(stream, frame_len); });
+  measure("frame to fields, frame view", [&]() { return decode_after(stream, frame_len); });
+
+  return sink == 0.123 ? 1 : 0;
+}
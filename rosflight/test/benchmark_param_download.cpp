@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file benchmark_param_download.cpp
+ *
+ * Measures how long a full parameter download takes over a slow, lossy serial link with the windowed request engine,
+ * against what it replaced: rosflight_io re-requesting every missing parameter at once, every 3 s.
+ *
+ * Usage: benchmark_param_download [parameters] [loss rate] [runs]
+ */
+
+#include <rosflight/mavrosflight/interface_adapter.h>
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_listener_interface.h>
+#include <rosflight/mavrosflight/param_manager.h>
+
+#include "fakes.h"
+#include "simulated_fcu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const std::chrono::microseconds MESSAGE_TIME(5700); //!< a PARAM_VALUE frame at 57600 baud
+const std::chrono::seconds RETRY_ALL_PERIOD(3);     //!< PARAMETER_PERIOD in the old rosflight_io
+const std::chrono::seconds GIVE_UP(120);
+
+/**
+ * \brief The previous download, reduced to its requests: the list first, then every missing index on each period
+ */
+class RetryAllDownload : public mavrosflight::MavlinkListenerInterface
+{
+public:
+  explicit RetryAllDownload(mavrosflight::MavlinkComm *comm) : comm_(comm), num_params_(0), received_count_(0)
+  {
+    comm_->register_mavlink_listener(this, {MAVLINK_MSG_ID_PARAM_VALUE});
+  }
+
+  virtual void handle_mavlink_message(const mavlink_message_t &msg)
+  {
+    mavlink_param_value_t param;
+    mavlink_msg_param_value_decode(&msg, &param);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (received_.empty())
+    {
+      num_params_ = param.param_count;
+      received_.assign(num_params_, false);
+    }
+    if (param.param_index < num_params_ && !received_[param.param_index])
+    {
+      received_[param.param_index] = true;
+      received_count_++;
+    }
+  }
+
+  bool complete()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_params_ > 0 && received_count_ == num_params_;
+  }
+
+  void request_params()
+  {
+    std::vector<int> missing;
+    bool first_param_received;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      first_param_received = received_count_ > 0;
+      for (size_t i = 0; i < received_.size(); i++)
+      {
+        if (!received_[i])
+          missing.push_back(i);
+      }
+    }
+
+    mavlink_message_t msg;
+    if (!first_param_received)
+    {
+      mavlink_msg_param_request_list_pack(1, 50, &msg, 1, MAV_COMP_ID_ALL);
+      comm_->send_message(msg);
+      return;
+    }
+
+    char empty[MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN] = {};
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+      mavlink_msg_param_request_read_pack(1, 50, &msg, 1, MAV_COMP_ID_ALL, empty, missing[i]);
+      comm_->send_message(msg);
+    }
+  }
+
+private:
+  mavrosflight::MavlinkComm *comm_;
+  std::mutex mutex_;
+  size_t num_params_;
+  size_t received_count_;
+  std::vector<bool> received_;
+};
+
+double retry_all_download(size_t num_params, double loss_rate, unsigned seed)
+{
+  rosflight_test::SimulatedFcu fcu(num_params, loss_rate, MESSAGE_TIME, seed);
+  RetryAllDownload download(&fcu);
+  fcu.open();
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point next_request = start;
+  while (!download.complete() && Clock::now() - start < GIVE_UP)
+  {
+    if (Clock::now() >= next_request)
+    {
+      download.request_params();
+      next_request += RETRY_ALL_PERIOD;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  fcu.close();
+  return elapsed;
+}
+
+double windowed_download(size_t num_params, double loss_rate, unsigned seed)
+{
+  rosflight_test::ThreadTimerProvider timers;
+  rosflight_test::SimulatedFcu fcu(num_params, loss_rate, MESSAGE_TIME, seed);
+  mavrosflight::DerivedLoggerType logger;
+  mavrosflight::ParamManager<mavrosflight::DerivedLoggerType> params(&fcu, logger, timers);
+  fcu.open();
+
+  Clock::time_point start = Clock::now();
+  params.request_params();
+  while (!params.got_all_params() && Clock::now() - start < GIVE_UP)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  timers.shutdown();
+  fcu.close();
+  return elapsed;
+}
+
+void print(const char *name, std::vector<double> times)
+{
+  std::sort(times.begin(), times.end());
+  printf("%-22s %10.2f %10.2f %10.2f\n", name, times[times.size() / 2], times[times.size() * 9 / 10], times.back());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  size_t num_params = argc > 1 ? atoi(argv[1]) : 200;
+  double loss_rate = argc > 2 ? atof(argv[2]) : 0.2;
+  int runs = argc > 3 ? atoi(argv[3]) : 5;
+  printf("%zu parameters, %.0f%% loss each way, %d runs\n", num_params, loss_rate * 100, runs);
+
+  std::vector<double> retry_all, windowed;
+  for (int run = 0; run < runs; run++)
+  {
+    retry_all.push_back(retry_all_download(num_params, loss_rate, run + 1));
+    windowed.push_back(windowed_download(num_params, loss_rate, run + 1));
+  }
+
+  printf("%-22s %10s %10s %10s\n", "download", "p50 (s)", "p90 (s)", "max (s)");
+  print("retry all every 3 s", retry_all);
+  print("windowed", windowed);
+  return 0;
+}
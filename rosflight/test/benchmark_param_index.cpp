@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file benchmark_param_index.cpp
+ *
+ * Measures parameter lookups, PARAM_VALUE updates and sets in ParamManager's index-addressed table against the
+ * std::map keyed by name that it replaced, on random 16-character names.
+ *
+ * Usage: benchmark_param_index [parameters] [operations]
+ */
+
+#include <rosflight/mavrosflight/interface_adapter.h>
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/param.h>
+#include <rosflight/mavrosflight/param_manager.h>
+
+#include "fakes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * \brief The previous parameter table, reduced to its lookups: a std::map keyed by name, searched twice per access
+ */
+class MapParamTable
+{
+public:
+  void handle_param_value(const mavlink_message_t &msg)
+  {
+    mavlink_param_value_t param;
+    mavlink_msg_param_value_decode(&msg, &param);
+
+    char c_name[MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN + 1];
+    memcpy(c_name, param.param_id, MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN);
+    c_name[MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN] = '\0';
+    std::string name(c_name);
+
+    if (!is_param_id(name))
+      params_[name] = mavrosflight::Param(param);
+    else
+      params_[name].handleUpdate(param);
+  }
+
+  bool get_param_value(std::string name, double *value)
+  {
+    if (!is_param_id(name))
+      return false;
+    *value = params_[name].getValue();
+    return true;
+  }
+
+  bool set_param_value(std::string name, double value)
+  {
+    if (!is_param_id(name))
+      return false;
+    mavlink_message_t msg;
+    params_[name].requestSet(value, &msg);
+    set_queue_.push_back(msg);
+    return true;
+  }
+
+private:
+  bool is_param_id(const std::string &name) { return params_.find(name) != params_.end(); }
+
+  std::map<std::string, mavrosflight::Param> params_;
+  std::deque<mavlink_message_t> set_queue_;
+};
+
+typedef mavrosflight::ParamManager<mavrosflight::DerivedLoggerType> ParamManager;
+
+void pack_value(mavlink_message_t *msg, const std::string &name, size_t index, size_t count, float value)
+{
+  mavlink_msg_param_value_pack(1, 1, msg, name.c_str(), value, MAV_PARAM_TYPE_REAL32, count, index);
+}
+
+struct Result
+{
+  double get_ns;
+  double update_ns;
+  double set_ns;
+};
+
+/**
+ * \brief Run the same random sequence of operations against either table
+ *
+ * A set is followed by the flight controller's echo, so ParamManager's set window never fills.
+ */
+template <typename Table>
+Result run(Table &table, const std::vector<std::string> &names, const std::vector<size_t> &order)
+{
+  mavlink_message_t msg;
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    pack_value(&msg, names[i], i, names.size(), 0.0f);
+    table.handle_param_value(msg);
+  }
+
+  Result result;
+  double sum = 0;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    double value;
+    table.get_param_value(names[order[i]], &value);
+    sum += value;
+  }
+  result.get_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / order.size();
+
+  start = Clock::now();
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    pack_value(&msg, names[order[i]], order[i], names.size(), static_cast<float>(i));
+    table.handle_param_value(msg);
+  }
+  result.update_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / order.size();
+
+  start = Clock::now();
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    float value = static_cast<float>(order.size() + i);
+    table.set_param_value(names[order[i]], value);
+    pack_value(&msg, names[order[i]], order[i], names.size(), value);
+    table.handle_param_value(msg);
+  }
+  result.set_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / order.size();
+
+  if (sum < 0) // keep the lookups from being optimized away
+    printf("%f\n", sum);
+  return result;
+}
+
+/**
+ * \brief Gives ParamManager the same interface as MapParamTable for run()
+ */
+class ParamManagerTable
+{
+public:
+  ParamManagerTable() : params_(&comm_, logger_, timers_) {}
+
+  void handle_param_value(const mavlink_message_t &msg) { params_.handle_mavlink_message(msg); }
+  bool get_param_value(const std::string &name, double *value) { return params_.get_param_value(name, value); }
+  bool set_param_value(const std::string &name, double value) { return params_.set_param_value(name, value); }
+
+private:
+  rosflight_test::ClosedComm comm_;
+  mavrosflight::DerivedLoggerType logger_;
+  rosflight_test::StoppedTimerProvider timers_;
+  ParamManager params_;
+};
+
+void print(const char *name, const Result &result)
+{
+  printf("%-16s %10.0f %12.0f %14.0f\n", name, result.get_ns, result.update_ns, result.set_ns);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  size_t num_params = argc > 1 ? atoi(argv[1]) : 150;
+  size_t operations = argc > 2 ? atoi(argv[2]) : 100000;
+  printf("%zu parameters, %zu operations of each kind, ns per operation\n", num_params, operations);
+
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> letter('A', 'Z');
+  std::vector<std::string> names(num_params);
+  for (size_t i = 0; i < num_params; i++)
+  {
+    for (size_t j = 0; j < MAVLINK_MSG_PARAM_VALUE_FIELD_PARAM_ID_LEN; j++)
+    {
+      names[i] += static_cast<char>(letter(random));
+    }
+  }
+
+  std::uniform_int_distribution<size_t> pick(0, num_params - 1);
+  std::vector<size_t> order(operations);
+  for (size_t i = 0; i < operations; i++)
+  {
+    order[i] = pick(random);
+  }
+
+  printf("%-16s %10s %12s %14s\n", "table", "get", "PARAM_VALUE", "set + echo");
+  {
+    MapParamTable table;
+    print("std::map", run(table, names, order));
+  }
+  {
+    ParamManagerTable table;
+    print("ParamManager", run(table, names, order));
+  }
+  return 0;
+}
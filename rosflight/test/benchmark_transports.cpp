@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file benchmark_transports.cpp
+ *
+ * Compares the latency from a peer process writing a frame until MavlinkComm hands it to a listener, over localhost
+ * UDP, TCP and a Unix domain socket.
+ *
+ * Usage: benchmark_transports [frames per second] [seconds]
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_comm.h>
+#include <rosflight/mavrosflight/mavlink_tcp.h>
+#include <rosflight/mavrosflight/mavlink_udp.h>
+#include <rosflight/mavrosflight/mavlink_unix.h>
+
+#include "latency_listener.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace mavrosflight;
+
+namespace
+{
+const uint16_t UDP_COMM_PORT = 14640;
+const uint16_t UDP_PEER_PORT = 14641;
+
+sockaddr_in loopback(uint16_t port)
+{
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+/**
+ * \brief Open the link, let the peer end connect to it, and time frames written from the peer end
+ * \param open_peer Callable returning the peer's socket once the link is open, or -1
+ */
+template <typename OpenPeer>
+void run(const char *name, MavlinkComm &comm, OpenPeer open_peer, int rate, int seconds)
+{
+  rosflight_test::LatencyListener listener;
+  comm.register_mavlink_frame_listener(&listener);
+  comm.open();
+  int peer = open_peer();
+  if (peer < 0)
+  {
+    perror(name);
+    comm.close();
+    return;
+  }
+
+  int frames = rate * seconds;
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  for (int i = 0; i < frames; i++)
+  {
+    next += std::chrono::nanoseconds(1000000000LL / rate);
+    std::this_thread::sleep_until(next);
+
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    uint16_t len = rosflight_test::pack_timed_frame(buf, i + 1);
+    if (write(peer, buf, len) != len)
+    {
+      perror("write");
+      break;
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100)); // let the last frames arrive
+
+  comm.close();
+  comm.unregister_mavlink_frame_listener(&listener);
+  close(peer);
+
+  std::vector<int64_t> latencies = listener.sorted_latencies_ns();
+  if (latencies.empty())
+  {
+    printf("%-6s received nothing\n", name);
+    return;
+  }
+  printf("%-6s %8lu/%-8d %10.1f %10.1f %10.1f\n", name, (unsigned long)latencies.size(), frames,
+         latencies[latencies.size() / 2] * 1e-3, latencies[latencies.size() * 99 / 100] * 1e-3,
+         latencies.back() * 1e-3);
+}
+
+/**
+ * \brief Accept the single connection a listening socket expects, and close the listening socket
+ */
+int accept_one(int listener)
+{
+  int fd = accept(listener, NULL, NULL);
+  close(listener);
+  return fd;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int rate = argc > 1 ? atoi(argv[1]) : 1000;
+  int seconds = argc > 2 ? atoi(argv[2]) : 5;
+
+  printf("%d frames/s for %d s\n", rate, seconds);
+  printf("%-6s %17s %10s %10s %10s\n", "", "received", "p50 (us)", "p99 (us)", "max (us)");
+
+  {
+    MavlinkUDP udp("127.0.0.1", UDP_COMM_PORT, "127.0.0.1", UDP_PEER_PORT);
+    run("udp", udp,
+        []() {
+          int fd = socket(AF_INET, SOCK_DGRAM, 0);
+          sockaddr_in local = loopback(UDP_PEER_PORT);
+          sockaddr_in remote = loopback(UDP_COMM_PORT);
+          if (bind(fd, (sockaddr *)&local, sizeof(local)) != 0 || connect(fd, (sockaddr *)&remote, sizeof(remote)) != 0)
+          {
+            close(fd);
+            return -1;
+          }
+          return fd;
+        },
+        rate, seconds);
+  }
+
+  {
+    // listen on an ephemeral port before the link connects to it
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = loopback(0);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 1) != 0
+        || getsockname(listener, (sockaddr *)&addr, &addr_len) != 0)
+    {
+      perror("tcp listen");
+      return 1;
+    }
+
+    MavlinkTCP tcp("127.0.0.1", ntohs(addr.sin_port));
+    run("tcp", tcp,
+        [listener]() {
+          int fd = accept_one(listener);
+          int one = 1;
+          if (fd >= 0)
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          return fd;
+        },
+        rate, seconds);
+  }
+
+  {
+    std::string path = "/tmp/benchmark_transports." + std::to_string(getpid()) + ".sock";
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 1) != 0)
+    {
+      perror("unix listen");
+      return 1;
+    }
+
+    MavlinkUnix unix_socket(path);
+    run("unix", unix_socket, [listener]() { return accept_one(listener); }, rate, seconds);
+    unlink(path.c_str());
+  }
+
+  return 0;
+}
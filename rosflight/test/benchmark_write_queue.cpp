@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file benchmark_write_queue.cpp
+ *
+ * Measures how fast threads can hand packets to MavlinkComm::send_message, and how long each call takes, against the
+ * write path it replaced: a heap-allocated buffer per packet on a std::list guarded by a recursive mutex.
+ *
+ * Usage: benchmark_write_queue [threads] [messages per thread] [messages per second per thread, 0 for no limit]
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_comm.h>
+
+#include "fakes.h"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <thread>
+#include <vector>
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * \brief The previous write path, reduced to its queueing, over a port that finishes every write at once
+ */
+class ListWritePath
+{
+public:
+  ListWritePath() : work_(io_service_), write_in_progress_(false)
+  {
+    io_thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &io_service_));
+  }
+
+  ~ListWritePath()
+  {
+    io_service_.stop();
+    io_thread_.join();
+    for (std::list<WriteBuffer *>::iterator it = write_queue_.begin(); it != write_queue_.end(); ++it)
+    {
+      delete *it;
+    }
+  }
+
+  void send_message(const mavlink_message_t &msg)
+  {
+    WriteBuffer *buffer = new WriteBuffer();
+    buffer->len = mavlink_msg_to_send_buffer(buffer->data, &msg);
+
+    {
+      mutex_lock lock(mutex_);
+      write_queue_.push_back(buffer);
+    }
+
+    async_write(true);
+  }
+
+private:
+  struct WriteBuffer
+  {
+    uint8_t data[MAVLINK_MAX_PACKET_LEN];
+    size_t len;
+    size_t pos;
+
+    WriteBuffer() : len(0), pos(0) {}
+  };
+
+  typedef boost::lock_guard<boost::recursive_mutex> mutex_lock;
+
+  void async_write(bool check_write_state)
+  {
+    if (check_write_state && write_in_progress_)
+      return;
+
+    mutex_lock lock(mutex_);
+    if (write_queue_.empty())
+      return;
+
+    write_in_progress_ = true;
+    WriteBuffer *buffer = write_queue_.front();
+    io_service_.post(boost::bind(&ListWritePath::async_write_end, this, buffer->len - buffer->pos));
+  }
+
+  void async_write_end(size_t bytes_transferred)
+  {
+    mutex_lock lock(mutex_);
+    if (write_queue_.empty())
+    {
+      write_in_progress_ = false;
+      return;
+    }
+
+    WriteBuffer *buffer = write_queue_.front();
+    buffer->pos += bytes_transferred;
+    if (buffer->pos == buffer->len)
+    {
+      write_queue_.pop_front();
+      delete buffer;
+    }
+
+    if (write_queue_.empty())
+      write_in_progress_ = false;
+    else
+      async_write(false);
+  }
+
+  boost::asio::io_service io_service_;
+  boost::asio::io_service::work work_;
+  boost::thread io_thread_;
+  boost::recursive_mutex mutex_;
+  std::list<WriteBuffer *> write_queue_;
+  bool write_in_progress_;
+};
+
+struct Result
+{
+  double messages_per_second;
+  double p50_ns;
+  double p99_ns;
+  double max_ns;
+};
+
+template <typename Sender>
+Result run(Sender &sender, int threads, int messages, double rate)
+{
+  std::vector<std::vector<uint32_t> > latencies(threads, std::vector<uint32_t>(messages));
+  std::vector<std::thread> senders;
+
+  Clock::time_point start = Clock::now();
+  for (int t = 0; t < threads; t++)
+  {
+    senders.emplace_back([&, t]() {
+      mavlink_message_t msg;
+      Clock::time_point next = Clock::now();
+      for (int i = 0; i < messages; i++)
+      {
+        if (rate > 0)
+        {
+          next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / rate));
+          std::this_thread::sleep_until(next);
+        }
+        mavlink_msg_offboard_control_pack(1, 50, &msg, 0, 0, 0.1f * i, 0.2f, 0.3f, 0.5f);
+        Clock::time_point before = Clock::now();
+        sender.send_message(msg);
+        latencies[t][i] = uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+      }
+    });
+  }
+  for (int t = 0; t < threads; t++)
+  {
+    senders[t].join();
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<uint32_t> all;
+  for (int t = 0; t < threads; t++)
+  {
+    all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+  }
+  std::sort(all.begin(), all.end());
+
+  Result result;
+  result.messages_per_second = all.size() / elapsed;
+  result.p50_ns = all[all.size() / 2];
+  result.p99_ns = all[all.size() * 99 / 100];
+  result.max_ns = all.back();
+  return result;
+}
+
+void print(const char *name, const Result &result)
+{
+  printf("%-22s %12.0f %10.0f %10.0f %12.0f\n", name, result.messages_per_second, result.p50_ns, result.p99_ns,
+         result.max_ns);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  int messages = argc > 2 ? atoi(argv[2]) : 200000;
+  double rate = argc > 3 ? atof(argv[3]) : 0;
+  printf("%d threads, %d messages each, ", threads, messages);
+  if (rate > 0)
+    printf("%.0f messages/s each\n", rate);
+  else
+    printf("as fast as possible\n");
+  printf("%-22s %12s %10s %10s %12s\n", "write path", "messages/s", "p50 (ns)", "p99 (ns)", "max (ns)");
+
+  {
+    ListWritePath list;
+    print("list + mutex", run(list, threads, messages, rate));
+  }
+
+  {
+    rosflight_test::NullComm comm;
+    comm.open();
+    Result result = run(comm, threads, messages, rate);
+    print("ring (send_message)", result);
+    printf("ring dropped %lu packets when full\n", (unsigned long)comm.get_write_queue_dropped());
+    comm.close();
+  }
+
+  return 0;
+}
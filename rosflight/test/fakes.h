@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file fakes.h
+ *
+ * Stand-ins for the port, clock and timers used by the mavrosflight tests
+ */
+
+#ifndef ROSFLIGHT_TEST_FAKES_H
+#define ROSFLIGHT_TEST_FAKES_H
+
+#include <rosflight/mavrosflight/mavlink_comm.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+#include <rosflight/mavrosflight/time_interface.h>
+#include <rosflight/mavrosflight/timer_interface.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ratio>
+#include <thread>
+#include <vector>
+
+namespace rosflight_test
+{
+/**
+ * \brief A port that is never opened, for objects that only need somewhere to register as listeners
+ */
+class ClosedComm : public mavrosflight::MavlinkComm
+{
+protected:
+  virtual bool is_open() { return false; }
+  virtual void do_open() {}
+  virtual void do_close() {}
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {}
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler) {}
+};
+
+/**
+ * \brief A port that is always open and finishes every write at once, throwing the bytes away
+ */
+class NullComm : public mavrosflight::MavlinkComm
+{
+public:
+  NullComm() : work_(io_service_) {}
+
+protected:
+  virtual bool is_open() { return true; }
+  virtual void do_open() {}
+  virtual void do_close() {}
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {}
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+  {
+    io_service_.post(boost::bind(handler, boost::system::error_code(), boost::asio::buffer_size(buffers)));
+  }
+
+private:
+  boost::asio::io_service::work work_; //!< keeps the io thread running, since reads never complete
+};
+
+/**
+ * \brief A port that reads the same bytes over and over, as fast as the io thread takes them
+ *
+ * Holds on to the handler it is given rather than copying it, so that the port itself never allocates.
+ */
+class ReplayComm : public mavrosflight::MavlinkComm
+{
+public:
+  explicit ReplayComm(const std::vector<uint8_t> &bytes) :
+    work_(io_service_),
+    bytes_(bytes),
+    position_(0),
+    read_length_(0),
+    read_handler_(nullptr)
+  {
+  }
+
+protected:
+  virtual bool is_open() { return true; }
+  virtual void do_open() {}
+  virtual void do_close() {}
+
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
+  {
+    // wrap around at the end of the bytes only, so the stream never changes
+    read_length_ = std::min(boost::asio::buffer_size(buffer), bytes_.size() - position_);
+    memcpy(boost::asio::buffer_cast<uint8_t *>(buffer), bytes_.data() + position_, read_length_);
+    position_ = (position_ + read_length_) % bytes_.size();
+    read_handler_ = &handler;
+    io_service_.post(boost::bind(&ReplayComm::complete_read, this));
+  }
+
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+  {
+    io_service_.post(boost::bind(handler, boost::system::error_code(), boost::asio::buffer_size(buffers)));
+  }
+
+private:
+  void complete_read() { (*read_handler_)(boost::system::error_code(), read_length_); }
+
+  boost::asio::io_service::work work_;
+  const std::vector<uint8_t> bytes_;
+  size_t position_;
+  size_t read_length_;
+  const IoHandler *read_handler_; //!< MavlinkComm's own read handler, which outlives every read
+};
+
+/**
+ * \brief A port that takes as long to write as a serial link at the given baud rate, and records every packet written
+ */
+class SlowLinkComm : public mavrosflight::MavlinkComm
+{
+public:
+  struct Written
+  {
+    std::chrono::steady_clock::time_point time; //!< when the last byte of the packet went out
+    std::vector<uint8_t> frame;
+  };
+
+  explicit SlowLinkComm(int baud_rate) :
+    work_(io_service_),
+    write_timer_(io_service_),
+    byte_time_(std::chrono::nanoseconds(10 * std::nano::den / baud_rate)) // 8N1 sends 10 bits per byte
+  {
+  }
+
+  std::vector<Written> written()
+  {
+    std::lock_guard<std::mutex> lock(written_mutex_);
+    return written_;
+  }
+
+protected:
+  virtual bool is_open() { return true; }
+  virtual void do_open() {}
+  virtual void do_close() {}
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {}
+
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+  {
+    std::vector<std::vector<uint8_t> > packets;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+      const uint8_t *data = boost::asio::buffer_cast<const uint8_t *>(buffers[i]);
+      packets.push_back(std::vector<uint8_t>(data, data + boost::asio::buffer_size(buffers[i])));
+    }
+
+    size_t bytes = boost::asio::buffer_size(buffers);
+    write_timer_.expires_from_now(bytes * byte_time_);
+    write_timer_.async_wait([this, packets, bytes, handler](const boost::system::error_code &error) {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      {
+        std::lock_guard<std::mutex> lock(written_mutex_);
+        for (size_t i = 0; i < packets.size(); i++)
+        {
+          Written written = {now, packets[i]};
+          written_.push_back(written);
+        }
+      }
+      handler(error, error ? 0 : bytes);
+    });
+  }
+
+private:
+  boost::asio::io_service::work work_;
+  boost::asio::steady_timer write_timer_;
+  std::chrono::nanoseconds byte_time_;
+
+  std::mutex written_mutex_;
+  std::vector<Written> written_;
+};
+
+/**
+ * \brief A port that fails when the test tells it to, for driving MavlinkComm through losing and reopening the link
+ *
+ * Reads only complete when the test fills them with deliver() or fails them with fail_read(), and writes complete at
+ * once, recording every packet written.
+ */
+class FlakyComm : public mavrosflight::MavlinkComm
+{
+public:
+  FlakyComm() :
+    work_(io_service_),
+    open_(false),
+    failed_opens_(0),
+    fail_writes_(false),
+    pending_buffer_(nullptr, 0),
+    writes_(0)
+  {
+  }
+
+  //! Make the next count attempts to open the port throw
+  void fail_opens(int count)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_opens_ = count;
+  }
+
+  //! Complete the pending read with the given bytes, which must fit in its buffer; returns false if no read is pending
+  bool deliver(const std::vector<uint8_t> &bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_read_ || bytes.size() > boost::asio::buffer_size(pending_buffer_))
+      return false;
+    memcpy(boost::asio::buffer_cast<uint8_t *>(pending_buffer_), bytes.data(), bytes.size());
+    io_service_.post(boost::bind(pending_read_, boost::system::error_code(), bytes.size()));
+    pending_read_.clear();
+    return true;
+  }
+
+  //! Complete the pending read with an error; returns false if no read is pending
+  bool fail_read(const boost::system::error_code &error)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_read_)
+      return false;
+    io_service_.post(boost::bind(pending_read_, error, 0));
+    pending_read_.clear();
+    return true;
+  }
+
+  //! Complete every write from now on with an error, or successfully again
+  void fail_writes(bool fail)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fail_writes_ = fail;
+  }
+
+  //! Run a function at the start of each do_close, from whichever thread closes the port
+  void on_close(const std::function<void()> &hook)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_hook_ = hook;
+  }
+
+  std::vector<std::chrono::steady_clock::time_point> open_attempts()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return open_attempts_;
+  }
+
+  std::vector<std::vector<uint8_t> > written()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return written_;
+  }
+
+  //! Number of calls to do_async_write, whether they failed or not
+  size_t writes()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writes_;
+  }
+
+protected:
+  virtual bool is_open() { return open_; }
+
+  virtual void do_open()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_attempts_.push_back(std::chrono::steady_clock::now());
+    if (failed_opens_ > 0)
+    {
+      failed_opens_--;
+      throw mavrosflight::SerialException("port unavailable");
+    }
+    open_ = true;
+  }
+
+  virtual void do_close()
+  {
+    std::function<void()> hook;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      hook = close_hook_;
+    }
+    if (hook)
+      hook();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_ = false;
+    pending_read_.clear();
+  }
+
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_buffer_ = buffer;
+    pending_read_ = handler;
+  }
+
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    writes_++;
+    if (fail_writes_)
+    {
+      io_service_.post(boost::bind(handler, boost::asio::error::make_error_code(boost::asio::error::broken_pipe), 0));
+      return;
+    }
+
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+      const uint8_t *data = boost::asio::buffer_cast<const uint8_t *>(buffers[i]);
+      written_.push_back(std::vector<uint8_t>(data, data + boost::asio::buffer_size(buffers[i])));
+    }
+    io_service_.post(boost::bind(handler, boost::system::error_code(), boost::asio::buffer_size(buffers)));
+  }
+
+private:
+  boost::asio::io_service::work work_;
+  std::atomic<bool> open_;
+
+  std::mutex mutex_;
+  int failed_opens_;
+  bool fail_writes_;
+  IoHandler pending_read_;
+  boost::asio::mutable_buffers_1 pending_buffer_;
+  std::function<void()> close_hook_;
+  std::vector<std::chrono::steady_clock::time_point> open_attempts_;
+  std::vector<std::vector<uint8_t> > written_;
+  size_t writes_;
+};
+
+/**
+ * \brief System clock that only moves when the test moves it
+ */
+class FakeClock : public mavrosflight::TimeInterface
+{
+public:
+  explicit FakeClock(std::chrono::nanoseconds start) : now_(start.count()) {}
+
+  virtual std::chrono::nanoseconds now() const { return std::chrono::nanoseconds(now_.load()); }
+
+  void advance(std::chrono::nanoseconds delta) { now_ += delta.count(); }
+
+private:
+  std::atomic<int64_t> now_;
+};
+
+/**
+ * \brief Timer provider whose timers never fire, so the test drives the object under test itself
+ */
+class StoppedTimerProvider : public mavrosflight::TimerProviderInterface
+{
+public:
+  virtual std::shared_ptr<mavrosflight::TimerInterface> create_timer(std::chrono::nanoseconds period,
+                                                                     std::function<void()> callback,
+                                                                     const bool oneshot,
+                                                                     const bool autostart)
+  {
+    return std::make_shared<StoppedTimer>();
+  }
+
+private:
+  struct StoppedTimer : public mavrosflight::TimerInterface
+  {
+    virtual void start() {}
+    virtual void stop() {}
+  };
+};
+
+/**
+ * \brief Timer provider that fires its timers from one background thread, in real time
+ *
+ * Call shutdown() before destroying the objects that own the timers, since a callback may be running until then.
+ */
+class ThreadTimerProvider : public mavrosflight::TimerProviderInterface
+{
+public:
+  ThreadTimerProvider() : running_(true), thread_(&ThreadTimerProvider::run, this) {}
+  ~ThreadTimerProvider() { shutdown(); }
+
+  virtual std::shared_ptr<mavrosflight::TimerInterface> create_timer(std::chrono::nanoseconds period,
+                                                                     std::function<void()> callback,
+                                                                     const bool oneshot,
+                                                                     const bool autostart)
+  {
+    std::shared_ptr<ThreadTimer> timer = std::make_shared<ThreadTimer>(period, callback, oneshot);
+    if (autostart)
+      timer->start();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    timers_.push_back(timer);
+    return timer;
+  }
+
+  void shutdown()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  class ThreadTimer : public mavrosflight::TimerInterface
+  {
+  public:
+    ThreadTimer(std::chrono::nanoseconds period, std::function<void()> callback, bool oneshot) :
+      period_(period),
+      callback_(callback),
+      oneshot_(oneshot),
+      started_(false)
+    {
+    }
+
+    virtual void start()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      started_ = true;
+      next_ = Clock::now() + period_;
+    }
+
+    virtual void stop()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      started_ = false;
+    }
+
+    //! Run the callback if the timer is due, without holding the lock, since the callback may start or stop it
+    void fire_if_due(Clock::time_point now)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!started_ || now < next_)
+          return;
+        next_ += period_;
+        started_ = !oneshot_;
+      }
+      callback_();
+    }
+
+  private:
+    const std::chrono::nanoseconds period_;
+    const std::function<void()> callback_;
+    const bool oneshot_;
+
+    std::mutex mutex_;
+    bool started_;
+    Clock::time_point next_;
+  };
+
+  void run()
+  {
+    while (true)
+    {
+      std::vector<std::shared_ptr<ThreadTimer> > timers;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+          return;
+        timers = timers_;
+      }
+
+      for (size_t i = 0; i < timers.size(); i++)
+      {
+        timers[i]->fire_if_due(Clock::now());
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  std::mutex mutex_;
+  bool running_;
+  std::vector<std::shared_ptr<ThreadTimer> > timers_;
+  std::thread thread_; //!< declared last, so that it starts after everything it uses
+};
+
+} // namespace rosflight_test
+
+#endif // ROSFLIGHT_TEST_FAKES_H
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file latency_listener.h
+ *
+ * Frame listener shared by the benchmarks that time frames from the peer end of a link to MavlinkComm's listeners
+ */
+
+#ifndef ROSFLIGHT_TEST_LATENCY_LISTENER_H
+#define ROSFLIGHT_TEST_LATENCY_LISTENER_H
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_frame.h>
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace rosflight_test
+{
+/**
+ * \brief Steady clock time as carried in a TIMESYNC ts1 field
+ */
+inline int64_t steady_now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * \brief Pack a TIMESYNC frame that carries the time it was sent in ts1
+ * \return Length of the frame in buf
+ */
+inline uint16_t pack_timed_frame(uint8_t *buf, int64_t index)
+{
+  mavlink_message_t msg;
+  mavlink_msg_timesync_pack(1, 1, &msg, index, steady_now_ns());
+  return mavlink_msg_to_send_buffer(buf, &msg);
+}
+
+/**
+ * \brief Records how long each frame from pack_timed_frame took to reach the listener
+ */
+class LatencyListener : public mavrosflight::MavlinkFrameListenerInterface
+{
+public:
+  virtual void handle_mavlink_frame(const mavrosflight::MavlinkFrame &frame)
+  {
+    int64_t now = steady_now_ns();
+    int64_t sent = MAVLINK_FRAME_FIELD(frame, mavlink_timesync_t, ts1);
+    std::lock_guard<std::mutex> lock(mutex_);
+    latencies_ns_.push_back(now - sent);
+  }
+
+  /**
+   * \brief The latencies recorded so far, in nanoseconds, sorted
+   */
+  std::vector<int64_t> sorted_latencies_ns()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<int64_t> sorted = latencies_ns_;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<int64_t> latencies_ns_;
+};
+
+} // namespace rosflight_test
+
+#endif // ROSFLIGHT_TEST_LATENCY_LISTENER_H
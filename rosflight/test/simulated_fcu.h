@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file simulated_fcu.h
+ *
+ * A flight controller with a parameter table, at the far end of a slow and lossy serial link, for the parameter tests
+ */
+
+#ifndef ROSFLIGHT_TEST_SIMULATED_FCU_H
+#define ROSFLIGHT_TEST_SIMULATED_FCU_H
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_comm.h>
+
+#include <boost/bind.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace rosflight_test
+{
+/**
+ * \brief A port to a simulated flight controller that holds a table of INT32 parameters
+ *
+ * Each message takes message_time to cross the link in either direction, one after another, and is lost with the
+ * given probability. The flight controller answers PARAM_REQUEST_LIST, PARAM_REQUEST_READ and PARAM_SET the way the
+ * firmware does. Parameter i is named param_name(i) and starts with the value i.
+ */
+class SimulatedFcu : public mavrosflight::MavlinkComm
+{
+public:
+  SimulatedFcu(size_t num_params, double loss_rate, std::chrono::microseconds message_time, unsigned seed = 1) :
+    work_(io_service_),
+    read_timer_(io_service_),
+    pending_buffer_(nullptr, 0),
+    message_time_(message_time),
+    loss_rate_(loss_rate),
+    random_(seed),
+    uplink_free_(Clock::now()),
+    downlink_free_(Clock::now()),
+    sets_received_(0)
+  {
+    for (size_t i = 0; i < num_params; i++)
+    {
+      values_.push_back(static_cast<int32_t>(i));
+    }
+    memset(&parse_status_, 0, sizeof(parse_status_));
+  }
+
+  static std::string param_name(size_t index)
+  {
+    char name[17];
+    snprintf(name, sizeof(name), "PARAM_%03u", static_cast<unsigned>(index));
+    return name;
+  }
+
+  int32_t value(size_t index)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return values_[index];
+  }
+
+  //! Change a value on the flight controller without telling the host, as if the board had been reconfigured
+  void set_value(size_t index, int32_t value)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_[index] = value;
+  }
+
+  //! Number of PARAM_SET messages that have reached the flight controller
+  size_t sets_received()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sets_received_;
+  }
+
+  //! The flight controller applies the first allowed sets of this parameter, then drops the rest without answering
+  void ignore_sets(int index, int allowed = 0)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    allowed_sets_[index] = allowed;
+  }
+
+protected:
+  virtual bool is_open() { return true; }
+  virtual void do_open() {}
+  virtual void do_close()
+  {
+    // close() runs this on the caller's thread while the io thread may still be in deliver()
+    std::lock_guard<std::mutex> lock(mutex_);
+    read_timer_.cancel();
+  }
+
+  virtual void do_async_read(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_buffer_ = buffer;
+      pending_read_ = handler;
+    }
+    deliver();
+  }
+
+  virtual void do_async_write(const WriteBufferSequence &buffers, const IoHandler &handler)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < buffers.size(); i++)
+      {
+        const uint8_t *data = boost::asio::buffer_cast<const uint8_t *>(buffers[i]);
+        for (size_t j = 0; j < boost::asio::buffer_size(buffers[i]); j++)
+        {
+          mavlink_message_t msg;
+          if (mavlink_parse_char(MAVLINK_COMM_1, data[j], &msg, &parse_status_))
+            receive(msg);
+        }
+      }
+    }
+
+    io_service_.post(boost::bind(handler, boost::system::error_code(), boost::asio::buffer_size(buffers)));
+    io_service_.post(boost::bind(&SimulatedFcu::deliver, this));
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Frame
+  {
+    Clock::time_point arrival; //!< when the last byte reaches the host
+    std::vector<uint8_t> bytes;
+  };
+
+  bool lost() { return std::uniform_real_distribution<double>(0.0, 1.0)(random_) < loss_rate_; }
+
+  //! Handle a message from the host once it has crossed the uplink; mutex_ must be held
+  void receive(const mavlink_message_t &msg)
+  {
+    uplink_free_ = std::max(uplink_free_, Clock::now()) + message_time_;
+    if (lost())
+      return;
+
+    switch (msg.msgid)
+    {
+    case MAVLINK_MSG_ID_PARAM_REQUEST_LIST:
+      for (size_t i = 0; i < values_.size(); i++)
+      {
+        reply(i);
+      }
+      break;
+    case MAVLINK_MSG_ID_PARAM_REQUEST_READ:
+    {
+      mavlink_param_request_read_t read;
+      mavlink_msg_param_request_read_decode(&msg, &read);
+      if (read.param_index >= 0 && static_cast<size_t>(read.param_index) < values_.size())
+        reply(read.param_index);
+      break;
+    }
+    case MAVLINK_MSG_ID_PARAM_SET:
+    {
+      mavlink_param_set_t set;
+      mavlink_msg_param_set_decode(&msg, &set);
+      sets_received_++;
+      char name[17] = {};
+      memcpy(name, set.param_id, 16);
+      for (size_t i = 0; i < values_.size(); i++)
+      {
+        if (param_name(i) != name)
+          continue;
+
+        std::map<int, int>::iterator allowed = allowed_sets_.find(static_cast<int>(i));
+        if (allowed != allowed_sets_.end() && allowed->second-- <= 0)
+          continue;
+        memcpy(&values_[i], &set.param_value, sizeof(int32_t));
+        reply(i);
+      }
+      break;
+    }
+    }
+  }
+
+  //! Send PARAM_VALUE for a parameter over the downlink; mutex_ must be held
+  void reply(size_t index)
+  {
+    downlink_free_ = std::max(downlink_free_, uplink_free_) + message_time_;
+    if (lost())
+      return;
+
+    float raw;
+    memcpy(&raw, &values_[index], sizeof(raw));
+    mavlink_message_t msg;
+    mavlink_msg_param_value_pack(1, 1, &msg, param_name(index).c_str(), raw, MAV_PARAM_TYPE_INT32, values_.size(),
+                                 index);
+
+    Frame frame;
+    frame.arrival = downlink_free_;
+    frame.bytes.resize(MAVLINK_MAX_PACKET_LEN);
+    frame.bytes.resize(mavlink_msg_to_send_buffer(frame.bytes.data(), &msg));
+    downlink_.push_back(frame);
+  }
+
+  //! Complete the pending read with every frame that has arrived, or wait for the next one; runs on the io thread
+  void deliver()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_read_)
+      return;
+
+    uint8_t *data = boost::asio::buffer_cast<uint8_t *>(pending_buffer_);
+    size_t capacity = boost::asio::buffer_size(pending_buffer_);
+    size_t length = 0;
+    while (!downlink_.empty() && downlink_.front().arrival <= Clock::now()
+           && length + downlink_.front().bytes.size() <= capacity)
+    {
+      memcpy(data + length, downlink_.front().bytes.data(), downlink_.front().bytes.size());
+      length += downlink_.front().bytes.size();
+      downlink_.pop_front();
+    }
+
+    if (length > 0)
+    {
+      IoHandler handler;
+      handler.swap(pending_read_);
+      io_service_.post(boost::bind(handler, boost::system::error_code(), length));
+    }
+    else if (!downlink_.empty())
+    {
+      read_timer_.expires_at(downlink_.front().arrival);
+      read_timer_.async_wait([this](const boost::system::error_code &error) {
+        if (!error)
+          deliver();
+      });
+    }
+  }
+
+  boost::asio::io_service::work work_;
+  boost::asio::steady_timer read_timer_;
+  boost::asio::mutable_buffers_1 pending_buffer_;
+  IoHandler pending_read_; //!< pending read, or empty
+
+  std::mutex mutex_;
+  const std::chrono::microseconds message_time_;
+  const double loss_rate_;
+  std::mt19937 random_;
+  mavlink_status_t parse_status_;
+  Clock::time_point uplink_free_;   //!< when the last message sent to the flight controller reaches it
+  Clock::time_point downlink_free_; //!< when the last message sent to the host reaches it
+  std::deque<Frame> downlink_;
+  std::vector<int32_t> values_;
+  size_t sets_received_;
+  std::map<int, int> allowed_sets_; //!< sets still applied of each parameter whose sets are being ignored
+};
+
+} // namespace rosflight_test
+
+#endif // ROSFLIGHT_TEST_SIMULATED_FCU_H
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_bounded_queue.cpp
+ */
+
+#include <rosflight/mavrosflight/bounded_queue.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using mavrosflight::BoundedQueue;
+
+TEST(BoundedQueue, RoundsCapacityUpToPowerOfTwo)
+{
+  EXPECT_EQ(2u, BoundedQueue<int>(1).capacity());
+  EXPECT_EQ(8u, BoundedQueue<int>(5).capacity());
+  EXPECT_EQ(256u, BoundedQueue<int>(256).capacity());
+}
+
+TEST(BoundedQueue, PopsInOrderPushed)
+{
+  BoundedQueue<int> queue(8);
+  for (int i = 0; i < 5; i++)
+  {
+    ASSERT_TRUE(queue.try_push(i));
+  }
+  EXPECT_EQ(5u, queue.size());
+
+  for (int i = 0; i < 5; i++)
+  {
+    int value = -1;
+    ASSERT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(i, value);
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(BoundedQueue, RejectsPushWhenFull)
+{
+  BoundedQueue<int> queue(4);
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT_TRUE(queue.try_push(i));
+  }
+  EXPECT_FALSE(queue.try_push(4));
+
+  int value;
+  ASSERT_TRUE(queue.try_pop(value));
+  EXPECT_EQ(0, value);
+  EXPECT_TRUE(queue.try_push(4));
+}
+
+TEST(BoundedQueue, RejectsPopWhenEmpty)
+{
+  BoundedQueue<int> queue(4);
+  int value = 7;
+  EXPECT_FALSE(queue.try_pop(value));
+  EXPECT_EQ(7, value);
+}
+
+TEST(BoundedQueue, WrapsAroundRepeatedly)
+{
+  BoundedQueue<int> queue(4);
+  int next_pop = 0;
+  for (int i = 0; i < 1000; i++)
+  {
+    ASSERT_TRUE(queue.try_push(i));
+    if (i % 3 != 0)
+    {
+      int value;
+      ASSERT_TRUE(queue.try_pop(value));
+      ASSERT_EQ(next_pop++, value);
+    }
+    if (queue.size() == queue.capacity())
+    {
+      int value;
+      ASSERT_TRUE(queue.try_pop(value));
+      ASSERT_EQ(next_pop++, value);
+    }
+  }
+}
+
+TEST(BoundedQueue, FillsAndConsumesSlotsInPlace)
+{
+  struct Packet
+  {
+    uint8_t data[64];
+    size_t len;
+  };
+
+  BoundedQueue<Packet> queue(2);
+  ASSERT_TRUE(queue.try_push([](Packet &slot) {
+    slot.data[0] = 0xFE;
+    slot.len = 1;
+  }));
+
+  size_t len = 0;
+  uint8_t first = 0;
+  ASSERT_TRUE(queue.try_pop([&](Packet &slot) {
+    len = slot.len;
+    first = slot.data[0];
+  }));
+  EXPECT_EQ(1u, len);
+  EXPECT_EQ(0xFE, first);
+}
+
+TEST(BoundedQueue, FrontIsNotReadyUntilPushCompletes)
+{
+  BoundedQueue<int> queue(4);
+  EXPECT_FALSE(queue.front_ready());
+
+  bool ready_while_filling = true;
+  bool empty_while_filling = true;
+  ASSERT_TRUE(queue.try_push([&](int &slot) {
+    slot = 1;
+    ready_while_filling = queue.front_ready();
+    empty_while_filling = queue.empty();
+  }));
+  EXPECT_FALSE(ready_while_filling);
+  EXPECT_FALSE(empty_while_filling);
+  EXPECT_TRUE(queue.front_ready());
+
+  int value;
+  ASSERT_TRUE(queue.try_pop(value));
+  EXPECT_FALSE(queue.front_ready());
+}
+
+// Every element arrives exactly once, and each consumer sees each producer's elements in the order they were pushed.
+TEST(BoundedQueue, ConcurrentProducersAndConsumersLoseNothing)
+{
+  const int PRODUCERS = 4;
+  const int CONSUMERS = 4;
+  const uint32_t PER_PRODUCER = 100000;
+
+  BoundedQueue<uint64_t> queue(64);
+  std::vector<std::atomic<uint32_t> > received(PRODUCERS * PER_PRODUCER);
+  for (size_t i = 0; i < received.size(); i++)
+  {
+    received[i] = 0;
+  }
+  std::atomic<int> producers_done(0);
+  std::atomic<uint64_t> out_of_order(0);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < PRODUCERS; p++)
+  {
+    threads.emplace_back([&, p]() {
+      for (uint32_t n = 0; n < PER_PRODUCER; n++)
+      {
+        uint64_t value = (uint64_t(p) << 32) | n;
+        while (!queue.try_push(value)) std::this_thread::yield();
+      }
+      producers_done++;
+    });
+  }
+  for (int c = 0; c < CONSUMERS; c++)
+  {
+    threads.emplace_back([&]() {
+      std::vector<int64_t> last(PRODUCERS, -1);
+      uint64_t value;
+      for (;;)
+      {
+        if (!queue.try_pop(value))
+        {
+          if (producers_done.load() == PRODUCERS && queue.empty())
+            break;
+          std::this_thread::yield();
+          continue;
+        }
+        int p = int(value >> 32);
+        uint32_t n = uint32_t(value);
+        if (int64_t(n) <= last[p])
+          out_of_order++;
+        last[p] = n;
+        received[p * PER_PRODUCER + n]++;
+      }
+    });
+  }
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i].join();
+  }
+
+  size_t missing = 0, duplicated = 0;
+  for (size_t i = 0; i < received.size(); i++)
+  {
+    missing += received[i] == 0;
+    duplicated += received[i] > 1;
+  }
+  EXPECT_EQ(0u, missing);
+  EXPECT_EQ(0u, duplicated);
+  EXPECT_EQ(0u, out_of_order.load());
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_frame_scanner.cpp
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_frame_scanner.h>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using mavrosflight::MavlinkFrameScanner;
+
+namespace
+{
+std::vector<uint8_t> to_bytes(const mavlink_message_t &msg)
+{
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+  return std::vector<uint8_t>(buf, buf + len);
+}
+
+std::vector<uint8_t> timesync_frame(int64_t tc1, int64_t ts1)
+{
+  mavlink_message_t msg;
+  mavlink_msg_timesync_pack(1, 1, &msg, tc1, ts1);
+  return to_bytes(msg);
+}
+
+std::vector<uint8_t> heartbeat_frame()
+{
+  mavlink_message_t msg;
+  mavlink_msg_heartbeat_pack(1, 1, &msg, 0, 0, 0, 0, 0);
+  return to_bytes(msg);
+}
+
+void append(std::vector<uint8_t> *data, const std::vector<uint8_t> &bytes)
+{
+  data->insert(data->end(), bytes.begin(), bytes.end());
+}
+
+/**
+ * \brief Records the frames emitted by a scan
+ */
+struct Frames
+{
+  std::vector<std::vector<uint8_t> > frames;
+
+  size_t scan(MavlinkFrameScanner &scanner, const std::vector<uint8_t> &data)
+  {
+    return scanner.scan(data.data(), data.size(), [this](const uint8_t *frame, size_t frame_len) {
+      frames.push_back(std::vector<uint8_t>(frame, frame + frame_len));
+    });
+  }
+};
+
+} // namespace
+
+TEST(MavlinkFrameScanner, EmitsEachValidFrame)
+{
+  std::vector<uint8_t> first = timesync_frame(1, 2);
+  std::vector<uint8_t> second = heartbeat_frame();
+  std::vector<uint8_t> third = timesync_frame(3, 4);
+  std::vector<uint8_t> data;
+  append(&data, first);
+  append(&data, second);
+  append(&data, third);
+
+  MavlinkFrameScanner scanner;
+  Frames out;
+  EXPECT_EQ(data.size(), out.scan(scanner, data));
+  ASSERT_EQ(3u, out.frames.size());
+  EXPECT_EQ(first, out.frames[0]);
+  EXPECT_EQ(second, out.frames[1]);
+  EXPECT_EQ(third, out.frames[2]);
+  EXPECT_EQ(3u, scanner.frames());
+  EXPECT_EQ(0u, scanner.bytes_skipped());
+}
+
+TEST(MavlinkFrameScanner, SkipsBytesBeforeStartByte)
+{
+  std::vector<uint8_t> data(10, 0x55);
+  append(&data, timesync_frame(1, 2));
+
+  MavlinkFrameScanner scanner;
+  Frames out;
+  EXPECT_EQ(data.size(), out.scan(scanner, data));
+  EXPECT_EQ(1u, out.frames.size());
+  EXPECT_EQ(10u, scanner.bytes_skipped());
+}
+
+TEST(MavlinkFrameScanner, ConsumesBufferWithoutStartByte)
+{
+  std::vector<uint8_t> data(32, 0x00);
+
+  MavlinkFrameScanner scanner;
+  Frames out;
+  EXPECT_EQ(data.size(), out.scan(scanner, data));
+  EXPECT_TRUE(out.frames.empty());
+  EXPECT_EQ(32u, scanner.bytes_skipped());
+}
+
+TEST(MavlinkFrameScanner, LeavesPartialFrameForNextScan)
+{
+  std::vector<uint8_t> first = timesync_frame(1, 2);
+  std::vector<uint8_t> second = timesync_frame(3, 4);
+
+  // every split of the second frame, including inside the header
+  for (size_t split = 1; split < second.size(); split++)
+  {
+    std::vector<uint8_t> data = first;
+    data.insert(data.end(), second.begin(), second.begin() + split);
+
+    MavlinkFrameScanner scanner;
+    Frames out;
+    size_t consumed = out.scan(scanner, data);
+    ASSERT_EQ(first.size(), consumed) << "split at " << split;
+    ASSERT_EQ(1u, out.frames.size());
+
+    std::vector<uint8_t> rest(data.begin() + consumed, data.end());
+    rest.insert(rest.end(), second.begin() + split, second.end());
+    EXPECT_EQ(rest.size(), out.scan(scanner, rest));
+    ASSERT_EQ(2u, out.frames.size());
+    EXPECT_EQ(second, out.frames[1]);
+    EXPECT_EQ(0u, scanner.bytes_skipped());
+  }
+}
+
+TEST(MavlinkFrameScanner, RejectsBadChecksumAndResynchronizes)
+{
+  std::vector<uint8_t> corrupt = timesync_frame(1, 2);
+  corrupt[MAVLINK_NUM_HEADER_BYTES] ^= 0x01;
+  std::vector<uint8_t> good = timesync_frame(3, 4);
+  std::vector<uint8_t> data = corrupt;
+  append(&data, good);
+
+  MavlinkFrameScanner scanner;
+  Frames out;
+  EXPECT_EQ(data.size(), out.scan(scanner, data));
+  ASSERT_EQ(1u, out.frames.size());
+  EXPECT_EQ(good, out.frames[0]);
+  EXPECT_EQ(1u, scanner.crc_errors());
+  EXPECT_EQ(corrupt.size(), scanner.bytes_skipped());
+}
+
+// a start byte in the noise looks like a frame long enough to swallow the real one that follows
+TEST(MavlinkFrameScanner, FindsFrameAfterFalseStartByte)
+{
+  std::vector<uint8_t> data;
+  data.push_back(MAVLINK_STX);
+  data.push_back(4);
+  append(&data, timesync_frame(1, 2));
+
+  MavlinkFrameScanner scanner;
+  Frames out;
+  EXPECT_EQ(data.size(), out.scan(scanner, data));
+  EXPECT_EQ(1u, out.frames.size());
+  EXPECT_EQ(2u, scanner.bytes_skipped());
+}
+
+#ifdef MAVLINK_MESSAGE_LENGTHS
+TEST(MavlinkFrameScanner, RejectsUnexpectedLength)
+{
+  std::vector<uint8_t> data = heartbeat_frame();
+  data[1]--; // one byte short of a heartbeat payload
+  append(&data, heartbeat_frame());
+
+  MavlinkFrameScanner scanner;
+  Frames out;
+  EXPECT_EQ(data.size(), out.scan(scanner, data));
+  EXPECT_EQ(1u, out.frames.size());
+  EXPECT_EQ(1u, scanner.length_errors());
+}
+#endif
+
+TEST(MavlinkFrameScanner, UnpacksFrameIntoMessage)
+{
+  std::vector<uint8_t> data = timesync_frame(123456789, -42);
+
+  mavlink_message_t msg;
+  MavlinkFrameScanner::unpack(data.data(), &msg);
+  EXPECT_EQ(MAVLINK_MSG_ID_TIMESYNC, msg.msgid);
+  EXPECT_EQ(data[1], msg.len);
+
+  mavlink_timesync_t timesync;
+  mavlink_msg_timesync_decode(&msg, &timesync);
+  EXPECT_EQ(123456789, timesync.tc1);
+  EXPECT_EQ(-42, timesync.ts1);
+}
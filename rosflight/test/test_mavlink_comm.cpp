@@ -0,0 +1,904 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_mavlink_comm.cpp
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_comm.h>
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
+#include <rosflight/mavrosflight/mavlink_listener_interface.h>
+
+#include "fakes.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mavrosflight::MavlinkComm;
+using mavrosflight::MavlinkFrame;
+using rosflight_test::FlakyComm;
+using rosflight_test::NullComm;
+using rosflight_test::ReplayComm;
+using rosflight_test::SlowLinkComm;
+
+using std::chrono::milliseconds;
+
+namespace
+{
+/**
+ * \brief Wait until the write queues have drained or the timeout passes
+ */
+MavlinkComm::TransportStats wait_for_writes(MavlinkComm &comm, std::chrono::milliseconds timeout)
+{
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+  MavlinkComm::TransportStats stats;
+  comm.get_transport_stats(&stats);
+  while (stats.write_queue_depth > 0 && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    comm.get_transport_stats(&stats);
+  }
+  return stats;
+}
+
+void send_command(MavlinkComm &comm, int index)
+{
+  mavlink_message_t msg;
+  mavlink_msg_offboard_control_pack(1, 50, &msg, 0, 0, float(index), 0, 0, 0);
+  comm.send_message(msg);
+}
+
+void send_param_set(MavlinkComm &comm, int index)
+{
+  mavlink_message_t msg;
+  mavlink_msg_param_set_pack(1, 50, &msg, 1, MAV_COMP_ID_ALL, "PARAM", float(index), MAV_PARAM_TYPE_REAL32);
+  comm.send_message(msg);
+}
+
+/**
+ * \brief Wait until the link has written the given number of packets with a message ID, or the timeout passes
+ */
+std::vector<SlowLinkComm::Written> wait_for_written(SlowLinkComm &comm,
+                                                    uint8_t msgid,
+                                                    size_t count,
+                                                    std::chrono::milliseconds timeout)
+{
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+  std::vector<SlowLinkComm::Written> matching;
+  do
+  {
+    std::this_thread::sleep_for(milliseconds(1));
+    std::vector<SlowLinkComm::Written> written = comm.written();
+    matching.clear();
+    for (size_t i = 0; i < written.size(); i++)
+    {
+      if (MavlinkFrame(written[i].frame.data()).msgid() == msgid)
+        matching.push_back(written[i]);
+    }
+  } while (matching.size() < count && std::chrono::steady_clock::now() < deadline);
+  return matching;
+}
+
+/**
+ * \brief Queue a parameter load's worth of PARAM_SETs, then send commands at 100 Hz while they drain
+ * \return The longest any command took from send_message until it was written
+ */
+std::chrono::microseconds worst_command_latency(SlowLinkComm &comm)
+{
+  const int PARAM_SETS = 200;
+  const int COMMANDS = 30;
+
+  for (int i = 0; i < PARAM_SETS; i++)
+  {
+    send_param_set(comm, i);
+  }
+
+  std::vector<std::chrono::steady_clock::time_point> sent(COMMANDS);
+  for (int i = 0; i < COMMANDS; i++)
+  {
+    sent[i] = std::chrono::steady_clock::now();
+    send_command(comm, i);
+    std::this_thread::sleep_for(milliseconds(10));
+  }
+
+  std::vector<SlowLinkComm::Written> commands =
+      wait_for_written(comm, MAVLINK_MSG_ID_OFFBOARD_CONTROL, COMMANDS, std::chrono::seconds(5));
+  EXPECT_EQ(size_t(COMMANDS), commands.size());
+
+  std::chrono::microseconds worst(0);
+  for (size_t i = 0; i < commands.size(); i++)
+  {
+    MavlinkFrame frame(commands[i].frame.data());
+    int index = int(MAVLINK_FRAME_FIELD(frame, mavlink_offboard_control_t, x));
+    worst = std::max(worst, std::chrono::duration_cast<std::chrono::microseconds>(commands[i].time - sent[index]));
+  }
+  return worst;
+}
+
+/**
+ * \brief Poll until the condition holds or the timeout passes
+ * \return Whether the condition held
+ */
+bool wait_until(std::function<bool()> condition, std::chrono::milliseconds timeout)
+{
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+  while (!condition())
+  {
+    if (std::chrono::steady_clock::now() >= deadline)
+      return false;
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  return true;
+}
+
+MavlinkComm::TransportStats transport_stats(MavlinkComm &comm)
+{
+  MavlinkComm::TransportStats stats;
+  comm.get_transport_stats(&stats);
+  return stats;
+}
+
+size_t count_written(FlakyComm &comm, uint8_t msgid)
+{
+  std::vector<std::vector<uint8_t> > written = comm.written();
+  size_t count = 0;
+  for (size_t i = 0; i < written.size(); i++)
+  {
+    if (MavlinkFrame(written[i].data()).msgid() == msgid)
+      count++;
+  }
+  return count;
+}
+
+//! A heartbeat from 1/1 with the given sequence number
+std::vector<uint8_t> heartbeat_frame(uint8_t seq)
+{
+  mavlink_message_t msg;
+  mavlink_msg_heartbeat_pack(1, 1, &msg, 0, 0, 0, 0, 0);
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+
+  // the checksum covers the sequence number, so it has to be recomputed
+  static const uint8_t crc_extra[] = MAVLINK_MESSAGE_CRCS;
+  buf[2] = seq;
+  uint16_t crc;
+  crc_init(&crc);
+  for (uint16_t i = 1; i < len - 2; i++)
+  {
+    crc_accumulate(buf[i], &crc);
+  }
+  crc_accumulate(crc_extra[buf[5]], &crc);
+  buf[len - 2] = crc & 0xff;
+  buf[len - 1] = crc >> 8;
+  return std::vector<uint8_t>(buf, buf + len);
+}
+
+//! Heartbeats with consecutive sequence numbers, back to back
+std::vector<uint8_t> heartbeat_frames(uint8_t first_seq, size_t count)
+{
+  std::vector<uint8_t> bytes;
+  for (size_t i = 0; i < count; i++)
+  {
+    std::vector<uint8_t> frame = heartbeat_frame(uint8_t(first_seq + i));
+    bytes.insert(bytes.end(), frame.begin(), frame.end());
+  }
+  return bytes;
+}
+
+/**
+ * \brief Records the sequence number of each frame and the thread it arrived on, and can be held up inside the handler
+ */
+class RecordingListener : public mavrosflight::MavlinkFrameListenerInterface
+{
+public:
+  RecordingListener() : held_(false) {}
+
+  virtual void handle_mavlink_frame(const MavlinkFrame &frame)
+  {
+    // gives up waiting eventually, so a failed test cannot leave a dispatcher thread stuck here
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait_for(lock, std::chrono::seconds(5), [this]() { return !held_; });
+    seqs_.push_back(frame.seq());
+    threads_.push_back(std::this_thread::get_id());
+    changed_.notify_all();
+  }
+
+  //! Make the handler wait until release() before recording anything more
+  void hold()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_ = true;
+  }
+
+  void release()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_ = false;
+    changed_.notify_all();
+  }
+
+  bool wait_for(size_t count, milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return changed_.wait_for(lock, timeout, [this, count]() { return seqs_.size() >= count; });
+  }
+
+  std::vector<uint8_t> seqs()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return seqs_;
+  }
+
+  std::vector<std::thread::id> threads()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return threads_;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool held_;
+  std::vector<uint8_t> seqs_;
+  std::vector<std::thread::id> threads_;
+};
+
+//! Heartbeats and TIMESYNC requests, alternating
+std::vector<uint8_t> mixed_stream(size_t pairs)
+{
+  std::vector<uint8_t> bytes;
+  for (size_t i = 0; i < pairs; i++)
+  {
+    std::vector<uint8_t> heartbeat = heartbeat_frame(uint8_t(2 * i));
+    bytes.insert(bytes.end(), heartbeat.begin(), heartbeat.end());
+
+    mavlink_message_t msg;
+    mavlink_msg_timesync_pack(1, 1, &msg, 0, int64_t(i));
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+    bytes.insert(bytes.end(), buf, buf + len);
+  }
+  return bytes;
+}
+
+/**
+ * \brief Counts what it is handed by message ID, through either listener interface
+ */
+class CountingListener : public mavrosflight::MavlinkListenerInterface,
+                         public mavrosflight::MavlinkFrameListenerInterface
+{
+public:
+  CountingListener() : heartbeats(0), timesyncs(0), others(0) {}
+
+  virtual void handle_mavlink_message(const mavlink_message_t &msg) { count(msg.msgid); }
+  virtual void handle_mavlink_frame(const MavlinkFrame &frame) { count(frame.msgid()); }
+
+  uint64_t total() const { return heartbeats + timesyncs + others; }
+
+  std::atomic<uint64_t> heartbeats;
+  std::atomic<uint64_t> timesyncs;
+  std::atomic<uint64_t> others;
+
+private:
+  void count(uint8_t msgid)
+  {
+    if (msgid == MAVLINK_MSG_ID_HEARTBEAT)
+      heartbeats++;
+    else if (msgid == MAVLINK_MSG_ID_TIMESYNC)
+      timesyncs++;
+    else
+      others++;
+  }
+};
+
+/**
+ * \brief Register and unregister a listener over and over while a stream of frames is being dispatched
+ *
+ * \param clock Listener registered for every message the whole time, to tell how much has been dispatched
+ */
+void churn_registrations(MavlinkComm &comm, CountingListener &clock, bool threaded)
+{
+  const int ROUNDS = 200;
+
+  CountingListener churned;
+  uint64_t received = 0;
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    if (round % 2 == 0)
+      comm.register_mavlink_frame_listener(&churned, {MAVLINK_MSG_ID_HEARTBEAT});
+    else
+      comm.register_mavlink_listener(&churned, {MAVLINK_MSG_ID_TIMESYNC});
+
+    uint64_t start = clock.total();
+    ASSERT_TRUE(wait_until([&clock, start]() { return clock.total() >= start + 20; }, milliseconds(1000)));
+
+    if (round % 2 == 0)
+      comm.unregister_mavlink_frame_listener(&churned);
+    else
+      comm.unregister_mavlink_listener(&churned);
+
+    // a dispatcher thread is joined by the unregister; the io thread may still be in a handler from the old table,
+    // but is done with it by the time the next read has been dispatched
+    uint64_t after = churned.total();
+    start = clock.total();
+    ASSERT_TRUE(wait_until([&clock, start]() { return clock.total() >= start + 100; }, milliseconds(1000)));
+    if (threaded)
+      EXPECT_EQ(after, churned.total()) << "round " << round;
+    else
+      EXPECT_LE(churned.total(), after + 1) << "round " << round;
+
+    received = churned.total();
+  }
+
+  EXPECT_GT(received, 0u);
+  EXPECT_EQ(0u, churned.others.load());
+  EXPECT_EQ(churned.total(), received);
+}
+
+/**
+ * \brief Receive heartbeats with the given sequence numbers, one read each, and return the counters for their source
+ */
+MavlinkComm::SourceStats receive_sequence(const std::vector<uint8_t> &seqs)
+{
+  FlakyComm comm;
+  comm.open();
+  for (size_t i = 0; i < seqs.size(); i++)
+  {
+    std::vector<uint8_t> frame = heartbeat_frame(seqs[i]);
+    EXPECT_TRUE(wait_until([&comm, &frame]() { return comm.deliver(frame); }, milliseconds(1000)));
+  }
+
+  // the read after the last frame is only started once that frame has been counted
+  wait_until([&comm]() { return comm.fail_read(boost::asio::error::eof); }, milliseconds(1000));
+  comm.close();
+
+  MavlinkComm::TransportStats stats;
+  comm.get_transport_stats(&stats);
+  EXPECT_EQ(1u, stats.sources.size());
+  return stats.sources.empty() ? MavlinkComm::SourceStats() : stats.sources[0];
+}
+
+/**
+ * \brief Error category whose message() blocks until released
+ *
+ * link_lost prints the error right after marking the link down, so this holds the io thread at the point where it
+ * decides how to shut the link down.
+ */
+class BlockingErrorCategory : public boost::system::error_category
+{
+public:
+  BlockingErrorCategory() : blocked_(false) {}
+
+  virtual const char *name() const BOOST_SYSTEM_NOEXCEPT { return "blocking"; }
+
+  virtual std::string message(int) const
+  {
+    if (!blocked_.exchange(true))
+    {
+      entered_.set_value();
+      release_.get_future().wait();
+    }
+    return "link failed";
+  }
+
+  std::future<void> entered() { return entered_.get_future(); }
+  void release() { release_.set_value(); }
+
+private:
+  mutable std::atomic<bool> blocked_;
+  mutable std::promise<void> entered_;
+  mutable std::promise<void> release_;
+};
+
+} // namespace
+
+// Senders outrun the port, so the queue is always full and senders keep dropping the oldest packet to make room
+TEST(MavlinkComm, ConcurrentSendersAreWrittenOrCounted)
+{
+  const int SENDERS = 4;
+  const int MESSAGES = 50000;
+
+  NullComm comm;
+  comm.open();
+
+  std::vector<std::thread> senders;
+  for (int t = 0; t < SENDERS; t++)
+  {
+    senders.emplace_back([&comm]() {
+      mavlink_message_t msg;
+      mavlink_msg_offboard_control_pack(1, 50, &msg, 0, 0, 0, 0, 0, 0);
+      for (int i = 0; i < MESSAGES; i++)
+      {
+        comm.send_message(msg);
+      }
+    });
+  }
+  for (int t = 0; t < SENDERS; t++)
+  {
+    senders[t].join();
+  }
+
+  MavlinkComm::TransportStats stats = wait_for_writes(comm, std::chrono::seconds(5));
+  EXPECT_EQ(0u, stats.write_queue_depth);
+  EXPECT_EQ(uint64_t(SENDERS * MESSAGES), stats.frames_out + stats.write_queue_dropped);
+  comm.close();
+}
+
+// At 57600 baud a PARAM_SET takes 5.4 ms to write and a command 4.5 ms, so a command should wait for at most the
+// parameter already on the wire, not the 1 s the whole burst takes to drain
+TEST(MavlinkComm, CommandLatencyOverSlowLinkIsBounded)
+{
+  SlowLinkComm comm(57600);
+  comm.open();
+  std::chrono::microseconds worst = worst_command_latency(comm);
+  RecordProperty("worst_command_latency_us", int(worst.count()));
+  EXPECT_LT(worst, milliseconds(20));
+  comm.close();
+}
+
+// the same traffic through a single lane, to show what the priorities protect against
+TEST(MavlinkComm, CommandsInBulkLaneWaitBehindBurst)
+{
+  SlowLinkComm comm(57600);
+  comm.set_write_priority(MAVLINK_MSG_ID_OFFBOARD_CONTROL, MavlinkComm::PRIORITY_BULK);
+  comm.open();
+  std::chrono::microseconds worst = worst_command_latency(comm);
+  RecordProperty("worst_command_latency_us", int(worst.count()));
+  EXPECT_GT(worst, milliseconds(200));
+  comm.close();
+}
+
+TEST(MavlinkComm, RateLimitSpacesPackets)
+{
+  const int PACKETS = 10;
+
+  SlowLinkComm comm(1000000);
+  comm.set_write_rate_limit(MAVLINK_MSG_ID_PARAM_SET, 100);
+  comm.open();
+  for (int i = 0; i < PACKETS; i++)
+  {
+    send_param_set(comm, i);
+  }
+
+  std::vector<SlowLinkComm::Written> written =
+      wait_for_written(comm, MAVLINK_MSG_ID_PARAM_SET, PACKETS, std::chrono::seconds(2));
+  ASSERT_EQ(size_t(PACKETS), written.size());
+  for (size_t i = 1; i < written.size(); i++)
+  {
+    // allow for the timer firing slightly early relative to the write completion of the previous packet
+    EXPECT_GE(written[i].time - written[i - 1].time, std::chrono::microseconds(9000)) << "packet " << i;
+  }
+  comm.close();
+}
+
+TEST(MavlinkComm, ReconnectBacksOffUntilPortReturns)
+{
+  FlakyComm comm;
+  comm.set_auto_reconnect(true, milliseconds(20), milliseconds(80));
+  comm.open();
+  EXPECT_TRUE(transport_stats(comm).link_up);
+
+  comm.fail_opens(3);
+  ASSERT_TRUE(wait_until([&comm]() { return comm.fail_read(boost::asio::error::eof); }, milliseconds(1000)));
+  ASSERT_TRUE(wait_until([&comm]() { return transport_stats(comm).reconnects == 1; }, milliseconds(2000)));
+
+  MavlinkComm::TransportStats stats = transport_stats(comm);
+  EXPECT_TRUE(stats.link_up);
+
+  // the first attempt from open(), three failed reopens with the delay doubling up to its limit, then success
+  std::vector<std::chrono::steady_clock::time_point> attempts = comm.open_attempts();
+  ASSERT_EQ(5u, attempts.size());
+  const int delays_ms[] = {40, 80, 80};
+  for (size_t i = 0; i < 3; i++)
+  {
+    EXPECT_GE(attempts[i + 2] - attempts[i + 1], milliseconds(delays_ms[i] - 1)) << "attempt " << i + 2;
+  }
+
+  // reading resumed on the reopened port
+  EXPECT_TRUE(wait_until([&comm]() { return comm.fail_read(boost::asio::error::eof); }, milliseconds(1000)));
+  comm.close();
+}
+
+TEST(MavlinkComm, PacketsQueuedWhileDownAreSentOrDroppedOnReconnect)
+{
+  FlakyComm comm;
+  comm.set_auto_reconnect(true, milliseconds(100), milliseconds(100));
+  comm.open();
+
+  ASSERT_TRUE(wait_until([&comm]() { return comm.fail_read(boost::asio::error::eof); }, milliseconds(1000)));
+  ASSERT_TRUE(wait_until([&comm]() { return !transport_stats(comm).link_up; }, milliseconds(1000)));
+
+  // the writes are parked until the port is back; the setpoint is out of date by then, the parameter is not
+  send_command(comm, 0);
+  send_param_set(comm, 0);
+  EXPECT_EQ(0u, comm.writes());
+
+  ASSERT_TRUE(wait_until([&comm]() { return transport_stats(comm).reconnects == 1; }, milliseconds(2000)));
+  MavlinkComm::TransportStats stats = wait_for_writes(comm, milliseconds(1000));
+  EXPECT_EQ(1u, count_written(comm, MAVLINK_MSG_ID_PARAM_SET));
+  EXPECT_EQ(0u, count_written(comm, MAVLINK_MSG_ID_OFFBOARD_CONTROL));
+  EXPECT_EQ(1u, stats.write_queue_dropped);
+
+  // packets queued after the reconnect go out as usual
+  send_command(comm, 1);
+  EXPECT_TRUE(wait_until([&comm]() { return count_written(comm, MAVLINK_MSG_ID_OFFBOARD_CONTROL) == 1; },
+                         milliseconds(1000)));
+  comm.close();
+}
+
+TEST(MavlinkComm, SetDropOnReconnectKeepsChosenMessages)
+{
+  FlakyComm comm;
+  comm.set_auto_reconnect(true, milliseconds(50), milliseconds(50));
+  comm.set_drop_on_reconnect(MAVLINK_MSG_ID_OFFBOARD_CONTROL, false);
+  comm.set_drop_on_reconnect(MAVLINK_MSG_ID_PARAM_SET, true);
+  comm.open();
+
+  ASSERT_TRUE(wait_until([&comm]() { return comm.fail_read(boost::asio::error::eof); }, milliseconds(1000)));
+  ASSERT_TRUE(wait_until([&comm]() { return !transport_stats(comm).link_up; }, milliseconds(1000)));
+  send_command(comm, 0);
+  send_param_set(comm, 0);
+
+  ASSERT_TRUE(wait_until([&comm]() { return transport_stats(comm).reconnects == 1; }, milliseconds(2000)));
+  wait_for_writes(comm, milliseconds(1000));
+  EXPECT_EQ(1u, count_written(comm, MAVLINK_MSG_ID_OFFBOARD_CONTROL));
+  EXPECT_EQ(0u, count_written(comm, MAVLINK_MSG_ID_PARAM_SET));
+  comm.close();
+}
+
+TEST(MavlinkComm, FailedWriteIsParkedAndResentAfterReconnect)
+{
+  FlakyComm comm;
+  comm.set_auto_reconnect(true, milliseconds(50), milliseconds(50));
+  comm.open();
+
+  comm.fail_writes(true);
+  send_param_set(comm, 7);
+  ASSERT_TRUE(wait_until([&comm]() { return !transport_stats(comm).link_up; }, milliseconds(1000)));
+  EXPECT_EQ(1u, comm.writes());
+  comm.fail_writes(false);
+
+  ASSERT_TRUE(wait_until([&comm]() { return count_written(comm, MAVLINK_MSG_ID_PARAM_SET) == 1; },
+                         milliseconds(2000)));
+  MavlinkComm::TransportStats stats = transport_stats(comm);
+  EXPECT_TRUE(stats.link_up);
+  EXPECT_EQ(1u, stats.reconnects);
+  EXPECT_EQ(1u, stats.frames_out);
+  EXPECT_EQ(0u, stats.write_queue_dropped);
+
+  std::vector<std::vector<uint8_t> > written = comm.written();
+  ASSERT_EQ(1u, written.size());
+  MavlinkFrame frame(written[0].data());
+  EXPECT_EQ(7.0f, MAVLINK_FRAME_FIELD(frame, mavlink_param_set_t, param_value));
+  comm.close();
+}
+
+TEST(MavlinkComm, ErrorWithoutReconnectClosesLink)
+{
+  FlakyComm comm;
+  comm.open();
+  EXPECT_TRUE(transport_stats(comm).link_up);
+
+  ASSERT_TRUE(wait_until([&comm]() { return comm.fail_read(boost::asio::error::eof); }, milliseconds(1000)));
+  ASSERT_TRUE(wait_until([&comm]() { return !transport_stats(comm).link_up; }, milliseconds(1000)));
+
+  // nothing tries to reopen the port, and nothing more is written
+  std::this_thread::sleep_for(milliseconds(50));
+  EXPECT_EQ(1u, comm.open_attempts().size());
+  send_param_set(comm, 0);
+  std::this_thread::sleep_for(milliseconds(10));
+  EXPECT_EQ(0u, comm.writes());
+  EXPECT_EQ(0u, transport_stats(comm).reconnects);
+  comm.close();
+}
+
+// the io thread shutting the link down after an error must not deadlock with the owner closing it at the same time
+TEST(MavlinkComm, CloseDuringLinkLostDoesNotDeadlock)
+{
+  // both are leaked if the close hangs, since the io thread would still be using them
+  FlakyComm *comm = new FlakyComm;
+  BlockingErrorCategory *category = new BlockingErrorCategory;
+  comm->open();
+
+  std::future<void> entered = category->entered();
+  ASSERT_TRUE(wait_until([comm, category]() { return comm->fail_read(boost::system::error_code(1, *category)); },
+                         milliseconds(1000)));
+  ASSERT_EQ(std::future_status::ready, entered.wait_for(std::chrono::seconds(1)));
+
+  // let the io thread go on while close() is closing the port, so it reaches the lock while close() holds it
+  std::shared_ptr<std::atomic<bool> > released = std::make_shared<std::atomic<bool> >(false);
+  comm->on_close([category, released]() {
+    if (!released->exchange(true))
+    {
+      category->release();
+      std::this_thread::sleep_for(milliseconds(50));
+    }
+  });
+
+  std::shared_ptr<std::promise<void> > closed = std::make_shared<std::promise<void> >();
+  std::future<void> done = closed->get_future();
+  std::thread([comm, closed]() {
+    comm->close();
+    closed->set_value();
+  }).detach();
+
+  ASSERT_EQ(std::future_status::ready, done.wait_for(std::chrono::seconds(2))) << "close() deadlocked";
+  EXPECT_FALSE(transport_stats(*comm).link_up);
+  delete comm;
+  delete category;
+}
+
+// packets already waiting when the port becomes free leave in as few writes as the batch limit allows
+TEST(MavlinkComm, QueuedPacketsLeaveInOneWrite)
+{
+  const int PACKETS = 8;
+  const size_t batch_sizes[] = {1, 5, PACKETS};
+
+  for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++)
+  {
+    // queued before the port is opened, so they are all waiting when writing starts
+    FlakyComm comm;
+    comm.set_max_write_batch(batch_sizes[b]);
+    for (int i = 0; i < PACKETS; i++)
+    {
+      send_param_set(comm, i);
+    }
+    EXPECT_EQ(0u, comm.writes());
+
+    comm.open();
+    ASSERT_TRUE(wait_until([&comm]() { return comm.written().size() == PACKETS; }, milliseconds(1000)));
+    EXPECT_EQ((PACKETS + batch_sizes[b] - 1) / batch_sizes[b], comm.writes()) << "batch size " << batch_sizes[b];
+
+    // and in the order they were queued
+    std::vector<std::vector<uint8_t> > written = comm.written();
+    for (int i = 0; i < PACKETS; i++)
+    {
+      MavlinkFrame frame(written[i].data());
+      EXPECT_EQ(float(i), MAVLINK_FRAME_FIELD(frame, mavlink_param_set_t, param_value));
+    }
+    comm.close();
+  }
+}
+
+TEST(MavlinkComm, CountsForwardGapsAsLost)
+{
+  MavlinkComm::SourceStats source = receive_sequence({10, 11, 14, 15, 20});
+  EXPECT_EQ(5u, source.frames);
+  EXPECT_EQ(6u, source.lost);
+  EXPECT_EQ(0u, source.out_of_order);
+  EXPECT_EQ(20, source.last_seq);
+}
+
+TEST(MavlinkComm, CountsSequenceWrapAsForward)
+{
+  MavlinkComm::SourceStats source = receive_sequence({253, 254, 255, 0, 1, 3});
+  EXPECT_EQ(6u, source.frames);
+  EXPECT_EQ(1u, source.lost);
+  EXPECT_EQ(0u, source.out_of_order);
+  EXPECT_EQ(3, source.last_seq);
+}
+
+TEST(MavlinkComm, CountsDuplicateAsOutOfOrder)
+{
+  MavlinkComm::SourceStats source = receive_sequence({40, 41, 41, 42});
+  EXPECT_EQ(4u, source.frames);
+  EXPECT_EQ(0u, source.lost);
+  EXPECT_EQ(1u, source.out_of_order);
+  EXPECT_EQ(42, source.last_seq);
+}
+
+// 6 arrives after 7 and 4 after 8; neither is a 255 frame gap, and neither moves the sequence back
+TEST(MavlinkComm, CountsReorderAsOutOfOrder)
+{
+  MavlinkComm::SourceStats source = receive_sequence({5, 7, 6, 8, 4, 9});
+  EXPECT_EQ(6u, source.frames);
+  EXPECT_EQ(1u, source.lost);
+  EXPECT_EQ(2u, source.out_of_order);
+  EXPECT_EQ(9, source.last_seq);
+}
+
+// each listener gets every frame in order, on a dispatcher thread of its own
+TEST(MavlinkComm, ThreadedDispatchKeepsOrderPerListener)
+{
+  const size_t READS = 5;
+  const size_t FRAMES_PER_READ = 10;
+
+  RecordingListener first, second; // outlive the dispatcher threads
+  FlakyComm comm;
+  comm.set_threaded_dispatch(true, 64);
+  comm.register_mavlink_frame_listener(&first);
+  comm.register_mavlink_frame_listener(&second);
+  comm.open();
+
+  for (size_t i = 0; i < READS; i++)
+  {
+    std::vector<uint8_t> bytes = heartbeat_frames(uint8_t(i * FRAMES_PER_READ), FRAMES_PER_READ);
+    ASSERT_TRUE(wait_until([&comm, &bytes]() { return comm.deliver(bytes); }, milliseconds(1000)));
+  }
+  ASSERT_TRUE(first.wait_for(READS * FRAMES_PER_READ, milliseconds(1000)));
+  ASSERT_TRUE(second.wait_for(READS * FRAMES_PER_READ, milliseconds(1000)));
+
+  std::vector<uint8_t> expected;
+  for (size_t i = 0; i < READS * FRAMES_PER_READ; i++)
+  {
+    expected.push_back(uint8_t(i));
+  }
+  EXPECT_EQ(expected, first.seqs());
+  EXPECT_EQ(expected, second.seqs());
+
+  std::vector<std::thread::id> first_threads = first.threads();
+  std::vector<std::thread::id> second_threads = second.threads();
+  EXPECT_EQ(first_threads.size(), size_t(std::count(first_threads.begin(), first_threads.end(), first_threads[0])));
+  EXPECT_EQ(second_threads.size(),
+            size_t(std::count(second_threads.begin(), second_threads.end(), second_threads[0])));
+  EXPECT_NE(first_threads[0], second_threads[0]);
+  EXPECT_NE(std::this_thread::get_id(), first_threads[0]);
+  comm.close();
+}
+
+// a listener that falls behind loses messages from its own full queue without holding up the port or anyone else
+TEST(MavlinkComm, SlowListenerDropsWithoutStallingOthers)
+{
+  const size_t QUEUE_SIZE = 8;
+  const size_t FRAMES = 40;
+
+  RecordingListener slow, fast;
+  FlakyComm comm;
+  comm.set_threaded_dispatch(true, QUEUE_SIZE);
+  comm.register_mavlink_frame_listener(&slow);
+  comm.register_mavlink_frame_listener(&fast);
+  slow.hold();
+  comm.open();
+
+  // one at a time, so only the slow listener can fall behind
+  for (size_t i = 0; i < FRAMES; i++)
+  {
+    std::vector<uint8_t> bytes = heartbeat_frame(uint8_t(i));
+    ASSERT_TRUE(wait_until([&comm, &bytes]() { return comm.deliver(bytes); }, milliseconds(1000)));
+    ASSERT_TRUE(fast.wait_for(i + 1, milliseconds(1000)));
+  }
+
+  // at most a full queue, plus the one frame held in the handler, is waiting for the slow listener
+  MavlinkComm::ListenerStats stats;
+  ASSERT_TRUE(comm.get_listener_stats(&slow, &stats));
+  EXPECT_GE(stats.dropped, FRAMES - QUEUE_SIZE - 1);
+
+  slow.release();
+  ASSERT_TRUE(wait_until(
+      [&comm, &slow, &stats]() { return comm.get_listener_stats(&slow, &stats) && stats.queue_depth == 0; },
+      milliseconds(1000)));
+  std::vector<uint8_t> seqs = slow.seqs();
+  EXPECT_EQ(FRAMES, seqs.size() + stats.dropped);
+  EXPECT_EQ(seqs.size(), stats.dispatched);
+  EXPECT_TRUE(std::is_sorted(seqs.begin(), seqs.end()));
+
+  ASSERT_TRUE(comm.get_listener_stats(&fast, &stats));
+  EXPECT_EQ(FRAMES, stats.dispatched);
+  EXPECT_EQ(0u, stats.dropped);
+  comm.close();
+}
+
+// close() hands over everything already queued before it stops the dispatcher threads, and nothing after
+TEST(MavlinkComm, CloseDeliversQueuedMessagesThenStopsDispatch)
+{
+  const size_t FRAMES = 10;
+
+  RecordingListener listener;
+  FlakyComm comm;
+  comm.set_threaded_dispatch(true, 64);
+  comm.register_mavlink_frame_listener(&listener);
+  listener.hold();
+  comm.open();
+
+  std::vector<uint8_t> bytes = heartbeat_frames(0, FRAMES);
+  ASSERT_TRUE(wait_until([&comm, &bytes]() { return comm.deliver(bytes); }, milliseconds(1000)));
+  MavlinkComm::ListenerStats stats;
+  ASSERT_TRUE(wait_until(
+      [&comm, &listener, &stats]() {
+        return comm.get_listener_stats(&listener, &stats) && stats.queue_depth == FRAMES - 1;
+      },
+      milliseconds(1000)));
+
+  std::thread closer([&comm]() { comm.close(); });
+  std::this_thread::sleep_for(milliseconds(20));
+  EXPECT_TRUE(listener.seqs().empty());
+  listener.release();
+  closer.join();
+
+  EXPECT_EQ(FRAMES, listener.seqs().size());
+  ASSERT_TRUE(comm.get_listener_stats(&listener, &stats));
+  EXPECT_EQ(0u, stats.queue_depth);
+  EXPECT_EQ(FRAMES, stats.dispatched);
+}
+
+TEST(MavlinkComm, ListenersOnlyGetTheirMessageIds)
+{
+  const size_t PAIRS = 20;
+
+  CountingListener everything, heartbeats, timesyncs, both;
+  FlakyComm comm;
+  comm.register_mavlink_listener(&everything);
+  comm.register_mavlink_frame_listener(&heartbeats, {MAVLINK_MSG_ID_HEARTBEAT});
+  comm.register_mavlink_listener(&timesyncs, {MAVLINK_MSG_ID_TIMESYNC});
+  comm.register_mavlink_frame_listener(&both, {MAVLINK_MSG_ID_TIMESYNC, MAVLINK_MSG_ID_HEARTBEAT});
+  comm.open();
+
+  std::vector<uint8_t> bytes = mixed_stream(PAIRS);
+  ASSERT_TRUE(wait_until([&comm, &bytes]() { return comm.deliver(bytes); }, milliseconds(1000)));
+  ASSERT_TRUE(wait_until([&everything]() { return everything.total() == 2 * PAIRS; }, milliseconds(1000)));
+
+  // registering again replaces the message IDs rather than adding a second entry
+  comm.register_mavlink_frame_listener(&heartbeats, {MAVLINK_MSG_ID_TIMESYNC});
+  ASSERT_TRUE(wait_until([&comm, &bytes]() { return comm.deliver(bytes); }, milliseconds(1000)));
+  ASSERT_TRUE(wait_until([&everything]() { return everything.total() == 4 * PAIRS; }, milliseconds(1000)));
+  comm.close();
+
+  EXPECT_EQ(2 * PAIRS, everything.heartbeats.load());
+  EXPECT_EQ(2 * PAIRS, everything.timesyncs.load());
+  EXPECT_EQ(PAIRS, heartbeats.heartbeats.load());
+  EXPECT_EQ(PAIRS, heartbeats.timesyncs.load());
+  EXPECT_EQ(0u, timesyncs.heartbeats.load());
+  EXPECT_EQ(2 * PAIRS, timesyncs.timesyncs.load());
+  EXPECT_EQ(4 * PAIRS, both.total());
+}
+
+TEST(MavlinkComm, RegistrationChangesWhileDispatching)
+{
+  CountingListener clock;
+  ReplayComm comm(mixed_stream(10));
+  comm.register_mavlink_listener(&clock);
+  comm.open();
+  churn_registrations(comm, clock, false);
+  comm.close();
+}
+
+TEST(MavlinkComm, RegistrationChangesWhileDispatchingThreaded)
+{
+  CountingListener clock;
+  ReplayComm comm(mixed_stream(10));
+  comm.set_threaded_dispatch(true);
+  comm.register_mavlink_listener(&clock);
+  comm.open();
+  churn_registrations(comm, clock, true);
+  comm.close();
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_mavlink_router.cpp
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_router.h>
+
+#include "fakes.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using mavrosflight::MavlinkFrame;
+using mavrosflight::MavlinkRouter;
+using rosflight_test::FlakyComm;
+
+using std::chrono::milliseconds;
+
+namespace
+{
+typedef std::vector<uint8_t> Bytes;
+
+bool wait_until(std::function<bool()> condition, std::chrono::milliseconds timeout)
+{
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+  while (!condition())
+  {
+    if (std::chrono::steady_clock::now() >= deadline)
+      return false;
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  return true;
+}
+
+Bytes encode(const mavlink_message_t &msg)
+{
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+  return Bytes(buf, buf + len);
+}
+
+Bytes heartbeat(uint8_t sysid)
+{
+  mavlink_message_t msg;
+  mavlink_msg_heartbeat_pack(sysid, 1, &msg, 0, 0, 0, 0, 0);
+  return encode(msg);
+}
+
+Bytes timesync(int64_t ts1)
+{
+  mavlink_message_t msg;
+  mavlink_msg_timesync_pack(1, 1, &msg, 0, ts1);
+  return encode(msg);
+}
+
+//! Hand bytes to the port's next read, waiting for the read to be started
+bool deliver(FlakyComm *comm, const Bytes &bytes)
+{
+  return wait_until([comm, &bytes]() { return comm->deliver(bytes); }, milliseconds(1000));
+}
+
+//! Wait for the port to have written count frames
+bool wait_for_writes(FlakyComm *comm, size_t count)
+{
+  return wait_until([comm, count]() { return comm->written().size() >= count; }, milliseconds(1000));
+}
+
+/**
+ * \brief An upstream link with a router and two endpoints: one taking everything, one taking only TIMESYNC
+ *
+ * The endpoints are owned by the router; the pointers are kept for driving and inspecting them.
+ */
+class MavlinkRouterTest : public ::testing::Test
+{
+protected:
+  MavlinkRouterTest() : everything(new FlakyComm), timesyncs(new FlakyComm)
+  {
+    upstream.open();
+    router.reset(new MavlinkRouter(&upstream));
+    router->add_endpoint(everything);
+    router->add_endpoint(timesyncs, {MAVLINK_MSG_ID_TIMESYNC});
+  }
+
+  virtual ~MavlinkRouterTest()
+  {
+    router.reset();
+    upstream.close();
+  }
+
+  FlakyComm upstream;
+  std::unique_ptr<MavlinkRouter> router;
+  FlakyComm *everything;
+  FlakyComm *timesyncs;
+};
+
+} // namespace
+
+TEST_F(MavlinkRouterTest, ForwardsUpstreamFramesUnchangedThroughEachFilter)
+{
+  std::vector<Bytes> frames;
+  Bytes stream;
+  for (int i = 0; i < 5; i++)
+  {
+    frames.push_back(heartbeat(1));
+    frames.push_back(timesync(i));
+    stream.insert(stream.end(), frames[frames.size() - 2].begin(), frames[frames.size() - 2].end());
+    stream.insert(stream.end(), frames.back().begin(), frames.back().end());
+  }
+
+  ASSERT_TRUE(deliver(&upstream, stream));
+  ASSERT_TRUE(wait_for_writes(everything, frames.size()));
+  ASSERT_TRUE(wait_for_writes(timesyncs, frames.size() / 2));
+
+  EXPECT_EQ(frames, everything->written());
+
+  std::vector<Bytes> written = timesyncs->written();
+  ASSERT_EQ(frames.size() / 2, written.size());
+  for (size_t i = 0; i < written.size(); i++)
+  {
+    EXPECT_EQ(frames[2 * i + 1], written[i]);
+  }
+
+  MavlinkRouter::EndpointStats stats = router->get_endpoint_stats(0);
+  EXPECT_EQ(frames.size(), stats.forwarded);
+  EXPECT_EQ(0u, stats.filtered);
+  EXPECT_EQ(0u, stats.dropped);
+
+  stats = router->get_endpoint_stats(1);
+  EXPECT_EQ(frames.size() / 2, stats.forwarded);
+  EXPECT_EQ(frames.size() / 2, stats.filtered);
+
+  // nothing the router forwarded went back up the flight controller link
+  EXPECT_TRUE(upstream.written().empty());
+}
+
+TEST_F(MavlinkRouterTest, EndpointFramesOnlyGoUpstream)
+{
+  Bytes from_gcs = heartbeat(255);
+  ASSERT_TRUE(deliver(everything, from_gcs));
+  ASSERT_TRUE(wait_for_writes(&upstream, 1));
+  Bytes from_logger = timesync(7);
+  ASSERT_TRUE(deliver(timesyncs, from_logger));
+  ASSERT_TRUE(wait_for_writes(&upstream, 2));
+
+  std::vector<Bytes> written = upstream.written();
+  ASSERT_EQ(2u, written.size());
+  EXPECT_EQ(from_gcs, written[0]);
+  EXPECT_EQ(from_logger, written[1]);
+  // counted once the frame has been handed upstream
+  EXPECT_TRUE(wait_until([this]() { return router->get_endpoint_stats(1).received == 1; }, milliseconds(1000)));
+  EXPECT_EQ(1u, router->get_endpoint_stats(0).received);
+
+  // an upstream frame in between, so a frame looping back to any endpoint would have been written before it
+  Bytes from_fcu = timesync(8);
+  ASSERT_TRUE(deliver(&upstream, from_fcu));
+  ASSERT_TRUE(wait_for_writes(everything, 1));
+  ASSERT_TRUE(wait_for_writes(timesyncs, 1));
+
+  // neither the endpoint that sent a frame nor the other one gets it back
+  EXPECT_EQ(std::vector<Bytes>(1, from_fcu), everything->written());
+  EXPECT_EQ(std::vector<Bytes>(1, from_fcu), timesyncs->written());
+  EXPECT_EQ(1u, router->get_endpoint_stats(0).forwarded);
+  EXPECT_EQ(1u, router->get_endpoint_stats(1).forwarded);
+}
+
+TEST_F(MavlinkRouterTest, EndpointThatIsDownDoesNotHoldUpOthers)
+{
+  // the first endpoint fails every write; without reconnecting, that closes it
+  everything->fail_writes(true);
+
+  for (int i = 0; i < 20; i++)
+  {
+    ASSERT_TRUE(deliver(&upstream, timesync(i)));
+  }
+  ASSERT_TRUE(wait_for_writes(timesyncs, 20));
+  EXPECT_EQ(20u, router->get_endpoint_stats(1).forwarded);
+  EXPECT_TRUE(everything->written().empty());
+}
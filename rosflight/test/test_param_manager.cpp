@@ -0,0 +1,766 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_param_manager.cpp
+ */
+
+#include <rosflight/mavrosflight/interface_adapter.h>
+#include <rosflight/mavrosflight/param_manager.h>
+
+#include "fakes.h"
+#include "simulated_fcu.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using mavrosflight::DerivedLoggerType;
+using rosflight_test::ClosedComm;
+using rosflight_test::SimulatedFcu;
+using rosflight_test::StoppedTimerProvider;
+using rosflight_test::ThreadTimerProvider;
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+
+typedef mavrosflight::ParamManager<DerivedLoggerType> ParamManager;
+
+namespace
+{
+const size_t NUM_PARAMS = 200;         //!< parameters on the simulated flight controller
+const size_t TABLE_SIZE = 1000;        //!< parameters handed straight to the param manager
+const microseconds MESSAGE_TIME(5700); //!< a PARAM_VALUE frame at 57600 baud
+
+} // namespace
+
+/**
+ * \brief Fills a param manager's table by handing it PARAM_VALUE messages directly, with no link or timers involved
+ */
+class ParamTableTest : public ::testing::Test
+{
+protected:
+  ParamTableTest() : params_(&comm_, logger_, timers_) {}
+
+  //! Names of every length up to the 16 characters of a parameter ID, which then has no terminating null
+  static std::string table_name(size_t index)
+  {
+    char name[17];
+    switch (index % 3)
+    {
+    case 0:
+      snprintf(name, sizeof(name), "P%u", static_cast<unsigned>(index));
+      break;
+    case 1:
+      snprintf(name, sizeof(name), "GAIN_%u_ROLL", static_cast<unsigned>(index));
+      break;
+    default:
+      snprintf(name, sizeof(name), "SENSOR_CAL_%05u", static_cast<unsigned>(index));
+      break;
+    }
+    return name;
+  }
+
+  void receive(const std::string &name, size_t index, float value, size_t count = TABLE_SIZE)
+  {
+    mavlink_message_t msg;
+    mavlink_msg_param_value_pack(1, 1, &msg, name.c_str(), value, MAV_PARAM_TYPE_REAL32, count, index);
+    params_.handle_mavlink_message(msg);
+  }
+
+  void fill_table()
+  {
+    for (size_t i = 0; i < TABLE_SIZE; i++)
+    {
+      receive(table_name(i), i, 0.5f * i);
+    }
+  }
+
+  ClosedComm comm_;
+  DerivedLoggerType logger_;
+  StoppedTimerProvider timers_;
+  ParamManager params_;
+};
+
+TEST_F(ParamTableTest, LookupFindsEveryParam)
+{
+  fill_table();
+  ASSERT_TRUE(params_.got_all_params());
+  EXPECT_EQ(static_cast<int>(TABLE_SIZE), params_.get_num_params());
+
+  for (size_t i = 0; i < TABLE_SIZE; i++)
+  {
+    double value;
+    ASSERT_TRUE(params_.get_param_value(table_name(i), &value)) << table_name(i);
+    EXPECT_EQ(0.5 * i, value) << table_name(i);
+  }
+}
+
+TEST_F(ParamTableTest, UnknownNamesAreNotFound)
+{
+  fill_table();
+
+  const char *unknown[] = {"",
+                           "P",
+                           "P1000",
+                           "GAIN_1_ROL",
+                           "GAIN_1_ROLLL",
+                           "SENSOR_CAL_0000",
+                           "SENSOR_CAL_00002X", // 17 characters, starting with a real name
+                           "p0"};
+  for (size_t i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++)
+  {
+    double value = 1.0;
+    EXPECT_FALSE(params_.get_param_value(unknown[i], &value)) << unknown[i];
+    EXPECT_EQ(0.0, value) << unknown[i];
+    EXPECT_FALSE(params_.set_param_value(unknown[i], 1.0)) << unknown[i];
+  }
+}
+
+TEST_F(ParamTableTest, NothingIsFoundBeforeTheFirstParam)
+{
+  double value;
+  EXPECT_FALSE(params_.get_param_value(table_name(0), &value));
+  EXPECT_FALSE(params_.set_param_value(table_name(0), 1.0));
+}
+
+TEST_F(ParamTableTest, EchoUpdatesExistingEntry)
+{
+  fill_table();
+
+  ASSERT_TRUE(params_.set_param_value(table_name(42), 7.25));
+  double value;
+  ASSERT_TRUE(params_.get_param_value(table_name(42), &value));
+  EXPECT_EQ(21.0, value); // unchanged until the flight controller echoes it
+
+  receive(table_name(42), 42, 7.25f);
+  ASSERT_TRUE(params_.get_param_value(table_name(42), &value));
+  EXPECT_EQ(7.25, value);
+  EXPECT_EQ(static_cast<int>(TABLE_SIZE), params_.get_params_received());
+  EXPECT_TRUE(params_.unsaved_changes());
+}
+
+TEST_F(ParamTableTest, InvalidIndicesAreIgnored)
+{
+  receive("FIRST", 0, 1.0f, 2);
+  receive("OUT_OF_RANGE", 2, 2.0f, 2);
+  receive("TAKEN", 0, 3.0f, 2);
+  EXPECT_EQ(1, params_.get_params_received());
+  EXPECT_FALSE(params_.got_all_params());
+
+  double value;
+  EXPECT_FALSE(params_.get_param_value("OUT_OF_RANGE", &value));
+  EXPECT_FALSE(params_.get_param_value("TAKEN", &value));
+  ASSERT_TRUE(params_.get_param_value("FIRST", &value));
+  EXPECT_EQ(1.0, value);
+
+  receive("SECOND", 1, 4.0f, 2);
+  EXPECT_TRUE(params_.got_all_params());
+}
+
+class ParamManagerTest : public ::testing::Test
+{
+protected:
+  ParamManagerTest() : cache_file_(::testing::TempDir() + "rosflight_param_cache_test.yml") {}
+
+  void connect(double loss_rate, size_t num_params = NUM_PARAMS)
+  {
+    disconnect();
+    timers_.reset(new ThreadTimerProvider());
+    fcu_.reset(new SimulatedFcu(num_params, loss_rate, MESSAGE_TIME));
+    params_.reset(new ParamManager(fcu_.get(), logger_, *timers_));
+    fcu_->open();
+  }
+
+  //! Stop everything that calls into the param manager before it goes away
+  void disconnect()
+  {
+    if (timers_)
+      timers_->shutdown();
+    if (fcu_)
+      fcu_->close();
+    params_.reset();
+    fcu_.reset();
+    timers_.reset();
+  }
+
+  virtual void TearDown()
+  {
+    disconnect();
+    std::remove(cache_file_.c_str());
+  }
+
+  //! Download every parameter, returning the download stats once it is complete or the timeout has passed
+  ParamManager::DownloadStats download(seconds timeout)
+  {
+    std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now() + timeout;
+    params_->request_params();
+    while (!params_->get_download_stats().complete && std::chrono::steady_clock::now() < give_up)
+    {
+      std::this_thread::sleep_for(milliseconds(5));
+    }
+    return params_->get_download_stats();
+  }
+
+  //! Wait for the table to be complete, and any parameters loaded from the cache checked against the flight controller
+  bool wait_for_verified(seconds timeout)
+  {
+    std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now() + timeout;
+    ParamManager::DownloadStats stats;
+    while (stats = params_->get_download_stats(), stats.verifying || !stats.complete)
+    {
+      if (std::chrono::steady_clock::now() >= give_up)
+        return false;
+      std::this_thread::sleep_for(milliseconds(5));
+    }
+    return true;
+  }
+
+  /**
+   * \brief Connect a new param manager that uses the cache file, and report the firmware version
+   */
+  void connect_with_cache(const std::string &firmware_version, size_t num_params = NUM_PARAMS)
+  {
+    connect(0.0, num_params);
+    params_->set_cache_file(cache_file_);
+    params_->set_firmware_version(firmware_version);
+  }
+
+  //! Download the table once so the cache file holds it
+  void fill_cache(const std::string &firmware_version)
+  {
+    std::remove(cache_file_.c_str());
+    connect_with_cache(firmware_version);
+    ASSERT_TRUE(download(seconds(10)).complete);
+    ASSERT_FALSE(params_->get_download_stats().from_cache);
+
+    // written once the last parameter has been handled
+    std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now() + seconds(1);
+    while (!std::ifstream(cache_file_.c_str()).good() && std::chrono::steady_clock::now() < give_up)
+    {
+      std::this_thread::sleep_for(milliseconds(5));
+    }
+    ASSERT_TRUE(std::ifstream(cache_file_.c_str()).good());
+  }
+
+  //! Outcome of a group of sets, filled in by their callbacks
+  struct SetOutcome
+  {
+    SetOutcome() : confirmed(0), failed(0) {}
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t confirmed;
+    size_t failed;
+  };
+
+  static ParamManager::SetCallback record(const std::shared_ptr<SetOutcome> &outcome)
+  {
+    return [outcome](size_t confirmed, size_t failed) {
+      std::lock_guard<std::mutex> lock(outcome->mutex);
+      outcome->confirmed += confirmed;
+      outcome->failed += failed;
+      outcome->changed.notify_all();
+    };
+  }
+
+  //! Wait until the callbacks have reported on the given number of sets
+  static bool wait_for_sets(SetOutcome &outcome, size_t count, seconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(outcome.mutex);
+    return outcome.changed.wait_for(lock, timeout, [&] { return outcome.confirmed + outcome.failed >= count; });
+  }
+
+  //! Set several parameters and wait for the outcome
+  ParamManager::SetManyResult set_many(const std::vector<std::string> &names,
+                                       const std::vector<double> &values,
+                                       bool all_or_nothing)
+  {
+    std::shared_ptr<std::promise<ParamManager::SetManyResult> > promise =
+        std::make_shared<std::promise<ParamManager::SetManyResult> >();
+    std::future<ParamManager::SetManyResult> future = promise->get_future();
+    params_->set_param_values(names, values, all_or_nothing,
+                              [promise](const ParamManager::SetManyResult &result) { promise->set_value(result); });
+
+    if (future.wait_for(seconds(30)) != std::future_status::ready)
+    {
+      ADD_FAILURE() << "set_param_values did not finish";
+      return ParamManager::SetManyResult();
+    }
+    return future.get();
+  }
+
+  void expect_table_matches_fcu()
+  {
+    for (size_t i = 0; i < NUM_PARAMS; i++)
+    {
+      double value;
+      ASSERT_TRUE(params_->get_param_value(SimulatedFcu::param_name(i), &value)) << SimulatedFcu::param_name(i);
+      EXPECT_EQ(fcu_->value(i), value) << SimulatedFcu::param_name(i);
+    }
+  }
+
+  const std::string cache_file_;
+  DerivedLoggerType logger_;
+  std::unique_ptr<ThreadTimerProvider> timers_;
+  std::unique_ptr<SimulatedFcu> fcu_;
+  std::unique_ptr<ParamManager> params_;
+};
+
+TEST_F(ParamManagerTest, DownloadOverCleanLinkNeedsOnlyTheList)
+{
+  connect(0.0);
+  ParamManager::DownloadStats stats = download(seconds(10));
+
+  ASSERT_TRUE(stats.complete);
+  EXPECT_EQ(NUM_PARAMS, stats.received);
+  EXPECT_EQ(0u, stats.requests);
+  EXPECT_EQ(0u, stats.retries);
+  expect_table_matches_fcu();
+}
+
+TEST_F(ParamManagerTest, DownloadCompletesOverLossyLink)
+{
+  connect(0.2);
+  ParamManager::DownloadStats stats = download(seconds(30));
+
+  ASSERT_TRUE(stats.complete);
+  EXPECT_EQ(NUM_PARAMS, stats.received);
+  EXPECT_EQ(NUM_PARAMS, stats.total);
+  EXPECT_GT(stats.requests, 0u);
+  expect_table_matches_fcu();
+  RecordProperty("download_ms", static_cast<int>(duration_cast<milliseconds>(stats.elapsed).count()));
+}
+
+TEST_F(ParamManagerTest, SetsAreConfirmedOverLossyLink)
+{
+  connect(0.05);
+  ASSERT_TRUE(download(seconds(30)).complete);
+
+  // negative INT32 values are NaN when read as floats, so they are only confirmed if values are compared bit for bit
+  const size_t NUM_SETS = 40;
+  std::shared_ptr<SetOutcome> outcome = std::make_shared<SetOutcome>();
+  for (size_t i = 0; i < NUM_SETS; i++)
+  {
+    ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(i), -1.0 - i, record(outcome)));
+  }
+  ASSERT_TRUE(wait_for_sets(*outcome, NUM_SETS, seconds(30)));
+
+  EXPECT_EQ(NUM_SETS, outcome->confirmed);
+  EXPECT_EQ(0u, outcome->failed);
+  for (size_t i = 0; i < NUM_SETS; i++)
+  {
+    EXPECT_EQ(-1 - static_cast<int32_t>(i), fcu_->value(i)) << SimulatedFcu::param_name(i);
+  }
+  expect_table_matches_fcu();
+
+  ParamManager::SetStats stats = params_->get_set_stats();
+  EXPECT_EQ(0u, stats.pending);
+  EXPECT_EQ(NUM_SETS, stats.confirmed);
+  RecordProperty("set_retries", static_cast<int>(stats.retries));
+}
+
+TEST_F(ParamManagerTest, SetIsRetriedUntilItFails)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+  fcu_->ignore_sets(5);
+
+  std::shared_ptr<SetOutcome> outcome = std::make_shared<SetOutcome>();
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(5), 500, record(outcome)));
+  ASSERT_TRUE(wait_for_sets(*outcome, 1, seconds(30)));
+
+  EXPECT_EQ(0u, outcome->confirmed);
+  EXPECT_EQ(1u, outcome->failed);
+  EXPECT_EQ(5, fcu_->value(5));
+
+  ParamManager::SetStats stats = params_->get_set_stats();
+  EXPECT_EQ(0u, stats.pending);
+  EXPECT_EQ(1u, stats.failed);
+  EXPECT_EQ(static_cast<uint64_t>(PARAM_SET_MAX_ATTEMPTS - 1), stats.retries);
+}
+
+TEST_F(ParamManagerTest, SetToCurrentValueIsConfirmedWithoutSending)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  size_t confirmed = 0;
+  size_t failed = 0;
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(7), 7, [&](size_t c, size_t f) {
+    confirmed = c;
+    failed = f;
+  }));
+
+  // the callback has already run, on this thread
+  EXPECT_EQ(1u, confirmed);
+  EXPECT_EQ(0u, failed);
+  EXPECT_EQ(0u, params_->get_set_stats().pending);
+}
+
+TEST_F(ParamManagerTest, SetUndoingPendingSetIsSent)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  std::shared_ptr<SetOutcome> outcome = std::make_shared<SetOutcome>();
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(3), 300, record(outcome)));
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(3), 3, record(outcome)));
+  ASSERT_TRUE(wait_for_sets(*outcome, 2, seconds(10)));
+
+  EXPECT_EQ(2u, outcome->confirmed);
+  EXPECT_EQ(3, fcu_->value(3));
+}
+
+TEST_F(ParamManagerTest, SetLatencyIsRecordedPerParam)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  std::shared_ptr<SetOutcome> outcome = std::make_shared<SetOutcome>();
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(2), 200, record(outcome)));
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(2), 201, record(outcome)));
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(4), 400, record(outcome)));
+  ASSERT_TRUE(params_->set_param_value(SimulatedFcu::param_name(6), 6, record(outcome))); // already the value
+  ASSERT_TRUE(wait_for_sets(*outcome, 4, seconds(10)));
+
+  std::map<std::string, ParamManager::ParamSetLatency> latencies = params_->get_set_latencies();
+  ASSERT_EQ(2u, latencies.size());
+  ASSERT_EQ(1u, latencies.count(SimulatedFcu::param_name(2)));
+  ASSERT_EQ(1u, latencies.count(SimulatedFcu::param_name(4)));
+
+  const ParamManager::ParamSetLatency &twice = latencies[SimulatedFcu::param_name(2)];
+  EXPECT_EQ(2u, twice.confirmed);
+  EXPECT_EQ(1, twice.last_attempts);
+  EXPECT_GT(twice.last, nanoseconds(0));
+  EXPECT_GE(twice.max, twice.last);
+  EXPECT_GE(twice.total, twice.max + nanoseconds(1));
+
+  const ParamManager::ParamSetLatency &once = latencies[SimulatedFcu::param_name(4)];
+  EXPECT_EQ(1u, once.confirmed);
+  EXPECT_EQ(once.last, once.max);
+  EXPECT_EQ(once.last, once.total);
+
+  // the overall figures cover the same sets
+  ParamManager::SetStats stats = params_->get_set_stats();
+  EXPECT_EQ(std::max(twice.max, once.max), stats.latency_max);
+  EXPECT_EQ((twice.total + once.total) / 3, stats.latency);
+}
+
+TEST_F(ParamManagerTest, SetOfUnknownParamIsRejected)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  bool called = false;
+  EXPECT_FALSE(params_->set_param_value("NO_SUCH_PARAM", 1, [&](size_t, size_t) { called = true; }));
+  EXPECT_FALSE(called);
+}
+
+TEST_F(ParamManagerTest, CacheForSameFirmwareIsLoadedThenVerified)
+{
+  ASSERT_NO_FATAL_FAILURE(fill_cache("v1"));
+
+  connect_with_cache("v1");
+  params_->request_params();
+  ParamManager::DownloadStats stats = params_->get_download_stats();
+  EXPECT_TRUE(stats.complete);
+  EXPECT_TRUE(stats.from_cache);
+  EXPECT_TRUE(stats.verifying);
+  expect_table_matches_fcu();
+
+  ASSERT_TRUE(wait_for_verified(seconds(10)));
+  stats = params_->get_download_stats();
+  EXPECT_TRUE(stats.complete);
+  EXPECT_TRUE(stats.from_cache);
+  expect_table_matches_fcu();
+}
+
+TEST_F(ParamManagerTest, CacheForOtherFirmwareIsDownloadedAgain)
+{
+  ASSERT_NO_FATAL_FAILURE(fill_cache("v1"));
+
+  connect_with_cache("v2");
+  params_->request_params();
+  EXPECT_FALSE(params_->get_download_stats().from_cache);
+  ASSERT_TRUE(download(seconds(10)).complete);
+  EXPECT_FALSE(params_->get_download_stats().from_cache);
+  expect_table_matches_fcu();
+
+  // and the cache now holds the new firmware's table
+  connect_with_cache("v2");
+  params_->request_params();
+  EXPECT_TRUE(params_->get_download_stats().from_cache);
+}
+
+TEST_F(ParamManagerTest, CorruptCacheIsIgnored)
+{
+  ASSERT_NO_FATAL_FAILURE(fill_cache("v1"));
+
+  // change a value without updating the hash
+  std::string contents;
+  {
+    std::ifstream in(cache_file_.c_str());
+    contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  const std::string entry = "name: PARAM_005, index: 5, type: 6, value: 5}";
+  size_t pos = contents.find(entry);
+  ASSERT_NE(std::string::npos, pos) << contents.substr(0, 400);
+  contents.replace(pos, entry.size(), "name: PARAM_005, index: 5, type: 6, value: 6}");
+  {
+    std::ofstream out(cache_file_.c_str());
+    out << contents;
+  }
+
+  connect_with_cache("v1");
+  params_->request_params();
+  EXPECT_FALSE(params_->get_download_stats().from_cache);
+  ASSERT_TRUE(download(seconds(10)).complete);
+  expect_table_matches_fcu();
+}
+
+TEST_F(ParamManagerTest, StaleCachedValueIsReplacedDuringVerify)
+{
+  ASSERT_NO_FATAL_FAILURE(fill_cache("v1"));
+
+  // the same firmware on a board configured differently
+  connect_with_cache("v1");
+  fcu_->set_value(10, 1000);
+  params_->request_params();
+  ASSERT_TRUE(params_->get_download_stats().from_cache);
+
+  ASSERT_TRUE(wait_for_verified(seconds(10)));
+  double value;
+  ASSERT_TRUE(params_->get_param_value(SimulatedFcu::param_name(10), &value));
+  EXPECT_EQ(1000, value);
+  expect_table_matches_fcu();
+
+  // the corrected table was written back
+  connect_with_cache("v1");
+  params_->request_params();
+  ASSERT_TRUE(params_->get_download_stats().from_cache);
+  ASSERT_TRUE(params_->get_param_value(SimulatedFcu::param_name(10), &value));
+  EXPECT_EQ(1000, value);
+}
+
+TEST_F(ParamManagerTest, StaleCachedTableIsDownloadedAgainDuringVerify)
+{
+  ASSERT_NO_FATAL_FAILURE(fill_cache("v1"));
+
+  // the same firmware version reporting a different table
+  connect_with_cache("v1", NUM_PARAMS / 2);
+  params_->request_params();
+  ASSERT_TRUE(params_->get_download_stats().from_cache);
+  EXPECT_EQ(NUM_PARAMS, params_->get_download_stats().total);
+
+  ASSERT_TRUE(wait_for_verified(seconds(10)));
+  ParamManager::DownloadStats stats = params_->get_download_stats();
+  EXPECT_FALSE(stats.from_cache);
+  EXPECT_FALSE(stats.verifying);
+  EXPECT_EQ(NUM_PARAMS / 2, stats.total);
+  double value;
+  EXPECT_FALSE(params_->get_param_value(SimulatedFcu::param_name(NUM_PARAMS - 1), &value));
+  for (size_t i = 0; i < NUM_PARAMS / 2; i++)
+  {
+    ASSERT_TRUE(params_->get_param_value(SimulatedFcu::param_name(i), &value)) << SimulatedFcu::param_name(i);
+    EXPECT_EQ(fcu_->value(i), value) << SimulatedFcu::param_name(i);
+  }
+}
+
+TEST_F(ParamManagerTest, SetManyAllOrNothingAppliesEverySet)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  std::vector<std::string> names = {SimulatedFcu::param_name(1), SimulatedFcu::param_name(2)};
+  ParamManager::SetManyResult result = set_many(names, {100, 200}, true);
+
+  EXPECT_TRUE(result.success);
+  EXPECT_FALSE(result.rolled_back);
+  EXPECT_EQ(std::vector<bool>(2, true), result.exists);
+  EXPECT_EQ(std::vector<bool>(2, true), result.confirmed);
+  EXPECT_EQ(100, fcu_->value(1));
+  EXPECT_EQ(200, fcu_->value(2));
+}
+
+TEST_F(ParamManagerTest, SetManyAllOrNothingRestoresAfterFailedSet)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+  fcu_->ignore_sets(5);
+
+  std::vector<std::string> names = {SimulatedFcu::param_name(1), SimulatedFcu::param_name(5),
+                                    SimulatedFcu::param_name(9)};
+  ParamManager::SetManyResult result = set_many(names, {100, 500, 900}, true);
+
+  EXPECT_FALSE(result.success);
+  EXPECT_TRUE(result.rolled_back);
+  EXPECT_EQ(std::vector<bool>(3, true), result.exists);
+  EXPECT_EQ(std::vector<bool>({true, false, true}), result.confirmed);
+  EXPECT_EQ(1, fcu_->value(1));
+  EXPECT_EQ(5, fcu_->value(5));
+  EXPECT_EQ(9, fcu_->value(9));
+  expect_table_matches_fcu();
+}
+
+TEST_F(ParamManagerTest, SetManyAllOrNothingReportsFailedRestore)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+  fcu_->ignore_sets(5);
+  fcu_->ignore_sets(1, 1); // takes the new value, then ignores the restore
+
+  std::vector<std::string> names = {SimulatedFcu::param_name(1), SimulatedFcu::param_name(5),
+                                    SimulatedFcu::param_name(9)};
+  ParamManager::SetManyResult result = set_many(names, {100, 500, 900}, true);
+
+  EXPECT_FALSE(result.success);
+  EXPECT_FALSE(result.rolled_back);
+  EXPECT_EQ(std::vector<bool>({true, false, true}), result.confirmed);
+  EXPECT_EQ(100, fcu_->value(1));
+  EXPECT_EQ(5, fcu_->value(5));
+  EXPECT_EQ(9, fcu_->value(9));
+  expect_table_matches_fcu();
+}
+
+TEST_F(ParamManagerTest, SetManyAllOrNothingSendsNothingIfAParamIsUnknown)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  ParamManager::SetManyResult result = set_many({SimulatedFcu::param_name(1), "NO_SUCH_PARAM"}, {100, 1}, true);
+
+  EXPECT_FALSE(result.success);
+  EXPECT_FALSE(result.rolled_back);
+  EXPECT_EQ(std::vector<bool>({true, false}), result.exists);
+  EXPECT_EQ(std::vector<bool>(2, false), result.confirmed);
+  EXPECT_EQ(1, fcu_->value(1));
+  EXPECT_EQ(0u, params_->get_set_stats().confirmed);
+}
+
+TEST_F(ParamManagerTest, SetManyWithoutAllOrNothingKeepsConfirmedSets)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+  fcu_->ignore_sets(5);
+
+  std::vector<std::string> names = {SimulatedFcu::param_name(1), SimulatedFcu::param_name(5), "NO_SUCH_PARAM"};
+  ParamManager::SetManyResult result = set_many(names, {100, 500, 1}, false);
+
+  EXPECT_FALSE(result.success);
+  EXPECT_FALSE(result.rolled_back);
+  EXPECT_EQ(std::vector<bool>({true, true, false}), result.exists);
+  EXPECT_EQ(std::vector<bool>({true, false, false}), result.confirmed);
+  EXPECT_EQ(100, fcu_->value(1));
+  EXPECT_EQ(5, fcu_->value(5));
+}
+
+TEST_F(ParamManagerTest, LoadFromFileSendsOnlyChangedValues)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  const std::string filename = ::testing::TempDir() + "rosflight_param_load_test.yml";
+  {
+    std::ofstream out(filename.c_str());
+    for (size_t i = 0; i < NUM_PARAMS; i++)
+    {
+      // 7.4 is still 7 once converted to INT32, so is not a change
+      double value = (i == 3 || i == 50 || i == NUM_PARAMS - 1) ? i + 1000.0 : (i == 7 ? 7.4 : double(i));
+      out << "- {name: " << SimulatedFcu::param_name(i) << ", type: " << int(MAV_PARAM_TYPE_INT32)
+          << ", value: " << value << "}\n";
+    }
+    out << "- {name: NO_SUCH_PARAM, type: " << int(MAV_PARAM_TYPE_INT32) << ", value: 1}\n";
+    out << "- {name: " << SimulatedFcu::param_name(10) << ", type: " << int(MAV_PARAM_TYPE_REAL32) << ", value: 5}\n";
+  }
+
+  std::shared_ptr<SetOutcome> outcome = std::make_shared<SetOutcome>();
+  std::vector<ParamManager::ParamChange> changes;
+  ASSERT_TRUE(params_->load_from_file(filename, record(outcome), &changes));
+  std::remove(filename.c_str());
+  ASSERT_TRUE(wait_for_sets(*outcome, 3, seconds(10)));
+
+  ASSERT_EQ(3u, changes.size());
+  const size_t changed[] = {3, 50, NUM_PARAMS - 1};
+  for (size_t i = 0; i < 3; i++)
+  {
+    EXPECT_EQ(SimulatedFcu::param_name(changed[i]), changes[i].name);
+    EXPECT_EQ(double(changed[i]), changes[i].old_value);
+    EXPECT_EQ(changed[i] + 1000.0, changes[i].new_value);
+    EXPECT_EQ(static_cast<int32_t>(changed[i] + 1000), fcu_->value(changed[i]));
+  }
+
+  EXPECT_EQ(3u, outcome->confirmed);
+  EXPECT_EQ(0u, outcome->failed);
+  EXPECT_EQ(3u, fcu_->sets_received());
+  EXPECT_EQ(7, fcu_->value(7));
+  EXPECT_EQ(10, fcu_->value(10));
+  expect_table_matches_fcu();
+}
+
+TEST_F(ParamManagerTest, LoadingSavedFileSendsNothing)
+{
+  connect(0.0);
+  ASSERT_TRUE(download(seconds(10)).complete);
+
+  const std::string filename = ::testing::TempDir() + "rosflight_param_load_test.yml";
+  ASSERT_TRUE(params_->save_to_file(filename));
+
+  size_t confirmed = 1;
+  size_t failed = 1;
+  std::vector<ParamManager::ParamChange> changes(1);
+  ASSERT_TRUE(params_->load_from_file(filename, [&](size_t c, size_t f) {
+    confirmed = c;
+    failed = f;
+  }, &changes));
+  std::remove(filename.c_str());
+
+  // the callback has already run, on this thread
+  EXPECT_EQ(0u, confirmed);
+  EXPECT_EQ(0u, failed);
+  EXPECT_TRUE(changes.empty());
+  EXPECT_EQ(0u, params_->get_set_stats().pending);
+  EXPECT_EQ(0u, fcu_->sets_received());
+}
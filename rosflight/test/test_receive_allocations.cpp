@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_receive_allocations.cpp
+ *
+ * Counts heap allocations on the receive path, from the bytes of a read to the listeners and on to the named value
+ * publishers, once it has warmed up.
+ * This file replaces the global operator new for the whole test binary. Outside a counted stretch, it only forwards
+ * to malloc.
+ */
+
+#include <rosflight/mavrosflight/mavlink_bridge.h>
+#include <rosflight/mavrosflight/mavlink_frame.h>
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
+#include <rosflight/mavrosflight/mavlink_listener_interface.h>
+#include <rosflight/named_publisher_cache.h>
+
+#include "fakes.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mavrosflight::MavlinkFrame;
+using rosflight_test::ReplayComm;
+
+namespace
+{
+std::atomic<bool> counting(false);
+std::atomic<uint64_t> allocations(0);
+
+} // namespace
+
+void *operator new(size_t size)
+{
+  if (counting.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+  void *ptr = malloc(size > 0 ? size : 1);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+namespace
+{
+const size_t WARMUP_FRAMES = 1000;
+const size_t COUNTED_FRAMES = 100000;
+
+class CountingListener : public mavrosflight::MavlinkListenerInterface,
+                         public mavrosflight::MavlinkFrameListenerInterface
+{
+public:
+  CountingListener() : messages(0), frames(0) {}
+
+  virtual void handle_mavlink_message(const mavlink_message_t &msg) { messages++; }
+  virtual void handle_mavlink_frame(const MavlinkFrame &frame) { frames++; }
+
+  std::atomic<uint64_t> messages;
+  std::atomic<uint64_t> frames;
+};
+
+//! IMU frames with a heartbeat every tenth, as the flight controller streams them
+std::vector<uint8_t> imu_stream()
+{
+  std::vector<uint8_t> bytes;
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  mavlink_message_t msg;
+  for (int i = 0; i < 100; i++)
+  {
+    if (i % 10 == 0)
+      mavlink_msg_heartbeat_pack(1, 1, &msg, 0, 0, 0, 0, 0);
+    else
+      mavlink_msg_small_imu_pack(1, 1, &msg, i * 1000, 0.1f, 0.2f, 9.8f, 0.01f, 0.02f, 0.03f, 25.0f);
+    uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+    bytes.insert(bytes.end(), buf, buf + len);
+  }
+  return bytes;
+}
+
+//! Run the stream through the comm, and count allocations while the listener sees COUNTED_FRAMES frames
+uint64_t count_allocations(ReplayComm &comm, CountingListener &listener)
+{
+  comm.open();
+  while (listener.frames < WARMUP_FRAMES)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  allocations = 0;
+  counting = true;
+  uint64_t start = listener.frames;
+  while (listener.frames < start + COUNTED_FRAMES)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  counting = false;
+
+  comm.close();
+  return allocations;
+}
+
+struct FakePublisher
+{
+  std::string topic;
+};
+
+//! Stands in for ros::NodeHandle, recording each topic advertised
+class FakeNodeHandle
+{
+public:
+  FakeNodeHandle() : advertised(std::make_shared<std::vector<std::string> >()) {}
+
+  template <typename MessageType>
+  FakePublisher advertise(const std::string &topic, uint32_t queue_size)
+  {
+    advertised->push_back(topic);
+    FakePublisher publisher = {topic};
+    return publisher;
+  }
+
+  std::shared_ptr<std::vector<std::string> > advertised; //!< shared with the copy the cache keeps
+};
+
+typedef rosflight::NamedPublisherCache<float, FakeNodeHandle, FakePublisher> FakePublisherCache;
+
+} // namespace
+
+TEST(ReceiveAllocations, DirectDispatchDoesNotAllocate)
+{
+  ReplayComm comm(imu_stream());
+  CountingListener listener;
+  comm.register_mavlink_frame_listener(&listener);
+  comm.register_mavlink_listener(&listener, {MAVLINK_MSG_ID_SMALL_IMU});
+
+  EXPECT_EQ(0u, count_allocations(comm, listener));
+  EXPECT_GT(listener.messages, 0u);
+}
+
+TEST(ReceiveAllocations, ThreadedDispatchDoesNotAllocate)
+{
+  ReplayComm comm(imu_stream());
+  comm.set_threaded_dispatch(true);
+  CountingListener listener;
+  comm.register_mavlink_frame_listener(&listener);
+  comm.register_mavlink_listener(&listener, {MAVLINK_MSG_ID_SMALL_IMU});
+
+  EXPECT_EQ(0u, count_allocations(comm, listener));
+  EXPECT_GT(listener.messages, 0u);
+}
+
+TEST(ReceiveAllocations, NamedPublisherLookupDoesNotAllocate)
+{
+  const size_t LOOKUPS = 100000;
+
+  // name fields as they arrive: a name that fills the field has no terminator, and anything after one is ignored
+  const char names[][FakePublisherCache::NAME_LEN] = {
+    {'b', 'a', 't', 't', 'e', 'r', 'y', '\0', '\0', '\0'},
+    {'a', 'i', 'r', 's', 'p', 'e', 'e', 'd', '_', 'x'},
+    {'b', 'a', 't', 't', 'e', 'r', 'y', '\0', 'z', 'z'},
+  };
+  const size_t NUM_NAMES = sizeof(names) / sizeof(names[0]);
+  const std::string topics[NUM_NAMES] = {
+    "named_value/float/battery",
+    "named_value/float/airspeed_x",
+    "named_value/float/battery",
+  };
+
+  FakeNodeHandle nh;
+  FakePublisherCache cache(nh, "named_value/float/");
+  for (size_t i = 0; i < NUM_NAMES; i++)
+  {
+    cache.get(names[i]);
+  }
+  ASSERT_EQ(2u, nh.advertised->size());
+  EXPECT_EQ(topics[0], (*nh.advertised)[0]);
+  EXPECT_EQ(topics[1], (*nh.advertised)[1]);
+
+  allocations = 0;
+  counting = true;
+  size_t mismatched = 0;
+  for (size_t i = 0; i < LOOKUPS; i++)
+  {
+    if (cache.get(names[i % NUM_NAMES]).topic != topics[i % NUM_NAMES])
+      mismatched++;
+  }
+  counting = false;
+
+  EXPECT_EQ(0u, allocations);
+  EXPECT_EQ(2u, nh.advertised->size());
+  EXPECT_EQ(0u, mismatched);
+}
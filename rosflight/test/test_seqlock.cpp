@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_seqlock.cpp
+ */
+
+#include <rosflight/mavrosflight/seqlock.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using mavrosflight::SeqLock;
+
+namespace
+{
+// spans several words and ends partway through one
+struct Value
+{
+  uint64_t words[4];
+  uint32_t tail;
+};
+
+Value make_value(uint64_t n)
+{
+  Value value;
+  for (size_t i = 0; i < 4; i++)
+  {
+    value.words[i] = n;
+  }
+  value.tail = uint32_t(n);
+  return value;
+}
+
+bool consistent(const Value &value)
+{
+  for (size_t i = 1; i < 4; i++)
+  {
+    if (value.words[i] != value.words[0])
+      return false;
+  }
+  return value.tail == uint32_t(value.words[0]);
+}
+
+} // namespace
+
+TEST(SeqLock, LoadsInitialValue)
+{
+  SeqLock<Value> lock(make_value(7));
+  Value value = lock.load();
+  EXPECT_TRUE(consistent(value));
+  EXPECT_EQ(7u, value.words[0]);
+}
+
+TEST(SeqLock, DefaultConstructsValue)
+{
+  SeqLock<double> lock;
+  EXPECT_EQ(0.0, lock.load());
+}
+
+TEST(SeqLock, LoadsLatestStore)
+{
+  SeqLock<Value> lock;
+  for (uint64_t n = 1; n <= 100; n++)
+  {
+    lock.store(make_value(n));
+    Value value = lock.load();
+    ASSERT_TRUE(consistent(value));
+    ASSERT_EQ(n, value.words[0]);
+  }
+}
+
+TEST(SeqLock, ReadersNeverSeeTornOrStaleValues)
+{
+  const uint64_t STORES = 200000;
+  SeqLock<Value> lock(make_value(0));
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> torn(0), backwards(0), loads(0);
+  std::atomic<int> started(0);
+
+  const int READERS = 4;
+  std::vector<std::thread> readers;
+  for (int i = 0; i < READERS; i++)
+  {
+    readers.emplace_back([&]() {
+      uint64_t last = 0;
+      bool first = true;
+      do
+      {
+        Value value = lock.load();
+        if (!consistent(value))
+          torn++;
+        if (value.words[0] < last)
+          backwards++;
+        last = value.words[0];
+        loads++;
+        if (first)
+          started++;
+        first = false;
+      } while (!done.load());
+    });
+  }
+
+  // on a single core the writer could otherwise finish before any reader has run
+  while (started.load() < READERS)
+  {
+    std::this_thread::yield();
+  }
+  for (uint64_t n = 1; n <= STORES; n++)
+  {
+    lock.store(make_value(n));
+  }
+  done = true;
+  for (size_t i = 0; i < readers.size(); i++)
+  {
+    readers[i].join();
+  }
+
+  EXPECT_EQ(0u, torn.load());
+  EXPECT_EQ(0u, backwards.load());
+  EXPECT_GT(loads.load(), 0u);
+  EXPECT_EQ(STORES, lock.load().words[0]);
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_serial_tuning.cpp
+ *
+ * Runs the low-latency serial setup against a pseudo terminal, whose driver implements TIOCEXCL but not the
+ * TIOCGSERIAL/TIOCSSERIAL pair, so the ASYNC_LOW_LATENCY step has to fall back to leaving the port as it is.
+ */
+
+#include <rosflight/mavrosflight/mavlink_frame_listener_interface.h>
+#include <rosflight/mavrosflight/mavlink_serial.h>
+#include <rosflight/mavrosflight/serial_exception.h>
+#include <rosflight/mavrosflight/serial_tuning.h>
+
+#ifdef __linux__
+#include <rosflight/mavrosflight/mavlink_epoll_serial.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <pty.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+using mavrosflight::MavlinkComm;
+using mavrosflight::MavlinkFrame;
+using mavrosflight::SerialException;
+using std::chrono::milliseconds;
+
+namespace
+{
+/**
+ * \brief A pseudo terminal pair; the slave end stands in for the flight controller's serial port
+ */
+class Pty
+{
+public:
+  Pty() : master_(-1), slave_(-1)
+  {
+    // raw, so bytes are passed on as they arrive rather than a line at a time
+    struct termios raw;
+    memset(&raw, 0, sizeof(raw));
+    cfmakeraw(&raw);
+    char name[64];
+    if (openpty(&master_, &slave_, name, &raw, NULL) == 0)
+      name_ = name;
+  }
+
+  ~Pty()
+  {
+    if (slave_ >= 0)
+      ::close(slave_);
+    if (master_ >= 0)
+      ::close(master_);
+  }
+
+  bool ok() const { return master_ >= 0; }
+  int master() const { return master_; }
+  int slave() const { return slave_; }
+  const std::string &name() const { return name_; }
+
+private:
+  int master_;
+  int slave_;
+  std::string name_;
+};
+
+class HeartbeatCounter : public mavrosflight::MavlinkFrameListenerInterface
+{
+public:
+  HeartbeatCounter() : count(0) {}
+  virtual void handle_mavlink_frame(const MavlinkFrame &frame)
+  {
+    if (frame.msgid() == MAVLINK_MSG_ID_HEARTBEAT)
+      count++;
+  }
+  std::atomic<int> count;
+};
+
+bool send_heartbeat(int fd)
+{
+  mavlink_message_t msg;
+  mavlink_msg_heartbeat_pack(1, 1, &msg, 0, 0, 0, 0, 0);
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+  return ::write(fd, buf, len) == len;
+}
+
+bool wait_for(const std::atomic<int> &count, int target)
+{
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + milliseconds(1000);
+  while (count < target)
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  return true;
+}
+
+/**
+ * \brief Open a port in low-latency mode on the pty and check a heartbeat written by the other end gets through
+ */
+void expect_low_latency_port_works(MavlinkComm &comm, const Pty &pty)
+{
+  HeartbeatCounter counter;
+  comm.register_mavlink_frame_listener(&counter);
+  ASSERT_NO_THROW(comm.open());
+  ASSERT_TRUE(send_heartbeat(pty.master()));
+  EXPECT_TRUE(wait_for(counter.count, 1));
+  comm.close();
+  comm.unregister_mavlink_frame_listener(&counter);
+}
+
+} // namespace
+
+TEST(SerialTuning, FallsBackWhenDriverLacksLowLatencyFlag)
+{
+  Pty pty;
+  ASSERT_TRUE(pty.ok());
+
+#ifdef __linux__
+  struct serial_struct serial;
+  ASSERT_NE(0, ioctl(pty.slave(), TIOCGSERIAL, &serial)) << "pty driver supports TIOCGSERIAL";
+#endif
+
+  struct termios before;
+  ASSERT_EQ(0, tcgetattr(pty.slave(), &before));
+
+  EXPECT_NO_THROW(mavrosflight::set_serial_low_latency(pty.slave()));
+
+  // VMIN/VTIME are left for the backends to manage
+  struct termios after;
+  ASSERT_EQ(0, tcgetattr(pty.slave(), &after));
+  EXPECT_EQ(before.c_cc[VMIN], after.c_cc[VMIN]);
+  EXPECT_EQ(before.c_cc[VTIME], after.c_cc[VTIME]);
+
+  // and the port still carries data
+  ASSERT_EQ(1, ::write(pty.master(), "x", 1));
+  char c = 0;
+  EXPECT_EQ(1, ::read(pty.slave(), &c, 1));
+  EXPECT_EQ('x', c);
+}
+
+TEST(SerialTuning, ThrowsWhenExclusiveAccessFails)
+{
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  EXPECT_THROW(mavrosflight::set_serial_low_latency(fds[0]), SerialException);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(SerialTuning, AsioSerialOpensInLowLatencyModeWithoutDriverSupport)
+{
+  Pty pty;
+  ASSERT_TRUE(pty.ok());
+  mavrosflight::MavlinkSerial serial(pty.name(), 115200, true);
+  expect_low_latency_port_works(serial, pty);
+}
+
+#ifdef __linux__
+TEST(SerialTuning, EpollSerialOpensInLowLatencyModeWithoutDriverSupport)
+{
+  Pty pty;
+  ASSERT_TRUE(pty.ok());
+  mavrosflight::MavlinkEpollSerial serial(pty.name(), 115200, true);
+  expect_low_latency_port_works(serial, pty);
+}
+#endif
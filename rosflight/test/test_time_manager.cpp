@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2017 Daniel Koch and James Jackson, BYU MAGICC Lab.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file test_time_manager.cpp
+ */
+
+#include <rosflight/mavrosflight/interface_adapter.h>
+#include <rosflight/mavrosflight/mavlink_frame.h>
+#include <rosflight/mavrosflight/time_manager.h>
+
+#include "fakes.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+using mavrosflight::DerivedLoggerType;
+using mavrosflight::MavlinkFrame;
+using mavrosflight::TimeManager;
+using rosflight_test::ClosedComm;
+using rosflight_test::FakeClock;
+using rosflight_test::StoppedTimerProvider;
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+
+namespace
+{
+const nanoseconds SYSTEM_START = seconds(1700000000);
+const nanoseconds FCU_TO_SYSTEM = SYSTEM_START - seconds(1000); //!< the FCU booted 1000 s before the test starts
+
+//! Distance between two times, in microseconds
+double error_us(nanoseconds expected, nanoseconds actual)
+{
+  return std::fabs(std::chrono::duration<double, std::micro>(actual - expected).count());
+}
+
+//! Reads the system clock, as ROS time does outside simulation
+class SystemClock : public mavrosflight::TimeInterface
+{
+public:
+  virtual nanoseconds now() const { return std::chrono::system_clock::now().time_since_epoch(); }
+  virtual bool is_system_clock() const { return true; }
+};
+
+//! Deliver a TIMESYNC response as if its last byte arrived at the given system time
+void respond(TimeManager<DerivedLoggerType> &time_manager,
+             nanoseconds ts1,
+             nanoseconds tc1,
+             std::chrono::system_clock::time_point received)
+{
+  mavlink_message_t msg;
+  mavlink_msg_timesync_pack(1, 1, &msg, tc1.count(), ts1.count());
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  mavlink_msg_to_send_buffer(buf, &msg);
+  time_manager.handle_mavlink_frame(MavlinkFrame(buf, received));
+}
+
+} // namespace
+
+class TimeManagerTest : public ::testing::Test
+{
+protected:
+  TimeManagerTest() :
+    clock_(SYSTEM_START),
+    time_manager_(&comm_, logger_, clock_, timer_provider_),
+    fcu_to_system_(FCU_TO_SYSTEM),
+    fcu_skew_(0)
+  {
+  }
+
+  //! FCU clock reading at a system time
+  nanoseconds fcu_time(nanoseconds system_time) const
+  {
+    double drift = fcu_skew_ * std::chrono::duration<double>(system_time - SYSTEM_START).count();
+    return system_time - fcu_to_system_ + nanoseconds(int64_t(std::llround(drift * 1e9)));
+  }
+
+  //! True offset from FCU time to system time, at the current system time
+  nanoseconds true_offset() const { return clock_.now() - fcu_time(clock_.now()); }
+
+  /**
+   * \brief Complete a TIMESYNC exchange over a link with the given round trip
+   *
+   * \param error Mistake in the FCU's timestamp, as if the link were that much asymmetric
+   */
+  void exchange(nanoseconds rtt, nanoseconds error = nanoseconds::zero()) { exchange(time_manager_, rtt, error); }
+
+  void exchange(TimeManager<DerivedLoggerType> &time_manager, nanoseconds rtt, nanoseconds error = nanoseconds::zero())
+  {
+    nanoseconds ts1 = clock_.now();
+    clock_.advance(rtt);
+    respond(time_manager, ts1, fcu_time(ts1 + rtt / 2) + error, std::chrono::system_clock::time_point());
+  }
+
+  ClosedComm comm_;
+  DerivedLoggerType logger_;
+  FakeClock clock_;
+  StoppedTimerProvider timer_provider_;
+  TimeManager<DerivedLoggerType> time_manager_;
+
+  nanoseconds fcu_to_system_; //!< FCU_TO_SYSTEM, until the test reboots the FCU
+  double fcu_skew_;           //!< how much faster the FCU clock runs than the system clock, in s/s
+};
+
+TEST_F(TimeManagerTest, UsesSystemTimeBeforeFirstExchange)
+{
+  clock_.advance(milliseconds(3));
+  EXPECT_EQ(clock_.now(), time_manager_.fcu_time_to_system_time(seconds(5)));
+}
+
+TEST_F(TimeManagerTest, ConvertsWithMeasuredOffset)
+{
+  exchange(microseconds(200));
+  EXPECT_EQ(FCU_TO_SYSTEM, time_manager_.get_offset());
+  EXPECT_EQ(seconds(5) + FCU_TO_SYSTEM, time_manager_.fcu_time_to_system_time(seconds(5)));
+  EXPECT_EQ(microseconds(200), time_manager_.get_rtt());
+}
+
+// Readers on several threads convert timestamps at 10 kHz each while the io thread keeps updating the clock model,
+// far faster than the 10 Hz it is updated at in flight. Every conversion has to come from one whole model.
+TEST_F(TimeManagerTest, ConcurrentConversionsAreConsistent)
+{
+  const int READERS = 4;
+  const int EXCHANGES = 1000;
+  const nanoseconds FCU_TIME = seconds(1001); // within the span of the exchanges, so skew estimates barely matter
+  const nanoseconds TOLERANCE = milliseconds(1);
+
+  exchange(microseconds(300));
+
+  std::atomic<bool> done(false);
+  std::vector<std::atomic<uint64_t> > conversions(READERS);
+  std::vector<std::atomic<uint64_t> > wrong(READERS);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < READERS; r++)
+  {
+    conversions[r] = 0;
+    wrong[r] = 0;
+    readers.emplace_back([&, r]() {
+      std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+      while (!done.load())
+      {
+        nanoseconds system_time = time_manager_.fcu_time_to_system_time(FCU_TIME);
+        if (std::llabs((system_time - (FCU_TIME + FCU_TO_SYSTEM)).count()) > TOLERANCE.count())
+          wrong[r]++;
+        conversions[r]++;
+
+        next += microseconds(100);
+        std::this_thread::sleep_until(next);
+      }
+    });
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int64_t> rtt_us(200, 400);
+  std::uniform_int_distribution<int64_t> error_us(-50, 50);
+  for (int i = 0; i < EXCHANGES; i++)
+  {
+    clock_.advance(milliseconds(1));
+    exchange(microseconds(rtt_us(rng)), microseconds(error_us(rng)));
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  done = true;
+  for (int r = 0; r < READERS; r++)
+  {
+    readers[r].join();
+  }
+
+  for (int r = 0; r < READERS; r++)
+  {
+    EXPECT_GT(conversions[r].load(), 0u) << "reader " << r;
+    EXPECT_EQ(0u, wrong[r].load()) << "reader " << r;
+  }
+  EXPECT_EQ(0u, time_manager_.get_rejected_samples());
+}
+
+TEST_F(TimeManagerTest, ConvergesOnOffsetAndSkew)
+{
+  fcu_skew_ = 20e-6; // the FCU crystal runs 20 ppm fast
+
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int64_t> rtt_us(200, 2000);
+  for (int i = 0; i < 600; i++)
+  {
+    nanoseconds rtt = microseconds(rtt_us(rng));
+    std::uniform_int_distribution<int64_t> error_ns(-rtt.count() / 4, rtt.count() / 4);
+    exchange(rtt, nanoseconds(error_ns(rng)));
+    clock_.advance(milliseconds(100));
+  }
+
+  EXPECT_NEAR(-20.0, time_manager_.get_skew_ppm(), 2.0);
+  EXPECT_LT(error_us(true_offset(), time_manager_.get_offset()), 50);
+  nanoseconds now = clock_.now();
+  EXPECT_LT(error_us(now, time_manager_.fcu_time_to_system_time(fcu_time(now))), 50);
+  EXPECT_LT(time_manager_.get_offset_stddev(), microseconds(50));
+  EXPECT_EQ(0u, time_manager_.get_rejected_samples());
+}
+
+TEST_F(TimeManagerTest, RejectsSingleOutlier)
+{
+  for (int i = 0; i < 50; i++)
+  {
+    exchange(microseconds(300));
+    clock_.advance(milliseconds(100));
+  }
+  nanoseconds offset = time_manager_.get_offset();
+
+  // a short round trip, so only the gate can keep it out of the model
+  exchange(microseconds(100), milliseconds(20));
+  EXPECT_EQ(1u, time_manager_.get_rejected_samples());
+  EXPECT_EQ(offset, time_manager_.get_offset());
+
+  for (int i = 0; i < 20; i++)
+  {
+    clock_.advance(milliseconds(100));
+    exchange(microseconds(300));
+  }
+  EXPECT_EQ(1u, time_manager_.get_rejected_samples());
+  EXPECT_LT(error_us(FCU_TO_SYSTEM, time_manager_.get_offset()), 10);
+}
+
+// After MAX_CONSECUTIVE_REJECTED exchanges the filter restarts from them alone. They are moved to the front of the
+// sample ring, which must work wherever in the ring they landed, including when they wrap around its end.
+TEST_F(TimeManagerTest, ResetsAfterFcuClockJumpAtEveryRingPosition)
+{
+  for (int position = 0; position < TIMESYNC_SAMPLE_WINDOW; position++)
+  {
+    ClosedComm comm;
+    TimeManager<DerivedLoggerType> time_manager(&comm, logger_, clock_, timer_provider_);
+    fcu_to_system_ = FCU_TO_SYSTEM;
+    for (int i = 0; i < TIMESYNC_SAMPLE_WINDOW + position; i++)
+    {
+      clock_.advance(milliseconds(100));
+      exchange(time_manager, microseconds(300));
+    }
+
+    // the FCU reboots; the exchanges since then get shorter, so the last one is the best sample
+    fcu_to_system_ = clock_.now() - seconds(1);
+    const nanoseconds rtts[] = {microseconds(900), microseconds(800), microseconds(700)};
+    for (size_t i = 0; i < 3; i++)
+    {
+      clock_.advance(milliseconds(100));
+      exchange(time_manager, rtts[i]);
+    }
+
+    EXPECT_EQ(3u, time_manager.get_rejected_samples()) << "position " << position;
+    EXPECT_EQ(rtts[2], time_manager.get_selected_rtt()) << "position " << position;
+    EXPECT_EQ(rtts[2], time_manager.get_rtt_min()) << "position " << position;
+    EXPECT_EQ(fcu_to_system_, time_manager.get_offset()) << "position " << position;
+
+    clock_.advance(milliseconds(100));
+    exchange(time_manager, microseconds(1000));
+    EXPECT_EQ(3u, time_manager.get_rejected_samples()) << "position " << position;
+    EXPECT_EQ(fcu_to_system_, time_manager.get_offset()) << "position " << position;
+  }
+}
+
+// the response sat in a queue for 4 ms after arriving, which is not part of the link's round trip
+TEST_F(TimeManagerTest, TakesQueueingOutOfRoundTripOnSystemClock)
+{
+  SystemClock system_clock;
+  TimeManager<DerivedLoggerType> time_manager(&comm_, logger_, system_clock, timer_provider_);
+
+  nanoseconds ts1 = system_clock.now() - milliseconds(10);
+  respond(time_manager, ts1, fcu_time(ts1), std::chrono::system_clock::now() - milliseconds(4));
+  EXPECT_LT(error_us(milliseconds(6), time_manager.get_rtt()), 1000);
+}
+
+// under simulated time the receive time is from an unrelated clock, so it must not be taken off the round trip
+TEST_F(TimeManagerTest, IgnoresReceiveTimeFromAnotherClock)
+{
+  nanoseconds ts1 = clock_.now();
+  clock_.advance(microseconds(200));
+  respond(time_manager_, ts1, fcu_time(ts1 + microseconds(100)), std::chrono::system_clock::now() - milliseconds(4));
+  EXPECT_EQ(microseconds(200), time_manager_.get_rtt());
+  EXPECT_EQ(FCU_TO_SYSTEM, time_manager_.get_offset());
+}
+
+// exchanges with a longer round trip than the best one in the window carry more asymmetry, and leave the model alone
+// until that one ages out of the window
+TEST_F(TimeManagerTest, LongerRoundTripsWaitForShortestToLeaveWindow)
+{
+  for (int i = 0; i < 10; i++)
+  {
+    exchange(microseconds(300));
+    clock_.advance(milliseconds(100));
+  }
+
+  exchange(microseconds(100));
+  EXPECT_EQ(microseconds(100), time_manager_.get_selected_rtt());
+  nanoseconds offset = time_manager_.get_offset();
+
+  for (int i = 1; i < TIMESYNC_SAMPLE_WINDOW; i++)
+  {
+    clock_.advance(milliseconds(100));
+    exchange(microseconds(2000), microseconds(300));
+    EXPECT_EQ(microseconds(2000), time_manager_.get_rtt()) << "exchange " << i;
+    EXPECT_EQ(microseconds(100), time_manager_.get_rtt_min()) << "exchange " << i;
+    EXPECT_EQ(microseconds(100), time_manager_.get_selected_rtt()) << "exchange " << i;
+    EXPECT_EQ(offset, time_manager_.get_offset()) << "exchange " << i;
+  }
+
+  // the short exchange has been pushed out, so the best of the long ones is used
+  clock_.advance(milliseconds(100));
+  exchange(microseconds(2000), microseconds(300));
+  EXPECT_EQ(microseconds(2000), time_manager_.get_rtt_min());
+  EXPECT_EQ(microseconds(2000), time_manager_.get_selected_rtt());
+  EXPECT_NE(offset, time_manager_.get_offset());
+  EXPECT_EQ(0u, time_manager_.get_rejected_samples());
+}
+
+TEST_F(TimeManagerTest, ShorterRoundTripIsUsedAtOnce)
+{
+  for (int i = 0; i < 10; i++)
+  {
+    exchange(microseconds(300));
+    clock_.advance(milliseconds(100));
+  }
+  EXPECT_EQ(microseconds(300), time_manager_.get_selected_rtt());
+
+  // longer than the best one in the window, so not used
+  exchange(microseconds(400), microseconds(100));
+  EXPECT_EQ(microseconds(300), time_manager_.get_selected_rtt());
+  nanoseconds offset = time_manager_.get_offset();
+
+  clock_.advance(milliseconds(100));
+  exchange(microseconds(50), microseconds(20));
+  EXPECT_EQ(microseconds(50), time_manager_.get_rtt_min());
+  EXPECT_EQ(microseconds(50), time_manager_.get_selected_rtt());
+  EXPECT_NE(offset, time_manager_.get_offset());
+  EXPECT_EQ(0u, time_manager_.get_rejected_samples());
+}